@@ -5,6 +5,7 @@
 #include <QString>
 #include <QHostAddress>
 #include <QDebug>
+#include <QFileInfo>
 #include <QList>
 #include <optional>
 
@@ -27,6 +28,8 @@ struct StellarSolverCliQuery
     SSolver::ScaleUnits units = SSolver::DEG_WIDTH;
     std::optional<int> cpu_limit = std::nullopt;
     QString save_fits_path = "";
+    bool superpixel = false;
+    bool mmap = false;
     // TODO what should be the default for mac or windows?
     QString index_files_path = "/usr/share/astrometry";
     SSolver::Parameters::ParametersProfile profile = SSolver::Parameters::PARALLEL_SMALLSCALE;
@@ -158,6 +161,10 @@ CommandLineParseResult parseCommandLine(QCommandLineParser &parser, StellarSolve
                         "Save image as .fit with included header data from solution\n"
                         "WARNING: Overwrites files!",
                         "path"},
+                       {"superpixel",
+                        "Solve bayered images from 2x2 superpixels at half the size instead of debayering them"},
+                       {"mmap",
+                        "Read uncompressed FITS images in place from the file instead of loading them, not with --save-fits"},
                        {"config",
                         "Use this 'solve-field' compatible 'astrometry.cfg' to specify the index file location",
                         "path"},
@@ -358,6 +365,16 @@ CommandLineParseResult parseCommandLine(QCommandLineParser &parser, StellarSolve
         query->save_fits_path = parser.value("save-fits");
     }
 
+    if (parser.isSet("superpixel"))
+    {
+        query->superpixel = true;
+    }
+
+    if (parser.isSet("mmap"))
+    {
+        query->mmap = true;
+    }
+
     if (parser.isSet("config"))
     {
         std::optional<QString> addPathDirective = std::nullopt;
@@ -419,7 +436,11 @@ void solve(const QString &image_file, StellarSolverCliQuery *query)
 
     fileio imageLoader;
     imageLoader.logToSignal = false;
-    if (!imageLoader.loadImage(image_file))
+    imageLoader.bayerSuperpixel = query->superpixel;
+    // A mapped image is read in place, so there is no image buffer to save with the solution
+    const QString suffix = QFileInfo(image_file).suffix();
+    const bool mapImage = query->mmap && query->save_fits_path.isEmpty() && (suffix == "fits" || suffix == "fit");
+    if (mapImage ? !imageLoader.loadFitsMapped(image_file) : !imageLoader.loadImage(image_file))
     {
         exit(1);
     }
@@ -428,6 +449,10 @@ void solve(const QString &image_file, StellarSolverCliQuery *query)
     printf("Solving...\n");
     printf("Field: %s\n", image_file.toUtf8().data());
     StellarSolver stellarSolver(stats, imageBuffer);
+    if (imageLoader.getMappedImage().isValid())
+    {
+        stellarSolver.loadNewImageMapped(stats, imageLoader.getMappedImage());
+    }
     stellarSolver.setIndexFolderPaths(QStringList() << query->index_files_path);
     stellarSolver.setParameterProfile(query->profile);
     SSolver::Parameters params = stellarSolver.getCurrentParameters();
@@ -1026,6 +1026,7 @@ dc1394error_t dc1394_bayer_Bilinear_uint16(const uint16_t *bayer, uint16_t *rgb,
     if ((tile > DC1394_COLOR_FILTER_MAX) || (tile < DC1394_COLOR_FILTER_MIN))
         return DC1394_INVALID_COLOR_FILTER;
 
+    ClearBorders_uint16(rgb, sx, sy, 1); //# Modified for the StellarSolver Internal Library, the edges were left alone, unlike the 8 bit version
     rgb += rgbStep + 3 + 1;
     height -= 2;
     width -= 2;
@@ -1765,7 +1766,8 @@ dc1394error_t dc1394_bayer_Simple_uint16(const uint16_t *bayer, uint16_t *rgb, i
 
    Return values are either 0/1/2/3 = G/M/C/Y or 0/1/2/3 = R/G1/B/G2
  */
-#define FC(row, col) (filters >> ((((row) << 1 & 14) + ((col)&1)) << 1) & 3)
+//# Modified for the StellarSolver Internal Library, the row is unsigned so that the rows above the image are not shifted as negative numbers
+#define FC(row, col) (filters >> ((((unsigned)(row) << 1 & 14) + ((col)&1)) << 1) & 3)
 
 /*
    This algorithm is officially called:
@@ -1800,7 +1802,7 @@ dc1394error_t dc1394_bayer_VNG(const uint8_t *bayer, uint8_t *dst, int sx, int s
                                dc1394color_filter_t pattern)
 {
     const int height = sy, width = sx;
-    static const signed char *cp;
+    const signed char *cp; //# Modified for the StellarSolver Internal Library, it was static, so VNG could not run in more than one thread
     /* the following has the same type as the image */
     uint8_t(*brow[5])[3], *pix; /* [FD] */
     int code[8][2][320], *ip, gval[8], gmin, gmax, sum[4];
@@ -1843,9 +1845,6 @@ dc1394error_t dc1394_bayer_VNG(const uint8_t *bayer, uint8_t *dst, int sx, int s
                 weight = *cp++;
                 grads  = *cp++;
                 
-                if(row < 0 || y1 < 0 || y2 < 0) //# Modified by Robert Lancaster for the StellarSolver Internal Library to fix warning
-                    return -1;
-                
                 color  = FC(row + y1, col + x1);
                 if ((int)FC(row + y2, col + x2) != color)
                     continue;
@@ -1948,7 +1947,7 @@ dc1394error_t dc1394_bayer_VNG_uint16(const uint16_t *bayer, uint16_t *dst, int
                                       dc1394color_filter_t pattern, int bits)
 {
     const int height = sy, width = sx;
-    static const signed char *cp;
+    const signed char *cp; //# Modified for the StellarSolver Internal Library, it was static, so VNG could not run in more than one thread
     /* the following has the same type as the image */
     uint16_t(*brow[5])[3], *pix; /* [FD] */
     int code[8][2][320], *ip, gval[8], gmin, gmax, sum[4];
@@ -1992,9 +1991,6 @@ dc1394error_t dc1394_bayer_VNG_uint16(const uint16_t *bayer, uint16_t *dst, int
                 weight = *cp++;
                 grads  = *cp++;
                 
-                if(row < 0 || y1 < 0 || y2 < 0) //# Modified by Robert Lancaster for the StellarSolver Internal Library to fix warning
-                    return -1;
-                
                 color  = FC(row + y1, col + x1);
                 if ((int)FC(row + y2, col + x2) != color)
                     continue;
@@ -2216,11 +2212,7 @@ dc1394error_t dc1394_bayer_AHD(const uint8_t *bayer, uint8_t *dst, int sx, int s
                 memset(sum, 0, sizeof sum);
                 for (y = row - 1; y != row + 2; y++){
                     for (x = col - 1; x != col + 2; x++){
-                        
-                        if(x < 0 || y < 0) //# Modified by Robert Lancaster for the StellarSolver Internal Library to fix warning
-                            return -1;
-                
-                        if (y < height && x < width)
+                        if (y >= 0 && x >= 0 && y < height && x < width) //# Modified for the StellarSolver Internal Library, it used to give up at the first pixel
                         {
                             f = FC(y, x);
                             sum[f] += dst[(y * width + x) * 3 + f]; /* [SA] */
@@ -2407,10 +2399,8 @@ dc1394error_t dc1394_bayer_AHD_uint16(const uint16_t *bayer, uint16_t *dst, int
                 memset(sum, 0, sizeof sum);
                 for (y = row - 1; y != row + 2; y++)
                     for (x = col - 1; x != col + 2; x++)
-                        if (y < height && x < width)
+                        if (y >= 0 && x >= 0 && y < height && x < width) //# Modified for the StellarSolver Internal Library, it used to give up at the first pixel
                         {
-                            if(y < 0) //# Modified by Robert Lancaster for the StellarSolver Internal Library to fix warning
-                                return -1;
                             f = FC(y, x);
                             sum[f] += dst[(y * width + x) * 3 + f]; /* [SA] */
                             sum[f + 4]++;
@@ -2524,6 +2514,114 @@ dc1394error_t dc1394_bayer_AHD_uint16(const uint16_t *bayer, uint16_t *dst, int
     return DC1394_SUCCESS;
 }
 
+//# Added for the StellarSolver Internal Library
+void dc1394_bayer_AHD_init(void)
+{
+    if (ahd_inited == DC1394_FALSE)
+    {
+        cam_to_cielab(NULL, NULL);
+        ahd_inited = DC1394_TRUE;
+    }
+}
+
+//# Added for the StellarSolver Internal Library
+uint32_t dc1394_bayer_margin(dc1394bayer_method_t method)
+{
+    /* The rows that a row of output is worked out from, and the rows at the edges that are cleared or
+       interpolated differently.  It is even, so that a band starts on the same tile of the pattern. */
+    switch (method)
+    {
+        case DC1394_BAYER_METHOD_NEAREST:
+        case DC1394_BAYER_METHOD_SIMPLE:
+        case DC1394_BAYER_METHOD_BILINEAR:
+            return 2;
+        case DC1394_BAYER_METHOD_HQLINEAR:
+        case DC1394_BAYER_METHOD_EDGESENSE:
+            return 4;
+        case DC1394_BAYER_METHOD_VNG:
+            return 8;
+        case DC1394_BAYER_METHOD_AHD:
+            return 12;
+        default:
+            return 0;
+    }
+}
+
+//# Added for the StellarSolver Internal Library
+/* These decode the rows with a margin of rows above and below into a buffer of their own, then copy the rows
+   out of it, so the rows come out the same as they do when the whole image is decoded.  EdgeSense leaves some
+   pixels near the bottom alone, those are zero. */
+dc1394error_t dc1394_bayer_decoding_8bit_rows(const uint8_t *bayer, uint8_t *rgb, uint32_t sx, uint32_t sy,
+                                              uint32_t firstRow, uint32_t numRows,
+                                              dc1394color_filter_t tile, dc1394bayer_method_t method)
+{
+    uint32_t margin = dc1394_bayer_margin(method);
+    uint32_t top, bottom;
+    uint8_t *band;
+    dc1394error_t error_code;
+
+    if (method == DC1394_BAYER_METHOD_DOWNSAMPLE && (firstRow != 0 || numRows != sy))
+        return DC1394_FUNCTION_NOT_SUPPORTED;
+    if (firstRow + numRows > sy)
+        return DC1394_INVALID_ARGUMENT_VALUE;
+
+    /* the band starts and ends on even rows, so it starts on the same tile of the pattern as the image
+       and the methods that work on pairs of rows see whole pairs */
+    top    = firstRow > margin ? (firstRow - margin) & ~1u : 0;
+    bottom = firstRow + numRows + margin + 1 < sy ? (firstRow + numRows + margin + 1) & ~1u : sy;
+    if (top == firstRow && bottom == firstRow + numRows)
+    {
+        if (method == DC1394_BAYER_METHOD_EDGESENSE)
+            memset(rgb, 0, (size_t)numRows * sx * 3 * sizeof(uint8_t));
+        return dc1394_bayer_decoding_8bit(bayer + (size_t)top * sx, rgb, sx, bottom - top, tile, method);
+    }
+
+    band = (uint8_t *)calloc((size_t)sx * (bottom - top) * 3, sizeof(uint8_t));
+    if (band == NULL)
+        return DC1394_MEMORY_ALLOCATION_FAILURE;
+    error_code = dc1394_bayer_decoding_8bit(bayer + (size_t)top * sx, band, sx, bottom - top, tile, method);
+    if (error_code == DC1394_SUCCESS)
+        memcpy(rgb, band + (size_t)(firstRow - top) * sx * 3, (size_t)numRows * sx * 3 * sizeof(uint8_t));
+    free(band);
+    return error_code;
+}
+
+//# Added for the StellarSolver Internal Library
+dc1394error_t dc1394_bayer_decoding_16bit_rows(const uint16_t *bayer, uint16_t *rgb, uint32_t sx, uint32_t sy,
+                                               uint32_t firstRow, uint32_t numRows,
+                                               dc1394color_filter_t tile, dc1394bayer_method_t method, uint32_t bits)
+{
+    uint32_t margin = dc1394_bayer_margin(method);
+    uint32_t top, bottom;
+    uint16_t *band;
+    dc1394error_t error_code;
+
+    if (method == DC1394_BAYER_METHOD_DOWNSAMPLE && (firstRow != 0 || numRows != sy))
+        return DC1394_FUNCTION_NOT_SUPPORTED;
+    if (firstRow + numRows > sy)
+        return DC1394_INVALID_ARGUMENT_VALUE;
+
+    /* the band starts and ends on even rows, so it starts on the same tile of the pattern as the image
+       and the methods that work on pairs of rows see whole pairs */
+    top    = firstRow > margin ? (firstRow - margin) & ~1u : 0;
+    bottom = firstRow + numRows + margin + 1 < sy ? (firstRow + numRows + margin + 1) & ~1u : sy;
+    if (top == firstRow && bottom == firstRow + numRows)
+    {
+        if (method == DC1394_BAYER_METHOD_EDGESENSE)
+            memset(rgb, 0, (size_t)numRows * sx * 3 * sizeof(uint16_t));
+        return dc1394_bayer_decoding_16bit(bayer + (size_t)top * sx, rgb, sx, bottom - top, tile, method, bits);
+    }
+
+    band = (uint16_t *)calloc((size_t)sx * (bottom - top) * 3, sizeof(uint16_t));
+    if (band == NULL)
+        return DC1394_MEMORY_ALLOCATION_FAILURE;
+    error_code = dc1394_bayer_decoding_16bit(bayer + (size_t)top * sx, band, sx, bottom - top, tile, method, bits);
+    if (error_code == DC1394_SUCCESS)
+        memcpy(rgb, band + (size_t)(firstRow - top) * sx * 3, (size_t)numRows * sx * 3 * sizeof(uint16_t));
+    free(band);
+    return error_code;
+}
+
 dc1394error_t dc1394_bayer_decoding_8bit(const uint8_t *bayer, uint8_t *rgb, uint32_t sx, uint32_t sy,
                                          dc1394color_filter_t tile, dc1394bayer_method_t method)
 {
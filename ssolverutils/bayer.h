@@ -275,6 +275,31 @@ dc1394error_t dc1394_bayer_decoding_8bit(const uint8_t *bayer, uint8_t *rgb, uin
 dc1394error_t dc1394_bayer_decoding_16bit(const uint16_t *bayer, uint16_t *rgb, uint32_t width, uint32_t height,
         dc1394color_filter_t tile, dc1394bayer_method_t method, uint32_t bits);
 
+/**
+ * Perform de-mosaicing on a band of rows of an 8-bit image buffer.  rgb receives numRows rows starting at firstRow,
+ * the same as those rows of the whole image from dc1394_bayer_decoding_8bit, so separate bands can be decoded by
+ * separate threads.  EdgeSense leaves some pixels near the bottom alone, those are zero.  Call dc1394_bayer_AHD_init
+ * first if the method is AHD.
+ */
+dc1394error_t dc1394_bayer_decoding_8bit_rows(const uint8_t *bayer, uint8_t *rgb, uint32_t width, uint32_t height,
+        uint32_t firstRow, uint32_t numRows, dc1394color_filter_t tile, dc1394bayer_method_t method);
+
+/**
+ * Perform de-mosaicing on a band of rows of a 16-bit image buffer, see dc1394_bayer_decoding_8bit_rows
+ */
+dc1394error_t dc1394_bayer_decoding_16bit_rows(const uint16_t *bayer, uint16_t *rgb, uint32_t width, uint32_t height,
+        uint32_t firstRow, uint32_t numRows, dc1394color_filter_t tile, dc1394bayer_method_t method, uint32_t bits);
+
+/**
+ * The number of rows above and below a band that its decoding depends on
+ */
+uint32_t dc1394_bayer_margin(dc1394bayer_method_t method);
+
+/**
+ * Fill in the tables that AHD de-mosaicing uses, before it is used from more than one thread
+ */
+void dc1394_bayer_AHD_init(void);
+
 /* Bayer to RGBX */
 dc1394error_t dc1394_bayer16_RGBX_NearestNeighbor(const uint16_t *bayer, uint16_t *rgbx, int sx, int sy, int tile);
 #ifdef __cplusplus
@@ -1,9 +1,23 @@
 //Qt Includes
 #include <QFileInfo>
+#include <QThread>
+#include <QtConcurrent>
+
+//System Includes
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <type_traits>
+#include <vector>
 
 //Project Includes
 #include "fileio.h"
 
+//Bands of fewer rows than this are not worth a thread of their own when debayering
+#define DEBAYER_MIN_BAND_ROWS 64
+
 fileio::fileio()
 {
     debayerParams.method  = DC1394_BAYER_METHOD_NEAREST;
@@ -31,7 +45,7 @@ bool fileio::loadImage(QString fileName)
     justLoadBuffer = false;
     QFileInfo newFileInfo(fileName);
     bool success = false;
-    if(newFileInfo.suffix() == "fits" || newFileInfo.suffix() == "fit")
+    if(newFileInfo.suffix() == "fits" || newFileInfo.suffix() == "fit" || newFileInfo.suffix() == "fz")
         success = loadFits(fileName);
     else
         success = loadOtherFormat(fileName);
@@ -45,7 +59,7 @@ bool fileio::loadImageBufferOnly(QString fileName)
     justLoadBuffer = true;
     QFileInfo newFileInfo(fileName);
     bool success = false;
-    if(newFileInfo.suffix() == "fits" || newFileInfo.suffix() == "fit")
+    if(newFileInfo.suffix() == "fits" || newFileInfo.suffix() == "fit" || newFileInfo.suffix() == "fz")
         success = loadFits(fileName);
     else
         success = loadOtherFormat(fileName);
@@ -54,11 +68,11 @@ bool fileio::loadImageBufferOnly(QString fileName)
 }
 
 //This method was copied and pasted and modified from the method privateLoad in fitsdata in KStars
-//It loads a FITS file, reads the FITS Headers, and loads the data from the image
-bool fileio::loadFits(QString fileName)
-{   
+//It opens a FITS file and reads the image parameters into stats, leaving the file open in fptr
+bool fileio::openFits(QString fileName)
+{
     file = fileName;
-    int status = 0, anynullptr = 0;
+    int status = 0;
     long naxes[3];
 
     // Use open diskfile as it does not use extended file names which has problems opening
@@ -86,6 +100,15 @@ bool fileio::loadFits(QString fileName)
         return false;
     }
 
+    // fpack puts a tile compressed image in the first extension, after an empty primary HDU
+    if (stats.ndim == 0 && fits_movabs_hdu(fptr, 2, IMAGE_HDU, &status) == 0 && fits_is_compressed_image(fptr, &status)
+            && fits_get_img_param(fptr, 3, &fitsBitPix, &(stats.ndim), naxes, &status))
+    {
+        logIssue(QString("FITS file open error (fits_get_img_param)."));
+        fits_close_file(fptr, &status);
+        return false;
+    }
+
     if (stats.ndim < 2)
     {
         logIssue("1D FITS images are not supported.");
@@ -93,6 +116,7 @@ bool fileio::loadFits(QString fileName)
         return false;
     }
 
+    stats.sourceDataType = 0;
     switch (fitsBitPix)
     {
         case BYTE_IMG:
@@ -142,13 +166,30 @@ bool fileio::loadFits(QString fileName)
     {
         logIssue(QString("Image has invalid dimensions %1x%2").arg(naxes[0]).arg(naxes[1]));
     }
+    // The Statistic counts the pixels of one channel in 32 bits, and the sizes of the buffers are worked out from it
+    if (static_cast<uint64_t>(naxes[0]) * static_cast<uint64_t>(naxes[1]) > UINT32_MAX)
+    {
+        logIssue(QString("Image dimensions %1x%2 are too large, a channel can have at most %3 pixels.").arg(naxes[0]).arg(
+                     naxes[1]).arg(UINT32_MAX));
+        fits_close_file(fptr, &status);
+        return false;
+    }
 
-    stats.width               = static_cast<uint16_t>(naxes[0]);
-    stats.height              = static_cast<uint16_t>(naxes[1]);
+    stats.width               = static_cast<uint32_t>(naxes[0]);
+    stats.height              = static_cast<uint32_t>(naxes[1]);
     stats.channels            = static_cast<uint8_t>(naxes[2]);
     stats.samples_per_channel = stats.width * stats.height;
+    return true;
+}
+
+//It loads a FITS file, reads the FITS Headers, and loads the data from the image
+bool fileio::loadFits(QString fileName)
+{
+    int status = 0, anynullptr = 0;
+    if (!openFits(fileName))
+        return false;
 
-    m_ImageBufferSize = stats.samples_per_channel * stats.channels * static_cast<uint16_t>(stats.bytesPerPixel);
+    m_ImageBufferSize = static_cast<size_t>(stats.samples_per_channel) * stats.channels * stats.bytesPerPixel;
     deleteImageBuffer();
     m_ImageBuffer = new uint8_t[m_ImageBufferSize];
     if (m_ImageBuffer == nullptr)
@@ -158,9 +199,12 @@ bool fileio::loadFits(QString fileName)
         return false;
     }
 
-    long nelements = stats.samples_per_channel * stats.channels;
+    LONGLONG nelements = static_cast<LONGLONG>(stats.samples_per_channel) * stats.channels;
 
-    if (fits_read_img(fptr, static_cast<uint16_t>(stats.dataType), 1, nelements, nullptr, m_ImageBuffer, &anynullptr, &status))
+    // The tiles of a compressed image are decompressed on all the cores if CFITSIO can be used from several threads
+    const bool parallelTiles = fits_is_compressed_image(fptr, &status) && fits_is_reentrant();
+    if (parallelTiles ? !readCompressedImage() :
+            fits_read_img(fptr, static_cast<uint16_t>(stats.dataType), 1, nelements, nullptr, m_ImageBuffer, &anynullptr, &status))
     {
         logIssue("Error reading image.");
         fits_close_file(fptr, &status);
@@ -169,12 +213,33 @@ bool fileio::loadFits(QString fileName)
 
     if( !justLoadBuffer )
     {
+        bool superpixelImage = false;
         if(checkDebayer())
-            debayer();
+        {
+            //An image that cannot be made into superpixels is debayered as it would be without them
+            if(bayerSuperpixel)
+                superpixelImage = superpixel();
+            if(!superpixelImage)
+                debayer();
+        }
 
         getSolverOptionsFromFITS();
 
         parseHeader();
+
+        if(superpixelImage)
+        {
+            //A superpixel covers 2x2 pixels of the sensor, and it is not bayered any more
+            if(scale_given && scale_units == SSolver::ARCSEC_PER_PIX)
+            {
+                scale_low *= 2;
+                scale_high *= 2;
+            }
+            m_HeaderRecords.erase(std::remove_if(m_HeaderRecords.begin(), m_HeaderRecords.end(), [](const Record & oneRecord)
+            {
+                return oneRecord.key == "BAYERPAT" || oneRecord.key == "XBAYROFF" || oneRecord.key == "YBAYROFF";
+            }), m_HeaderRecords.end());
+        }
     }
 
     fits_close_file(fptr, &status);
@@ -182,6 +247,204 @@ bool fileio::loadFits(QString fileName)
     return true;
 }
 
+//This reads a tile compressed image into the image buffer in bands of rows, decompressing them in parallel.  A CFITSIO
+//handle can only be used by one thread at a time, and handles that open the same file share their buffers, so the file
+//is mapped into memory and each band opens the mapping as a memory file of its own.  The bands cover whole rows of
+//tiles, so no tile is decompressed twice.
+bool fileio::readCompressedImage()
+{
+    int status = 0, hduNumber = 1, anynull = 0;
+    long tileRows = 1;
+    fits_get_hdu_num(fptr, &hduNumber);
+    // A missing ZTILE2 means that each tile is one row
+    if (fits_read_key(fptr, TLONG, "ZTILE2", &tileRows, nullptr, &status) || tileRows < 1)
+        tileRows = 1;
+    status = 0;
+
+    // CFITSIO also opens gzipped files, whose data is not in the file as it is on the disk
+    QFile mappedFile(file);
+    uchar *fileData = nullptr;
+    if (mappedFile.open(QIODevice::ReadOnly) && mappedFile.peek(6) == "SIMPLE")
+        fileData = mappedFile.map(0, mappedFile.size());
+    if (fileData == nullptr)
+    {
+        LONGLONG nelements = static_cast<LONGLONG>(stats.samples_per_channel) * stats.channels;
+        return fits_read_img(fptr, static_cast<int>(stats.dataType), 1, nelements, nullptr, m_ImageBuffer, &anynull, &status) == 0;
+    }
+    const size_t fileSize = static_cast<size_t>(mappedFile.size());
+
+    const uint32_t width = stats.width;
+    const uint32_t height = stats.height;
+    const uint32_t numTileRows = static_cast<uint32_t>((height + tileRows - 1) / tileRows);
+    const uint32_t numBands = qBound(1u, numTileRows, static_cast<uint32_t>(QThread::idealThreadCount()));
+    std::atomic<int> errorStatus { 0 };
+    auto readRows = [&](uint32_t band, uint32_t firstTileRow, uint32_t lastTileRow)
+    {
+        const uint32_t firstRow = firstTileRow * tileRows;
+        const uint32_t lastRow = std::min<uint32_t>(lastTileRow * tileRows, height);
+        if (firstRow >= lastRow)
+            return;
+        // Memory files with the same name would share one CFITSIO file
+        const QByteArray name = QString("fileio_%1_band_%2").arg(reinterpret_cast<quintptr>(this)).arg(band).toLatin1();
+        void *memory = fileData;
+        size_t memorySize = fileSize;
+        int bandStatus = 0, bandAnynull = 0;
+        fitsfile *bandFile = nullptr;
+        if (fits_open_memfile(&bandFile, name.constData(), READONLY, &memory, &memorySize, 0, nullptr, &bandStatus) == 0 &&
+                fits_movabs_hdu(bandFile, hduNumber, IMAGE_HDU, &bandStatus) == 0)
+        {
+            for (uint32_t channel = 0; channel < stats.channels && bandStatus == 0; channel++)
+            {
+                long firstPixel[3] = { 1, static_cast<long>(firstRow) + 1, static_cast<long>(channel) + 1 };
+                uint8_t *destination = m_ImageBuffer + (static_cast<size_t>(channel) * stats.samples_per_channel +
+                                       static_cast<size_t>(firstRow) * width) * stats.bytesPerPixel;
+                fits_read_pix(bandFile, static_cast<int>(stats.dataType), firstPixel, static_cast<LONGLONG>(width) * (lastRow - firstRow),
+                              nullptr, destination, &bandAnynull, &bandStatus);
+            }
+        }
+        if (bandStatus != 0)
+            errorStatus = bandStatus;
+        if (bandFile)
+        {
+            int closeStatus = 0;
+            fits_close_file(bandFile, &closeStatus);
+        }
+    };
+
+    QList<QFuture<void>> futures;
+    for (uint32_t band = 1; band < numBands; band++)
+        futures.append(QtConcurrent::run(readRows, band, static_cast<uint32_t>(static_cast<uint64_t>(numTileRows) * band / numBands),
+                                         static_cast<uint32_t>(static_cast<uint64_t>(numTileRows) * (band + 1) / numBands)));
+    readRows(0, 0, numTileRows / numBands);
+    for (auto &oneFuture : futures)
+        oneFuture.waitForFinished();
+    mappedFile.unmap(fileData);
+
+    if (errorStatus != 0)
+    {
+        char errorMessage[FLEN_STATUS];
+        fits_get_errstatus(errorStatus, errorMessage);
+        logIssue(QString("Decompressing the image failed: %1").arg(errorMessage));
+        return false;
+    }
+    return true;
+}
+
+//This opens a FITS file that may be too large to load, reading only its headers.  The image is read through the
+//row reader a band of rows at a time, and the file stays open for as long as a copy of the reader exists.
+bool fileio::loadFitsStream(QString fileName)
+{
+    if (!openFits(fileName))
+        return false;
+    deleteImageBuffer();
+
+    if (checkDebayer())
+        logIssue("Streamed images are not debayered, stars are extracted from the raw bayered image.");
+    getSolverOptionsFromFITS();
+    parseHeader();
+
+    std::shared_ptr<fitsfile> streamFile(fptr, [](fitsfile * f)
+    {
+        int status = 0;
+        fits_close_file(f, &status);
+    });
+    fptr = nullptr;
+
+    const int dataType = static_cast<int>(stats.dataType);
+    const LONGLONG width = stats.width;
+    m_RowReader = [streamFile, dataType, width](uint32_t channel, uint32_t firstRow, uint32_t numRows, void *buffer)
+    {
+        int status = 0, anynull = 0;
+        long firstPixel[3] = { 1, static_cast<long>(firstRow) + 1, static_cast<long>(channel) + 1 };
+        return fits_read_pix(streamFile.get(), dataType, firstPixel, width * numRows, nullptr, buffer, &anynull, &status) == 0;
+    };
+    return true;
+}
+
+//This maps an uncompressed FITS image into memory instead of loading it, so loading takes no time and the pages of the
+//file are only read from the disk as the star extractor reaches them.  The pixels stay big endian, the extractor swaps
+//their bytes as it converts them to floats.  Images that cannot be read in place, because they are compressed, scaled,
+//or bayered, are loaded with loadFits instead, and getMappedImage is then not valid.
+bool fileio::loadFitsMapped(QString fileName)
+{
+    m_MappedImage = FITSImage::MappedImage();
+    if (!openFits(fileName))
+        return false;
+
+    int status = 0, bitpix = 0;
+    fits_get_img_type(fptr, &bitpix, &status);
+    const int compressed = fits_is_compressed_image(fptr, &status);
+
+    // The keywords are read with their own status, a missing keyword leaves the default
+    int keyStatus = 0;
+    double bzero = 0, bscale = 1;
+    fits_read_key(fptr, TDOUBLE, "BZERO", &bzero, nullptr, &keyStatus);
+    keyStatus = 0;
+    fits_read_key(fptr, TDOUBLE, "BSCALE", &bscale, nullptr, &keyStatus);
+    keyStatus = 0;
+    char bayerPattern[FLEN_VALUE];
+    const bool bayered = fits_read_keyword(fptr, "BAYERPAT", bayerPattern, nullptr, &keyStatus) == 0;
+
+    // SEP reads the unsigned integers of FITS, stored with an offset of 2^15 or 2^31, as well as the signed ones
+    uint32_t dataType = 0;
+    if (bscale == 1)
+    {
+        if (bitpix == BYTE_IMG && bzero == 0)
+            dataType = TBYTE;
+        else if (bitpix == SHORT_IMG && bzero == 0)
+            dataType = TSHORT;
+        else if (bitpix == SHORT_IMG && bzero == 32768.0)
+            dataType = TUSHORT;
+        else if (bitpix == LONG_IMG && bzero == 0)
+            dataType = TLONG;
+        else if (bitpix == LONG_IMG && bzero == 2147483648.0)
+            dataType = TULONG;
+        else if (bitpix == FLOAT_IMG && bzero == 0)
+            dataType = TFLOAT;
+        else if (bitpix == DOUBLE_IMG && bzero == 0)
+            dataType = TDOUBLE;
+    }
+
+    LONGLONG headStart = 0, dataStart = 0, dataEnd = 0;
+    fits_get_hduaddrll(fptr, &headStart, &dataStart, &dataEnd, &status);
+    const qint64 imageBytes = static_cast<qint64>(stats.samples_per_channel) * stats.channels * stats.bytesPerPixel;
+
+    // CFITSIO also opens gzipped files, whose data is not in the file as it is on the disk
+    auto mappedFile = std::make_shared<QFile>(fileName);
+    uchar *pixels = nullptr;
+    if (status == 0 && !compressed && !bayered && dataType != 0 && mappedFile->open(QIODevice::ReadOnly)
+            && mappedFile->peek(6) == "SIMPLE" && dataStart + imageBytes <= mappedFile->size())
+        pixels = mappedFile->map(dataStart, imageBytes);
+
+    if (pixels == nullptr)
+    {
+        status = 0;
+        fits_close_file(fptr, &status);
+        fptr = nullptr;
+        logIssue("The image cannot be read in place, loading it instead.");
+        return loadFits(fileName);
+    }
+
+    deleteImageBuffer();
+    m_RowReader = nullptr;
+    stats.dataType = dataType;
+    m_MappedImage.data = std::shared_ptr<const uint8_t>(pixels, [mappedFile](const uint8_t * mapped)
+    {
+        mappedFile->unmap(const_cast<uchar *>(mapped));
+    });
+    m_MappedImage.dataType = dataType;
+    m_MappedImage.bytesPerPixel = stats.bytesPerPixel;
+    m_MappedImage.width = stats.width;
+    m_MappedImage.height = stats.height;
+
+    getSolverOptionsFromFITS();
+    parseHeader();
+
+    fits_close_file(fptr, &status);
+    fptr = nullptr;
+    return true;
+}
+
 //This method I wrote combining code from the fits loading method above, the fits debayering method below, and QT
 //I also consulted the ImageToFITS method in fitsdata in KStars
 //The goal of this method is to load the data from a file that is not FITS format
@@ -209,14 +472,15 @@ bool fileio::loadOtherFormat(QString fileName)
     // because we convert it to 32bit-packed RGB with each color 8 bit, we can hardcode this here
     stats.bytesPerPixel = 1;
     stats.dataType      = SEP_TBYTE;
+    stats.sourceDataType = 0;
 
 
-    stats.width = static_cast<uint16_t>(imageFromFile.width());
-    stats.height = static_cast<uint16_t>(imageFromFile.height());
+    stats.width = static_cast<uint32_t>(imageFromFile.width());
+    stats.height = static_cast<uint32_t>(imageFromFile.height());
     stats.channels = 3;
     stats.ndim = 3;
     stats.samples_per_channel = stats.width * stats.height;
-    m_ImageBufferSize = stats.samples_per_channel * stats.channels * static_cast<uint16_t>(stats.bytesPerPixel);
+    m_ImageBufferSize = static_cast<size_t>(stats.samples_per_channel) * stats.channels * stats.bytesPerPixel;
     deleteImageBuffer();
     m_ImageBuffer = new uint8_t[m_ImageBufferSize];
     if (m_ImageBuffer == nullptr)
@@ -234,8 +498,8 @@ bool fileio::loadOtherFormat(QString fileName)
     uint8_t * gBuff = debayered_buffer + (stats.width * stats.height);
     uint8_t * bBuff = debayered_buffer + (stats.width * stats.height * 2);
 
-    int imax = stats.samples_per_channel * 4 - 4;
-    for (int i = 0; i <= imax; i += 4)
+    const size_t imax = static_cast<size_t>(stats.samples_per_channel) * 4;
+    for (size_t i = 0; i < imax; i += 4)
     {
         *rBuff++ = original_bayered_buffer[i + 2];
         *gBuff++ = original_bayered_buffer[i + 1];
@@ -308,157 +572,176 @@ bool fileio::debayer()
 //This method debayers 8 bit images
 bool fileio::debayer_8bit()
 {
-    dc1394error_t error_code;
-
-    uint32_t rgb_size = stats.samples_per_channel * 3 * stats.bytesPerPixel;
-    auto * destinationBuffer = new uint8_t[rgb_size];
+    return debayerType<uint8_t>();
+}
 
-    auto * bayer_source_buffer      = reinterpret_cast<uint8_t *>(m_ImageBuffer);
-    auto * bayer_destination_buffer = reinterpret_cast<uint8_t *>(destinationBuffer);
+//This method was copied and pasted from Fitsdata in KStars
+//This method debayers 16 bit images
+bool fileio::debayer_16bit()
+{
+    return debayerType<uint16_t>();
+}
 
-    if (bayer_destination_buffer == nullptr)
-    {
-        logIssue("Unable to allocate memory for temporary bayer buffer.");
-        return false;
-    }
+//This method debayers the image in bands of rows, each in its own thread.  Each band is decoded with the rows around it
+//by dc1394_bayer_decoding_8bit_rows or dc1394_bayer_decoding_16bit_rows, so the result is the same as decoding the
+//whole image at once, then it is split into the three channels that FITS uses.
+template <typename T>
+bool fileio::debayerType()
+{
+    //The tables AHD uses are filled in once, before any thread uses them
+    static std::once_flag ahdInitialized;
+    if (debayerParams.method == DC1394_BAYER_METHOD_AHD)
+        std::call_once(ahdInitialized, dc1394_bayer_AHD_init);
 
-    int ds1394_height = stats.height;
-    auto dc1394_source = bayer_source_buffer;
+    const uint32_t width = stats.width;
+    uint32_t height = stats.height;
+    auto * source = reinterpret_cast<T const *>(m_ImageBuffer);
 
     if (debayerParams.offsetY == 1)
     {
-        dc1394_source += stats.width;
-        ds1394_height--;
+        source += width;
+        height--;
     }
 
     if (debayerParams.offsetX == 1)
     {
-        dc1394_source++;
+        source++;
     }
 
-    error_code = dc1394_bayer_decoding_8bit(dc1394_source, bayer_destination_buffer, stats.width, ds1394_height,
-                                            debayerParams.filter,
-                                            debayerParams.method);
-
-    if (error_code != DC1394_SUCCESS)
+    const size_t channelSize = stats.samples_per_channel;
+    const size_t rgb_size = channelSize * 3 * sizeof(T);
+    uint8_t *destinationBuffer = new (std::nothrow) uint8_t[rgb_size];
+    if (destinationBuffer == nullptr)
     {
-        logIssue(QString("Debayer failed (%1)").arg(error_code));
-        stats.channels = 1;
-        delete[] destinationBuffer;
+        logIssue("Unable to allocate memory for temporary bayer buffer.");
         return false;
     }
+    auto * destination = reinterpret_cast<T *>(destinationBuffer);
 
-    if (m_ImageBufferSize != rgb_size)
+    //Downsample makes a smaller image, so it can only decode the whole image at once
+    const uint32_t numBands = debayerParams.method == DC1394_BAYER_METHOD_DOWNSAMPLE ? 1 :
+                              qBound(1u, height / DEBAYER_MIN_BAND_ROWS, static_cast<uint32_t>(QThread::idealThreadCount()));
+    std::atomic<int> error_code { DC1394_SUCCESS };
+    auto debayerRows = [&](uint32_t firstRow, uint32_t lastRow)
     {
-        delete[] m_ImageBuffer;
-        m_ImageBuffer = new uint8_t[rgb_size];
-
-        if (m_ImageBuffer == nullptr)
+        const uint32_t numRows = lastRow - firstRow;
+        std::vector<T> band(static_cast<size_t>(numRows) * width * 3);
+        dc1394error_t bandError;
+        if (std::is_same<T, uint8_t>::value)
+            bandError = dc1394_bayer_decoding_8bit_rows(reinterpret_cast<const uint8_t *>(source), reinterpret_cast<uint8_t *>(band.data()),
+                        width, height, firstRow, numRows, debayerParams.filter, debayerParams.method);
+        else
+            bandError = dc1394_bayer_decoding_16bit_rows(reinterpret_cast<const uint16_t *>(source), reinterpret_cast<uint16_t *>(band.data()),
+                        width, height, firstRow, numRows, debayerParams.filter, debayerParams.method, 16);
+        if (bandError != DC1394_SUCCESS)
         {
-            delete[] destinationBuffer;
-            logIssue("Unable to allocate memory for temporary bayer buffer.");
-            return false;
+            error_code = bandError;
+            return;
         }
 
-        m_ImageBufferSize = rgb_size;
-    }
-
-    auto bayered_buffer = reinterpret_cast<uint8_t *>(m_ImageBuffer);
-
-    // Data in R1G1B1, we need to copy them into 3 layers for FITS
+        // Data in R1G1B1, we need to copy them into 3 layers for FITS
+        const size_t offset = static_cast<size_t>(firstRow) * width;
+        T * rBuff = destination + offset;
+        T * gBuff = destination + channelSize + offset;
+        T * bBuff = destination + channelSize * 2 + offset;
+        const T * rgb = band.data();
+        const size_t bandSize = static_cast<size_t>(numRows) * width;
+        for (size_t i = 0; i < bandSize; i++)
+        {
+            rBuff[i] = rgb[3 * i];
+            gBuff[i] = rgb[3 * i + 1];
+            bBuff[i] = rgb[3 * i + 2];
+        }
+    };
 
-    uint8_t * rBuff = bayered_buffer;
-    uint8_t * gBuff = bayered_buffer + (stats.width * stats.height);
-    uint8_t * bBuff = bayered_buffer + (stats.width * stats.height * 2);
+    QList<QFuture<void>> futures;
+    for (uint32_t band = 1; band < numBands; band++)
+        futures.append(QtConcurrent::run(debayerRows, static_cast<uint32_t>(static_cast<uint64_t>(height) * band / numBands),
+                                         static_cast<uint32_t>(static_cast<uint64_t>(height) * (band + 1) / numBands)));
+    debayerRows(0, height / numBands);
+    for (auto &oneFuture : futures)
+        oneFuture.waitForFinished();
 
-    int imax = stats.samples_per_channel * 3 - 3;
-    for (int i = 0; i <= imax; i += 3)
+    if (error_code != DC1394_SUCCESS)
     {
-        *rBuff++ = bayer_destination_buffer[i];
-        *gBuff++ = bayer_destination_buffer[i + 1];
-        *bBuff++ = bayer_destination_buffer[i + 2];
+        logIssue(QString("Debayer failed (%1)").arg(error_code.load()));
+        stats.channels = 1;
+        delete[] destinationBuffer;
+        return false;
     }
 
-    delete[] destinationBuffer;
+    //With a vertical offset the last row has nothing to decode
+    for (size_t c = 0; c < 3; c++)
+        std::fill(destination + c * channelSize + static_cast<size_t>(height) * width, destination + (c + 1) * channelSize, 0);
+
+    delete[] m_ImageBuffer;
+    m_ImageBuffer = destinationBuffer;
+    m_ImageBufferSize = rgb_size;
+    stats.channels = 3;
     return true;
 }
 
-//This method was copied and pasted from Fitsdata in KStars
-//This method debayers 16 bit images
-bool fileio::debayer_16bit()
+//This method turns a bayered image into a luminance image half its size without debayering it.
+//Each pixel is the average of one 2x2 cell of the color filter array, so it has one red, two green and one blue pixel
+//in it whatever the pattern is.  The cells start at the bayer offsets, and a last row or column that does not
+//fill a cell is left out.  The result is one channel of floats, so no precision is lost in the average.
+bool fileio::superpixel()
 {
-    dc1394error_t error_code;
-
-    uint32_t rgb_size = stats.samples_per_channel * 3 * stats.bytesPerPixel;
-    auto * destinationBuffer = new uint8_t[rgb_size];
-
-    auto * bayer_source_buffer      = reinterpret_cast<uint16_t *>(m_ImageBuffer);
-    auto * bayer_destination_buffer = reinterpret_cast<uint16_t *>(destinationBuffer);
-
-    if (bayer_destination_buffer == nullptr)
+    switch (stats.dataType)
     {
-        logIssue("Unable to allocate memory for temporary bayer buffer.");
-        return false;
-    }
-
-    int ds1394_height = stats.height;
-    auto dc1394_source = bayer_source_buffer;
+        case TBYTE:
+            return superpixelType<uint8_t>();
 
-    if (debayerParams.offsetY == 1)
-    {
-        dc1394_source += stats.width;
-        ds1394_height--;
-    }
+        case TUSHORT:
+            return superpixelType<uint16_t>();
 
-    if (debayerParams.offsetX == 1)
-    {
-        dc1394_source++;
+        default:
+            return false;
     }
+}
 
-    error_code = dc1394_bayer_decoding_16bit(dc1394_source, bayer_destination_buffer, stats.width, ds1394_height,
-                 debayerParams.filter,
-                 debayerParams.method, 16);
-
-    if (error_code != DC1394_SUCCESS)
+template <typename T>
+bool fileio::superpixelType()
+{
+    const uint32_t offsetX = debayerParams.offsetX == 1 ? 1 : 0;
+    const uint32_t offsetY = debayerParams.offsetY == 1 ? 1 : 0;
+    if(stats.width < offsetX + 2 || stats.height < offsetY + 2)
     {
-        logIssue(QString("Debayer failed (%1)").arg(error_code));
-        stats.channels = 1;
-        delete[] destinationBuffer;
+        logIssue("The image is too small for superpixels.");
         return false;
     }
-
-    if (m_ImageBufferSize != rgb_size)
+    const uint32_t w = (stats.width - offsetX) / 2;
+    const uint32_t h = (stats.height - offsetY) / 2;
+    const size_t superpixelSize = static_cast<size_t>(w) * h * sizeof(float);
+    uint8_t *superpixelBuffer = new (std::nothrow) uint8_t[superpixelSize];
+    if (superpixelBuffer == nullptr)
     {
-        delete[] m_ImageBuffer;
-        m_ImageBuffer = new uint8_t[rgb_size];
-
-        if (m_ImageBuffer == nullptr)
-        {
-            delete[] destinationBuffer;
-            logIssue("Unable to allocate memory for temporary bayer buffer.");
-            return false;
-        }
-
-        m_ImageBufferSize = rgb_size;
+        logIssue("Unable to allocate memory for the superpixel buffer.");
+        return false;
     }
 
-    auto bayered_buffer = reinterpret_cast<uint16_t *>(m_ImageBuffer);
-
-    // Data in R1G1B1, we need to copy them into 3 layers for FITS
-
-    uint16_t * rBuff = bayered_buffer;
-    uint16_t * gBuff = bayered_buffer + (stats.width * stats.height);
-    uint16_t * bBuff = bayered_buffer + (stats.width * stats.height * 2);
-
-    int imax = stats.samples_per_channel * 3 - 3;
-    for (int i = 0; i <= imax; i += 3)
+    auto * source = reinterpret_cast<T const *>(m_ImageBuffer);
+    auto * destination = reinterpret_cast<float *>(superpixelBuffer);
+    for (uint32_t y = 0; y < h; y++)
     {
-        *rBuff++ = bayer_destination_buffer[i];
-        *gBuff++ = bayer_destination_buffer[i + 1];
-        *bBuff++ = bayer_destination_buffer[i + 2];
+        const T *top = source + static_cast<size_t>(2 * y + offsetY) * stats.width + offsetX;
+        const T *bottom = top + stats.width;
+        float *out = destination + static_cast<size_t>(y) * w;
+        for (uint32_t x = 0; x < w; x++)
+            out[x] = 0.25f * (static_cast<int32_t>(top[2 * x]) + top[2 * x + 1] + bottom[2 * x] + bottom[2 * x + 1]);
     }
 
-    delete[] destinationBuffer;
+    delete[] m_ImageBuffer;
+    m_ImageBuffer = superpixelBuffer;
+    m_ImageBufferSize = superpixelSize;
+    stats.width = w;
+    stats.height = h;
+    stats.channels = 1;
+    stats.samples_per_channel = w * h;
+    //The saturation limit still applies to the averages, as a fraction of the range of the sensor's pixels
+    stats.sourceDataType = stats.dataType;
+    stats.dataType = TFLOAT;
+    stats.bytesPerPixel = sizeof(float);
     return true;
 }
 
@@ -649,7 +932,10 @@ bool fileio::parseHeader()
     char * header = nullptr;
     int status = 0, nkeys = 0;
 
-    if (fits_hdr2str(fptr, 0, nullptr, 0, &header, &nkeys, &status))
+    // The header of a compressed image is converted back into the header of the image it holds
+    const bool compressed = fits_is_compressed_image(fptr, &status);
+    if (compressed ? fits_convert_hdr2str(fptr, 0, nullptr, 0, &header, &nkeys, &status) :
+            fits_hdr2str(fptr, 0, nullptr, 0, &header, &nkeys, &status))
     {
         fits_report_error(stderr, status);
         free(header);
@@ -733,7 +1019,7 @@ bool fileio::saveAsFITS(QString fileName, FITSImage::Statistic &imageStats, uint
     }
 
     long nelements;
-    long naxes[3] = { imageStats.width, imageStats.height, channels };
+    long naxes[3] = { static_cast<long>(imageStats.width), static_cast<long>(imageStats.height), channels };
     char error_status[512] = {0};
 
     QFileInfo newFileInfo(fileName);
@@ -864,14 +1150,14 @@ bool fileio::saveAsFITS(QString fileName, FITSImage::Statistic &imageStats, uint
     //fits_update_key(fptr, TLONG, "EXPOSURE", &exposure, "Total Exposure Time", &status);
 
     // NAXIS1
-    if (fits_update_key(fptr, TUSHORT, "NAXIS1", &(imageStats.width), "length of data axis 1", &status))
+    if (fits_update_key(fptr, TUINT, "NAXIS1", &(imageStats.width), "length of data axis 1", &status))
     {
         fits_report_error(stderr, status);
         return false;
     }
 
     // NAXIS2
-    if (fits_update_key(fptr, TUSHORT, "NAXIS2", &(imageStats.height), "length of data axis 2", &status))
+    if (fits_update_key(fptr, TUINT, "NAXIS2", &(imageStats.height), "length of data axis 2", &status))
     {
         fits_report_error(stderr, status);
         return false;
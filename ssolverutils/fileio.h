@@ -39,9 +39,13 @@ public:
     ~fileio();
     void deleteImageBuffer();
     bool logToSignal = false;
+    // Bayered FITS images are turned into a half size luminance image of 2x2 superpixels instead of being debayered
+    bool bayerSuperpixel = false;
     bool loadImage(QString fileName);
     bool loadImageBufferOnly(QString fileName);
     bool loadFits(QString fileName);
+    bool loadFitsStream(QString fileName);
+    bool loadFitsMapped(QString fileName);
     bool parseHeader();
     bool saveAsFITS(QString fileName, FITSImage::Statistic &imageStats, uint8_t *m_ImageBuffer, FITSImage::Solution solution, const QList<Record> &records, bool hasSolution);
     bool loadOtherFormat(QString fileName);
@@ -49,8 +53,15 @@ public:
     bool debayer();
     bool debayer_8bit();
     bool debayer_16bit();
+    bool superpixel();
     bool getSolverOptionsFromFITS();
 
+    // This sets the method that bayered images are debayered with
+    void setDebayerMethod(dc1394bayer_method_t method)
+    {
+        debayerParams.method = method;
+    }
+
     bool position_given = false;
     double ra;
     double dec;
@@ -67,6 +78,18 @@ public:
         return stats;
     }
 
+    // This reads the image opened by loadFitsStream a band of rows at a time
+    FITSImage::RowReader getRowReader() const
+    {
+        return m_RowReader;
+    }
+
+    // This is the image mapped by loadFitsMapped, it is not valid if the image had to be loaded instead
+    FITSImage::MappedImage getMappedImage() const
+    {
+        return m_MappedImage;
+    }
+
     const QList<Record> &getRecords() const
     {
         return m_HeaderRecords;
@@ -90,11 +113,17 @@ private:
     /// Generic data image buffer
     uint8_t *m_ImageBuffer { nullptr };
     /// Above buffer size in bytes
-    uint32_t m_ImageBufferSize { 0 };
+    size_t m_ImageBufferSize { 0 };
     bool justLoadBuffer = false;
+    FITSImage::RowReader m_RowReader;
+    FITSImage::MappedImage m_MappedImage;
+    bool openFits(QString fileName);
+    bool readCompressedImage();
     StretchParams stretchParams;
     BayerParams debayerParams;
     void logIssue(QString messsage);
+    template <typename T> bool superpixelType();
+    template <typename T> bool debayerType();
 
     QImage rawImage;
     void generateQImage();
@@ -7,10 +7,15 @@
 */
 
 //Qt Includes
+#include <QThread>
 #include <QtConcurrent>
 
 //System Includes
 #include <math.h>
+#include <algorithm>
+#include <limits>
+#include <type_traits>
+#include <vector>
 
 //CFITSIO Includes
 #include <fitsio.h>
@@ -23,6 +28,38 @@
 
 namespace {
 
+// Bands of fewer rows than this are not worth a thread of their own
+constexpr int MIN_BAND_ROWS = 16;
+
+// 8 and 16 bit integer images are stretched through a lookup table, and when there are several threads their
+// statistics come from exact histograms
+template <typename T>
+constexpr bool hasLookupTable = std::is_integral<T>::value && sizeof(T) <= 2;
+
+// Runs job(0) to job(numJobs - 1) on the thread pool, doing the first one on this thread, and waits for them all.
+template <typename Job>
+void runJobs(int numJobs, const Job &job)
+{
+  QList<QFuture<void>> futures;
+  for (int i = 1; i < numJobs; i++)
+    futures.append(QtConcurrent::run(job, i));
+  job(0);
+  for (auto &future : futures)
+    future.waitForFinished();
+}
+
+// Splits the rows into one band for each thread and runs rowsJob(firstRow, lastRow) on each of them.
+template <typename RowsJob>
+void runInBands(int numRows, const RowsJob &rowsJob)
+{
+  const int numBands = qBound(1, numRows / MIN_BAND_ROWS, QThread::idealThreadCount());
+  runJobs(numBands, [&](int band)
+  {
+    rowsJob(static_cast<int>(static_cast<int64_t>(numRows) * band / numBands),
+            static_cast<int>(static_cast<int64_t>(numRows) * (band + 1) / numBands));
+  });
+}
+
 // Returns the median value of the vector.
 // The vector is modified in an undefined way.
 template <typename T>
@@ -56,203 +93,123 @@ T median(T *values, int size, int sampleBy)
   return median(samples);
 }
 
-// This stretches one channel given the input parameters.
+// This stretches the values of one channel given its parameters.
 // Based on the spec in section 8.5.6
 // https://pixinsight.com/doc/docs/XISF-1.0-spec/XISF-1.0-spec.html
-// Uses multiple threads, blocks until done.
 // The extension parameters are not used.
-// Sampling is applied to the output (that is, with sampling=2, we compute every other output
-// sample both in width and height, so the output would have about 4X fewer pixels.
+// For 8 and 16 bit integers every possible value is stretched once, into a lookup table.
 template <typename T>
-void stretchOneChannel(T *input_buffer, QImage *output_image,
-                       const StretchParams& stretch_params, 
-                       int input_range, int image_height, int image_width, int sampling)
+class ChannelStretch
 {
-  QVector<QFuture<void>> futures;
+  public:
+    ChannelStretch(const StretchParams1Channel &params, int input_range)
+    {
+      // Maximum possible input value (e.g. 1024*64 - 1 for a 16 bit unsigned int).
+      const float maxInput = input_range > 1 ? input_range - 1 : input_range;
+
+      midtones = params.midtones;
+      // Precomputed expressions moved out of the loop.
+      // hightlights - shadows, protecting for divide-by-0, in a 0->1.0 scale.
+      const float hsRangeFactor = params.highlights == params.shadows ? 1.0f : 1.0f / (params.highlights - params.shadows);
+      // Shadow and highlight values translated to the ADU scale.
+      nativeShadows = params.shadows * maxInput;
+      nativeHighlights = params.highlights * maxInput;
+      // Constants based on above needed for the stretch calculations.
+      k1 = (midtones - 1) * hsRangeFactor * maxOutput / maxInput;
+      k2 = ((2 * midtones) - 1) * hsRangeFactor / maxInput;
+
+      if constexpr (hasLookupTable<T>)
+      {
+        table.resize(static_cast<size_t>(std::numeric_limits<T>::max()) - std::numeric_limits<T>::min() + 1);
+        for (size_t i = 0; i < table.size(); i++)
+          table[i] = compute(static_cast<T>(static_cast<int>(i) + std::numeric_limits<T>::min()));
+      }
+    }
 
-  // We're outputting uint8, so the max output is 255.
-  constexpr int maxOutput = 255;
+    uint8_t operator()(T input) const
+    {
+      if constexpr (hasLookupTable<T>)
+        return table[static_cast<int>(input) - std::numeric_limits<T>::min()];
+      else
+        return compute(input);
+    }
 
-  // Maximum possible input value (e.g. 1024*64 - 1 for a 16 bit unsigned int).
-  const float maxInput = input_range > 1 ? input_range - 1 : input_range;
-  
-  const float midtones   = stretch_params.grey_red.midtones;
-  const float highlights = stretch_params.grey_red.highlights;
-  const float shadows    = stretch_params.grey_red.shadows;
-
-  // Precomputed expressions moved out of the loop.
-  // hightlights - shadows, protecting for divide-by-0, in a 0->1.0 scale.
-  const float hsRangeFactor = highlights == shadows ? 1.0f : 1.0f / (highlights - shadows);
-  // Shadow and highlight values translated to the ADU scale.
-  const T nativeShadows = shadows * maxInput;
-  const T nativeHighlights = highlights * maxInput;
-  // Constants based on above needed for the stretch calculations.
-  const float k1 = (midtones - 1) * hsRangeFactor * maxOutput / maxInput;
-  const float k2 = ((2 * midtones) - 1) * hsRangeFactor / maxInput;
-  
-  // Increment the input index by the sampling, the output index increments by 1.
-  for (int j = 0, jout = 0; j < image_height; j+=sampling, jout++)
-  {
-    futures.append(QtConcurrent::run([ = ]()
+  private:
+    // We're outputting uint8, so the max output is 255.
+    static constexpr int maxOutput = 255;
+
+    uint8_t compute(T input) const
     {
-        T * inputLine  = input_buffer + j * image_width;
-        auto * scanLine = output_image->scanLine(jout);
-        
-    for (int i = 0, iout = 0; i < image_width; i+=sampling, iout++)
-        {
-          const T input = inputLine[i];
-          if (input < nativeShadows) scanLine[iout] = 0;
-          else if (input >= nativeHighlights) scanLine[iout] = maxOutput;
-          else 
-          {
-            const T inputFloored = (input - nativeShadows);
-            scanLine[iout] = (inputFloored * k1) / (inputFloored * k2 - midtones);
-	  }
-        }
-    }));
-  }
-  for(QFuture<void> future : futures)
-    future.waitForFinished();
-}
+      if (input < nativeShadows) return 0;
+      if (input >= nativeHighlights) return maxOutput;
+      const T inputFloored = (input - nativeShadows);
+      return (inputFloored * k1) / (inputFloored * k2 - midtones);
+    }
 
-// This is like the above 1-channel stretch, but extended for 3 channels.
-// This could have been more modular, but the three channels are combined
-// into a single qRgb value at the end, so it seems the simplest thing is to
-// replicate the code. It is assume the colors are not interleaved--the red image
-// is stored fully, then the green, then the blue.
+    T nativeShadows;
+    T nativeHighlights;
+    float k1;
+    float k2;
+    float midtones;
+    std::vector<uint8_t> table;
+};
+
+// This stretches the image into the output image, one band of output rows on each thread.
+// The R, G, B channels of a color image are not interleaved--the red image is stored fully,
+// then the green, then the blue--and they are combined into a single qRgb value.
 // Sampling is applied to the output (that is, with sampling=2, we compute every other output
 // sample both in width and height, so the output would have about 4X fewer pixels.
 template <typename T>
-void stretchThreeChannels(T *inputBuffer, QImage *outputImage,
-                          const StretchParams& stretchParams, 
-                          int inputRange, int imageHeight, int imageWidth, int sampling)
+void stretchChannels(T *input_buffer, QImage *output_image,
+                     const StretchParams& stretch_params,
+                     int input_range, int image_height, int image_width, int num_channels, int sampling)
 {
-  QVector<QFuture<void>> futures;
+  if (num_channels != 1 && num_channels != 3)
+    return;
 
-  // We're outputting uint8, so the max output is 255.
-  constexpr int maxOutput = 255;
+  const ChannelStretch<T> red(stretch_params.grey_red, input_range);
+  std::unique_ptr<ChannelStretch<T>> green, blue;
+  if (num_channels == 3)
+  {
+    green.reset(new ChannelStretch<T>(stretch_params.green, input_range));
+    blue.reset(new ChannelStretch<T>(stretch_params.blue, input_range));
+  }
 
-  // Maximum possible input value (e.g. 1024*64 - 1 for a 16 bit unsigned int).
-  const float maxInput = inputRange > 1 ? inputRange - 1 : inputRange;
-  
-  const float midtonesR   = stretchParams.grey_red.midtones;
-  const float highlightsR = stretchParams.grey_red.highlights;
-  const float shadowsR    = stretchParams.grey_red.shadows;
-  const float midtonesG   = stretchParams.green.midtones;
-  const float highlightsG = stretchParams.green.highlights;
-  const float shadowsG    = stretchParams.green.shadows;
-  const float midtonesB   = stretchParams.blue.midtones;
-  const float highlightsB = stretchParams.blue.highlights;
-  const float shadowsB    = stretchParams.blue.shadows;
-
-  // Precomputed expressions moved out of the loop.
-  // hightlights - shadows, protecting for divide-by-0, in a 0->1.0 scale.
-  const float hsRangeFactorR = highlightsR == shadowsR ? 1.0f : 1.0f / (highlightsR - shadowsR);
-  const float hsRangeFactorG = highlightsG == shadowsG ? 1.0f : 1.0f / (highlightsG - shadowsG);
-  const float hsRangeFactorB = highlightsB == shadowsB ? 1.0f : 1.0f / (highlightsB - shadowsB);
-  // Shadow and highlight values translated to the ADU scale.
-  const T nativeShadowsR = shadowsR * maxInput;
-  const T nativeShadowsG = shadowsG * maxInput;
-  const T nativeShadowsB = shadowsB * maxInput;
-  const T nativeHighlightsR = highlightsR * maxInput;
-  const T nativeHighlightsG = highlightsG * maxInput;
-  const T nativeHighlightsB = highlightsB * maxInput;
-  // Constants based on above needed for the stretch calculations.
-  const float k1R = (midtonesR - 1) * hsRangeFactorR * maxOutput / maxInput;
-  const float k1G = (midtonesG - 1) * hsRangeFactorG * maxOutput / maxInput;
-  const float k1B = (midtonesB - 1) * hsRangeFactorB * maxOutput / maxInput;
-  const float k2R = ((2 * midtonesR) - 1) * hsRangeFactorR / maxInput;
-  const float k2G = ((2 * midtonesG) - 1) * hsRangeFactorG / maxInput;
-  const float k2B = ((2 * midtonesB) - 1) * hsRangeFactorB / maxInput;
-  
-  const int size = imageWidth * imageHeight;
-  
-  for (int j = 0, jout = 0; j < imageHeight; j+=sampling, jout++)
+  // The image is detached here, once, so the threads can write their lines without touching its data pointer.
+  uchar *outputBits = output_image->bits();
+  const size_t bytesPerLine = output_image->bytesPerLine();
+  const size_t size = static_cast<size_t>(image_width) * image_height;
+  const int outputHeight = (image_height + sampling - 1) / sampling;
+
+  runInBands(outputHeight, [&](int firstRow, int lastRow)
   {
-    futures.append(QtConcurrent::run([ = ]()
+    for (int jout = firstRow; jout < lastRow; jout++)
     {
-        // R, G, B input images are stored one after another.
-        T * inputLineR  = inputBuffer + j * imageWidth;
-        T * inputLineG  = inputLineR + size;
-        T * inputLineB  = inputLineG + size;
-        
-        auto * scanLine = reinterpret_cast<QRgb*>(outputImage->scanLine(jout));
-        
-    for (int i = 0, iout = 0; i < imageWidth; i+=sampling, iout++)
-        {
-          const T inputR = inputLineR[i];
-          const T inputG = inputLineG[i];
-          const T inputB = inputLineB[i];
-
-          uint8_t red, green, blue;
-          
-          if (inputR < nativeShadowsR) red = 0;
-          else if (inputR >= nativeHighlightsR) red = maxOutput;
-          else 
-          {
-            const T inputFloored = (inputR - nativeShadowsR);
-            red = (inputFloored * k1R) / (inputFloored * k2R - midtonesR);
-	  }
-
-          if (inputG < nativeShadowsG) green = 0;
-          else if (inputG >= nativeHighlightsG) green = maxOutput;
-          else 
-          {
-            const T inputFloored = (inputG - nativeShadowsG);
-            green = (inputFloored * k1G) / (inputFloored * k2G - midtonesG);
-	  }
-
-          if (inputB < nativeShadowsB) blue = 0;
-          else if (inputB >= nativeHighlightsB) blue = maxOutput;
-          else 
-          {
-            const T inputFloored = (inputB - nativeShadowsB);
-            blue = (inputFloored * k1B) / (inputFloored * k2B - midtonesB);
-	  }
-          scanLine[iout] = qRgb(red, green, blue);
-        }
-    }));
-  }
-  for(QFuture<void> future : futures)
-    future.waitForFinished();
+      // Increment the input index by the sampling, the output index increments by 1.
+      const T * inputLineR = input_buffer + static_cast<size_t>(jout) * sampling * image_width;
+      uchar * scanLine = outputBits + jout * bytesPerLine;
+      if (num_channels == 1)
+      {
+        for (int i = 0, iout = 0; i < image_width; i += sampling, iout++)
+          scanLine[iout] = red(inputLineR[i]);
+      }
+      else
+      {
+        const T * inputLineG = inputLineR + size;
+        const T * inputLineB = inputLineG + size;
+        auto * rgbLine = reinterpret_cast<QRgb*>(scanLine);
+        for (int i = 0, iout = 0; i < image_width; i += sampling, iout++)
+          rgbLine[iout] = qRgb(red(inputLineR[i]), (*green)(inputLineG[i]), (*blue)(inputLineB[i]));
+      }
+    }
+  });
 }
 
-template <typename T>
-void stretchChannels(T *input_buffer, QImage *output_image,
-                       const StretchParams& stretch_params, 
-                     int input_range, int image_height, int image_width, int num_channels, int sampling)
-{
-    if (num_channels == 1)
-      stretchOneChannel(input_buffer, output_image, stretch_params, input_range,
-                        image_height, image_width, sampling);
-    else if (num_channels == 3)
-      stretchThreeChannels(input_buffer, output_image, stretch_params, input_range,
-                           image_height, image_width, sampling);
-}
-  
 // See section 8.5.7 in above link  https://pixinsight.com/doc/docs/XISF-1.0-spec/XISF-1.0-spec.html
-template <typename T>
-void computeParamsOneChannel(T *buffer, StretchParams1Channel *params, 
-                             int inputRange, int height, int width)
+// This turns the median of a channel and the median of its deviations from the median into stretch parameters.
+void setParamsFromMedian(float medianSample, float medDev, int inputRange, StretchParams1Channel *params)
 {
-  // Find the median sample.
-  constexpr int maxSamples = 500000;
-  const int sampleBy = width * height < maxSamples ? 1 : width * height / maxSamples;
-
-  T medianSample = median(buffer, width * height, sampleBy);
-  // Find the Median deviation: 1.4826 * median of abs(sample[i] - median).
-  const int numSamples = width * height / sampleBy;
-  std::vector<T> deviations(numSamples);
-  for (int index = 0, i = 0; i < numSamples; ++i, index += sampleBy)
-  {
-    if (medianSample > buffer[index])
-      deviations[i] = medianSample - buffer[index];
-    else
-      deviations[i] = buffer[index] - medianSample;
-  }
-
   // Shift everything to 0 -> 1.0.
-  const float medDev = median(deviations);
   const float normalizedMedian = medianSample / static_cast<float>(inputRange);
   const float MADN = 1.4826 * medDev / static_cast<float>(inputRange);
 
@@ -287,6 +244,108 @@ void computeParamsOneChannel(T *buffer, StretchParams1Channel *params,
   params->highlights_expansion = 1.0;
 }
 
+// This finds the median and the median deviation of a channel from samples of it.
+template <typename T>
+void computeParamsOneChannel(T *buffer, StretchParams1Channel *params,
+                             int inputRange, int height, int width)
+{
+  // Find the median sample.
+  constexpr int maxSamples = 500000;
+  const int sampleBy = width * height < maxSamples ? 1 : width * height / maxSamples;
+
+  T medianSample = median(buffer, width * height, sampleBy);
+  // Find the Median deviation: 1.4826 * median of abs(sample[i] - median).
+  const int numSamples = width * height / sampleBy;
+  std::vector<T> deviations(numSamples);
+  for (int index = 0, i = 0; i < numSamples; ++i, index += sampleBy)
+  {
+    if (medianSample > buffer[index])
+      deviations[i] = medianSample - buffer[index];
+    else
+      deviations[i] = buffer[index] - medianSample;
+  }
+  setParamsFromMedian(medianSample, median(deviations), inputRange, params);
+}
+
+// This finds the exact median and median deviation of 8 or 16 bit channels.  They are histogrammed in bands of rows
+// on all the threads.
+template <typename T>
+void computeParamsFromHistograms(T *buffer, StretchParams1Channel *channelParams[3], int channels,
+                                 int inputRange, int height, int width)
+{
+  const size_t channelSize = static_cast<size_t>(width) * height;
+  constexpr int numBins = 1 << (8 * sizeof(T));
+  constexpr int lowest = std::numeric_limits<T>::min();
+  const int bandsPerChannel = qBound(1, height / MIN_BAND_ROWS, std::max(1, QThread::idealThreadCount() / channels));
+  std::vector<std::vector<uint32_t>> histograms(static_cast<size_t>(channels) * bandsPerChannel);
+  runJobs(static_cast<int>(histograms.size()), [&](int job)
+  {
+    const int channel = job / bandsPerChannel, band = job % bandsPerChannel;
+    const size_t first = static_cast<size_t>(height) * band / bandsPerChannel * width;
+    const size_t last = static_cast<size_t>(height) * (band + 1) / bandsPerChannel * width;
+    const T *values = buffer + channel * channelSize;
+    std::vector<uint32_t> &histogram = histograms[job];
+    histogram.assign(numBins, 0);
+    for (size_t i = first; i < last; i++)
+      histogram[static_cast<int>(values[i]) - lowest]++;
+  });
+
+  for (int channel = 0; channel < channels; channel++)
+  {
+    std::vector<uint64_t> histogram(numBins, 0);
+    for (int band = 0; band < bandsPerChannel; band++)
+    {
+      const std::vector<uint32_t> &bandHistogram = histograms[channel * bandsPerChannel + band];
+      for (int bin = 0; bin < numBins; bin++)
+        histogram[bin] += bandHistogram[bin];
+    }
+
+    // The median is the value the middle sample would have if they were sorted.
+    const uint64_t middle = channelSize / 2;
+    uint64_t count = 0;
+    int medianBin = 0;
+    while ((count += histogram[medianBin]) <= middle)
+      medianBin++;
+
+    // Deviations of d from the median come from the bins d above and d below it.
+    count = histogram[medianBin];
+    int medDev = 0;
+    while (count <= middle)
+    {
+      medDev++;
+      if (medianBin + medDev < numBins)
+        count += histogram[medianBin + medDev];
+      if (medianBin - medDev >= 0)
+        count += histogram[medianBin - medDev];
+    }
+    setParamsFromMedian(static_cast<T>(medianBin + lowest), static_cast<T>(medDev), inputRange, channelParams[channel]);
+  }
+}
+
+// This computes the parameters of all the channels at once.  8 and 16 bit channels have exact medians from histograms
+// when there are several threads to share them.  On a single thread, taking a histogram of every pixel is about
+// twice as slow as sampling, so they are sampled like the other types, with one thread for each channel.
+template <typename T>
+void computeParamsAllChannels(T *buffer, StretchParams *result, int channels,
+                              int inputRange, int height, int width)
+{
+  StretchParams1Channel *channelParams[3] = { &result->grey_red, &result->green, &result->blue };
+  const size_t channelSize = static_cast<size_t>(width) * height;
+
+  if constexpr (hasLookupTable<T>)
+  {
+    if (QThread::idealThreadCount() > 1)
+    {
+      computeParamsFromHistograms(buffer, channelParams, channels, inputRange, height, width);
+      return;
+    }
+  }
+  runJobs(channels, [&](int channel)
+  {
+    computeParamsOneChannel(buffer + channel * channelSize, channelParams[channel], inputRange, height, width);
+  });
+}
+
 // Need to know the possible range of input values.
 // Using the type of the sample and guessing.
 // Perhaps we should examine the contents for the file
@@ -385,65 +444,38 @@ StretchParams Stretch::computeParams(uint8_t *input)
 {
   recalculateInputRange(input);
   StretchParams result;
-  for (int channel = 0; channel < image_channels; ++channel)
+  switch (dataType)
   {
-    int offset = channel * image_width * image_height;
-    StretchParams1Channel *params = channel == 0 ? &result.grey_red :
-      (channel == 1 ? &result.green : &result.blue);
-    switch (dataType)
-    {
-        case SEP_TBYTE:
-        {
-            auto buffer = reinterpret_cast<uint8_t*>(input);
-            computeParamsOneChannel(buffer + offset, params, input_range,
-                                    image_height, image_width);
-            break;
-        }
-        case TSHORT:
-        {
-            auto buffer = reinterpret_cast<short*>(input);
-            computeParamsOneChannel(buffer + offset, params, input_range,
-                                    image_height, image_width);
-            break;
-        }
-        case TUSHORT:
-        {
-            auto buffer = reinterpret_cast<unsigned short*>(input);
-            computeParamsOneChannel(buffer + offset, params, input_range,
-                                    image_height, image_width);
-            break;
-        }
-        case TLONG:
-        {
-            auto buffer = reinterpret_cast<long*>(input);
-            computeParamsOneChannel(buffer + offset, params, input_range,
-                                    image_height, image_width);
-            break;
-        }
-        case TFLOAT:
-        {
-            auto buffer = reinterpret_cast<float*>(input);
-            computeParamsOneChannel(buffer + offset, params, input_range,
-                                    image_height, image_width);
-            break;
-        }
-        case TLONGLONG:
-        {
-            auto buffer = reinterpret_cast<long long*>(input);
-            computeParamsOneChannel(buffer + offset, params, input_range,
-                                    image_height, image_width);
-            break;
-        }
-        case TDOUBLE:
-        {
-            auto buffer = reinterpret_cast<double*>(input);
-            computeParamsOneChannel(buffer + offset, params, input_range,
-                                    image_height, image_width);
-            break;
-        }
-        default:
-        break;
-    }
+      case SEP_TBYTE:
+          computeParamsAllChannels(reinterpret_cast<uint8_t*>(input), &result, image_channels, input_range,
+                                   image_height, image_width);
+          break;
+      case TSHORT:
+          computeParamsAllChannels(reinterpret_cast<short*>(input), &result, image_channels, input_range,
+                                   image_height, image_width);
+          break;
+      case TUSHORT:
+          computeParamsAllChannels(reinterpret_cast<unsigned short*>(input), &result, image_channels, input_range,
+                                   image_height, image_width);
+          break;
+      case TLONG:
+          computeParamsAllChannels(reinterpret_cast<long*>(input), &result, image_channels, input_range,
+                                   image_height, image_width);
+          break;
+      case TFLOAT:
+          computeParamsAllChannels(reinterpret_cast<float*>(input), &result, image_channels, input_range,
+                                   image_height, image_width);
+          break;
+      case TLONGLONG:
+          computeParamsAllChannels(reinterpret_cast<long long*>(input), &result, image_channels, input_range,
+                                   image_height, image_width);
+          break;
+      case TDOUBLE:
+          computeParamsAllChannels(reinterpret_cast<double*>(input), &result, image_channels, input_range,
+                                   image_height, image_width);
+          break;
+      default:
+      break;
   }
   return result;
 }
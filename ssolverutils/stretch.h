@@ -71,6 +71,8 @@ class Stretch
 
         /**
          * @brief computeParams Automatically generates and sets stretch parameters from the image.
+         * @note 8 and 16 bit channels are histogrammed on all threads and use their exact medians,
+         * other types use the medians of up to 500000 samples, one thread per channel.
          */
         StretchParams computeParams(uint8_t *input);
 
@@ -83,6 +85,7 @@ class Stretch
          * @param sampling The sampling parameter. Applies to both width and height.
          * Sampling is applied to the output (that is, with sampling=2, we compute every other output
          * sample both in width and height, so the output would have about 4X fewer pixels.
+         * The output rows are stretched in bands on all threads, 8 and 16 bit values through a lookup table.
          */
         void run(uint8_t *input, QImage *output_image, int sampling=1);
 
@@ -198,7 +198,8 @@ int engine_add_index(engine_t* engine, char* path) {
     free(base);
 
     t0 = timenow();
-    ind = index_load(path, engine->inparallel ? 0 : INDEX_ONLY_LOAD_METADATA, NULL);
+    ind = index_load(path, (engine->inparallel ? 0 : INDEX_ONLY_LOAD_METADATA) |
+                     (engine->compact_codes ? INDEX_COMPACT_CODES : 0), NULL);
     debug("index_load(\"%s\") took %g ms\n", path, 1000 * (timenow() - t0));
     if (!ind) {
         ERROR("Failed to load index from path %s", path);
@@ -436,6 +437,8 @@ int engine_run_job(engine_t* engine, job_t* job) {
 
     if (engine->inparallel)
         bp->indexes_inparallel = TRUE;
+    if (engine->compact_codes)
+        bp->index_options |= INDEX_COMPACT_CODES;
 
     if (job->use_radec_center) {
         logmsg("Only searching for solutions within %g degrees of RA,Dec (%g,%g)\n",
@@ -38,6 +38,7 @@
 #include "quad-utils.h"
 #include "errors.h"
 #include "tweak2.h"
+#include "gslutils.h"
 
 #if TESTING_TRYALLCODES
 #define DEBUGSOLVER 1
@@ -190,18 +191,21 @@ void solver_tweak2(solver_t* sp, MatchObj* mo, int order, sip_t* verifysip) {
 
     logverb("solver_tweak2: set_crpix %i, crpix (%.1f,%.1f)\n",
             sp->set_crpix, sp->crpix[0], sp->crpix[1]);
-    mo->sip = tweak2(xy, Nxy,
-                     sp->verify_pix, // pixel positional noise sigma
-                     solver_field_width(sp),
-                     solver_field_height(sp),
-                     refradec, mo->nindex,
-                     indexjitter, qc, Q2,
-                     sp->distractor_ratio,
-                     sp->logratio_bail_threshold,
-                     order, sp->tweak_abporder,
-                     &startsip, NULL, &theta, &odds,
-                     sp->set_crpix ? sp->crpix : NULL,
-                     &newodds, &besti, mo->testperm, startorder);
+    if (!sp->fitws)
+        sp->fitws = gslutils_lsq_new();
+    mo->sip = tweak2_ws(xy, Nxy,
+                        sp->verify_pix, // pixel positional noise sigma
+                        solver_field_width(sp),
+                        solver_field_height(sp),
+                        refradec, mo->nindex,
+                        indexjitter, qc, Q2,
+                        sp->distractor_ratio,
+                        sp->logratio_bail_threshold,
+                        order, sp->tweak_abporder,
+                        &startsip, NULL, &theta, &odds,
+                        sp->set_crpix ? sp->crpix : NULL,
+                        &newodds, &besti, mo->testperm, startorder,
+                        sp->fitws);
     free(refradec);
 
     // FIXME -- update refxy?  Nobody uses it, right?
@@ -1081,7 +1085,7 @@ static void try_all_codes_2(const int* fieldstars, int dimquad,
                             const double* code, solver_t* solver,
                             anbool current_parity, double tol2) {
     int i;
-    kdtree_qres_t* result = NULL;
+    kdtree_qres_t* result;
     int dimcode = (dimquad - 2) * 2;
     int stars[DQMAX];
     double flipcode[DCMAX];
@@ -1089,6 +1093,12 @@ static void try_all_codes_2(const int* fieldstars, int dimquad,
     // We actually only use elements up to dimquads-2.
     anbool placed[DQMAX];
 
+    // The result buffer lives as long as the solver, so after the first few
+    // quads the code-tree searches no longer touch the heap.
+    if (!solver->coderes)
+        solver->coderes = kdtree_qres_new();
+    result = solver->coderes;
+
     // Un-flipped:
     stars[0] = fieldstars[0];
     stars[1] = fieldstars[1];
@@ -1115,7 +1125,7 @@ static void try_all_codes_2(const int* fieldstars, int dimquad,
                      tol2, stars, NULL, 0, placed, &result);
 
  bailout:
-    kdtree_free_query(result);
+    kdtree_qres_reset(result);
 }
 
 /**
@@ -1222,8 +1232,8 @@ static void try_permutations(const int* origstars, int dimquad,
 #endif
 				
             // Search with the code we've built.
-            *presult = kdtree_rangesearch_options_reuse
-                (solver->index->codekd->tree, *presult, code, tol2, options);
+            *presult = codetree_rangesearch
+                (solver->index->codekd, *presult, code, tol2, options); //# Modified for the StellarSolver Internal Library, for compact code trees
             //debug("      trying ABCD = [%i %i %i %i]: %i results.\n",
             //fstars[A], fstars[B], fstars[C], fstars[D], result->nres);
 
@@ -1517,9 +1527,11 @@ static int solver_handle_hit(solver_t* sp, MatchObj* mo, sip_t* sip,
             }
 
             int doshift = 1;
-            fit_sip_wcs(matchxyz, matchxy, weights, N, &(sip.wcstan),
-                        sp->tweak_aborder, sp->tweak_abporder, doshift,
-                        &sip);
+            if (!sp->fitws)
+                sp->fitws = gslutils_lsq_new();
+            fit_sip_wcs_ws(matchxyz, matchxy, weights, N, &(sip.wcstan),
+                           sp->tweak_aborder, sp->tweak_abporder, doshift,
+                           &sip, sp->fitws);
 
             for (i=0; i<Ngood; i++) {
                 double xx,yy;
@@ -1631,6 +1643,10 @@ void solver_clear_indexes(solver_t* solver) {
 
 void solver_cleanup(solver_t* solver) {
     solver_free_field(solver);
+    kdtree_free_query(solver->coderes);
+    solver->coderes = NULL;
+    gslutils_lsq_free(solver->fitws);
+    solver->fitws = NULL;
     pl_free(solver->indexes);
     solver->indexes = NULL;
     if (solver->have_best_match) {
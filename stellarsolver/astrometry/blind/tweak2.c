@@ -23,6 +23,8 @@
 #include "mathutil.h"
 #include "verify.h"
 #include "fitsioutils.h"
+#include "gslutils.h"
+#include "tweak2.h"
 
 
 // Tweak debug plots?
@@ -211,6 +213,37 @@ sip_t* tweak2(const double* fieldxy, int Nfield,
               int* p_besti,
               int* testperm,
               int startorder) {
+    gslutils_lsq_t* ws = gslutils_lsq_new();
+    sip_t* sipout = tweak2_ws(fieldxy, Nfield, fieldjitter, W, H,
+                              indexradec, Nindex, indexjitter,
+                              quadcenter, quadR2, distractors, logodds_bail,
+                              sip_order, sip_invorder, startwcs, destwcs,
+                              newtheta, newodds, crpix, p_logodds, p_besti,
+                              testperm, startorder, ws);
+    gslutils_lsq_free(ws);
+    return sipout;
+}
+
+//# Modified for the StellarSolver Internal Library: the SIP fits reuse "ws"
+sip_t* tweak2_ws(const double* fieldxy, int Nfield,
+                 double fieldjitter,
+                 int W, int H,
+                 const double* indexradec, int Nindex,
+                 double indexjitter,
+                 const double* quadcenter, double quadR2,
+                 double distractors,
+                 double logodds_bail,
+                 int sip_order,
+                 int sip_invorder,
+                 const sip_t* startwcs,
+                 sip_t* destwcs,
+                 int** newtheta, double** newodds,
+                 double* crpix,
+                 double* p_logodds,
+                 int* p_besti,
+                 int* testperm,
+                 int startorder,
+                 gslutils_lsq_t* ws) {
     int order;
     sip_t* sipout;
     int* indexin;
@@ -472,9 +505,9 @@ sip_t* tweak2(const double* fieldxy, int Nfield,
             }
 
             int doshift = 1;
-            fit_sip_wcs(matchxyz, matchxy, weights, Nmatch,
-                        &(sipout->wcstan), order, sip_invorder,
-                        doshift, sipout);
+            fit_sip_wcs_ws(matchxyz, matchxy, weights, Nmatch,
+                           &(sipout->wcstan), order, sip_invorder,
+                           doshift, sipout, ws);
 
             debug("Got SIP:\n");
             if (log_get_level() > LOG_VERB)
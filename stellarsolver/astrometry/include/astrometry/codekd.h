@@ -18,6 +18,10 @@ typedef struct {
     kdtree_t* tree;
     qfits_header* header;
     int* inverse_perm;
+    //# Modified for the StellarSolver Internal Library: an optional reduced-precision
+    // copy of "tree" (see codetree_compact), shared with the other code trees of the
+    // same file.  Its permutation array holds indices into the data of "tree", not code ids.
+    kdtree_t* compact;
 } codetree_t;
 
 codetree_t* codetree_open(const char* fn);
@@ -38,6 +42,49 @@ qfits_header* codetree_header(codetree_t* s);
 
 int codetree_close(codetree_t* s);
 
+/**
+ Gives a double-precision code tree a u16-quantized copy (one scale per
+ tree) that codetree_rangesearch() then searches instead of the
+ original.  The copy is smaller than the original, so the search walks
+ less memory, but it is an addition to the original, so it uses more
+ memory in all: the candidates are re-checked against the original
+ doubles, so the results are identical.  Does nothing if the tree is
+ already stored in u16.
+
+ The copy is built once for each file "fn", as long as its size and
+ modification time do not change, and shared by every code tree opened
+ from it.  It is freed when the last of them is closed, unless
+ codetree_set_compact_cache_limit() asked for idle copies to be kept.
+
+ Returns 0 on success.
+ */
+int codetree_compact(codetree_t* s, const char* fn);
+
+/**
+ Frees the compact copies that no code tree is using.
+ */
+void codetree_clear_compact_cache(void);
+
+/**
+ Keeps the compact copies that no code tree is using, so that the next
+ solve does not build them again, until they add up to more than "bytes".
+ The least recently used are freed first.  0, the default, keeps none.
+ */
+void codetree_set_compact_cache_limit(size_t bytes);
+
+/**
+ The bytes of the compact copies that no code tree is using.
+ */
+size_t codetree_compact_cache_idle_bytes(void);
+
+/**
+ Finds codes within sqrt(maxd2) of "code", like
+ kdtree_rangesearch_options_reuse() on s->tree.  The returned "inds" are
+ code ids.
+ */
+kdtree_qres_t* codetree_rangesearch(codetree_t* s, kdtree_qres_t* res,
+                                    const double* code, double maxd2, int options);
+
 // for writing
 codetree_t* codetree_new(void);
 /** //# Modified by Robert Lancaster for the StellarSolver Internal Library
@@ -33,6 +33,8 @@ struct engine {
     double sizesmallest;
     double sizebiggest;
     anbool inparallel;
+    //# Modified for the StellarSolver Internal Library: search compact u16 copies of the code trees
+    anbool compact_codes;
     double minwidth;
     double maxwidth;
     float cpulimit;
@@ -39,6 +39,24 @@ int fit_sip_wcs(const double* starxyz,
                 sip_t* sipout
                 );
 
+struct gslutils_lsq;
+/**
+ Same as fit_sip_wcs, but builds the fits in "ws" (see gslutils.h), so
+ repeated fits don't allocate once it has grown to the largest
+ problem.
+ */
+int fit_sip_wcs_ws(const double* starxyz,
+                   const double* fieldxy,
+                   const double* weights,
+                   int M,
+                   const tan_t* tanin,
+                   int sip_order,
+                   int inv_order,
+                   int doshift,
+                   sip_t* sipout,
+                   struct gslutils_lsq* ws
+                   );
+
 int fit_sip_wcs_2(const double* starxyz,
                   const double* fieldxy,
                   const double* weights,
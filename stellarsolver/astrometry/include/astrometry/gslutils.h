@@ -45,6 +45,54 @@ int gslutils_solve_leastsquares(gsl_matrix* A, gsl_vector** B,
  */
 int gslutils_solve_leastsquares_v(gsl_matrix* A, int NB, ...);
 
+//# Modified for the StellarSolver Internal Library: reusable least-squares storage
+#define GSLUTILS_LSQ_MAX_NB 2
+
+/**
+ Storage for repeated least-squares fits.  gslutils_lsq_prepare() sizes
+ "A" (M x N) and the NB right-hand sides "B" (length M), which the caller
+ fills in; gslutils_lsq_solve() then leaves the solutions in "X" (length
+ N).  Once the workspace has grown to the largest problem it has seen,
+ neither call allocates.
+
+ The matrices and vectors are views into "mem", so they are only valid
+ until the next gslutils_lsq_prepare().
+ */
+struct gslutils_lsq {
+    double* mem;
+    size_t capacity;
+    // number of times "mem" was (re)allocated.
+    size_t nalloc;
+    int M, N, NB;
+
+    gsl_matrix* A;
+    gsl_vector* B[GSLUTILS_LSQ_MAX_NB];
+    gsl_vector* X[GSLUTILS_LSQ_MAX_NB];
+
+    gsl_matrix_view vA;
+    gsl_vector_view vB[GSLUTILS_LSQ_MAX_NB];
+    gsl_vector_view vX[GSLUTILS_LSQ_MAX_NB];
+    gsl_vector_view vtau;
+    gsl_vector_view vresid;
+};
+typedef struct gslutils_lsq gslutils_lsq_t;
+
+gslutils_lsq_t* gslutils_lsq_new(void);
+
+void gslutils_lsq_free(gslutils_lsq_t* ws);
+
+/**
+ Sizes the workspace for NB (<= GSLUTILS_LSQ_MAX_NB) right-hand sides of
+ an M x N system.  Returns 0 on success.
+ */
+int gslutils_lsq_prepare(gslutils_lsq_t* ws, int M, int N, int NB);
+
+/**
+ Solves A X_i = B_i using the first M rows (at most the prepared M), like
+ gslutils_solve_leastsquares().  This destroys A.
+ */
+int gslutils_lsq_solve(gslutils_lsq_t* ws, int M);
+
 // C = A B
 void gslutils_matrix_multiply(gsl_matrix* C, const gsl_matrix* A, const gsl_matrix* B);
 
@@ -73,6 +73,10 @@ typedef struct {
     int dimquads;
     int nstars;
     int nquads;
+
+    //# Modified for the StellarSolver Internal Library: search a compact copy of the
+    // code tree (see codetree_compact); set by INDEX_COMPACT_CODES.
+    anbool compact_codes;
 } index_t;
 
 /**
@@ -112,6 +116,7 @@ char* index_get_quad_filename(const char* indexname);
 char* index_get_qidx_filename(const char* indexname);
 
 #define INDEX_ONLY_LOAD_METADATA 2
+#define INDEX_COMPACT_CODES 4
 
 int index_get_quad_dim(const index_t* index);
 
@@ -134,7 +139,9 @@ index_t* index_build_from(codetree_t* codekd, quadfile_t* quads, startree_t* sta
  *               'myindex'
  *
  *   flags - If INDEX_ONLY_LOAD_METADATA, then only metadata will be
- *               loaded.
+ *               loaded.  If INDEX_COMPACT_CODES, a double-precision
+ *               code tree gets a u16 copy when it is (re)loaded, see
+ *               codetree_compact.
  *
  *   dest - If NULL, a new index_t will be allocated and returned;
  *               otherwise, the results will be put in this index_t
@@ -58,7 +58,10 @@ enum kd_build_options {
     KD_BUILD_LINEAR_LR     = 0x10,
     // DEBUG
     KD_BUILD_FORCE_SORT    = 0x20,
-    
+    /* Build independent subtrees on several threads once the top levels
+     have been split.  The result is identical to the serial build. */
+    KD_BUILD_PARALLEL      = 0x40,
+
 };
 
 typedef uint64_t u64;
@@ -259,6 +262,8 @@ struct kdtree_qres {
     } results;
     double *sdists;          /* Squared distance from query point */
     u32 *inds;    /* Indexes into original data set */
+    size_t pointsize;        /* Bytes per entry in "results" as allocated. */
+    size_t nalloc;           /* Number of times the arrays were (re)allocated. */
 };
 
 // Returns the number of data points in this kdtree.
@@ -335,6 +340,18 @@ void kdtree_inverse_permutation(const kdtree_t* tree, int* invperm);
 /* Free results */
 void kdtree_free_query(kdtree_qres_t *res);
 
+/*
+ Allocate an empty result buffer to be passed to
+ kdtree_rangesearch_options_reuse() over and over.  Combined with
+ KD_OPTIONS_NO_RESIZE_RESULTS, the arrays only grow to the largest
+ number of results seen and are never reallocated after that.
+ Free with kdtree_free_query().
+ */
+kdtree_qres_t* kdtree_qres_new(void);
+
+/* Forget the results in "res" but keep its arrays for the next query. */
+void kdtree_qres_reset(kdtree_qres_t *res);
+
 /* Free a tree; does not free kd->data */
 void kdtree_free(kdtree_t *kd);
 
@@ -536,6 +553,12 @@ kdtree_t* KDFUNC(kdtree_build)
      (kdtree_t* kd, void *data, int N, int D, int Nleaf,
       int treetype, unsigned int options);
 
+/*
+ Sets how many threads builds with KD_BUILD_PARALLEL use; 0 (the default)
+ means one per CPU.
+ */
+void kdtree_set_build_threads(int nthreads);
+
 
      kdtree_t* KDFUNC(kdtree_build_2)
           (kdtree_t* kd, void *data, int N, int D, int Nleaf,
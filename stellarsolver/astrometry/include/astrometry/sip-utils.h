@@ -29,6 +29,16 @@ int sip_compute_inverse_polynomials(sip_t* sip, int NX, int NY,
                                     double xlo, double xhi,
                                     double ylo, double yhi);
 
+struct gslutils_lsq;
+/**
+ Same as above, but builds the fit in "ws" (see gslutils.h) rather than
+ allocating its own matrices.
+ */
+int sip_compute_inverse_polynomials_ws(sip_t* sip, int NX, int NY,
+                                       double xlo, double xhi,
+                                       double ylo, double yhi,
+                                       struct gslutils_lsq* ws);
+
 /*
  Finds stars that are inside the bounds of a given field (wcs).
 
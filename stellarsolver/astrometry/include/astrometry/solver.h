@@ -204,6 +204,12 @@ struct solver_t {
 
     // Cached data about this field, for verify_hit().
     verify_field_t* vf;
+
+    // Code-tree search results, reused for every quad this solver tries.
+    kdtree_qres_t* coderes;
+
+    // Least-squares workspace for the SIP fits of tweaking, reused across matches.
+    struct gslutils_lsq* fitws;
 };
 typedef struct solver_t solver_t;
 
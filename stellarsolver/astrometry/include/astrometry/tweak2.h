@@ -59,6 +59,31 @@ sip_t* tweak2(const double* fieldxy, int Nfield,
               int* p_besti,
               int* testperm, int startorder);
 
+struct gslutils_lsq;
+/**
+ Same as tweak2, but does its SIP fits in "ws" (see gslutils.h), which
+ can be reused across calls.  (tweak2 uses one workspace for all the fits
+ of a call.)
+ */
+sip_t* tweak2_ws(const double* fieldxy, int Nfield,
+                 double fieldjitter,
+                 int W, int H,
+                 const double* indexradec, int Nindex,
+                 double indexjitter,
+                 const double* quadcenter, double quadR2,
+                 double distractors,
+                 double logodds_bail,
+                 int sip_order,
+                 int sip_invorder,
+                 const sip_t* startwcs,
+                 sip_t* destwcs,
+                 int** newtheta, double** newodds,
+                 double* crpix,
+                 double* p_logodds,
+                 int* p_besti,
+                 int* testperm, int startorder,
+                 struct gslutils_lsq* ws);
+
 
 #endif
 
@@ -8,6 +8,14 @@
 #include <assert.h>
 #include <string.h>
 #include <math.h>
+//# Modified for the StellarSolver Internal Library: the trees can be built on several threads.
+// windows.h goes before errors.h, which defines ERROR again.
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <pthread.h>
+#include <unistd.h>
+#endif
 
 #include "os-features.h"
 #include "kdtree.h"
@@ -414,6 +422,140 @@ int kdtree_compute_levels(int N, int Nleaf) {
     return maxlevel;
 }
 
+static int build_threads = 0;
+
+void kdtree_set_build_threads(int nthreads) {
+    build_threads = nthreads;
+}
+
+int kdtree_build_threads(void) {
+#if defined(_WIN32)
+    SYSTEM_INFO info;
+    if (build_threads > 0)
+        return build_threads;
+    GetSystemInfo(&info);
+    return (int)info.dwNumberOfProcessors;
+#else
+    long n;
+    if (build_threads > 0)
+        return build_threads;
+    n = sysconf(_SC_NPROCESSORS_ONLN);
+    return (n > 0) ? (int)n : 1;
+#endif
+}
+
+//# Modified for the StellarSolver Internal Library to build subtrees in parallel
+struct task_runner {
+    int (*task)(void* baton, int i);
+    void* baton;
+    int ntasks;
+#if defined(_WIN32)
+    volatile LONG next;
+    volatile LONG failed;
+#else
+    int failed;
+    int next;
+    pthread_mutex_t mutex;
+#endif
+};
+
+static int next_task(struct task_runner* r) {
+#if defined(_WIN32)
+    return (int)InterlockedIncrement(&r->next) - 1;
+#else
+    int i;
+    pthread_mutex_lock(&r->mutex);
+    i = r->next++;
+    pthread_mutex_unlock(&r->mutex);
+    return i;
+#endif
+}
+
+static void task_failed(struct task_runner* r) {
+#if defined(_WIN32)
+    InterlockedExchange(&r->failed, 1);
+#else
+    pthread_mutex_lock(&r->mutex);
+    r->failed = 1;
+    pthread_mutex_unlock(&r->mutex);
+#endif
+}
+
+static void run_tasks(struct task_runner* r) {
+    int i;
+    while ((i = next_task(r)) < r->ntasks) {
+        if (r->task(r->baton, i))
+            task_failed(r);
+    }
+}
+
+#if defined(_WIN32)
+static DWORD WINAPI task_thread(LPVOID arg) {
+    run_tasks((struct task_runner*)arg);
+    return 0;
+}
+#else
+static void* task_thread(void* arg) {
+    run_tasks((struct task_runner*)arg);
+    return NULL;
+}
+#endif
+
+int kdtree_run_tasks(int ntasks, int nthreads,
+                     int (*task)(void* baton, int i), void* baton) {
+    struct task_runner r;
+    int i, nstarted = 0;
+#if defined(_WIN32)
+    HANDLE* threads;
+#else
+    pthread_t* threads;
+#endif
+
+    r.task = task;
+    r.baton = baton;
+    r.ntasks = ntasks;
+    r.failed = 0;
+    r.next = 0;
+    if (nthreads > ntasks)
+        nthreads = ntasks;
+    if (nthreads < 1)
+        nthreads = 1;
+
+    threads = MALLOC(nthreads * sizeof(*threads));
+    if (!threads)
+        nthreads = 1;
+#if !defined(_WIN32)
+    pthread_mutex_init(&r.mutex, NULL);
+#endif
+    // The calling thread works too, so start one fewer; if a thread can't
+    // be started, the remaining ones just take more tasks each.
+    for (i = 1; i < nthreads; i++) {
+#if defined(_WIN32)
+        threads[nstarted] = CreateThread(NULL, 0, task_thread, &r, 0, NULL);
+        if (!threads[nstarted])
+            break;
+#else
+        if (pthread_create(&threads[nstarted], NULL, task_thread, &r))
+            break;
+#endif
+        nstarted++;
+    }
+    run_tasks(&r);
+    for (i = 0; i < nstarted; i++) {
+#if defined(_WIN32)
+        WaitForSingleObject(threads[i], INFINITE);
+        CloseHandle(threads[i]);
+#else
+        pthread_join(threads[i], NULL);
+#endif
+    }
+#if !defined(_WIN32)
+    pthread_mutex_destroy(&r.mutex);
+#endif
+    FREE(threads);
+    return r.failed ? -1 : 0;
+}
+
 int kdtree_nnodes_to_nlevels(int Nnodes) {
     return an_flsB(Nnodes + 1);
 }
@@ -530,6 +672,15 @@ void kdtree_free_query(kdtree_qres_t *kq) {
     FREE(kq);
 }
 
+kdtree_qres_t* kdtree_qres_new(void) {
+    return CALLOC(1, sizeof(kdtree_qres_t));
+}
+
+void kdtree_qres_reset(kdtree_qres_t *kq) {
+    if (!kq) return;
+    kq->nres = 0;
+}
+
 void kdtree_free(kdtree_t *kd) {
     if (!kd) return;
     FREE(kd->name);
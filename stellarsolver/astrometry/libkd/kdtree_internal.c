@@ -488,11 +488,25 @@ anbool resize_results(kdtree_qres_t* res, int newsize, int D,
         print_results(res, D);
     }
 
-    if (do_dists)
+    size_t pointsize = D * sizeof(etype);
+
+    // Nothing to do if the arrays already have the right size and layout;
+    // this is what makes reusing a result struct allocation-free.
+    if (newsize == res->capacity && res->inds &&
+        (!do_dists || res->sdists) &&
+        (!do_points || (res->results.any && res->pointsize == pointsize)))
+        return TRUE;
+
+    // Any array that exists is kept at "capacity" entries, so that a
+    // later query with different options never sees a short array.
+    if (do_dists || res->sdists)
         res->sdists  = REALLOC(res->sdists , newsize * sizeof(double));
     if (do_points)
-        res->results.any = REALLOC(res->results.any, newsize * D * sizeof(etype));
+        res->pointsize = pointsize;
+    if (do_points || res->results.any)
+        res->results.any = REALLOC(res->results.any, newsize * res->pointsize);
     res->inds = REALLOC(res->inds, newsize * sizeof(u32));
+    res->nalloc++;
     if (newsize && (!res->results.any || (do_dists && !res->sdists) || !res->inds))
         SYSERROR("Failed to resize kdtree results arrays");
     res->capacity = newsize;
@@ -1398,7 +1412,9 @@ kdtree_qres_t* MANGLE(kdtree_rangesearch_options)
                     }
                 }
             } else {
-                dtype rsplit = POINT_TE(kd, dim, split);
+                //# Modified for the StellarSolver Internal Library: the split is converted
+                // to the external type; as a dtype it was truncated for integer trees.
+                etype rsplit = POINT_TE(kd, dim, split);
                 if (query[dim] < rsplit) {
                     // query is on the "left" side of the split.
                     stackpos++;
@@ -2175,12 +2191,343 @@ static int needs_data_conversion() {
     return DTYPE_INTEGER && !ETYPE_INTEGER;
 }
 
+/*
+ Splits the points [left, right] owned by interior node "i": saves the
+ node's bounding box and splitting plane, and partitions the data so the
+ left child owns [left, m-1] and the right child [m, right].  Returns "m",
+ or -1 on error.  Only the data and perm entries in [left, right] are
+ touched, so disjoint subtrees can be split concurrently.
+ */
+static int build_node(kdtree_t* kd, int i, int left, int right,
+                      unsigned int options, dtype* lo, dtype* hi,
+                      const dtype* nullbb) {
+    int D = kd->ndim;
+    dtype* data = kd->data.DTYPE;
+    unsigned int d;
+    dtype maxrange;
+    ttype s;
+    int dim = 0;
+    int m;
+    dtype qsplit = 0;
+    int xx;
+
+#if defined(KD_DIM)
+    D = KD_DIM;
+#endif
+
+    if (left >= right) {
+        //debug("Empty node %i: left=right=%i\n", i, left);
+        if (options & KD_BUILD_BBOX)
+            save_bb(kd, i, nullbb, nullbb);
+        //# Modified for the StellarSolver Internal Library: the split of an empty
+        // node is never read, but it is set so that every tree built from the
+        // same data is the same, byte for byte.
+        if (kd->split.any)
+            *KD_SPLIT(kd, i) = 0;
+        if (kd->splitdim)
+            kd->splitdim[i] = 0;
+        // Both children end at "right".
+        return right + 1;
+    }
+
+    /* More sanity */
+    assert(0 <= left);
+    assert(left <= right);
+    assert(right < kd->ndata);
+
+    /* Find the bounding-box for this node. */
+    compute_bb(KD_DATA(kd, D, left), D, right - left + 1, lo, hi);
+
+    if (options & KD_BUILD_BBOX)
+        save_bb(kd, i, lo, hi);
+
+    /* Split along dimension with largest range */
+    maxrange = DTYPE_MIN;
+    for (d=0; d<D; d++)
+        if ((hi[d] - lo[d]) >= maxrange) {
+            maxrange = hi[d] - lo[d];
+            dim = d;
+        }
+    d = dim;
+    assert (d < D);
+
+    if ((options & KD_BUILD_FORCE_SORT) ||
+        (TTYPE_INTEGER && !(options & KD_BUILD_SPLITDIM))) {
+
+        /* We're packing dimension and split location into an int. */
+
+        /* Sort the data. */
+
+        /* Because the nature of the inttree is to bin the split
+         * planes, we have to be careful. Here, we MUST sort instead
+         * of merely partitioning, because we may not be able to
+         * properly represent the median as a split plane. Imagine the
+         * following on the dtype line: 
+         *
+         *    |P P   | P M  | P    |P     |  PP |  ------> X
+         *           1      2
+         * The |'s are possible split positions. If M is selected to
+         * split on, we actually cannot select the split 1 or 2
+         * immediately, because if we selected 2, then M would be on
+         * the wrong side (the medians always go to the right) and we
+         * can't select 1 because then P would be on the wrong side.
+         * So, the solution is to try split 2, and if point M-1 is on
+         * the correct side, great. Otherwise, we have to move shift
+         * point M-1 into the right side and only then chose plane 1. */
+
+
+        /* FIXME but qsort allocates a 2nd perm array GAH */
+        if (kdtree_qsort(data, kd->perm, left, right, D, dim)) {
+            ERROR("kdtree_qsort failed");
+            return -1;
+        }
+        m = (1 + (size_t)left + (size_t)right)/2;
+        assert(m >= 0);
+        assert(m >= left);
+        assert(m <= right);
+
+        /* Make sure sort works */
+        for(xx=left; xx<=right-1; xx++) {
+            assert(KD_ARRAY_VAL(data, D, xx,   d) <=
+                   KD_ARRAY_VAL(data, D, xx+1, d));
+        }
+
+        /* Encode split dimension and value. */
+        /* "s" is the location of the splitting plane in the "tree"
+         data type. */
+        s = POINT_DT(kd, d, KD_ARRAY_VAL(data, D, m, d), KD_ROUND);
+
+        if (kd->split.any) {
+            /* If we are using the "split" array to store both the
+             splitting plane and the splitting dimension, then we
+             truncate a few bits from "s" here. */
+            bigint tmps = s;
+            tmps &= kd->splitmask;
+            assert((tmps & kd->dimmask) == 0);
+            s = tmps;
+        }
+        /* "qsplit" is the location of the splitting plane in the "data"
+         type. */
+        qsplit = POINT_TD(kd, d, s);
+
+        /* Play games to make sure we properly partition the data */
+        while (m < right && KD_ARRAY_VAL(data, D, m, d) < qsplit) m++;
+        while (left < m  && qsplit < KD_ARRAY_VAL(data, D, m-1, d)) m--;
+
+        /* Even more sanity */
+        assert(m >= -1);
+        assert(left <= m);
+        assert(m <= right);
+        for (xx=left; m && xx<=m-1; xx++)
+            assert(KD_ARRAY_VAL(data, D, xx, d) <= qsplit);
+        for (xx=m; xx<=right; xx++)
+            assert(qsplit <= KD_ARRAY_VAL(data, D, xx, d));
+
+    } else {
+        /* "m-1" becomes R of the left child;
+         "m" becomes L of the right child. */
+        if (kd->has_linear_lr) {
+            m = kdtree_left(kd, KD_CHILD_RIGHT(i));
+        } else {
+            /* Pivot the data at the median */
+            m = (1 + (size_t)left + (size_t)right) / 2;
+        }
+        assert(m >= 0);
+        assert(m >= left);
+        assert(m <= right);
+        kdtree_quickselect_partition(data, kd->perm, left, right, D, dim, m);
+
+        s = POINT_DT(kd, d, KD_ARRAY_VAL(data, D, m, d), KD_ROUND);
+
+        assert(m != 0);
+        assert(left <= (m-1));
+        assert(m <= right);
+        for (xx=left; xx<=m-1; xx++)
+            assert(KD_ARRAY_VAL(data, D, xx, d) <=
+                   KD_ARRAY_VAL(data, D, m, d));
+        for (xx=left; xx<=m-1; xx++)
+            assert(KD_ARRAY_VAL(data, D, xx, d) <= s);
+        for (xx=m; xx<=right; xx++)
+            assert(KD_ARRAY_VAL(data, D, m, d) <=
+                   KD_ARRAY_VAL(data, D, xx, d));
+        for (xx=m; xx<=right; xx++)
+            assert(s <= KD_ARRAY_VAL(data, D, xx, d));
+    }
+
+    if (kd->split.any) {
+        if (kd->splitdim)
+            *KD_SPLIT(kd, i) = s;
+        else {
+            bigint tmps = s;
+            *KD_SPLIT(kd, i) = tmps | dim;
+        }
+    }
+    if (kd->splitdim)
+        kd->splitdim[i] = dim;
+
+    return m;
+}
+
+/*
+ Splits node "i" and, recursively, all interior nodes below it.  The R
+ pointers of the leaves are written straight into their slots of kd->lr.
+ */
+static int build_subtree(kdtree_t* kd, int i, int left, int right,
+                         unsigned int options, dtype* lo, dtype* hi,
+                         const dtype* nullbb) {
+    int c;
+    int m = build_node(kd, i, left, right, options, lo, hi, nullbb);
+    if (m == -1)
+        return -1;
+    for (c = KD_CHILD_LEFT(i); c <= KD_CHILD_RIGHT(i); c++) {
+        int cleft  = (c == KD_CHILD_LEFT(i)) ? left  : m;
+        int cright = (c == KD_CHILD_LEFT(i)) ? m - 1 : right;
+        if (KD_IS_LEAF(kd, c))
+            kd->lr[c - kd->ninterior] = cright;
+        else if (build_subtree(kd, c, cleft, cright, options, lo, hi, nullbb))
+            return -1;
+    }
+    return 0;
+}
+
+static int build_serial(kdtree_t* kd, int maxlevel, unsigned int options,
+                        dtype* lo, dtype* hi, const dtype* nullbb) {
+    int i;
+    int lnext, level;
+
+    /* Use the lr array as a stack while building. In place in your face! */
+    kd->lr[0] = kd->ndata - 1;
+    lnext = 1;
+    level = 0;
+
+    /* And in one shot, make the kdtree. Because the lr pointers
+     * are only stored for the bottom layer, we use the lr array as a
+     * stack. At finish, it contains the r pointers for the bottom nodes.
+     * The l pointer is simply +1 of the previous right pointer, or 0 if we
+     * are at the first element of the lr array. */
+    for (i = 0; i < kd->ninterior; i++) {
+        unsigned int c;
+        int left, right;
+        int m;
+
+        /* Have we reached the next level in the tree? */
+        if (i == lnext) {
+            level++;
+            lnext = lnext * 2 + 1;
+        }
+
+        /* Since we're not storing the L pointers, we have to infer L */
+        if (i == (1<<level)-1) {
+            left = 0;
+        } else {
+            left = kd->lr[i-1] + 1;
+        }
+        right = kd->lr[i];
+
+        assert(right != (unsigned int)-1);
+
+        m = build_node(kd, i, left, right, options, lo, hi, nullbb);
+        if (m == -1)
+            return -1;
+
+        /* Store the R pointers for each child */
+        c = 2*i;
+        if (level == maxlevel - 2)
+            c -= kd->ninterior;
+
+        kd->lr[c+1] = m-1;
+        kd->lr[c+2] = right;
+
+        assert(c+2 < kd->nbottom);
+    }
+    return 0;
+}
+
+//# Modified for the StellarSolver Internal Library to build subtrees in parallel
+// Subtrees are handed out to the threads after this many levels have been
+// split serially, so each thread gets several of them to balance the load.
+#define KD_PARALLEL_MIN_SUBTREES_PER_THREAD 4
+// Below this many points a parallel build isn't worth starting threads for.
+#define KD_PARALLEL_MIN_POINTS 65536
+
+struct build_task {
+    kdtree_t* kd;
+    unsigned int options;
+    const dtype* nullbb;
+    int firstnode;
+    int* lefts;
+    int* rights;
+};
+
+static int build_subtree_task(void* baton, int k) {
+    struct build_task* t = baton;
+    int D = t->kd->ndim;
+    int node = t->firstnode + k;
+    int rtn;
+#ifndef _MSC_VER //# Modified by Robert Lancaster for the StellarSolver Internal Library
+        dtype hi[D], lo[D];
+#else
+        dtype *hi = (dtype*) malloc(sizeof(dtype)*D);
+        dtype *lo = (dtype*) malloc(sizeof(dtype)*D);
+#endif
+    rtn = build_subtree(t->kd, node, t->lefts[node], t->rights[node],
+                        t->options, lo, hi, t->nullbb);
+#ifdef _MSC_VER //# Modified by Robert Lancaster for the StellarSolver Internal Library
+    free(hi);
+    free(lo);
+#endif
+    return rtn;
+}
+
+/*
+ Splits the top "toplevels" levels in order, then builds the subtrees below
+ them on a pool of threads.  Every node sees exactly the same points as in
+ the serial build, so the resulting tree is identical.
+ */
+static int build_parallel(kdtree_t* kd, int toplevels, int nthreads,
+                          unsigned int options, dtype* lo, dtype* hi,
+                          const dtype* nullbb) {
+    struct build_task task;
+    int nnodes = (1 << (toplevels + 1)) - 1;
+    int firstnode = (1 << toplevels) - 1;
+    int i, rtn;
+
+    task.kd = kd;
+    task.options = options;
+    task.nullbb = nullbb;
+    task.firstnode = firstnode;
+    task.lefts  = MALLOC(nnodes * sizeof(int));
+    task.rights = MALLOC(nnodes * sizeof(int));
+    if (!task.lefts || !task.rights) {
+        FREE(task.lefts);
+        FREE(task.rights);
+        return -1;
+    }
+    task.lefts[0] = 0;
+    task.rights[0] = kd->ndata - 1;
+    for (i = 0; i < firstnode; i++) {
+        int m = build_node(kd, i, task.lefts[i], task.rights[i], options, lo, hi, nullbb);
+        if (m == -1) {
+            FREE(task.lefts);
+            FREE(task.rights);
+            return -1;
+        }
+        task.lefts [KD_CHILD_LEFT(i)]  = task.lefts[i];
+        task.rights[KD_CHILD_LEFT(i)]  = m - 1;
+        task.lefts [KD_CHILD_RIGHT(i)] = m;
+        task.rights[KD_CHILD_RIGHT(i)] = task.rights[i];
+    }
+    rtn = kdtree_run_tasks(firstnode + 1, nthreads, build_subtree_task, &task);
+    FREE(task.lefts);
+    FREE(task.rights);
+    return rtn;
+}
+
 kdtree_t* MANGLE(kdtree_build_2)
      (kdtree_t* kd, etype* indata, int N, int D, int Nleaf, int treetype, unsigned int options, double* minval, double* maxval) {
     int i;
-    int xx;
-    int lnext, level;
     int maxlevel;
+    int nthreads, toplevels;
 
 #ifndef _MSC_VER //# Modified by Robert Lancaster for the StellarSolver Internal Library
         dtype hi[D], lo[D];
@@ -2188,7 +2535,6 @@ kdtree_t* MANGLE(kdtree_build_2)
         dtype *hi = (dtype*) malloc(sizeof(dtype)*D);
         dtype *lo = (dtype*) malloc(sizeof(dtype)*D);
 #endif
-    dtype* data = NULL;
 
 #ifndef _MSC_VER //# Modified by Robert Lancaster for the StellarSolver Internal Library
         dtype nullbb[D];
@@ -2315,203 +2661,20 @@ kdtree_t* MANGLE(kdtree_build_2)
     if (options & KD_BUILD_LINEAR_LR)
         kd->has_linear_lr = TRUE;
 
-    /* Use the lr array as a stack while building. In place in your face! */
-    kd->lr[0] = N - 1;
-    lnext = 1;
-    level = 0;
-
-    // shorthand
-    data = kd->data.DTYPE;
-
-    /* And in one shot, make the kdtree. Because the lr pointers
-     * are only stored for the bottom layer, we use the lr array as a
-     * stack. At finish, it contains the r pointers for the bottom nodes.
-     * The l pointer is simply +1 of the previous right pointer, or 0 if we
-     * are at the first element of the lr array. */
-    for (i = 0; i < kd->ninterior; i++) {
-        unsigned int d;
-        int left, right;
-        dtype maxrange;
-        ttype s;
-        unsigned int c;
-        int dim = 0;
-        int m;
-        dtype qsplit = 0;
-
-        /* Have we reached the next level in the tree? */
-        if (i == lnext) {
-            level++;
-            lnext = lnext * 2 + 1;
-        }
-
-        /* Since we're not storing the L pointers, we have to infer L */
-        if (i == (1<<level)-1) {
-            left = 0;
-        } else {
-            left = kd->lr[i-1] + 1;
-        }
-        right = kd->lr[i];
-
-        assert(right != (unsigned int)-1);
-
-        if (left >= right) {
-            //debug("Empty node %i: left=right=%i\n", i, left);
-            if (options & KD_BUILD_BBOX)
-                save_bb(kd, i, nullbb, nullbb);
-            if (kd->splitdim)
-                kd->splitdim[i] = 0;
-            c = 2*i;
-            if (level == maxlevel - 2)
-                c -= kd->ninterior;
-            kd->lr[c+1] = right;
-            kd->lr[c+2] = right;
-            continue;
-        }
-
-        /* More sanity */
-        assert(0 <= left);
-        assert(left <= right);
-        assert(right < N);
-
-        /* Find the bounding-box for this node. */
-        compute_bb(KD_DATA(kd, D, left), D, right - left + 1, lo, hi);
-
-        if (options & KD_BUILD_BBOX)
-            save_bb(kd, i, lo, hi);
-
-        /* Split along dimension with largest range */
-        maxrange = DTYPE_MIN;
-        for (d=0; d<D; d++)
-            if ((hi[d] - lo[d]) >= maxrange) {
-                maxrange = hi[d] - lo[d];
-                dim = d;
-            }
-        d = dim;
-        assert (d < D);
-
-        if ((options & KD_BUILD_FORCE_SORT) ||
-            (TTYPE_INTEGER && !(options & KD_BUILD_SPLITDIM))) {
-            
-            /* We're packing dimension and split location into an int. */
-
-            /* Sort the data. */
-
-            /* Because the nature of the inttree is to bin the split
-             * planes, we have to be careful. Here, we MUST sort instead
-             * of merely partitioning, because we may not be able to
-             * properly represent the median as a split plane. Imagine the
-             * following on the dtype line: 
-             *
-             *    |P P   | P M  | P    |P     |  PP |  ------> X
-             *           1      2
-             * The |'s are possible split positions. If M is selected to
-             * split on, we actually cannot select the split 1 or 2
-             * immediately, because if we selected 2, then M would be on
-             * the wrong side (the medians always go to the right) and we
-             * can't select 1 because then P would be on the wrong side.
-             * So, the solution is to try split 2, and if point M-1 is on
-             * the correct side, great. Otherwise, we have to move shift
-             * point M-1 into the right side and only then chose plane 1. */
-
-
-            /* FIXME but qsort allocates a 2nd perm array GAH */
-            if (kdtree_qsort(data, kd->perm, left, right, D, dim)) {
-                ERROR("kdtree_qsort failed");
-                return NULL;
-            }
-            m = (1 + (size_t)left + (size_t)right)/2;
-            assert(m >= 0);
-            assert(m >= left);
-            assert(m <= right);
-            
-            /* Make sure sort works */
-            for(xx=left; xx<=right-1; xx++) {
-                assert(KD_ARRAY_VAL(data, D, xx,   d) <=
-                       KD_ARRAY_VAL(data, D, xx+1, d));
-            }
-
-            /* Encode split dimension and value. */
-            /* "s" is the location of the splitting plane in the "tree"
-             data type. */
-            s = POINT_DT(kd, d, KD_ARRAY_VAL(data, D, m, d), KD_ROUND);
-
-            if (kd->split.any) {
-                /* If we are using the "split" array to store both the
-                 splitting plane and the splitting dimension, then we
-                 truncate a few bits from "s" here. */
-                bigint tmps = s;
-                tmps &= kd->splitmask;
-                assert((tmps & kd->dimmask) == 0);
-                s = tmps;
-            }
-            /* "qsplit" is the location of the splitting plane in the "data"
-             type. */
-            qsplit = POINT_TD(kd, d, s);
-
-            /* Play games to make sure we properly partition the data */
-            while (m < right && KD_ARRAY_VAL(data, D, m, d) < qsplit) m++;
-            while (left < m  && qsplit < KD_ARRAY_VAL(data, D, m-1, d)) m--;
-
-            /* Even more sanity */
-            assert(m >= -1);
-            assert(left <= m);
-            assert(m <= right);
-            for (xx=left; m && xx<=m-1; xx++)
-                assert(KD_ARRAY_VAL(data, D, xx, d) <= qsplit);
-            for (xx=m; xx<=right; xx++)
-                assert(qsplit <= KD_ARRAY_VAL(data, D, xx, d));
-
-        } else {
-            /* "m-1" becomes R of the left child;
-             "m" becomes L of the right child. */
-            if (kd->has_linear_lr) {
-                m = kdtree_left(kd, KD_CHILD_RIGHT(i));
-            } else {
-                /* Pivot the data at the median */
-                m = (1 + (size_t)left + (size_t)right) / 2;
-            }
-            assert(m >= 0);
-            assert(m >= left);
-            assert(m <= right);
-            kdtree_quickselect_partition(data, kd->perm, left, right, D, dim, m);
-
-            s = POINT_DT(kd, d, KD_ARRAY_VAL(data, D, m, d), KD_ROUND);
-
-            assert(m != 0);
-            assert(left <= (m-1));
-            assert(m <= right);
-            for (xx=left; xx<=m-1; xx++)
-                assert(KD_ARRAY_VAL(data, D, xx, d) <=
-                       KD_ARRAY_VAL(data, D, m, d));
-            for (xx=left; xx<=m-1; xx++)
-                assert(KD_ARRAY_VAL(data, D, xx, d) <= s);
-            for (xx=m; xx<=right; xx++)
-                assert(KD_ARRAY_VAL(data, D, m, d) <=
-                       KD_ARRAY_VAL(data, D, xx, d));
-            for (xx=m; xx<=right; xx++)
-                assert(s <= KD_ARRAY_VAL(data, D, xx, d));
-        }
-
-        if (kd->split.any) {
-            if (kd->splitdim)
-                *KD_SPLIT(kd, i) = s;
-            else {
-                bigint tmps = s;
-                *KD_SPLIT(kd, i) = tmps | dim;
-            }
+    nthreads = (options & KD_BUILD_PARALLEL) ? kdtree_build_threads() : 1;
+    toplevels = 0;
+    while ((1 << toplevels) < nthreads * KD_PARALLEL_MIN_SUBTREES_PER_THREAD)
+        toplevels++;
+    // The subtree roots must be interior nodes with interior children.
+    if (nthreads > 1 && N >= KD_PARALLEL_MIN_POINTS &&
+        toplevels < maxlevel - 2) {
+        if (build_parallel(kd, toplevels, nthreads, options, lo, hi, nullbb)) {
+            ERROR("Failed to build kdtree");
+            return NULL;
         }
-        if (kd->splitdim)
-            kd->splitdim[i] = dim;
-
-        /* Store the R pointers for each child */
-        c = 2*i;
-        if (level == maxlevel - 2)
-            c -= kd->ninterior;
-
-        kd->lr[c+1] = m-1;
-        kd->lr[c+2] = right;
-
-        assert(c+2 < kd->nbottom);
+    } else if (build_serial(kd, maxlevel, options, lo, hi, nullbb)) {
+        ERROR("Failed to build kdtree");
+        return NULL;
     }
 
     for (i=0; i<kd->nbottom-1; i++)
@@ -43,4 +43,13 @@ rtn KDMANGLE(func, d, s, s)args
 */
 int kdtree_compute_levels(int N, int Nleaf);
 
+/* The number of threads a parallel build should use. */
+int kdtree_build_threads(void);
+
+/* Runs task(baton, i) for every i in [0, ntasks) on up to "nthreads"
+   threads (including the calling one), handing out tasks in increasing
+   order.  Returns 0 if every task returned 0. */
+int kdtree_run_tasks(int ntasks, int nthreads,
+                     int (*task)(void* baton, int i), void* baton);
+
 #endif
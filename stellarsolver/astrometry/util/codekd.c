@@ -5,6 +5,17 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+//# Modified for the StellarSolver Internal Library: the compact trees are shared between threads.
+// windows.h goes before errors.h, which defines ERROR again.
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <pthread.h>
+#endif
 
 #include "codekd.h"
 #include "kdtree_fits_io.h"
@@ -90,6 +101,8 @@ codetree_t* codetree_open(const char* fn) {
     return my_open(fn, NULL);
 }
 
+static void release_compact_tree(kdtree_t* ckd); //# Modified for the StellarSolver Internal Library
+
 int codetree_close(codetree_t* s) {
     if (!s) return 0;
     if (s->inverse_perm)
@@ -98,10 +111,275 @@ int codetree_close(codetree_t* s) {
         qfits_header_destroy(s->header);
     if (s->tree)
         kdtree_fits_close(s->tree);
+    if (s->compact)
+        release_compact_tree(s->compact);
     free(s);
     return 0;
 }
 
+//# Modified for the StellarSolver Internal Library: reduced-precision code trees
+// The compact trees are kept here rather than with the code trees, one for
+// each code tree file, and are shared by all the code trees opened from that
+// file.  A file is known by its name, size and modification time, so a file
+// that is replaced gets a new tree.  Every solve loads its index files again,
+// so the host can ask for the trees that no code tree is using to be kept,
+// least recently used first out, up to compact_cache_idle_bytes.  By default
+// none are kept.
+static size_t compact_cache_idle_bytes = 0;
+
+typedef struct compact_entry {
+    char* fn;
+    int ndata;
+    off_t size;
+    time_t mtime;
+    kdtree_t* tree;
+    size_t bytes;
+    int users;
+    struct compact_entry* next;
+} compact_entry;
+
+// Most recently used first.
+static compact_entry* compact_cache = NULL;
+
+#if defined(_WIN32)
+static SRWLOCK compact_cache_lock = SRWLOCK_INIT;
+static void lock_compact_cache(void) {
+    AcquireSRWLockExclusive(&compact_cache_lock);
+}
+static void unlock_compact_cache(void) {
+    ReleaseSRWLockExclusive(&compact_cache_lock);
+}
+#else
+static pthread_mutex_t compact_cache_lock = PTHREAD_MUTEX_INITIALIZER;
+static void lock_compact_cache(void) {
+    pthread_mutex_lock(&compact_cache_lock);
+}
+static void unlock_compact_cache(void) {
+    pthread_mutex_unlock(&compact_cache_lock);
+}
+#endif
+
+static size_t compact_tree_bytes(const kdtree_t* kd) {
+    size_t bytes = kdtree_sizeof_data(kd);
+    if (kd->perm)
+        bytes += kdtree_sizeof_perm(kd);
+    if (kd->lr)
+        bytes += kdtree_sizeof_lr(kd);
+    if (kd->bb.any)
+        bytes += kdtree_sizeof_bb(kd);
+    if (kd->split.any)
+        bytes += kdtree_sizeof_split(kd);
+    if (kd->splitdim)
+        bytes += kdtree_sizeof_splitdim(kd);
+    return bytes;
+}
+
+static void free_compact_entry(compact_entry* e) {
+    kdtree_free(e->tree);
+    free(e->fn);
+    free(e);
+}
+
+// Frees the least recently used idle trees until the idle ones add up to
+// no more than maxidle bytes.  Must be called with the lock held.
+static void trim_compact_cache(size_t maxidle) {
+    compact_entry** link;
+    size_t idle = 0;
+
+    for (link = &compact_cache; *link;) {
+        compact_entry* e = *link;
+        if (!e->users && idle + e->bytes > maxidle) {
+            *link = e->next;
+            free_compact_entry(e);
+            continue;
+        }
+        if (!e->users)
+            idle += e->bytes;
+        link = &e->next;
+    }
+}
+
+static kdtree_t* build_compact_tree(const kdtree_t* kd) {
+    kdtree_t* ckd;
+    double* codes;
+    int N, D, Nleaf;
+
+    N = kd->ndata;
+    D = kd->ndim;
+    // The codes are used in the order they are stored in "tree", so that the
+    // compact tree's permutation array indexes straight into it.  The build
+    // only reads them to quantize them, so codes already stored as doubles
+    // are not copied.
+    if (kdtree_datatype(kd) == KDT_DATA_DOUBLE) {
+        codes = kd->data.d;
+    } else {
+        codes = malloc((size_t)N * (size_t)D * sizeof(double));
+        if (!codes) {
+            ERROR("Failed to allocate %i codes to compact the code kdtree", N);
+            return NULL;
+        }
+        kdtree_copy_data_double(kd, 0, N, codes);
+    }
+    Nleaf = N / kd->nbottom;
+    if (Nleaf < 1)
+        Nleaf = 1;
+    // The cache lock is held while the tree is built, so build it on all the cores.
+    ckd = kdtree_build(NULL, codes, N, D, Nleaf, KDTT_DSS,
+                       KD_BUILD_SPLIT | KD_BUILD_SPLITDIM | KD_BUILD_PARALLEL);
+    if (codes != kd->data.d)
+        free(codes);
+    if (!ckd) {
+        ERROR("Failed to build the compact code kdtree");
+        return NULL;
+    }
+    logverb("Compacted code kdtree: %zu bytes of codes, plus %zu for the compact copy\n",
+            kdtree_sizeof_data(kd), kdtree_sizeof_data(ckd));
+    return ckd;
+}
+
+int codetree_compact(codetree_t* s, const char* fn) {
+    kdtree_t* kd = s->tree;
+    compact_entry** link;
+    compact_entry* e = NULL;
+    struct stat st;
+    anbool known;
+
+    if (s->compact)
+        return 0;
+    if (kdtree_datatype(kd) == KDT_DATA_U16) {
+        logverb("Code kdtree is already stored as u16.\n");
+        return 0;
+    }
+    if (kdtree_exttype(kd) != KDT_EXT_DOUBLE || kd->ndim > DCMAX) {
+        ERROR("Can't compact a code kdtree of type %s with %i dimensions",
+              kdtree_kdtype_to_string(kdtree_exttype(kd)), kd->ndim);
+        return -1;
+    }
+
+    // A tree whose file cannot be found is never shared.
+    known = (stat(fn, &st) == 0);
+
+    // The lock is held while a tree is built, so that engines loading the
+    // same index at the same time build it only once.
+    lock_compact_cache();
+    for (link = &compact_cache; known && *link; link = &(*link)->next) {
+        if ((*link)->ndata == kd->ndata && (*link)->size == st.st_size &&
+            (*link)->mtime == st.st_mtime && !strcmp((*link)->fn, fn)) {
+            e = *link;
+            *link = e->next;
+            break;
+        }
+    }
+    if (!e) {
+        e = calloc(1, sizeof(compact_entry));
+        if (e) {
+            e->fn = strdup(fn);
+            e->ndata = kd->ndata;
+            e->size = known ? st.st_size : -1;
+            e->mtime = known ? st.st_mtime : 0;
+            e->tree = build_compact_tree(kd);
+        }
+        if (!e || !e->fn || !e->tree) {
+            unlock_compact_cache();
+            if (e) {
+                if (e->tree)
+                    kdtree_free(e->tree);
+                free(e->fn);
+                free(e);
+            }
+            return -1;
+        }
+        e->bytes = compact_tree_bytes(e->tree);
+    }
+    e->users++;
+    e->next = compact_cache;
+    compact_cache = e;
+    s->compact = e->tree;
+    unlock_compact_cache();
+    return 0;
+}
+
+static void release_compact_tree(kdtree_t* ckd) {
+    compact_entry* e;
+
+    lock_compact_cache();
+    for (e = compact_cache; e; e = e->next) {
+        if (e->tree == ckd) {
+            e->users--;
+            break;
+        }
+    }
+    trim_compact_cache(compact_cache_idle_bytes);
+    unlock_compact_cache();
+}
+
+void codetree_clear_compact_cache(void) {
+    lock_compact_cache();
+    trim_compact_cache(0);
+    unlock_compact_cache();
+}
+
+void codetree_set_compact_cache_limit(size_t bytes) {
+    lock_compact_cache();
+    compact_cache_idle_bytes = bytes;
+    trim_compact_cache(bytes);
+    unlock_compact_cache();
+}
+
+size_t codetree_compact_cache_idle_bytes(void) {
+    compact_entry* e;
+    size_t idle = 0;
+
+    lock_compact_cache();
+    for (e = compact_cache; e; e = e->next) {
+        if (!e->users)
+            idle += e->bytes;
+    }
+    unlock_compact_cache();
+    return idle;
+}
+
+kdtree_qres_t* codetree_rangesearch(codetree_t* s, kdtree_qres_t* res,
+                                    const double* code, double maxd2, int options) {
+    kdtree_t* ckd = s->compact;
+    double exact[DCMAX];
+    double r, d2;
+    unsigned int i, j;
+    int D, k;
+    u32 ind;
+
+    if (!ckd)
+        return kdtree_rangesearch_options_reuse(s->tree, res, code, maxd2, options);
+
+    // Widen the search by the rounding of the stored codes, the query and
+    // the split planes (half a step each), so no true match can be missed.
+    D = ckd->ndim;
+    r = sqrt(maxd2) + (0.5 * sqrt(D) + 1.0) * ckd->invscale;
+    res = kdtree_rangesearch_options_reuse(ckd, res, code, r * r, options);
+    if (!res)
+        return NULL;
+
+    // Re-check the candidates against the exact codes.
+    j = 0;
+    for (i=0; i<res->nres; i++) {
+        ind = res->inds[i];
+        kdtree_copy_data_double(s->tree, ind, 1, exact);
+        d2 = 0.0;
+        for (k=0; k<D; k++)
+            d2 += (exact[k] - code[k]) * (exact[k] - code[k]);
+        if (d2 > maxd2)
+            continue;
+        res->inds[j] = s->tree->perm ? s->tree->perm[ind] : ind;
+        if (res->sdists)
+            res->sdists[j] = d2;
+        if (res->results.any)
+            memcpy(res->results.d + (size_t)j * D, exact, D * sizeof(double));
+        j++;
+    }
+    res->nres = j;
+    return res;
+}
+
 static int Ndata(codetree_t* s) {
     return s->tree->ndata;
 }
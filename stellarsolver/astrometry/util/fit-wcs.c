@@ -82,6 +82,24 @@ int fit_sip_wcs(const double* starxyz,
                 int inv_order,
                 int doshift,
                 sip_t* sipout) {
+    gslutils_lsq_t* ws = gslutils_lsq_new();
+    int rtn = fit_sip_wcs_ws(starxyz, fieldxy, weights, M, tanin1, sip_order,
+                             inv_order, doshift, sipout, ws);
+    gslutils_lsq_free(ws);
+    return rtn;
+}
+
+//# Modified for the StellarSolver Internal Library: the matrices live in a reusable workspace
+int fit_sip_wcs_ws(const double* starxyz,
+                   const double* fieldxy,
+                   const double* weights,
+                   int M,
+                   const tan_t* tanin1,
+                   int sip_order,
+                   int inv_order,
+                   int doshift,
+                   sip_t* sipout,
+                   gslutils_lsq_t* ws) {
     int sip_coeffs;
     double xyzcrval[3];
     double cdinv[2][2];
@@ -92,7 +110,6 @@ int fit_sip_wcs(const double* starxyz,
     int rtn;
     gsl_matrix *mA;
     gsl_vector *b1, *b2, *x1, *x2;
-    gsl_vector *r1=NULL, *r2=NULL;
     tan_t tanin2;
     int ngood;
     const tan_t* tanin = &tanin2;
@@ -119,12 +136,11 @@ int fit_sip_wcs(const double* starxyz,
         return -1;
     }
 
-    mA = gsl_matrix_alloc(M, N);
-    b1 = gsl_vector_alloc(M);
-    b2 = gsl_vector_alloc(M);
-    assert(mA);
-    assert(b1);
-    assert(b2);
+    if (gslutils_lsq_prepare(ws, M, N, 2))
+        return -1;
+    mA = ws->A;
+    b1 = ws->B[0];
+    b2 = ws->B[1];
 
     /*
      *  We use a clever trick to estimate CD, A, and B terms in two
@@ -308,23 +324,14 @@ int fit_sip_wcs(const double* starxyz,
     if (weights)
         logverb("Total weight: %g\n", totalweight);
 
-    if (ngood < M) {
-        _gsl_vector_view sub_b1 = gsl_vector_subvector(b1, 0, ngood);
-        _gsl_vector_view sub_b2 = gsl_vector_subvector(b2, 0, ngood);
-        _gsl_matrix_view sub_mA = gsl_matrix_submatrix(mA, 0, 0, ngood, N);
-
-        rtn = gslutils_solve_leastsquares_v(&(sub_mA.matrix), 2,
-                                            &(sub_b1.vector), &x1, NULL,
-                                            &(sub_b2.vector), &x2, NULL);
-
-    } else {
-        // Solve the equation.
-        rtn = gslutils_solve_leastsquares_v(mA, 2, b1, &x1, NULL, b2, &x2, NULL);
-    }
+    // Solve the equation, using only the first ngood rows.
+    rtn = gslutils_lsq_solve(ws, ngood);
     if (rtn) {
         ERROR("Failed to solve SIP matrix equation!");
         return -1;
     }
+    x1 = ws->X[0];
+    x2 = ws->X[1];
 
     // Row 0 of X are the shift (p=0, q=0) terms.
     // Row 1 of X are the terms that multiply "u".
@@ -388,7 +395,8 @@ int fit_sip_wcs(const double* starxyz,
         sipout->b[1][0] = 0.0;
     }
 
-    sip_compute_inverse_polynomials(sipout, 0, 0, 0, 0, 0, 0);
+    // (this reuses the workspace; x1 and x2 are not needed after this.)
+    sip_compute_inverse_polynomials_ws(sipout, 0, 0, 0, 0, 0, 0, ws);
 
     if (doshift) {
         sU =
@@ -409,17 +417,6 @@ int fit_sip_wcs(const double* starxyz,
         wcs_shift(&(sipout->wcstan), -su, -sv);
     }
 
-    if (r1)
-        gsl_vector_free(r1);
-    if (r2)
-        gsl_vector_free(r2);
-
-    gsl_matrix_free(mA);
-    gsl_vector_free(b1);
-    gsl_vector_free(b2);
-    gsl_vector_free(x1);
-    gsl_vector_free(x2);
-
     return 0;
 }
 
@@ -11,6 +11,7 @@
 #include <gsl/gsl_blas.h>
 #include <gsl/gsl_errno.h>
 #include <stdarg.h>
+#include <stdlib.h>
 
 #include "os-features.h"
 #include "gslutils.h"
@@ -143,3 +144,82 @@ int gslutils_solve_leastsquares(gsl_matrix* A, gsl_vector** B,
     return 0;
 }
 
+
+//# Modified for the StellarSolver Internal Library: reusable least-squares storage
+gslutils_lsq_t* gslutils_lsq_new() {
+    return calloc(1, sizeof(gslutils_lsq_t));
+}
+
+void gslutils_lsq_free(gslutils_lsq_t* ws) {
+    if (!ws)
+        return;
+    free(ws->mem);
+    free(ws);
+}
+
+int gslutils_lsq_prepare(gslutils_lsq_t* ws, int M, int N, int NB) {
+    size_t need;
+    double* p;
+    int i;
+
+    if (M <= 0 || N <= 0 || NB <= 0 || NB > GSLUTILS_LSQ_MAX_NB) {
+        ERROR("Bad least-squares size: M=%i, N=%i, NB=%i", M, N, NB);
+        return -1;
+    }
+    // A, the B and X vectors, tau and the residuals.
+    need = (size_t)M * N + (size_t)NB * (M + N) + MIN(M, N) + M;
+    if (need > ws->capacity) {
+        p = realloc(ws->mem, need * sizeof(double));
+        if (!p) {
+            ERROR("Failed to allocate a %i x %i least-squares workspace", M, N);
+            return -1;
+        }
+        ws->mem = p;
+        ws->capacity = need;
+        ws->nalloc++;
+    }
+    ws->M = M;
+    ws->N = N;
+    ws->NB = NB;
+
+    p = ws->mem;
+    ws->vA = gsl_matrix_view_array(p, M, N);
+    ws->A = &(ws->vA.matrix);
+    p += (size_t)M * N;
+    for (i=0; i<NB; i++) {
+        ws->vB[i] = gsl_vector_view_array(p, M);
+        ws->B[i] = &(ws->vB[i].vector);
+        p += M;
+        ws->vX[i] = gsl_vector_view_array(p, N);
+        ws->X[i] = &(ws->vX[i].vector);
+        p += N;
+    }
+    ws->vtau = gsl_vector_view_array(p, MIN(M, N));
+    p += MIN(M, N);
+    ws->vresid = gsl_vector_view_array(p, M);
+    return 0;
+}
+
+int gslutils_lsq_solve(gslutils_lsq_t* ws, int M) {
+    gsl_matrix_view A;
+    gsl_vector_view tau, resid, b;
+    int i, N = ws->N;
+
+    if (M <= 0 || M > ws->M) {
+        ERROR("Least-squares fit of %i rows in a workspace of %i", M, ws->M);
+        return -1;
+    }
+    A = gsl_matrix_submatrix(ws->A, 0, 0, M, N);
+    tau = gsl_vector_subvector(&(ws->vtau.vector), 0, MIN(M, N));
+    resid = gsl_vector_subvector(&(ws->vresid.vector), 0, M);
+
+    if (gsl_linalg_QR_decomp(&(A.matrix), &(tau.vector)))
+        return -1;
+    for (i=0; i<ws->NB; i++) {
+        b = gsl_vector_subvector(ws->B[i], 0, M);
+        if (gsl_linalg_QR_lssolve(&(A.matrix), &(tau.vector), &(b.vector),
+                                  ws->X[i], &(resid.vector)))
+            return -1;
+    }
+    return 0;
+}
@@ -334,6 +334,13 @@ index_t* index_build_from(codetree_t* codekd, quadfile_t* quads, startree_t* sta
     return index;
 }
 
+static void compact_codes(index_t* index) {
+    if (!index->compact_codes || !index->codekd)
+        return;
+    if (codetree_compact(index->codekd, index->codefn))
+        logmsg("Searching the full-precision code kdtree of %s\n", index->indexname);
+}
+
 index_t* index_load(const char* indexname, int flags, index_t* dest) {
     index_t* allocd = NULL;
     anbool singlefile;
@@ -381,6 +388,9 @@ index_t* index_load(const char* indexname, int flags, index_t* dest) {
         // fast reopening.  anqfits_t doesn't keep a FILE* or anything
         // open, so that's fine.
     }
+    // Set after the first load so that metadata-only loads don't compact.
+    dest->compact_codes = (flags & INDEX_COMPACT_CODES) ? TRUE : FALSE;
+    compact_codes(dest);
 
     return dest;
 
@@ -432,6 +442,7 @@ int index_reload(index_t* index) {
             }
         }
     }
+    compact_codes(index);
     return 0;
 
  bailout:
@@ -50,6 +50,18 @@ int sip_ensure_inverse_polynomials(sip_t* sip) {
 int sip_compute_inverse_polynomials(sip_t* sip, int NX, int NY,
                                     double xlo, double xhi,
                                     double ylo, double yhi) {
+    gslutils_lsq_t* ws = gslutils_lsq_new();
+    int rtn = sip_compute_inverse_polynomials_ws(sip, NX, NY, xlo, xhi,
+                                                 ylo, yhi, ws);
+    gslutils_lsq_free(ws);
+    return rtn;
+}
+
+//# Modified for the StellarSolver Internal Library: the matrices live in a reusable workspace
+int sip_compute_inverse_polynomials_ws(sip_t* sip, int NX, int NY,
+                                       double xlo, double xhi,
+                                       double ylo, double yhi,
+                                       gslutils_lsq_t* ws) {
     int inv_sip_order;
     int M, N;
     int i, j, p, q, gu, gv;
@@ -95,12 +107,11 @@ int sip_compute_inverse_polynomials(sip_t* sip, int NX, int NY,
     // Number of samples to fit.
     M = NX * NY;
 
-    mA = gsl_matrix_alloc(M, N);
-    b1 = gsl_vector_alloc(M);
-    b2 = gsl_vector_alloc(M);
-    assert(mA);
-    assert(b1);
-    assert(b2);
+    if (gslutils_lsq_prepare(ws, M, N, 2))
+        return -1;
+    mA = ws->A;
+    b1 = ws->B[0];
+    b2 = ws->B[1];
 
     /*
      *  Rearranging formula (4), (5), and (6) from the SIP paper gives the
@@ -169,10 +180,12 @@ int sip_compute_inverse_polynomials(sip_t* sip, int NX, int NY,
     assert(i == M);
 
     // Solve the linear equation.
-    if (gslutils_solve_leastsquares_v(mA, 2, b1, &x1, NULL, b2, &x2, NULL)) {
+    if (gslutils_lsq_solve(ws, M)) {
         ERROR("Failed to solve SIP inverse matrix equation!");
         return -1;
     }
+    x1 = ws->X[0];
+    x2 = ws->X[1];
 
     // Extract the coefficients
     j = 0;
@@ -233,12 +246,6 @@ int sip_compute_inverse_polynomials(sip_t* sip, int NX, int NY,
         debug("  dist: %g\n", sqrt(sumdu + sumdv));
     }
 
-    gsl_matrix_free(mA);
-    gsl_vector_free(b1);
-    gsl_vector_free(b2);
-    gsl_vector_free(x1);
-    gsl_vector_free(x2);
-
     return 0;
 }
 
@@ -256,7 +256,7 @@ void ExternalExtractorSolver::run()
                         emit finished(fail);
                         return;
                     }
-                    if(m_ExtractedStars.size() == 0)
+                    if(m_ExtractedStars->isEmpty())
                     {
                         cleanupTempFiles();
                         emit logOutput("No stars were found, so the image cannot be solved");
@@ -307,6 +307,7 @@ ExtractorSolver* ExternalExtractorSolver::spawnChildSolver(int n)
     ExternalExtractorSolver *solver = new ExternalExtractorSolver(m_ProcessType, m_ExtractorType, m_SolverType, m_Statistics,
             m_ImageBuffer, nullptr);
     solver->setParent(this->parent()); //This makes the parent the StellarSolver
+    //The children share the star catalog rather than copying it, nothing changes it once extraction is done
     solver->m_ExtractedStars = m_ExtractedStars;
     solver->m_BasePath = m_BasePath;
     solver->m_BaseName = m_BaseName + "_" + QString::number(n);
@@ -544,24 +545,26 @@ int ExternalExtractorSolver::runExternalExtractor()
     if(extractorProcess->exitCode() != 0 || extractorProcess->exitStatus() == QProcess::CrashExit)
         return extractorProcess->exitCode();
 
-    int exitCode = getStarsFromXYLSFile();
+    auto stars = std::make_shared<FITSImage::StarCatalog>();
+    int exitCode = getStarsFromXYLSFile(*stars);
     if(exitCode != 0)
         return exitCode;
 
     if(m_UseSubframe)
     {
-        for(int i = 0; i < m_ExtractedStars.size(); i++)
+        const auto starX = stars->x();
+        const auto starY = stars->y();
+        std::vector<int> inside;
+        for(int i = 0; i < stars->size(); i++)
         {
-            FITSImage::Star star = m_ExtractedStars.at(i);
-            if(!m_SubFrameRect.contains(star.x, star.y))
-            {
-                m_ExtractedStars.removeAt(i);
-                i--;
-            }
+            if(m_SubFrameRect.contains(static_cast<int>(starX[i]), static_cast<int>(starY[i])))
+                inside.push_back(i);
         }
+        stars->select(inside);
     }
 
-    applyStarFilters(m_ExtractedStars);
+    applyStarFilters(*stars);
+    m_ExtractedStars = stars;
 
     m_HasExtracted = true;
 
@@ -1148,7 +1151,7 @@ void ExternalExtractorSolver::logSolver()
 
 //This method is copied and pasted and modified from tablist.c in astrometry.net
 //This is needed to load in the stars sextracted by an external SExtractor to get them into the table
-int ExternalExtractorSolver::getStarsFromXYLSFile()
+int ExternalExtractorSolver::getStarsFromXYLSFile(FITSImage::StarCatalog &stars)
 {
     QFile sextractorFile(starXYLSFilePath);
     if(!sextractorFile.exists())
@@ -1194,7 +1197,8 @@ int ExternalExtractorSolver::getStarsFromXYLSFile()
     for (jj = 1; jj <= ncols; jj++)
         fits_get_coltype(new_fptr, jj, nullptr, &nelements[jj], nullptr, &status);
 
-    m_ExtractedStars.clear();
+    stars.clear();
+    stars.reserve(nrows);
 
     /* read each column, row by row */
     val = value;
@@ -1278,7 +1282,7 @@ int ExternalExtractorSolver::getStarsFromXYLSFile()
 
         FITSImage::Star star = {starx, stary, mag, flux, peak, HFR, a, b, theta, 0, 0, (int)(a*b * 3.14)};
 
-        m_ExtractedStars.append(star);
+        stars.append(star);
     }
     fits_close_file(new_fptr, &status);
 
@@ -1624,7 +1628,8 @@ int ExternalExtractorSolver::writeStarExtractorTable()
     }
 
     int tfields = 3;
-    int nrows = m_ExtractedStars.size();
+    const FITSImage::StarCatalog &stars = *m_ExtractedStars;
+    int nrows = stars.size();
 
     //Columns: X_IMAGE, double, pixels, Y_IMAGE, double, pixels, MAG_AUTO, double, mag
     char* ttype[] = { xcol, ycol, magcol };
@@ -1632,16 +1637,10 @@ int ExternalExtractorSolver::writeStarExtractorTable()
     char* tunit[] = { colUnits, colUnits, magUnits };
     const char* extfile = "SExtractor_File";
 
-    float *xArray = new float[m_ExtractedStars.size()];
-    float *yArray = new float[m_ExtractedStars.size()];
-    float *magArray = new float[m_ExtractedStars.size()];
-
-    for (int i = 0; i < m_ExtractedStars.size(); i++)
-    {
-        xArray[i] = m_ExtractedStars.at(i).x;
-        yArray[i] = m_ExtractedStars.at(i).y;
-        magArray[i] = m_ExtractedStars.at(i).mag;
-    }
+    //The columns are written straight from the star catalog, CFITSIO converts the positions to the float columns
+    double *xArray = const_cast<double *>(stars.x().data());
+    double *yArray = const_cast<double *>(stars.y().data());
+    float *magArray = const_cast<float *>(stars.mag().data());
 
     int firstrow  = 1;  /* first row in table to write   */
     int firstelem = 1;
@@ -1654,14 +1653,14 @@ int ExternalExtractorSolver::writeStarExtractorTable()
         goto exit;
     }
 
-    if(fits_write_col(new_fptr, TFLOAT, column, firstrow, firstelem, nrows, xArray, &status))
+    if(fits_write_col(new_fptr, TDOUBLE, column, firstrow, firstelem, nrows, xArray, &status))
     {
         emit logOutput(QString("Could not write x pixels in binary table."));
         goto exit;
     }
 
     column = 2;
-    if(fits_write_col(new_fptr, TFLOAT, column, firstrow, firstelem, nrows, yArray, &status))
+    if(fits_write_col(new_fptr, TDOUBLE, column, firstrow, firstelem, nrows, yArray, &status))
     {
         emit logOutput(QString("Could not write y pixels in binary table."));
         goto exit;
@@ -1682,10 +1681,6 @@ int ExternalExtractorSolver::writeStarExtractorTable()
     status = 0;
 
 exit:
-    delete[] xArray;
-    delete[] yArray;
-    delete[] magArray;
-
     return status;
 }
 
@@ -1695,7 +1690,7 @@ int ExternalExtractorSolver::saveAsFITS()
 {
     //Only merge image channels if it is an RGB image and we are either averaging or integrating the channels
     if(m_Statistics.channels == 3 && (m_ColorChannel == FITSImage::AVERAGE_RGB || m_ColorChannel == FITSImage::INTEGRATED_RGB))
-        mergeImageChannels();
+        prepareImage(true, 1);
 
     QString newFilename = m_BasePath + "/" + m_BaseName + ".fit";
 
@@ -1708,7 +1703,7 @@ int ExternalExtractorSolver::saveAsFITS()
     long channelShift = (m_Statistics.channels < 3
                          || usingMergedChannelImage) ? 0 : m_Statistics.samples_per_channel * m_Statistics.bytesPerPixel * m_ColorChannel;
     long nelements, exposure;
-    long naxes[3] = { m_Statistics.width, m_Statistics.height, 1 };
+    long naxes[3] = { static_cast<long>(m_Statistics.width), static_cast<long>(m_Statistics.height), 1 };
     char error_status[512] = {0};
 
     QFileInfo newFileInfo(newFilename);
@@ -1776,14 +1771,14 @@ int ExternalExtractorSolver::saveAsFITS()
     fits_update_key(fptr, TLONG, "EXPOSURE", &exposure, "Total Exposure Time", &status);
 
     // NAXIS1
-    if (fits_update_key(fptr, TUSHORT, "NAXIS1", &(m_Statistics.width), "length of data axis 1", &status))
+    if (fits_update_key(fptr, TUINT, "NAXIS1", &(m_Statistics.width), "length of data axis 1", &status))
     {
         fits_report_error(stderr, status);
         return status;
     }
 
     // NAXIS2
-    if (fits_update_key(fptr, TUSHORT, "NAXIS2", &(m_Statistics.height), "length of data axis 2", &status))
+    if (fits_update_key(fptr, TUINT, "NAXIS2", &(m_Statistics.height), "length of data axis 2", &status))
     {
         fits_report_error(stderr, status);
         return status;
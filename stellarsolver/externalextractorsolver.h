@@ -134,9 +134,10 @@ class STELLARSOLVER_API ExternalExtractorSolver : public InternalExtractorSolver
 
         /**
          * @brief getStarsFromXYLSFile gets the star list from an xylist file
+         * @param stars The catalog the stars are read into
          * @return 0 if it succeeds
          */
-        int getStarsFromXYLSFile();
+        int getStarsFromXYLSFile(FITSImage::StarCatalog &stars);
 
         // Note: this method is needed so that the options selected in StellarSolver get passed to the solver
         /**
@@ -14,10 +14,12 @@
 #include <QVector>
 
 #include <atomic>
+#include <memory>
 
 //Project Includes
 #include "stellarsolver_export.h"
 #include "structuredefinitions.h"
+#include "starcatalog.h"
 #include "parameters.h"
 #include "wcsdata.h"
 
@@ -65,6 +67,12 @@ class STELLARSOLVER_API ExtractorSolver : public QThread
         // By Default we should use green since most telescopes are best color corrected for Green
         int m_ColorChannel = FITSImage::GREEN;
 
+        // If this is set, the image is not in memory and the internal extractor reads it in bands of rows instead
+        FITSImage::RowReader m_RowReader;
+
+        // If this is set, the image is read in place from a FITS file mapped into memory instead of the image buffer
+        FITSImage::MappedImage m_MappedImage;
+
         // Astrometry Scale Parameters, These are not saved parameters and change for each image, use the methods to set them
         bool m_UseScale = false;            // Whether or not to use the image scale parameters
         double scalelo = 0;                 // Lower bound of image scale estimate
@@ -159,20 +167,38 @@ class STELLARSOLVER_API ExtractorSolver : public QThread
             return m_Background;
         }
 
+        /**
+         * @brief getExtractionTiles gets the tiles the last star extraction was split into, with their timing
+         * @return The tiles, empty if the extractor does not use tiles
+         */
+        const QList<FITSImage::ExtractionTile> &getExtractionTiles() const
+        {
+            return m_ExtractionTiles;
+        }
+
         /**
          * @brief getNumStarsFound gets the number of stars found in the star extraction
          * @return The number of stars found
          */
         int getNumStarsFound() const
         {
-            return m_ExtractedStars.size();
+            return m_ExtractedStars->size();
         };
 
         /**
          * @brief getStarList gets the list of stars found during star extraction
-         * @return A QList full of stars and their properties
+         * @return A QList full of stars and their properties, built from the star catalog
+         */
+        QList<FITSImage::Star> getStarList() const
+        {
+            return m_ExtractedStars->toList();
+        }
+
+        /**
+         * @brief getStarCatalog gets the stars found during star extraction without copying them
+         * @return The star catalog, which is shared with any child solvers and is not changed once extraction is done
          */
-        const QList<FITSImage::Star> &getStarList() const
+        std::shared_ptr<const FITSImage::StarCatalog> getStarCatalog() const
         {
             return m_ExtractedStars;
         }
@@ -275,7 +301,9 @@ class STELLARSOLVER_API ExtractorSolver : public QThread
     // The Results
 
         FITSImage::Background m_Background;     // This is a report on the background levels found during star extraction
-        QList<FITSImage::Star> m_ExtractedStars;// This is the list of stars that get extracted from the image
+        // This is the catalog of stars that get extracted from the image, shared with the child solvers
+        std::shared_ptr<const FITSImage::StarCatalog> m_ExtractedStars { std::make_shared<const FITSImage::StarCatalog>() };
+        QList<FITSImage::ExtractionTile> m_ExtractionTiles; // This reports on the tiles the star extraction was split into
         FITSImage::Solution m_Solution;         // This is the solution that comes back from the Solver
         std::atomic<short> solutionIndexNumber{-1}; // This is the index number of the index used to solve the image.
         std::atomic<short> solutionHealpix{-1};    // This is the healpix of the index used to solve the image.
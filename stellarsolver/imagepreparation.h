@@ -0,0 +1,141 @@
+/*  ImagePreparation, StellarSolver Internal Library developed by Robert Lancaster, 2020
+
+    This application is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public
+    License as published by the Free Software Foundation; either
+    version 2 of the License, or (at your option) any later version.
+*/
+#pragma once
+
+//System Includes
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+#include <vector>
+
+/**
+ * The ImagePreparation functions turn one or three channels of an image buffer into the one channel float image that
+ * star extraction and solving use, averaging blocks of d x d pixels on the way.  They do not depend on Qt, so that they
+ * can be tested and benchmarked on their own.
+ */
+namespace ImagePreparation
+{
+
+// This describes the source image and the prepared image
+typedef struct
+{
+    uint32_t sourceWidth;
+    uint32_t sourceHeight;
+    size_t channelSize;     // The number of pixels from one channel to the next
+    int numChannels;        // The number of channels added up for each pixel, starting with the one source points to
+    double channelScale;    // The factor applied to the sum of the channels, 1/3 to average three channels
+    int d;                  // The size of the blocks that are averaged, in both dimensions
+    uint32_t width;         // The size of the prepared image, blocks that go past the edge of the source are partial
+    uint32_t height;
+} Layout;
+
+/**
+ * @brief layout describes the image prepared from a source image
+ * @param sourceWidth, sourceHeight The size of the source image
+ * @param channelSize The number of pixels from one channel to the next
+ * @param numChannels The number of channels to add up
+ * @param channelScale The factor applied to the sum of the channels
+ * @param d The size of the blocks that are averaged
+ */
+inline Layout layout(uint32_t sourceWidth, uint32_t sourceHeight, size_t channelSize, int numChannels, double channelScale,
+                     int d)
+{
+    return { sourceWidth, sourceHeight, channelSize, numChannels, channelScale, d,
+             (sourceWidth + d - 1) / d, (sourceHeight + d - 1) / d };
+}
+
+// The largest block size whose sums are exact for all data types
+constexpr int MAX_BLOCK_SIZE = 64;
+
+// Adds the sums of each block of D pixels in a row to sums.  With D known at compile time the block loop unrolls and
+// the loop over the blocks can be vectorized.
+template <int D, typename T, typename Sum>
+inline void addBlocks(const T *row, Sum *sums, uint32_t numBlocks)
+{
+    for(uint32_t x = 0; x < numBlocks; x++)
+    {
+        Sum total = 0;
+        for(int x2 = 0; x2 < D; x2++)
+            total += row[static_cast<size_t>(x) * D + x2];
+        sums[x] += total;
+    }
+}
+
+template <typename T, typename Sum>
+inline void addBlocks(const T *row, Sum *sums, uint32_t numBlocks, int d)
+{
+    switch(d)
+    {
+        case 1:
+            addBlocks<1>(row, sums, numBlocks);
+            break;
+        case 2:
+            addBlocks<2>(row, sums, numBlocks);
+            break;
+        case 3:
+            addBlocks<3>(row, sums, numBlocks);
+            break;
+        case 4:
+            addBlocks<4>(row, sums, numBlocks);
+            break;
+        default:
+            for(uint32_t x = 0; x < numBlocks; x++)
+            {
+                Sum total = 0;
+                for(int x2 = 0; x2 < d; x2++)
+                    total += row[static_cast<size_t>(x) * d + x2];
+                sums[x] += total;
+            }
+            break;
+    }
+}
+
+/**
+ * @brief prepareRows fills rows firstRow to lastRow - 1 of the prepared image.  Separate bands of rows can be prepared
+ * by different threads at the same time.
+ * Integer pixels are added up in integers, 32 bit ones for 8 and 16 bit pixels, which is exact for blocks up to
+ * MAX_BLOCK_SIZE and lets the compiler vectorize the loops.  Floating point pixels are added up in doubles.
+ * The last column and row of blocks are averaged over the pixels that are in the source.
+ * @param source The first pixel of the first channel to use
+ * @param l The layout from layout()
+ * @param destination The prepared image, l.width x l.height floats
+ */
+template <typename T>
+void prepareRows(const T *source, const Layout &l, float *destination, uint32_t firstRow, uint32_t lastRow)
+{
+    typedef typename std::conditional < std::is_floating_point<T>::value, double,
+            typename std::conditional < sizeof(T) <= 2, int32_t, int64_t >::type >::type Sum;
+    const int d = l.d;
+    const uint32_t fullWidth = l.sourceWidth / d;
+    std::vector<Sum> sums(l.width);
+    for(uint32_t y = firstRow; y < lastRow; y++)
+    {
+        const uint32_t firstLine = y * d;
+        const int blockHeight = std::min<uint32_t>(d, l.sourceHeight - firstLine);
+        std::fill(sums.begin(), sums.end(), 0);
+        for(int c = 0; c < l.numChannels; c++)
+        {
+            for(int y2 = 0; y2 < blockHeight; y2++)
+            {
+                const T *row = source + c * l.channelSize + static_cast<size_t>(firstLine + y2) * l.sourceWidth;
+                addBlocks(row, sums.data(), fullWidth, d);
+                for(uint32_t x = fullWidth * d; x < l.sourceWidth; x++)
+                    sums[fullWidth] += row[x];
+            }
+        }
+        float *out = destination + static_cast<size_t>(y) * l.width;
+        const double scale = l.channelScale / (d * blockHeight);
+        for(uint32_t x = 0; x < fullWidth; x++)
+            out[x] = static_cast<float>(sums[x] * scale);
+        if(fullWidth < l.width)
+            out[fullWidth] = static_cast<float>(sums[fullWidth] * l.channelScale / ((l.sourceWidth - fullWidth * d) * blockHeight));
+    }
+}
+
+}  // namespace ImagePreparation
@@ -8,10 +8,14 @@
 
 //Qt Includes
 #include <QMutexLocker>
+#include <QElapsedTimer>
+#include <QThread>
 #include "qmath.h"
 
 //Project Includes
 #include "internalextractorsolver.h"
+#include "imagepreparation.h"
+#include "starfilters.h"
 
 //System Includes
 #if defined(__APPLE__)
@@ -25,6 +29,10 @@
 
 #include <memory>
 #include <atomic>
+#include <algorithm>
+#include <type_traits>
+#include <cstring>
+#include <vector>
 
 
 //SEP Includes
@@ -44,6 +52,18 @@ using namespace SEP;
 
 static std::atomic<int> solverNum{1};
 
+// The executor SEP is given for the blocks of its background, so they run on the thread pool like the rest of the
+// extraction.  This thread runs the first block itself, it is never a pool thread.
+static void runOnThreadPool(void (*fn)(void *, int), void *arg, int n)
+{
+    QList<QFuture<void>> blockFutures;
+    for (int block = 1; block < n; block++)
+        blockFutures.append(QtConcurrent::run(fn, arg, block));
+    fn(arg, 0);
+    for (auto &oneFuture : blockFutures)
+        oneFuture.waitForFinished();
+}
+
 InternalExtractorSolver::InternalExtractorSolver(ProcessType pType, ExtractorType eType, SolverType sType,
         const FITSImage::Statistic &imagestats, uint8_t const *imageBuffer, QObject *parent) : ExtractorSolver(pType, eType, sType,
                     imagestats, imageBuffer, parent)
@@ -56,15 +76,10 @@ InternalExtractorSolver::InternalExtractorSolver(ProcessType pType, ExtractorTyp
 InternalExtractorSolver::~InternalExtractorSolver()
 {
     waitSEP(); // Just in case it has not shut down
-    if(downSampledBuffer)
-    {
-        delete [] downSampledBuffer;
-        downSampledBuffer = nullptr;
-    }
-    if(mergedChannelBuffer)
+    if(preparedBuffer)
     {
-        delete [] mergedChannelBuffer;
-        mergedChannelBuffer = nullptr;
+        delete [] preparedBuffer;
+        preparedBuffer = nullptr;
     }
     disconnect();
     quit();
@@ -108,6 +123,7 @@ ExtractorSolver* InternalExtractorSolver::spawnChildSolver(int n)
     InternalExtractorSolver *solver = new InternalExtractorSolver(m_ProcessType, m_ExtractorType, m_SolverType, m_Statistics,
             m_ImageBuffer, nullptr);
     solver->setParent(this->parent());  //This makes the parent the StellarSolver
+    //The children share the star catalog rather than copying it, nothing changes it once extraction is done
     solver->m_ExtractedStars = m_ExtractedStars;
     solver->m_BasePath = m_BasePath;
     //They will all share the same basename
@@ -163,7 +179,7 @@ void InternalExtractorSolver::run()
             if(!m_HasExtracted)
             {
                 extract();
-                if(m_ExtractedStars.size() == 0)
+                if(m_ExtractedStars->isEmpty())
                 {
                     emit logOutput("No stars were found, so the image cannot be solved");
                     cleanupTempFiles();
@@ -195,29 +211,64 @@ void InternalExtractorSolver::cleanupTempFiles()
     //There are NO temp files anymore for the internal SEP or Astrometry builds!!!
 }
 
-float* InternalExtractorSolver::allocateDataBuffer(uint32_t x, uint32_t y, uint32_t w, uint32_t h)
+int InternalExtractorSolver::sepDataType() const
 {
+    // The pixels of a mapped FITS file are big endian, SEP swaps their bytes as it converts them
+    if (m_MappedImage.isValid())
+    {
+        switch (m_MappedImage.dataType)
+        {
+            case SEP_TBYTE:
+                return SEP_TBYTE;
+            case TSHORT:
+                return SEP_TSHORT_BE;
+            case TUSHORT:
+                return SEP_TUSHORT_BE;
+            case TLONG:
+                return SEP_TINT_BE;
+            case TULONG:
+                return SEP_TUINT_BE;
+            case TFLOAT:
+                return SEP_TFLOAT_BE;
+            case TDOUBLE:
+                return SEP_TDOUBLE_BE;
+            default:
+                return 0;
+        }
+    }
     switch (m_Statistics.dataType)
     {
         case SEP_TBYTE:
-            return getFloatBuffer<uint8_t>(x, y, w, h);
+            return SEP_TBYTE;
         case TSHORT:
-            return getFloatBuffer<int16_t>(x, y, w, h);
+            return SEP_TSHORT;
         case TUSHORT:
-            return getFloatBuffer<uint16_t>(x, y, w, h);
+            return SEP_TUSHORT;
         case TLONG:
-            return getFloatBuffer<int32_t>(x, y, w, h);
+            return SEP_TINT;
         case TULONG:
-            return getFloatBuffer<uint32_t>(x, y, w, h);
+            return SEP_TUINT;
         case TFLOAT:
-            return getFloatBuffer<float>(x, y, w, h);
+            return SEP_TFLOAT;
         case TDOUBLE:
-            return getFloatBuffer<double>(x, y, w, h);
+            return SEP_TDOUBLE;
         default:
-            emit logOutput("Failed to allocate memory.");
-            return nullptr;
+            return 0;
+    }
+}
+
+void* InternalExtractorSolver::imageDataAt(uint32_t x, uint32_t y) const
+{
+    if (m_MappedImage.isValid())
+    {
+        const uint32_t channel = m_Statistics.channels < 3 ? 0 : m_ColorChannel;
+        return const_cast<uint8_t *>(m_MappedImage.at(channel, x, y));
     }
-    return nullptr;
+    size_t channelShift = (m_Statistics.channels < 3 || usingDownsampledImage
+                           || usingMergedChannelImage) ? 0 : ( static_cast<size_t>(m_Statistics.samples_per_channel) * m_Statistics.bytesPerPixel * m_ColorChannel );
+    size_t offset = (static_cast<size_t>(y) * m_Statistics.width + x) * m_Statistics.bytesPerPixel;
+    // SEP subtracts the background as it reads the pixels, so it never writes to the image buffer.
+    return const_cast<uint8_t *>(m_ImageBuffer + channelShift + offset);
 }
 
 namespace
@@ -256,6 +307,41 @@ void computeMargin(uint32_t x1, uint32_t y1, uint32_t x2, uint32_t y2,
     *height = endY - *startY + 1;
 }
 
+// SEP's Extract keeps its buffers from one image to the next, so the workers borrow one from here rather than making
+// a new one for every tile. The pool is shared by all the solvers, so a guide camera extracting many frames a second
+// reuses the same buffers for every frame. It keeps no more Extracts than there are cores, so the buffers of a burst of
+// solvers running at once are freed when they finish.
+class ExtractPool
+{
+    public:
+        std::unique_ptr<Extract> acquire()
+        {
+            QMutexLocker locker(&m_Mutex);
+            if (m_Idle.empty())
+                return std::unique_ptr<Extract>(new Extract());
+            std::unique_ptr<Extract> extractor = std::move(m_Idle.back());
+            m_Idle.pop_back();
+            return extractor;
+        }
+
+        void release(std::unique_ptr<Extract> extractor)
+        {
+            QMutexLocker locker(&m_Mutex);
+            if (m_Idle.size() < static_cast<size_t>(std::max(1, QThread::idealThreadCount())))
+                m_Idle.push_back(std::move(extractor));
+        }
+
+    private:
+        QMutex m_Mutex;
+        std::vector<std::unique_ptr<Extract>> m_Idle;
+};
+
+ExtractPool &extractPool()
+{
+    static ExtractPool pool;
+    return pool;
+}
+
 }  // namespace
 
 //The code in this section is my attempt at running an internal star extractor program based on SEP
@@ -275,22 +361,27 @@ int InternalExtractorSolver::runSEPExtractor()
     emit logOutput("+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++");
     emit logOutput("Starting Internal StellarSolver Star Extractor with the " + m_ActiveParameters.listName + " profile . . .");
     //Only merge image channels if it is an RGB image and we are either averaging or integrating the channels
-    if(m_Statistics.channels == 3 && (m_ColorChannel == FITSImage::AVERAGE_RGB || m_ColorChannel == FITSImage::INTEGRATED_RGB))
+    const bool merge = m_Statistics.channels == 3 && (m_ColorChannel == FITSImage::AVERAGE_RGB
+                       || m_ColorChannel == FITSImage::INTEGRATED_RGB);
+    //Only downsample images before SEP if the Star extraction is being used for plate solving
+    //An image that is not in memory is extracted at full resolution, a band at a time, and a mapped one in place
+    const int downsample = (m_ProcessType == SOLVE && m_SolverType == SOLVER_STELLARSOLVER && m_ActiveParameters.downsample > 1
+                            && !m_RowReader && !m_MappedImage.isValid()) ? m_ActiveParameters.downsample : 1;
+    //Both are done in one pass over the image
+    if(merge || downsample > 1)
     {
-        if (mergeImageChannels() == false)
+        if (prepareImage(merge, downsample) == false)
         {
-            emit logOutput("Merging image channels failed.");
+            emit logOutput(merge ? "Merging image channels failed." : "Downsampling failed.");
             return -1;
         }
     }
-    //Only downsample images before SEP if the Star extraction is being used for plate solving
-    if(m_ProcessType == SOLVE && m_SolverType == SOLVER_STELLARSOLVER && m_ActiveParameters.downsample != 1)
+    // SEP reads the image buffer in its own data type, one line at a time, instead of a float copy of each partition.
+    const int dtype = sepDataType();
+    if(dtype == 0)
     {
-        if (downsampleImage(m_ActiveParameters.downsample) == false)
-        {
-            emit logOutput("Downsampling failed.");
-            return -1;
-        }
+        emit logOutput("Unsupported image data type.");
+        return -1;
     }
     uint32_t x = 0, y = 0;
     uint32_t w = m_Statistics.width, h = m_Statistics.height;
@@ -305,6 +396,151 @@ int InternalExtractorSolver::runSEPExtractor()
 
     }
 
+    // The margin is extra image placed around partitions, so we can detect large stars near
+    // the edges of the partitions. The margin size needs to be about half the size of a star to
+    // be detected, since the other half of the star would be internal to the partition.
+    // Below determines the margin size used.  If m_ActiveParameters.maxSize == 0, that means that the max
+    // star size is unspecified.  In this case we use a margin of 10, so stars of size > 20 may be missed
+    // on the edge of a partition. If the max-star size is given very large, we limit the size of the margin
+    // used to 50 (e.g. corresponding to a 100-pixel-wide star).
+    int DEFAULT_MARGIN = m_ActiveParameters.maxSize / 2;
+    if (DEFAULT_MARGIN <= 20)
+        DEFAULT_MARGIN = 20;
+    else if (DEFAULT_MARGIN > 50)
+        DEFAULT_MARGIN = 50;
+
+    // One background model is made for the whole area the tiles cover, using all the threads, and all the tiles
+    // subtract it. Its meshes line up across tile boundaries, the margins are not histogrammed twice, and every
+    // tile uses the same detection threshold.
+    uint32_t areaX, areaY, areaWidth, areaHeight;
+    computeMargin(x, y, x + w - 1, y + h - 1, m_Statistics.width, m_Statistics.height, DEFAULT_MARGIN,
+                  &areaX, &areaY, &areaWidth, &areaHeight);
+
+    m_ExtractionTiles.clear();
+    // The stars of all the tiles are gathered here, and the catalog is only shared once it is filtered
+    auto stars = std::make_shared<FITSImage::StarCatalog>();
+    sep_bkg *bkg = nullptr;
+    // This is set when bkg belongs to m_BackgroundCache, rather than to this extraction
+    bool backgroundIsCached = false;
+    if(m_RowReader)
+    {
+        // The image is not in memory, so the background comes from a decimated read and the stars from one band of rows at a time.
+        bkg = streamBackground(dtype, areaX, areaY, areaWidth, areaHeight);
+        if(!bkg)
+            return -1;
+        if(extractStream(dtype, x, y, w, h, DEFAULT_MARGIN, bkg, areaX, areaY, *stars) != 0)
+        {
+            sep_bkg_free(bkg);
+            return -1;
+        }
+    }
+    else
+    {
+        sep_image area = {imageDataAt(areaX, areaY),
+                          nullptr,
+                          nullptr,
+                          nullptr,
+                          dtype,
+                          0,
+                          0,
+                          0,
+                          static_cast<int>(m_Statistics.width),
+                          static_cast<int>(m_Statistics.height),
+                          static_cast<int>(areaWidth),
+                          static_cast<int>(areaHeight),
+                          0,
+                          SEP_NOISE_NONE,
+                          1.0,
+                          0,
+                          static_cast<int>(m_PartitionThreads),
+                          runOnThreadPool
+                         };
+        // For a run of frames of the same field, the background of the last frame is kept if a few of its meshes,
+        // measured again, show the sky has not moved.  Only the pixels of those meshes are histogrammed.
+        const int channel = m_Statistics.channels == 3 ? m_ColorChannel : 0;
+        const QRect areaRect(areaX, areaY, areaWidth, areaHeight);
+        if (m_BackgroundCache && m_BackgroundCache->bkg && m_BackgroundCache->area == areaRect &&
+                m_BackgroundCache->channel == channel && m_BackgroundCache->dtype == dtype)
+        {
+            constexpr int BACKGROUND_DRIFT_SAMPLES = 4;
+            float drift = 0;
+            if (sep_bkg_drift(&area, m_BackgroundCache->bkg, m_BackgroundCache->meshBack, m_BackgroundCache->meshSigma,
+                              BACKGROUND_DRIFT_SAMPLES, &drift) == 0 &&
+                    drift <= m_BackgroundCache->tolerance)
+            {
+                bkg = m_BackgroundCache->bkg;
+                backgroundIsCached = true;
+            }
+            if (m_SSLogLevel == LOG_VERBOSE)
+                emit logOutput(QString("The background drifted by %1 sigma, %2 the previous background").arg(drift, 0, 'f', 3)
+                               .arg(bkg ? "reusing" : "replacing"));
+        }
+
+        if (!bkg)
+        {
+            // The meshes are kept as they were measured for the drift check of the next frame
+            float *meshBack = nullptr, *meshSigma = nullptr;
+            int status = m_BackgroundCache ? sep_background_meshes(&area, 64, 64, 3, 3, 0.0, &bkg, &meshBack, &meshSigma) :
+                         sep_background(&area, 64, 64, 3, 3, 0.0, &bkg);
+            if (status != 0)
+            {
+                char errorMessage[512];
+                sep_get_errmsg(status, errorMessage);
+                emit logOutput(errorMessage);
+                return -1;
+            }
+            if (m_BackgroundCache)
+            {
+                sep_bkg_free(m_BackgroundCache->bkg);
+                free(m_BackgroundCache->meshBack);
+                free(m_BackgroundCache->meshSigma);
+                m_BackgroundCache->bkg = bkg;
+                m_BackgroundCache->meshBack = meshBack;
+                m_BackgroundCache->meshSigma = meshSigma;
+                m_BackgroundCache->area = areaRect;
+                m_BackgroundCache->channel = channel;
+                m_BackgroundCache->dtype = dtype;
+                backgroundIsCached = true;
+            }
+        }
+
+        extractRegion(static_cast<const uint8_t *>(imageDataAt(0, 0)), m_Statistics.width, m_Statistics.height, dtype,
+                      x, y, w, h, DEFAULT_MARGIN, static_cast<double>(w) * h,
+                      bkg, -static_cast<int>(areaX), -static_cast<int>(areaY), 0, *stars);
+    }
+
+    if (m_ExtractionTiles.size() > 1)
+    {
+        double slowest = 0;
+        for (const auto &tile : m_ExtractionTiles)
+            slowest = std::max(slowest, tile.milliseconds);
+        const int numWorkers = std::min(static_cast<int>(m_ExtractionTiles.size()), static_cast<int>(m_PartitionThreads));
+        emit logOutput(QString("Extracted %1 tiles with %2 threads, the slowest tile took %3 ms").arg(m_ExtractionTiles.size())
+                       .arg(numWorkers).arg(slowest, 0, 'f', 1));
+    }
+
+    m_Background.bw = bkg->bw;
+    m_Background.bh = bkg->bh;
+    m_Background.num_stars_detected = stars->size();
+    m_Background.global = bkg->global;
+    m_Background.globalrms = bkg->globalrms;
+    if (!backgroundIsCached)
+        sep_bkg_free(bkg);
+
+    applyStarFilters(*stars);
+    m_ExtractedStars = stars;
+
+    futures.clear();
+
+    m_HasExtracted = true;
+
+    return 0;
+}
+
+void InternalExtractorSolver::extractRegion(const uint8_t *view, uint32_t viewWidth, uint32_t viewHeight, int dtype,
+        uint32_t x, uint32_t y, uint32_t w, uint32_t h, uint32_t margin, double keepArea,
+        sep_bkg *bkg, int bkgX, int bkgY, uint32_t offsetY, FITSImage::StarCatalog &stars)
+{
     // This data structure defines partitions of the full image processed to parallelize computation.
     // startX and startY define the x,y coordinates in the full image where this partition starts.
     // innerStartX and Y, and innerEndX and Y are the corners of the image patch of interest,
@@ -316,220 +552,382 @@ int InternalExtractorSolver::runSEPExtractor()
         public:
             int startX = 0, startY = 0, width = 0, height = 0;
             int innerStartX = 0, innerStartY = 0, innerEndX = 0, innerEndY = 0;
+            StartupOffset() {}
             StartupOffset(int x, int y, int w, int h, int inX1, int inY1, int inX2, int inY2)
                 : startX(x), startY(y), width(w), height(h),
                   innerStartX(inX1), innerStartY(inY1), innerEndX(inX2), innerEndY(inY2) {}
     };
 
-    QVector<float *> dataBuffers;
-    QList<StartupOffset> startupOffsets;
-    QList<FITSImage::Background> backgrounds;
+    QVector<StartupOffset> startupOffsets;
 
-    // The margin is extra image placed around partitions, so we can detect large stars near
-    // the edges of the partitions. The margin size needs to be about half the size of a star to
-    // be detected, since the other half of the star would be internal to the partition.
-    // Below determines the margin size used.  If m_ActiveParameters.maxSize == 0, that means that the max
-    // star size is unspecified.  In this case we use a margin of 10, so stars of size > 20 may be missed
-    // on the edge of a partition. If the max-star size is given very large, we limit the size of the margin
-    // used to 50 (e.g. corresponding to a 100-pixel-wide star).
-    int DEFAULT_MARGIN = m_ActiveParameters.maxSize / 2;
-    if (DEFAULT_MARGIN <= 20)
-        DEFAULT_MARGIN = 20;
-    else if (DEFAULT_MARGIN > 50)
-        DEFAULT_MARGIN = 50;
-
-    // Only partition if:
-    // We have 2 or more threads.
-    // The image width and height is larger than partition size.
+    // The image is cut into several tiles per thread, rather than one partition per thread. Star density varies a lot
+    // across a frame (the Milky Way vs. dark sky), so threads that finish sparse tiles go on to take more tiles
+    // while others are still working through dense ones. Tiles are never smaller than PARTITION_SIZE, so the
+    // margins stay a small part of each tile.
     constexpr int PARTITION_SIZE = 200;
-    if (m_ActiveParameters.partition &&  w > PARTITION_SIZE && h > PARTITION_SIZE && (m_PartitionThreads % 2) == 0)
+    constexpr int TILES_PER_THREAD = 4;
+    uint32_t horizontalPartitions = 1, verticalPartitions = 1;
+    if (m_ActiveParameters.partition && m_PartitionThreads > 1)
+    {
+        const double tileSize = std::max(static_cast<double>(PARTITION_SIZE),
+                                         sqrt(static_cast<double>(w) * h / (m_PartitionThreads * TILES_PER_THREAD)));
+        horizontalPartitions = std::max(1u, static_cast<uint32_t>(w / tileSize));
+        verticalPartitions = std::max(1u, static_cast<uint32_t>(h / tileSize));
+    }
+
+    // The tile edges are spread evenly, so the leftover pixels are shared out between the tiles.
+    for (uint32_t i = 0; i < verticalPartitions; i++)
     {
-        // Partition the image to regions.
-        // If there is extra at the end, we add an offset.
-        // e.g. 500x400 image with patitions sized 200x200 would have 4 paritions
-        // #1 0, 0, 200, 200 (200 x 200)
-        // #2 200, 0, 200 + 100, 200 (300 x 200)
-        // #3 0, 200, 200, 200 (200 x 200)
-        // #4 200, 200, 200 + 100, 200 (300 x 200)
-
-        int W_PARTITION_SIZE = PARTITION_SIZE;
-        int H_PARTITION_SIZE = PARTITION_SIZE;
-
-        // Limit it to PARTITION_THREADS
-        if ( (w * h) / (W_PARTITION_SIZE * H_PARTITION_SIZE) > m_PartitionThreads)
+        for (uint32_t j = 0; j < horizontalPartitions; j++)
         {
-            W_PARTITION_SIZE = w / (m_PartitionThreads / 2);
-            H_PARTITION_SIZE = h / 2;
+            const uint32_t rawStartX = x + static_cast<uint64_t>(w) * j / horizontalPartitions;
+            const uint32_t rawStartY = y + static_cast<uint64_t>(h) * i / verticalPartitions;
+            const uint32_t rawEndX = x + static_cast<uint64_t>(w) * (j + 1) / horizontalPartitions;
+            const uint32_t rawEndY = y + static_cast<uint64_t>(h) * (i + 1) / verticalPartitions;
+
+            uint32_t startX, startY, subWidth, subHeight;
+            computeMargin(rawStartX, rawStartY, rawEndX - 1, rawEndY - 1,
+                          viewWidth, viewHeight, margin,
+                          &startX, &startY, &subWidth, &subHeight);
+
+            startupOffsets.append(StartupOffset(startX, startY, subWidth, subHeight,
+                                                rawStartX, rawStartY, rawEndX - 1, rawEndY - 1));
         }
+    }
 
-        int horizontalPartitions = w / W_PARTITION_SIZE;
-        int verticalPartitions = h / H_PARTITION_SIZE;
-        int horizontalOffset = w - (W_PARTITION_SIZE * horizontalPartitions);
-        int verticalOffset = h - (H_PARTITION_SIZE * verticalPartitions);
+    const int numTiles = startupOffsets.size();
+    const bool partitioned = numTiles > 1;
+    QVector<ImageParams> tileParameters(numTiles);
+    QVector<FITSImage::StarCatalog> tileStars(numTiles);
+    QVector<double> tileMilliseconds(numTiles, 0.0);
+    for (int i = 0; i < numTiles; i++)
+    {
+        const StartupOffset &tile = startupOffsets[i];
+        const double innerArea = static_cast<double>(tile.innerEndX - tile.innerStartX + 1) * (tile.innerEndY - tile.innerStartY + 1);
+        // Each tile may keep its share of the stars, in proportion to its area.
+        const uint32_t keep = std::max(1u, static_cast<uint32_t>(ceil(m_ActiveParameters.initialKeep * innerArea / keepArea)));
+        const size_t offset = (static_cast<size_t>(tile.startY) * viewWidth + tile.startX) * m_Statistics.bytesPerPixel;
+        tileParameters[i] = {const_cast<uint8_t *>(view + offset),
+                             dtype,
+                             viewWidth,
+                             viewHeight,
+                             0,
+                             0,
+                             static_cast<uint32_t>(tile.width),
+                             static_cast<uint32_t>(tile.height),
+                             keep,
+                             bkg,
+                             bkgX + tile.startX,
+                             bkgY + tile.startY
+                            };
+    }
 
-        for (int i = 0; i < verticalPartitions; i++)
+    // Each worker takes the next tile that nobody has started yet, until there are none left.
+    std::atomic<int> nextTile{0};
+    auto extractTiles = [&]()
+    {
+        std::unique_ptr<Extract> extractor = extractPool().acquire();
+        int tile;
+        while (!m_WasAborted && (tile = nextTile++) < numTiles)
         {
-            for (int j = 0; j < horizontalPartitions; j++)
-            {
-                int offsetW = (j == horizontalPartitions - 1) ? horizontalOffset : 0;
-                int offsetH = (i == verticalPartitions - 1) ? verticalOffset : 0;
-
-                const uint32_t rawStartX = x + j * W_PARTITION_SIZE;
-                const uint32_t rawStartY = y + i * H_PARTITION_SIZE;
-                const uint32_t rawEndX = rawStartX + W_PARTITION_SIZE + offsetW;
-                const uint32_t rawEndY = rawStartY + H_PARTITION_SIZE + offsetH;
-
-                uint32_t startX, startY, subWidth, subHeight;
-                computeMargin(rawStartX, rawStartY, rawEndX - 1, rawEndY - 1,
-                              m_Statistics.width, m_Statistics.height, DEFAULT_MARGIN,
-                              &startX, &startY, &subWidth, &subHeight);
-
-                startupOffsets.append(StartupOffset(startX, startY, subWidth, subHeight,
-                                                    rawStartX, rawStartY, rawEndX - 1, rawEndY - 1));
-
-                float* data = allocateDataBuffer(startX, startY, subWidth, subHeight);
-                if(data == nullptr)
-                {
-                    for (auto *buffer : dataBuffers)
-                        delete [] buffer;
-                    dataBuffers.clear();
-                    emit logOutput("Failed to allocate memory.");
-                    return -1;
-                }
-                if(data)
-                    dataBuffers.append(data);
-                FITSImage::Background tempBackground;
-                backgrounds.append(tempBackground);
-
-                ImageParams parameters = {data,
-                                          subWidth,
-                                          subHeight,
-                                          0,
-                                          0,
-                                          subWidth,
-                                          subHeight,
-                                          m_ActiveParameters.initialKeep / m_PartitionThreads,
-                                          &backgrounds[backgrounds.size() - 1]
-                                         };
-                #if QT_VERSION >= QT_VERSION_CHECK(6, 0, 0)
-                    futures.append(QtConcurrent::run(&InternalExtractorSolver::extractPartition, this, parameters));
-                #else
-                    futures.append(QtConcurrent::run(this, &InternalExtractorSolver::extractPartition, parameters));
-                #endif
-            }
+            QElapsedTimer timer;
+            timer.start();
+            tileStars[tile] = extractPartition(tileParameters[tile], extractor.get(), !partitioned);
+            tileMilliseconds[tile] = timer.nsecsElapsed() / 1000000.0;
         }
+        extractPool().release(std::move(extractor));
+    };
+    // A single tile is extracted in this thread, so that only its measuring is spread over the thread pool
+    if (partitioned)
+    {
+        const int numWorkers = std::min(numTiles, static_cast<int>(m_PartitionThreads));
+        for (int i = 0; i < numWorkers; i++)
+            futures.append(QtConcurrent::run(extractTiles));
+        for (auto &oneFuture : futures)
+            oneFuture.waitForFinished();
+        futures.clear();
     }
     else
-    {
-        // In this case, there is no partitioning, but it is still possible that margins apply.
-        // E.g. a subframe rectangle with enough space around it to have margins.
-        uint32_t startX, startY, subWidth, subHeight;
-        computeMargin(x, y, x + w - 1, y + h - 1, m_Statistics.width, m_Statistics.height, DEFAULT_MARGIN,
-                      &startX, &startY, &subWidth, &subHeight);
+        extractTiles();
 
-        auto* data = allocateDataBuffer(startX, startY, subWidth, subHeight);
-        if(data == nullptr)
+    for (int i = 0; i < numTiles; i++)
+    {
+        const StartupOffset &oneOffset = startupOffsets[i];
+        const int startX = oneOffset.startX;
+        const int startY = oneOffset.startY;
+        FITSImage::StarCatalog &acceptedStars = tileStars[i];
+        const auto starX = acceptedStars.x();
+        const auto starY = acceptedStars.y();
+        std::vector<int> inside;
+        inside.reserve(acceptedStars.size());
+        for (int star = 0; star < acceptedStars.size(); star++)
         {
-            for (auto *buffer : dataBuffers)
-            {
-                if(buffer)
-                    delete [] buffer;
-                buffer = nullptr;
-            }
-            dataBuffers.clear();
-            emit logOutput("Failed to allocate memory.");
-            return -1;
+            // Don't use stars from the margins (they're detected in other partitions).
+            if (starX[star] < (oneOffset.innerStartX - startX) ||
+                    starY[star] < (oneOffset.innerStartY - startY) ||
+                    starX[star] > (oneOffset.innerEndX   - startX) ||
+                    starY[star] > (oneOffset.innerEndY   - startY))
+                continue;
+            inside.push_back(star);
         }
-        if(data)
-            dataBuffers.append(data);
-        startupOffsets.append(StartupOffset(startX, startY, subWidth, subHeight, x, y, x + w - 1, y + h - 1));
-        FITSImage::Background tempBackground;
-        backgrounds.append(tempBackground);
-
-        ImageParams parameters = {data, subWidth, subHeight, 0, 0, subWidth, subHeight, static_cast<uint32_t>(m_ActiveParameters.initialKeep), &backgrounds[backgrounds.size() - 1]};
-        #if QT_VERSION >= QT_VERSION_CHECK(6, 0, 0)
-            futures.append(QtConcurrent::run(&InternalExtractorSolver::extractPartition, this, parameters));
-        #else
-            futures.append(QtConcurrent::run(this, &InternalExtractorSolver::extractPartition, parameters));
-        #endif
+        acceptedStars.select(inside);
+        acceptedStars.translate(startX, static_cast<double>(startY) + offsetY);
+        FITSImage::ExtractionTile tileReport = {oneOffset.innerStartX,
+                                                oneOffset.innerStartY + static_cast<int>(offsetY),
+                                                oneOffset.innerEndX - oneOffset.innerStartX + 1,
+                                                oneOffset.innerEndY - oneOffset.innerStartY + 1,
+                                                static_cast<int>(acceptedStars.size()),
+                                                tileMilliseconds[i]
+                                               };
+        m_ExtractionTiles.append(tileReport);
+        stars.append(acceptedStars);
     }
+}
 
-    for (auto &oneFuture : futures)
+QList<QList<FITSImage::Star>> InternalExtractorSolver::extractRegions(const QList<QRect> &rois)
+{
+    const int numRegions = rois.size();
+    QVector<FITSImage::StarCatalog> regionStars(numRegions);
+    // The regions are read in place from the image buffer, so they can only be read from one of its channels
+    if (m_Statistics.channels == 3 && (m_ColorChannel == FITSImage::AVERAGE_RGB || m_ColorChannel == FITSImage::INTEGRATED_RGB))
     {
-        oneFuture.waitForFinished();
-        QList<FITSImage::Star> partitionStars = oneFuture.result();
-        QList<FITSImage::Star> acceptedStars;
-        if (!startupOffsets.empty())
+        emit logOutput("The channels of an image cannot be merged for the stars of regions, please choose one channel.");
+        QList<QList<FITSImage::Star>> empty;
+        for (int i = 0; i < numRegions; i++)
+            empty.append(QList<FITSImage::Star>());
+        return empty;
+    }
+    const int dtype = sepDataType();
+    if (dtype == 0)
+        emit logOutput("Unsupported image data type.");
+    const QRect imageRect(0, 0, m_Statistics.width, m_Statistics.height);
+
+    // The regions are small, so each one is a single partition with its own background.  Each worker takes the next
+    // region that nobody has started yet, with one Extract from the pool for all of its regions.
+    std::atomic<int> nextRegion{0};
+    auto extractNextRegions = [&]()
+    {
+        std::unique_ptr<Extract> extractor = extractPool().acquire();
+        int i;
+        while (dtype != 0 && (i = nextRegion++) < numRegions)
         {
-            const StartupOffset oneOffset = startupOffsets.takeFirst();
-            const int startX = oneOffset.startX;
-            const int startY = oneOffset.startY;
-            for (auto &oneStar : partitionStars)
+            const QRect roi = rois[i].normalized().intersected(imageRect);
+            if (roi.isEmpty())
+                continue;
+            sep_image region = {imageDataAt(roi.x(), roi.y()),
+                                nullptr,
+                                nullptr,
+                                nullptr,
+                                dtype,
+                                0,
+                                0,
+                                0,
+                                static_cast<int>(m_Statistics.width),
+                                static_cast<int>(m_Statistics.height),
+                                roi.width(),
+                                roi.height(),
+                                0,
+                                SEP_NOISE_NONE,
+                                1.0,
+                                0,
+                                1
+                               };
+            sep_bkg *bkg = nullptr;
+            int status = sep_background(&region, 64, 64, 3, 3, 0.0, &bkg);
+            if (status != 0)
             {
-                // Don't use stars from the margins (they're detected in other partitions).
-                if (oneStar.x < (oneOffset.innerStartX - startX) ||
-                        oneStar.y < (oneOffset.innerStartY - startY) ||
-                        oneStar.x > (oneOffset.innerEndX   - startX) ||
-                        oneStar.y > (oneOffset.innerEndY   - startY))
-                    continue;
-                oneStar.x += startX;
-                oneStar.y += startY;
-                acceptedStars.append(oneStar);
+                char errorMessage[512];
+                sep_get_errmsg(status, errorMessage);
+                emit logOutput(errorMessage);
+                continue;
             }
+            ImageParams parameters = {region.data,
+                                      dtype,
+                                      m_Statistics.width,
+                                      m_Statistics.height,
+                                      0,
+                                      0,
+                                      static_cast<uint32_t>(roi.width()),
+                                      static_cast<uint32_t>(roi.height()),
+                                      static_cast<uint32_t>(m_ActiveParameters.initialKeep),
+                                      bkg,
+                                      0,
+                                      0
+                                     };
+            regionStars[i] = extractPartition(parameters, extractor.get(), false);
+            sep_bkg_free(bkg);
+            regionStars[i].translate(roi.x(), roi.y());
         }
-        m_ExtractedStars.append(acceptedStars);
+        extractPool().release(std::move(extractor));
+    };
+    QList<QFuture<void>> regionFutures;
+    const int numWorkers = std::min(numRegions, static_cast<int>(m_PartitionThreads));
+    for (int i = 1; i < numWorkers; i++)
+        regionFutures.append(QtConcurrent::run(extractNextRegions));
+    extractNextRegions();
+    for (auto &oneFuture : regionFutures)
+        oneFuture.waitForFinished();
+
+    QList<QList<FITSImage::Star>> result;
+    for (auto &stars : regionStars)
+    {
+        applyStarFilters(stars);
+        result.append(stars.toList());
     }
+    return result;
+}
 
-    double sumGlobal = 0, sumRmsSq = 0;
-    for (const auto &bg : std::as_const(backgrounds))
+sep_bkg *InternalExtractorSolver::streamBackground(int dtype, uint32_t areaX, uint32_t areaY, uint32_t areaWidth,
+        uint32_t areaHeight)
+{
+    // The background is estimated from every d-th pixel of every d-th row, with meshes d times smaller, so each mesh
+    // covers the same part of the sky as a 64 pixel mesh of the whole image.  Skipping pixels, rather than binning
+    // them, leaves the noise of each sample unchanged, so the rms map needs no correction.
+    constexpr double STREAM_BACKGROUND_PIXELS = 16e6;
+    constexpr int STREAM_MAX_DECIMATION = 4;
+    int d = 1;
+    while (d < STREAM_MAX_DECIMATION && static_cast<double>(areaWidth) * areaHeight / (d * d) > STREAM_BACKGROUND_PIXELS)
+        d *= 2;
+
+    const uint32_t channel = m_Statistics.channels == 3 ? m_ColorChannel : 0;
+    const int bytesPerPixel = m_Statistics.bytesPerPixel;
+    const uint32_t decimatedWidth = (areaWidth + d - 1) / d;
+    const uint32_t decimatedHeight = (areaHeight + d - 1) / d;
+    std::vector<uint8_t> row, decimated;
+    try
     {
-        sumGlobal += bg.global;
-        sumRmsSq += bg.globalrms * bg.globalrms;
+        row.resize(static_cast<size_t>(m_Statistics.width) * bytesPerPixel);
+        decimated.resize(static_cast<size_t>(decimatedWidth) * decimatedHeight * bytesPerPixel);
     }
-    if (!backgrounds.empty())
+    catch (std::bad_alloc&)
     {
-        m_Background.bw = backgrounds[0].bw;
-        m_Background.bh = backgrounds[0].bh;
+        emit logOutput("Failed to allocate memory.");
+        return nullptr;
     }
-    m_Background.num_stars_detected = m_ExtractedStars.size();
-    m_Background.global = sumGlobal / backgrounds.size();
-    m_Background.globalrms = sqrt( sumRmsSq / backgrounds.size() );
 
-    applyStarFilters(m_ExtractedStars);
+    for (uint32_t j = 0; j < decimatedHeight; j++)
+    {
+        if (m_WasAborted)
+            return nullptr;
+        const uint32_t rowY = areaY + j * d;
+        if (!m_RowReader(channel, rowY, 1, row.data()))
+        {
+            emit logOutput(QString("Reading row %1 of the image failed.").arg(rowY));
+            return nullptr;
+        }
+        uint8_t *out = decimated.data() + static_cast<size_t>(j) * decimatedWidth * bytesPerPixel;
+        const uint8_t *in = row.data() + static_cast<size_t>(areaX) * bytesPerPixel;
+        for (uint32_t i = 0; i < decimatedWidth; i++)
+            memcpy(out + static_cast<size_t>(i) * bytesPerPixel, in + static_cast<size_t>(i) * d * bytesPerPixel, bytesPerPixel);
+    }
 
+    sep_image decimatedImage = {decimated.data(),
+                                nullptr,
+                                nullptr,
+                                nullptr,
+                                dtype,
+                                0,
+                                0,
+                                0,
+                                static_cast<int>(decimatedWidth),
+                                static_cast<int>(decimatedHeight),
+                                static_cast<int>(decimatedWidth),
+                                static_cast<int>(decimatedHeight),
+                                0,
+                                SEP_NOISE_NONE,
+                                1.0,
+                                0,
+                                static_cast<int>(m_PartitionThreads),
+                                runOnThreadPool
+                               };
+    sep_bkg *bkg = nullptr;
+    int status = sep_background(&decimatedImage, 64 / d, 64 / d, 3, 3, 0.0, &bkg);
+    if (status != 0)
+    {
+        char errorMessage[512];
+        sep_get_errmsg(status, errorMessage);
+        emit logOutput(errorMessage);
+        return nullptr;
+    }
+
+    // There are as many meshes across the decimated image as 64 pixel meshes across the area, so the same nodes
+    // describe the background of the area at full resolution.
+    bkg->w = areaWidth;
+    bkg->h = areaHeight;
+    bkg->bw = 64;
+    bkg->bh = 64;
+    if (m_SSLogLevel == LOG_VERBOSE)
+        emit logOutput(QString("Estimated the background with a decimation of %1 over a %2x%3 area").arg(d).arg(areaWidth).arg(areaHeight));
+    return bkg;
+}
 
-    for (auto * buffer : dataBuffers)
+int InternalExtractorSolver::extractStream(int dtype, uint32_t x, uint32_t y, uint32_t w, uint32_t h, uint32_t margin,
+        sep_bkg *bkg, uint32_t areaX, uint32_t areaY, FITSImage::StarCatalog &stars)
+{
+    // Each band of rows, with its margins, is read into a buffer of about STREAM_BAND_BYTES and cut into tiles
+    // like an image in memory.  The rows the bands share are moved up in the buffer instead of being read twice.
+    constexpr size_t STREAM_BAND_BYTES = 64 * 1024 * 1024;
+    constexpr uint32_t STREAM_MIN_BAND_ROWS = 256;
+    const uint32_t channel = m_Statistics.channels == 3 ? m_ColorChannel : 0;
+    const size_t rowBytes = static_cast<size_t>(m_Statistics.width) * m_Statistics.bytesPerPixel;
+    const size_t budgetRows = STREAM_BAND_BYTES / rowBytes;
+    const uint32_t bandRows = budgetRows > STREAM_MIN_BAND_ROWS + 2 * margin ?
+                              static_cast<uint32_t>(budgetRows - 2 * margin) : STREAM_MIN_BAND_ROWS;
+
+    std::vector<uint8_t> band;
+    try
     {
-        if(buffer)
-            delete [] buffer;
+        band.resize(rowBytes * (std::min(bandRows, h) + 2 * margin));
+    }
+    catch (std::bad_alloc&)
+    {
+        emit logOutput("Failed to allocate memory.");
+        return -1;
     }
-    dataBuffers.clear();
-    futures.clear();
 
-    m_HasExtracted = true;
+    uint32_t bufferStart = 0, bufferRows = 0;
+    for (uint32_t bandY = y; bandY < y + h && !m_WasAborted; bandY += bandRows)
+    {
+        const uint32_t bandHeight = std::min(bandRows, y + h - bandY);
+        uint32_t startX, startY, subWidth, subHeight;
+        computeMargin(x, bandY, x + w - 1, bandY + bandHeight - 1, m_Statistics.width, m_Statistics.height, margin,
+                      &startX, &startY, &subWidth, &subHeight);
+
+        uint32_t reused = 0;
+        if (bufferRows > 0 && startY < bufferStart + bufferRows)
+        {
+            reused = bufferStart + bufferRows - startY;
+            memmove(band.data(), band.data() + (startY - bufferStart) * rowBytes, reused * rowBytes);
+        }
+        if (!m_RowReader(channel, startY + reused, subHeight - reused, band.data() + reused * rowBytes))
+        {
+            emit logOutput(QString("Reading rows %1 to %2 of the image failed.").arg(startY + reused).arg(startY + subHeight - 1));
+            return -1;
+        }
+        bufferStart = startY;
+        bufferRows = subHeight;
 
+        extractRegion(band.data(), m_Statistics.width, subHeight, dtype,
+                      x, bandY - startY, w, bandHeight, margin, static_cast<double>(w) * h,
+                      bkg, -static_cast<int>(areaX), static_cast<int>(startY) - static_cast<int>(areaY), startY, stars);
+    }
     return 0;
 }
 
-QList<FITSImage::Star> InternalExtractorSolver::extractPartition(const ImageParams &parameters)
+FITSImage::StarCatalog InternalExtractorSolver::extractPartition(const ImageParams &parameters, Extract *extractor,
+        bool measureInParallel)
 {
-    float *imback = nullptr;
     double *fluxerr = nullptr, *area = nullptr;
     short *flag = nullptr;
     int status = 0;
-    sep_bkg *bkg = nullptr;
     sep_catalog * catalog = nullptr;
-    QList<FITSImage::Star> partitionStars;
+    FITSImage::StarCatalog partitionStars;
     const uint32_t maxRadius = 50;
 
     auto cleanup = [ & ]()
     {
-        sep_bkg_free(bkg);
-        bkg = nullptr;
         Extract::sep_catalog_free(catalog);
         catalog = nullptr;
-        free(imback);
-        imback = nullptr;
         free(fluxerr);
         fluxerr = nullptr;
         free(area);
@@ -545,10 +943,6 @@ QList<FITSImage::Star> InternalExtractorSolver::extractPartition(const ImagePara
         }
     };
 
-    //These are for the HFR
-    double requested_frac[2] = { 0.5, 0.99 };
-    double flux_fractions[2] = {0};
-    short flux_flag = 0;
     std::vector<std::pair<int, double>> ovals;
     int numToProcess = 0;
 
@@ -557,7 +951,7 @@ QList<FITSImage::Star> InternalExtractorSolver::extractPartition(const ImagePara
                     nullptr,
                     nullptr,
                     nullptr,
-                    SEP_TFLOAT,
+                    parameters.dtype,
                     0,
                     0,
                     0,
@@ -568,47 +962,21 @@ QList<FITSImage::Star> InternalExtractorSolver::extractPartition(const ImagePara
                     0,
                     SEP_NOISE_NONE,
                     1.0,
-                    0
+                    0,
+                    1
                    };
 
-    // #1 Background estimate
-    status = sep_background(&im, 64, 64, 3, 3, 0.0, &bkg);
-    if (status != 0)
-    {
-        cleanup();
-        return partitionStars;
-    }
-
-    // #2 Background evaluation
-    imback = (float *)malloc((parameters.subW * parameters.subH) * sizeof(float));
-    status = sep_bkg_array(bkg, imback, SEP_TFLOAT);
-    if (status != 0)
-    {
-        cleanup();
-        return partitionStars;
-    }
-
-    //Saving some background information
-    parameters.background->bh = bkg->bh;
-    parameters.background->bw = bkg->bw;
-    parameters.background->global = bkg->global;
-    parameters.background->globalrms = bkg->globalrms;
-
-    // #3 Background subtraction
-    status = sep_bkg_subarray(bkg, im.data, im.dtype);
-    if (status != 0)
-    {
-        cleanup();
-        return partitionStars;
-    }
+    // #1 Background subtraction
+    // SEP subtracts the shared background from each line as it reads the image, the image buffer is left untouched.
+    im.bkg = parameters.bkg;
+    im.bkgx = parameters.bkgX;
+    im.bkgy = parameters.bkgY;
 
-    std::unique_ptr<Extract> extractor;
-    extractor.reset(new Extract());
-    // #4 Source Extraction
+    // #2 Source Extraction
     // Note that we set deblend_cont = 1.0 to turn off deblending.
-    const double extractionThreshold = m_ActiveParameters.threshold_bg_multiple * bkg->globalrms +
+    const double extractionThreshold = m_ActiveParameters.threshold_bg_multiple * parameters.bkg->globalrms +
                                        m_ActiveParameters.threshold_offset;
-    //fprintf(stderr, "Using %.1f =  %.1f * %.1f + %.1f\n", extractionThreshold, m_ActiveParameters.threshold_bg_multiple, bkg->globalrms,  m_ActiveParameters.threshold_offset);
+    //fprintf(stderr, "Using %.1f =  %.1f * %.1f + %.1f\n", extractionThreshold, m_ActiveParameters.threshold_bg_multiple, parameters.bkg->globalrms,  m_ActiveParameters.threshold_offset);
     status = extractor->sep_extract(&im, extractionThreshold, SEP_THRESH_ABS, m_ActiveParameters.minarea,
                                     convFilter.data(),
                                     sqrt(convFilter.size()), sqrt(convFilter.size()), SEP_FILTER_CONV,
@@ -620,9 +988,6 @@ QList<FITSImage::Star> InternalExtractorSolver::extractPartition(const ImagePara
         return partitionStars;
     }
 
-    // Record the number of stars detected.
-    parameters.background->num_stars_detected = catalog->nobj;
-
     // Find the oval sizes for each detection in the detected star catalog, and sort by that. Oval size
     // correlates very well with HFR and likely magnitude.
     for (int i = 0; i < catalog->nobj; i++)
@@ -634,15 +999,15 @@ QList<FITSImage::Star> InternalExtractorSolver::extractPartition(const ImagePara
         std::sort(ovals.begin(), ovals.end(), [](const std::pair<int, double> &o1, const std::pair<int, double> &o2) -> bool { return o1.second > o2.second;});
 
     numToProcess = std::min(static_cast<uint32_t>(catalog->nobj), parameters.keep);
-    for (int index = 0; index < numToProcess; index++)
-    {
-        // Processing detections in the order of the sort above.
-        int i = ovals[index].first;
 
+    // #3 Photometry
+    // Each detection is measured on its own, this fills in its row of the catalog and returns false if the detection is rejected.
+    auto measureObject = [&](int i, int row) -> bool
+    {
         if (catalog->flag[i] & SEP_OBJ_TRUNC)
         {
             // Don't accept detections that go over the boundary.
-            continue;
+            return false;
         }
 
         //Variables that are obtained from the catalog
@@ -668,6 +1033,11 @@ QList<FITSImage::Star> InternalExtractorSolver::extractPartition(const ImagePara
         double sumerr;
         double kron_area;
 
+        //These are for the HFR
+        double requested_frac[2] = { 0.5, 0.99 };
+        double flux_fractions[2] = {0};
+        short flux_flag = 0;
+
         //This will need to be done for both auto and ellipse
         if(m_ActiveParameters.apertureShape != SHAPE_CIRCLE)
         {
@@ -720,101 +1090,106 @@ QList<FITSImage::Star> InternalExtractorSolver::extractPartition(const ImagePara
             HFR = flux_fractions[0];
         }
 
-        FITSImage::Star oneStar = {xPos,
-                                   yPos,
-                                   mag,
-                                   static_cast<float>(sum),
-                                   static_cast<float>(peak),
-                                   HFR,
-                                   a,
-                                   b,
-                                   qRadiansToDegrees(theta),
-                                   0,
-                                   0,
-                                   numPixels
-                                  };
-        // Make a copy and add it to QList
-        partitionStars.append(oneStar);
+        partitionStars.set(row, {xPos,
+                                 yPos,
+                                 mag,
+                                 static_cast<float>(sum),
+                                 static_cast<float>(peak),
+                                 HFR,
+                                 a,
+                                 b,
+                                 qRadiansToDegrees(theta),
+                                 0,
+                                 0,
+                                 numPixels
+                                });
+        return true;
+    };
+
+    // On a crowded field, and above all with HFR, measuring the detections takes longer than finding them.  When this
+    // partition is the only one, they are measured in chunks on the thread pool, each detection into its own row, so
+    // the order of the sort is kept.  This thread measures the first chunk and then waits for the others.  It is
+    // never a pool thread, since the partitions of a tiled image are spread over the pool and measure their own.
+    constexpr int MEASURE_CHUNK_SIZE = 32;
+    partitionStars.resize(numToProcess);
+    std::vector<char> accepted(numToProcess, 0);
+    char *acceptedData = accepted.data();
+    auto measureChunk = [&](int first, int last)
+    {
+        for (int index = first; index < last && !m_WasAborted; index++)
+            acceptedData[index] = measureObject(ovals[index].first, index);
+    };
+    QList<QFuture<void>> measureFutures;
+    const int firstChunkEnd = measureInParallel ? std::min(MEASURE_CHUNK_SIZE, numToProcess) : numToProcess;
+    for (int first = firstChunkEnd; first < numToProcess; first += MEASURE_CHUNK_SIZE)
+        measureFutures.append(QtConcurrent::run(measureChunk, first, std::min(first + MEASURE_CHUNK_SIZE, numToProcess)));
+    measureChunk(0, firstChunkEnd);
+    for (auto &oneFuture : measureFutures)
+        oneFuture.waitForFinished();
+
+    std::vector<int> acceptedRows;
+    acceptedRows.reserve(numToProcess);
+    for (int index = 0; index < numToProcess; index++)
+    {
+        if (accepted[index])
+            acceptedRows.push_back(index);
     }
+    partitionStars.select(acceptedRows);
 
     cleanup();
 
     return partitionStars;
 }
 
-void InternalExtractorSolver::applyStarFilters(QList<FITSImage::Star> &starList)
+void InternalExtractorSolver::applyStarFilters(FITSImage::StarCatalog &stars)
 {
-    if(starList.size() > 1)
+    if(stars.size() > 1)
     {
-        emit logOutput(QString("Stars Found before Filtering: %1").arg(starList.size()));
-        if(m_ActiveParameters.resort)
-        {
-            //Note that a star is dimmer when the mag is greater!
-            //We want to sort in decreasing order though!
-            std::sort(starList.begin(), starList.end(), [](const FITSImage::Star & s1, const FITSImage::Star & s2)
-            {
-                return s1.mag < s2.mag;
-            });
-        }
+        emit logOutput(QString("Stars Found before Filtering: %1").arg(stars.size()));
+        StarFilters::Options options = {m_ActiveParameters.resort,
+                                        m_ActiveParameters.maxSize,
+                                        m_ActiveParameters.minSize,
+                                        m_ActiveParameters.resort ? m_ActiveParameters.removeBrightest : 0.0,
+                                        m_ActiveParameters.resort ? m_ActiveParameters.removeDimmest : 0.0,
+                                        m_ActiveParameters.maxEllipse,
+                                        0.0,
+                                        m_ActiveParameters.resort ? m_ActiveParameters.keepNum : 0
+                                       };
 
         if(m_ActiveParameters.maxSize > 0.0)
-        {
             emit logOutput(QString("Removing stars wider than %1 pixels").arg(m_ActiveParameters.maxSize));
-            starList.erase(std::remove_if(starList.begin(), starList.end(), [&](FITSImage::Star & oneStar)
-            {
-                return (oneStar.a > m_ActiveParameters.maxSize || oneStar.b > m_ActiveParameters.maxSize);
-            }), starList.end());
-        }
 
         if(m_ActiveParameters.minSize > 0.0)
-        {
             emit logOutput(QString("Removing stars smaller than %1 pixels").arg(m_ActiveParameters.minSize));
-            starList.erase(std::remove_if(starList.begin(), starList.end(), [&](FITSImage::Star & oneStar)
-            {
-                return ((oneStar.a < m_ActiveParameters.minSize || oneStar.b < m_ActiveParameters.minSize));
-            }), starList.end());
-        }
-
-        if(m_ActiveParameters.resort && m_ActiveParameters.removeBrightest > 0.0 && m_ActiveParameters.removeBrightest < 100.0)
-        {
-            int numToRemove = starList.count() * (m_ActiveParameters.removeBrightest / 100.0);
-            emit logOutput(QString("Removing the %1 brightest stars").arg(numToRemove));
-            if(numToRemove > 1)
-            {
-                for(int i = 0; i < numToRemove; i++)
-                    starList.removeFirst();
-            }
-        }
-
-        if(m_ActiveParameters.resort && m_ActiveParameters.removeDimmest > 0.0 && m_ActiveParameters.removeDimmest < 100.0)
-        {
-            int numToRemove = starList.count() * (m_ActiveParameters.removeDimmest / 100.0);
-            emit logOutput(QString("Removing the %1 dimmest stars").arg(numToRemove));
-            if(numToRemove > 1)
-            {
-                for(int i = 0; i < numToRemove; i++)
-                    starList.removeLast();
-            }
-        }
 
         if(m_ActiveParameters.maxEllipse > 1)
-        {
             emit logOutput(QString("Removing the stars with a/b ratios greater than %1").arg(m_ActiveParameters.maxEllipse));
-            starList.erase(std::remove_if(starList.begin(), starList.end(), [&](FITSImage::Star & oneStar)
-            {
-                return (oneStar.b != 0 && oneStar.a / oneStar.b > m_ActiveParameters.maxEllipse);
-            }), starList.end());
-        }
 
         if(m_ActiveParameters.saturationLimit > 0.0 && m_ActiveParameters.saturationLimit < 100.0)
         {
+            // A merged or downsampled image is made of floats, but it saturates where the pixels it was made from did
             double maxSizeofDataType;
-            if(m_Statistics.dataType == TSHORT || m_Statistics.dataType == TLONG || m_Statistics.dataType == TLONGLONG)
-                maxSizeofDataType = pow(2, m_Statistics.bytesPerPixel * 8) / 2 - 1;
-            else if(m_Statistics.dataType == TUSHORT || m_Statistics.dataType == TULONG)
-                maxSizeofDataType = pow(2, m_Statistics.bytesPerPixel * 8) - 1;
-            else // Float and Double Images saturation level is not so easy to determine, especially since they were probably processed by another program and the saturation level is now changed.
-                maxSizeofDataType = -1;
+            switch(m_Statistics.sourceDataType ? m_Statistics.sourceDataType : m_Statistics.dataType)
+            {
+                case TSHORT:
+                    maxSizeofDataType = INT16_MAX;
+                    break;
+                case TUSHORT:
+                    maxSizeofDataType = UINT16_MAX;
+                    break;
+                case TLONG:
+                    maxSizeofDataType = INT32_MAX;
+                    break;
+                case TULONG:
+                    maxSizeofDataType = UINT32_MAX;
+                    break;
+                case TLONGLONG:
+                    maxSizeofDataType = pow(2, 63) - 1;
+                    break;
+                default: // Float and Double Images saturation level is not so easy to determine, especially since they were probably processed by another program and the saturation level is now changed.
+                    maxSizeofDataType = -1;
+                    break;
+            }
 
             if(maxSizeofDataType == -1)
             {
@@ -824,222 +1199,110 @@ void InternalExtractorSolver::applyStarFilters(QList<FITSImage::Star> &starList)
             {
                 emit logOutput(QString("Removing the saturated stars with peak values greater than %1 Percent of %2").arg(
                                    m_ActiveParameters.saturationLimit).arg(maxSizeofDataType));
-                starList.erase(std::remove_if(starList.begin(), starList.end(), [&](FITSImage::Star & oneStar)
-                {
-                    return (oneStar.peak > (m_ActiveParameters.saturationLimit / 100.0) * maxSizeofDataType);
-                }), starList.end());
+                options.maxPeak = (m_ActiveParameters.saturationLimit / 100.0) * maxSizeofDataType;
             }
         }
 
-        if(m_ActiveParameters.resort && m_ActiveParameters.keepNum > 0)
-        {
-            emit logOutput(QString("Keeping just the %1 brightest stars").arg(m_ActiveParameters.keepNum));
-            int numToRemove = starList.size() - m_ActiveParameters.keepNum;
-            if(numToRemove > 1)
-            {
-                for(int i = 0; i < numToRemove; i++)
-                    starList.removeLast();
-            }
-        }
-        emit logOutput(QString("Stars Found after Filtering: %1").arg(starList.size()));
-    }
-}
+        if(options.keepNum > 0)
+            emit logOutput(QString("Keeping just the %1 brightest stars").arg(options.keepNum));
 
-template <typename T>
-float* InternalExtractorSolver::getFloatBuffer(int x, int y, int w, int h)
-{
-    float* buffer = nullptr;
-    try
-    {
-        buffer = new float[w * h];
-    }
-    catch (std::bad_alloc&)
-    {
-        emit logOutput("Failed to allocate memory.");
-        return nullptr;
-    }
-
-    int channelShift = (m_Statistics.channels < 3 || usingDownsampledImage
-                        || usingMergedChannelImage) ? 0 : ( m_Statistics.samples_per_channel * m_Statistics.bytesPerPixel * m_ColorChannel );
-    auto * rawBuffer = reinterpret_cast<T const *>(m_ImageBuffer + channelShift);
-    float * floatPtr = buffer;
-
-    int x2 = x + w;
-    int y2 = y + h;
+        // All the filters are tested in one pass, and only the stars that are kept get sorted by magnitude.
+        StarFilters::Report report;
+        stars.select(StarFilters::filterRows(stars, options, &report));
 
-    for (int y1 = y; y1 < y2; y1++)
-    {
-        int offset = y1 * m_Statistics.width;
-        for (int x1 = x; x1 < x2; x1++)
-        {
-            *floatPtr++ = rawBuffer[offset + x1];
-        }
+        if(options.removeBrightest > 0.0 && options.removeBrightest < 100.0)
+            emit logOutput(QString("Removed the %1 brightest stars").arg(report.brightestRemoved));
+        if(options.removeDimmest > 0.0 && options.removeDimmest < 100.0)
+            emit logOutput(QString("Removed the %1 dimmest stars").arg(report.dimmestRemoved));
+        emit logOutput(QString("Stars Found after Filtering: %1").arg(stars.size()));
     }
-
-    return buffer;
 }
 
-bool InternalExtractorSolver::downsampleImage(int d)
+bool InternalExtractorSolver::prepareImage(bool merge, int d)
 {
     switch (m_Statistics.dataType)
     {
         case SEP_TBYTE:
-            return downSampleImageType<uint8_t>(d);
+            return prepareImageType<uint8_t>(merge, d);
         case TSHORT:
-            return downSampleImageType<int16_t>(d);
+            return prepareImageType<int16_t>(merge, d);
         case TUSHORT:
-            return downSampleImageType<uint16_t>(d);
+            return prepareImageType<uint16_t>(merge, d);
         case TLONG:
-            return downSampleImageType<int32_t>(d);
+            return prepareImageType<int32_t>(merge, d);
         case TULONG:
-            return downSampleImageType<uint32_t>(d);
+            return prepareImageType<uint32_t>(merge, d);
         case TFLOAT:
-            return downSampleImageType<float>(d);
+            return prepareImageType<float>(merge, d);
         case TDOUBLE:
-            return downSampleImageType<double>(d);
+            return prepareImageType<double>(merge, d);
         default:
             return false;
     }
 }
 
 template <typename T>
-bool InternalExtractorSolver::downSampleImageType(int d)
+bool InternalExtractorSolver::prepareImageType(bool merge, int d)
 {
-    int w = m_Statistics.width;
-    int h = m_Statistics.height;
-    int oldBufferSize = m_Statistics.samples_per_channel * m_Statistics.bytesPerPixel;
-    //It is d times smaller in width and height
-    int newBufferSize = oldBufferSize / (d * d);
-    if(downSampledBuffer)
-        delete [] downSampledBuffer;   
-    downSampledBuffer = nullptr;
-    try
-    {
-        downSampledBuffer = new uint8_t[newBufferSize];
-    }
-    catch (std::bad_alloc&)
-    {
-        downSampledBuffer = nullptr;
-        emit logOutput("Failed to allocate memory.");
+    if(merge && (m_Statistics.channels != 3 || (m_ColorChannel != FITSImage::INTEGRATED_RGB && m_ColorChannel != FITSImage::AVERAGE_RGB)))
         return false;
-    }
-    int channelShift = ( m_Statistics.channels < 3
-                         || usingMergedChannelImage) ? 0 : ( m_Statistics.samples_per_channel * m_Statistics.bytesPerPixel * m_ColorChannel );
-    auto * sourceBuffer = reinterpret_cast<T const *>(m_ImageBuffer + channelShift);
-    auto * destinationBuffer = reinterpret_cast<T *>(downSampledBuffer);
-
-    for(int y = 0; y < h - d; y += d)
-    {
-        for (int x = 0; x < w - d; x += d)
-        {
-            //The sum of all the pixels in the sample
-            double total = 0;
-
-            for(int y2 = 0; y2 < d; y2++)
-            {
-                //The offset for the current line of the sample to take, since we have to sample different rows
-                int currentLine = w * y2;
-
-                auto *sample = sourceBuffer + currentLine + x;
-                for(int x2 = 0; x2 < d; x2++)
-                {
-                    //This iterates the sample x2 spots to the right,
-                    total += *sample++;
-                }
-            }
-            //This calculates the average pixel value and puts it in the new downsampled image.
-            int pixel = (x / d) + (y / d) * (w / d);
-            destinationBuffer[pixel] = total / (d * d);
-        }
-        //Shifts the pointer by a whole line, d times
-        sourceBuffer += w * d;
-    }
-
-    m_ImageBuffer = downSampledBuffer;
-    m_Statistics.samples_per_channel /= (d * d);
-    m_Statistics.width /= d;
-    m_Statistics.height /= d;
-    if(scaleunit == ARCSEC_PER_PIX)
-    {
-        scalelo *= d;
-        scalehi *= d;
-    }
-    usingDownsampledImage = true;
-    return true;
-}
-
-bool InternalExtractorSolver::mergeImageChannels()
-{
-    switch (m_Statistics.dataType)
-    {
-        case SEP_TBYTE:
-            return mergeImageChannelsType<uint8_t>();
-        case TSHORT:
-            return mergeImageChannelsType<int16_t>();
-        case TUSHORT:
-            return mergeImageChannelsType<uint16_t>();
-        case TLONG:
-            return mergeImageChannelsType<int32_t>();
-        case TULONG:
-            return mergeImageChannelsType<uint32_t>();
-        case TFLOAT:
-            return mergeImageChannelsType<float>();
-        case TDOUBLE:
-            return mergeImageChannelsType<double>();
-        default:
-            return false;
-    }
-
-}
-
-template <typename T>
-bool InternalExtractorSolver::mergeImageChannelsType()
-{
-    if(m_Statistics.channels != 3)
-        return false;
-    if(m_ColorChannel != FITSImage::INTEGRATED_RGB && m_ColorChannel != FITSImage::AVERAGE_RGB)
+    if(d < 1 || d > ImagePreparation::MAX_BLOCK_SIZE)
         return false;
 
-    auto w = m_Statistics.width;
-    auto h = m_Statistics.height;
-    auto nextChannel = m_Statistics.samples_per_channel;
-    auto channelSize = m_Statistics.samples_per_channel * m_Statistics.bytesPerPixel;
-
-    if(mergedChannelBuffer)
-        delete [] mergedChannelBuffer;
-
-    mergedChannelBuffer = nullptr;
+    //The channels that are added up for each pixel.  It is d times smaller in width and height, and one channel of floats
+    const int numChannels = merge ? 3 : 1;
+    const size_t firstChannel = (merge || m_Statistics.channels < 3 || usingMergedChannelImage) ? 0 : m_ColorChannel;
+    const double channelScale = (merge && m_ColorChannel == FITSImage::AVERAGE_RGB) ? 1.0 / 3.0 : 1.0;
+    const ImagePreparation::Layout layout = ImagePreparation::layout(m_Statistics.width, m_Statistics.height,
+                                            m_Statistics.samples_per_channel, numChannels, channelScale, d);
+    const uint32_t w = layout.width;
+    const uint32_t h = layout.height;
+    uint8_t *buffer = nullptr;
     try
     {
-        mergedChannelBuffer = new uint8_t[channelSize];
+        buffer = new uint8_t[static_cast<size_t>(w) * h * sizeof(float)];
     }
     catch (std::bad_alloc&)
     {
-        downSampledBuffer = nullptr;
         emit logOutput("Failed to allocate memory.");
         return false;
     }
-    auto * source = reinterpret_cast<T const *>(m_ImageBuffer);
-    auto * dest = reinterpret_cast<T *>(mergedChannelBuffer);
+    auto * source = reinterpret_cast<T const *>(m_ImageBuffer) + firstChannel * m_Statistics.samples_per_channel;
+    auto * destination = reinterpret_cast<float *>(buffer);
+
+    //Each thread takes a band of rows, this thread does the first one
+    const uint32_t numBands = std::max(1u, std::min(m_PartitionThreads, h));
+    QList<QFuture<void>> bandFutures;
+    for(uint32_t band = 1; band < numBands; band++)
+        bandFutures.append(QtConcurrent::run(ImagePreparation::prepareRows<T>, source, layout, destination,
+                                             static_cast<uint32_t>(static_cast<uint64_t>(h) * band / numBands),
+                                             static_cast<uint32_t>(static_cast<uint64_t>(h) * (band + 1) / numBands)));
+    ImagePreparation::prepareRows<T>(source, layout, destination, 0, h / numBands);
+    for(auto &oneFuture : bandFutures)
+        oneFuture.waitForFinished();
 
-    for(int y = 0; y < h; y++)
+    if(preparedBuffer)
+        delete [] preparedBuffer;
+    preparedBuffer = buffer;
+    m_ImageBuffer = preparedBuffer;
+    m_Statistics.width = w;
+    m_Statistics.height = h;
+    m_Statistics.samples_per_channel = w * h;
+    if(m_Statistics.sourceDataType == 0)
+        m_Statistics.sourceDataType = m_Statistics.dataType;
+    m_Statistics.dataType = TFLOAT;
+    m_Statistics.bytesPerPixel = sizeof(float);
+    if(merge)
+        usingMergedChannelImage = true;
+    if(d > 1)
     {
-        for (int x = 0; x < w; x++)
+        if(scaleunit == ARCSEC_PER_PIX)
         {
-            double total  = 0;
-            int r = x + y * w;
-            int g = x + y * w + nextChannel;
-            int b = x + y * w + nextChannel * 2;
-            if(m_ColorChannel == FITSImage::INTEGRATED_RGB)
-                total = source[r] + source[g] + source[b];
-            if(m_ColorChannel == FITSImage::AVERAGE_RGB)
-                total = (source[r] + source[g] + source[b]) / 3.0;
-            dest[ x + y * w ] = static_cast<T>(total);
+            scalelo *= d;
+            scalehi *= d;
         }
+        usingDownsampledImage = true;
     }
-
-    m_ImageBuffer = mergedChannelBuffer;
-    usingMergedChannelImage = true;
     return true;
 }
 
@@ -1127,17 +1390,19 @@ bool InternalExtractorSolver::prepare_job()
         dl_append(job->scales, appu);
         blind_add_field_range(bp, appl, appu);
 
+        // Only the factor the image was actually downsampled by is reported
+        const int d = usingDownsampledImage ? m_ActiveParameters.downsample : 1;
         if(scaleunit == ARCMIN_WIDTH || scaleunit == DEG_WIDTH || scaleunit == FOCAL_MM)
         {
-            if(m_ActiveParameters.downsample == 1)
+            if(d == 1)
                 emit logOutput(QString("Image width %1 pixels; arcsec per pixel range: %2 to %3").arg (m_Statistics.width).arg (appl).arg (
                                    appu));
             else
                 emit logOutput(QString("Image width: %1 pixels, Downsampled Image width: %2 pixels; arcsec per pixel range: %3 to %4").arg(
-                                   m_Statistics.width * m_ActiveParameters.downsample).arg (m_Statistics.width).arg (appl).arg (appu));
+                                   m_Statistics.width * d).arg (m_Statistics.width).arg (appl).arg (appu));
         }
-        if(m_ActiveParameters.downsample != 1 && scaleunit == ARCSEC_PER_PIX)
-            emit logOutput(QString("Downsampling is multiplying the pixel scale by: %1").arg(m_ActiveParameters.downsample));
+        if(d != 1 && scaleunit == ARCSEC_PER_PIX)
+            emit logOutput(QString("Downsampling is multiplying the pixel scale by: %1").arg(d));
     }
 
     blind_add_field(bp, 1);
@@ -1146,6 +1411,40 @@ bool InternalExtractorSolver::prepare_job()
     return true;
 }
 
+FITSImage::Solution InternalExtractorSolver::solutionFromWCS(const sip_t &wcs, double scaleDivisor, bool usePosition,
+        double searchRA, double searchDE)
+{
+    double ra, dec, fieldw, fieldh;
+    char* fieldunits;
+    sip_get_radec_center(&wcs, &ra, &dec);
+    sip_get_field_size(&wcs, &fieldw, &fieldh, &fieldunits);
+    double orient = sip_get_orientation(&wcs);
+    double pixscale = sip_pixel_scale(&wcs) / scaleDivisor;
+
+    // Note, negative determinant = positive parity.
+    FITSImage::Parity parity = (sip_det_cd(&wcs) < 0 ? FITSImage::POSITIVE : FITSImage::NEGATIVE);
+
+    double raErr = 0;
+    double decErr = 0;
+    if(usePosition)
+    {
+        raErr = (searchRA - ra) * 3600;
+        decErr = (searchDE - dec) * 3600;
+    }
+
+    if(strcmp(fieldunits, "degrees") == 0)
+    {
+        fieldw *= 60;
+        fieldh *= 60;
+    }
+    if(strcmp(fieldunits, "arcseconds") == 0)
+    {
+        fieldw /= 60;
+        fieldh /= 60;
+    }
+    return {fieldw, fieldh, ra, dec, orient, pixscale, parity, raErr, decErr};
+}
+
 //This method was adapted from the main method in engine-main.c in astrometry.net
 int InternalExtractorSolver::runInternalSolver()
 {
@@ -1160,6 +1459,7 @@ int InternalExtractorSolver::runInternalSolver()
 
     //This sets some basic engine settings
     engine->inparallel = m_ActiveParameters.inParallel ? TRUE : FALSE;
+    engine->compact_codes = m_ActiveParameters.compactCodeTrees ? TRUE : FALSE;
     engine->minwidth = m_ActiveParameters.minwidth;
     engine->maxwidth = m_ActiveParameters.maxwidth;
 
@@ -1213,35 +1513,13 @@ int InternalExtractorSolver::runInternalSolver()
     blind_t* bp = &(job->bp);
 
     //This will set up the field file to solve as an xylist
-    double *xArray = nullptr;
-    double *yArray = nullptr;
-    try
-    {
-        xArray = new double[m_ExtractedStars.size()];
-        yArray = new double[m_ExtractedStars.size()];
-    }
-    catch (std::bad_alloc&)
-    {
-        if(xArray)
-            delete [] xArray;
-        if(yArray)
-            delete [] yArray;
-        emit logOutput("Failed to allocate memory.");
-        return -1;
-    }
-
-    int i = 0;
-    for(const auto &oneStar : m_ExtractedStars)
-    {
-        xArray[i] = oneStar.x;
-        yArray[i] = oneStar.y;
-        i++;
-    }
-
+    //The field points straight at the positions in the star catalog, which astrometry.net only reads.
+    //The catalog is held here, so it outlives the solve even if it is shared with other solvers.
+    const std::shared_ptr<const FITSImage::StarCatalog> fieldStars = m_ExtractedStars;
     starxy_t* fieldToSolve = (starxy_t*)calloc(1, sizeof(starxy_t));
-    fieldToSolve->x = xArray;
-    fieldToSolve->y = yArray;
-    fieldToSolve->N = m_ExtractedStars.size();
+    fieldToSolve->x = const_cast<double *>(fieldStars->x().data());
+    fieldToSolve->y = const_cast<double *>(fieldStars->y().data());
+    fieldToSolve->N = fieldStars->size();
     fieldToSolve->flux = nullptr;
     fieldToSolve->background = nullptr;
     bp->solver.fieldxy = fieldToSolve;
@@ -1321,14 +1599,9 @@ int InternalExtractorSolver::runInternalSolver()
     job->scales = nullptr;
     dl_free(job->depths);
     job->depths = nullptr;
+    //Only the field is freed, the positions belong to the star catalog
     free(fieldToSolve);
     fieldToSolve = nullptr;
-    if(xArray)
-        delete[] xArray;
-    xArray = nullptr;
-    if(yArray)
-        delete[] yArray;
-    yArray = nullptr;
 
     //Note: I can only get these items after the solve because I made a couple of small changes to the Astrometry.net Code.
     //I made it return in solve_fields in blind.c before it ran "cleanup".  I also had it wait to clean up solutions, blind and solver in engine.c.  We will do that after we get the solution information.
@@ -1339,60 +1612,24 @@ int InternalExtractorSolver::runInternalSolver()
     {
         wcs = *match.sip;
         m_HasWCS = true;
-        double ra, dec, fieldw, fieldh, pixscale;
+        m_Solution = solutionFromWCS(wcs, usingDownsampledImage ? m_ActiveParameters.downsample : 1, m_UsePosition, search_ra,
+                                     search_dec);
         char rastr[32], decstr[32];
-        FITSImage::Parity parity;
-        char* fieldunits;
-
-        // print info about the field.
-
-        double orient;
-        sip_get_radec_center(&wcs, &ra, &dec);
         sip_get_radec_center_hms_string(&wcs, rastr, decstr);
-        sip_get_field_size(&wcs, &fieldw, &fieldh, &fieldunits);
-        orient = sip_get_orientation(&wcs);
-
-        // Note, negative determinant = positive parity.
-        double det = sip_det_cd(&wcs);
-        parity = (det < 0 ? FITSImage::POSITIVE : FITSImage::NEGATIVE);
-        if(usingDownsampledImage)
-            pixscale = sip_pixel_scale(&wcs) / m_ActiveParameters.downsample;
-        else
-            pixscale = sip_pixel_scale(&wcs);
-
-        double raErr = 0;
-        double decErr = 0;
-        if(m_UsePosition)
-        {
-            raErr = (search_ra - ra) * 3600;
-            decErr = (search_dec - dec) * 3600;
-        }
-
-        if(strcmp(fieldunits, "degrees") == 0)
-        {
-            fieldw *= 60;
-            fieldh *= 60;
-        }
-        if(strcmp(fieldunits, "arcseconds") == 0)
-        {
-            fieldw /= 60;
-            fieldh /= 60;
-        }
 
         emit logOutput("+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++");
         emit logOutput(QString("Solve Log Odds:  %1").arg(bp->solver.best_logodds));
         emit logOutput(QString("Number of Matches:  %1").arg(match.nmatch));
         emit logOutput(QString("Solved with index:  %1").arg(match.indexid));
-        emit logOutput(QString("Field center: (RA,Dec) = (%1, %2) deg.").arg( ra).arg( dec));
+        emit logOutput(QString("Field center: (RA,Dec) = (%1, %2) deg.").arg( m_Solution.ra).arg( m_Solution.dec));
         emit logOutput(QString("Field center: (RA H:M:S, Dec D:M:S) = (%1, %2).").arg( rastr, decstr));
         if(m_UsePosition)
-            emit logOutput(QString("Field is: (%1, %2) deg from search coords.").arg( raErr).arg( decErr));
-        emit logOutput(QString("Field size: %1 x %2 arcminutes").arg( fieldw).arg( fieldh));
-        emit logOutput(QString("Pixel Scale: %1\"").arg( pixscale));
-        emit logOutput(QString("Field rotation angle: up is %1 degrees E of N").arg( orient));
-        emit logOutput(QString("Field parity: %1\n").arg(FITSImage::getParityText(parity).toUtf8().data()));
+            emit logOutput(QString("Field is: (%1, %2) deg from search coords.").arg( m_Solution.raError).arg( m_Solution.decError));
+        emit logOutput(QString("Field size: %1 x %2 arcminutes").arg( m_Solution.fieldWidth).arg( m_Solution.fieldHeight));
+        emit logOutput(QString("Pixel Scale: %1\"").arg( m_Solution.pixscale));
+        emit logOutput(QString("Field rotation angle: up is %1 degrees E of N").arg( m_Solution.orientation));
+        emit logOutput(QString("Field parity: %1\n").arg(FITSImage::getParityText(m_Solution.parity).toUtf8().data()));
 
-        m_Solution = {fieldw, fieldh, ra, dec, orient, pixscale, parity, raErr, decErr};
         solutionIndexNumber = match.indexid;
         solutionHealpix = match.healpix;
         m_HasSolved = true;
@@ -1423,5 +1660,6 @@ int InternalExtractorSolver::runInternalSolver()
 
 WCSData InternalExtractorSolver::getWCSData()
 {
-    return WCSData(wcs, m_ActiveParameters.downsample);
+    // The solution is only scaled back up if the stars came from a downsampled image
+    return WCSData(wcs, usingDownsampledImage ? m_ActiveParameters.downsample : 1);
 }
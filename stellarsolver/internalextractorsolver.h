@@ -11,8 +11,17 @@
 #include <QtConcurrent>
 #include "qmutex.h"
 
+//System Includes
+#include <algorithm>
+#include <cstdlib>
+#include <memory>
+
 //SEP Includes
 #include "sep/sep.h"
+namespace SEP
+{
+class Extract;
+}
 
 //Project Includes
 #include "extractorsolver.h"
@@ -27,6 +36,27 @@ extern "C" {
 
 using namespace SSolver;
 
+/**
+ * @brief The BackgroundCache struct keeps the SEP background model of one extraction, so that the next frame of the
+ * same field can use it instead of measuring the background again.  See StellarSolver::setReuseBackground.
+ */
+struct BackgroundCache
+{
+    ~BackgroundCache()
+    {
+        SEP::sep_bkg_free(bkg);
+        free(meshBack);
+        free(meshSigma);
+    }
+    SEP::sep_bkg *bkg {nullptr};
+    float *meshBack {nullptr};  // The background of each mesh before the map was filtered, the next frame is compared with it
+    float *meshSigma {nullptr}; // The rms of each mesh before the map was filtered
+    QRect area;             // The part of the image the model was made for
+    int channel {0};        // The color channel the model was made from
+    int dtype {0};          // The SEP data type of the image
+    double tolerance {0.1}; // How far the sky may drift, in units of the background rms, before the model is replaced
+};
+
 class STELLARSOLVER_API InternalExtractorSolver: public ExtractorSolver
 {
     public:
@@ -37,7 +67,8 @@ class STELLARSOLVER_API InternalExtractorSolver: public ExtractorSolver
         // This struct contains information about the image used by SEP
         typedef struct
         {
-            float *data;
+            void *data;     // The first pixel of the partition in the image buffer, which SEP reads without copying
+            int dtype;      // The SEP data type of the image buffer
             uint32_t width;
             uint32_t height;
             uint32_t subX;
@@ -45,7 +76,9 @@ class STELLARSOLVER_API InternalExtractorSolver: public ExtractorSolver
             uint32_t subW;
             uint32_t subH;
             uint32_t keep;
-            FITSImage::Background *background;
+            SEP::sep_bkg *bkg;   // The background of the whole area being extracted, shared by all the partitions
+            int bkgX;       // The position of this partition in the area the background was made for
+            int bkgY;
         } ImageParams;
 
         /**
@@ -77,7 +110,47 @@ class STELLARSOLVER_API InternalExtractorSolver: public ExtractorSolver
          */
         WCSData getWCSData() override;
 
+        /**
+         * @brief solutionFromWCS describes the field of a plate solve, for a solve and for a refined WCS alike
+         * @param wcs The WCS of the solve
+         * @param scaleDivisor What the pixel scale of the WCS is divided by, the downsample factor if it was made for a downsampled image
+         * @param usePosition Whether a search position was given, the errors from it are 0 otherwise
+         * @param searchRA The RA of the search position in degrees
+         * @param searchDE The DEC of the search position in degrees
+         * @return The Solution, with the field size in arcminutes
+         */
+        static FITSImage::Solution solutionFromWCS(const sip_t &wcs, double scaleDivisor, bool usePosition, double searchRA,
+                double searchDE);
 
+        /**
+         * @brief extractRegions extracts the stars of several small regions of the image, each with its own background,
+         * in parallel on the thread pool in the calling thread.  It does not start this solver's thread.
+         * @param rois The regions of the image to extract
+         * The regions are read from one channel of the image, so the channels of an RGB image cannot be merged.
+         * @return One list of stars for each region, in image coordinates and in the order of rois, all of them empty if
+         * the color channel is one that merges the channels
+         */
+        QList<QList<FITSImage::Star>> extractRegions(const QList<QRect> &rois);
+
+        /**
+         * @brief setPartitionThreads sets how many threads extract the stars, which is the number of cores by default.
+         * The image is cut into about four tiles for each of them when partitioning is on.
+         * @param threads The number of threads, at least 1
+         */
+        void setPartitionThreads(uint32_t threads)
+        {
+            m_PartitionThreads = std::max(1u, threads);
+        }
+
+        /**
+         * @brief setBackgroundCache sets where the background model of the last extraction is kept.  If it is set,
+         * the model is taken from there when the sky has not drifted, and a new one is left there.
+         * @param cache The cache to share, or nullptr to measure the background of every extraction
+         */
+        void setBackgroundCache(std::shared_ptr<BackgroundCache> cache)
+        {
+            m_BackgroundCache = std::move(cache);
+        }
 
     protected:
 
@@ -94,51 +167,89 @@ class STELLARSOLVER_API InternalExtractorSolver: public ExtractorSolver
         int runSEPExtractor();
 
         /**
-         * @brief applyStarFilters filters the stars list so that the list can be reduced for faster solving
-         * @param starList
+         * @brief applyStarFilters filters the star catalog so that it can be reduced for faster solving
+         * @param stars The catalog to filter, the stars that are kept are gathered into it once at the end
          */
-        void applyStarFilters(QList<FITSImage::Star> &starList);
+        void applyStarFilters(FITSImage::StarCatalog &stars);
 
         /**
          * @brief extractPartition actually performs star extraction in separate threads for different parts of the image
          * @param parameters The details about the image partition
-         * @return A QList containing Stars with all the details found during the operation
+         * @param extractor The SEP extractor the calling thread is using, it keeps its buffers for the next partition
+         * @param measureInParallel Whether the stars are measured on the thread pool, which the calling thread must not be on
+         * @return A StarCatalog containing the stars with all the details found during the operation
          */
-        QList<FITSImage::Star> extractPartition(const ImageParams &parameters);
+        FITSImage::StarCatalog extractPartition(const ImageParams &parameters, SEP::Extract *extractor, bool measureInParallel);
 
         /**
-         * @brief allocateDataBuffer allocates the space needed for the image buffer object used by SEP
-         * @param data is the image buffer used by SEP being allocated
-         * @param x is the starting x coordinate of the partition to be processed
-         * @param y is the starting y coordinate of the partition to be processed
-         * @param w is the width of the partition to be processed
-         * @param h is the height of the partition to be processed
-         * @return The data buffer if successfull, a nullptr otherwise.
+         * @brief extractRegion cuts a region of an image into tiles, extracts them in parallel and appends their stars
+         * @param view points to the first pixel of the rows that are in memory
+         * @param viewWidth is the width of the rows in memory
+         * @param viewHeight is the number of rows in memory
+         * @param dtype is the SEP data type of the rows
+         * @param x, y, w, h is the region to extract, in the coordinates of the rows in memory
+         * @param margin is the margin added around each tile
+         * @param keepArea is the area that initialKeep stars are shared out over
+         * @param bkg is the background model, bkgX and bkgY are the position of the view in it
+         * @param offsetY is added to the y coordinate of the stars and tiles, the row of the image the view starts at
+         * @param stars is the catalog the stars are appended to
          */
-        float* allocateDataBuffer(uint32_t x, uint32_t y, uint32_t w, uint32_t h);
+        void extractRegion(const uint8_t *view, uint32_t viewWidth, uint32_t viewHeight, int dtype,
+                           uint32_t x, uint32_t y, uint32_t w, uint32_t h, uint32_t margin, double keepArea,
+                           SEP::sep_bkg *bkg, int bkgX, int bkgY, uint32_t offsetY, FITSImage::StarCatalog &stars);
 
         /**
-         * @brief mergeImageChannels merges the R, G, and B channels of a 3 channel image
-         * to make one enhanced channel for star extraction or solving
+         * @brief streamBackground estimates the background of an area of an image that is not in memory from a decimated read
+         * @return The background model for the area at full resolution, or nullptr if it failed
          */
-        bool mergeImageChannels();
+        SEP::sep_bkg *streamBackground(int dtype, uint32_t areaX, uint32_t areaY, uint32_t areaWidth, uint32_t areaHeight);
 
         /**
-         * @brief mergeImageChannelsType allows the mergeImageChannels method to handle different data types
+         * @brief extractStream extracts the stars of an image that is not in memory, reading it one band of rows at a time
+         * @return 0 means success
          */
-        template <typename T> bool mergeImageChannelsType();
+        int extractStream(int dtype, uint32_t x, uint32_t y, uint32_t w, uint32_t h, uint32_t margin,
+                          SEP::sep_bkg *bkg, uint32_t areaX, uint32_t areaY, FITSImage::StarCatalog &stars);
 
-    private:
+        /**
+         * @brief sepDataType gives the SEP data type matching the image buffer, so SEP can read the buffer as it is
+         * @return The SEP data type, or 0 if SEP cannot read this data type
+         */
+        int sepDataType() const;
 
-        // The generic data buffer containing the downsampled image data
-        uint8_t *downSampledBuffer { nullptr };
+        /**
+         * @brief imageDataAt points to a pixel of the image channel used for star extraction
+         * @param x is the x coordinate of the pixel
+         * @param y is the y coordinate of the pixel
+         * @return A pointer into the image buffer, SEP only reads from it
+         */
+        void* imageDataAt(uint32_t x, uint32_t y) const;
+
+        /**
+         * @brief prepareImage makes the one channel float image used for star extraction or solving in a single
+         * multithreaded pass over the image buffer.  It can merge the R, G, and B channels of a 3 channel image
+         * and average blocks of d x d pixels at the same time.
+         * @param merge Whether the channels are merged, as the color channel asks, or the color channel is taken
+         * @param d The factor to downsample by in both dimensions, 1 keeps the size
+         */
+        bool prepareImage(bool merge, int d);
+
+        /**
+         * @brief prepareImageType allows the prepareImage method to handle different data types
+         */
+        template <typename T> bool prepareImageType(bool merge, int d);
+
+    private:
 
-        // The generic data buffer containing an RGB image's merged channels data
-        uint8_t *mergedChannelBuffer { nullptr };
+        // The float data buffer containing the merged and/or downsampled image data
+        uint8_t *preparedBuffer { nullptr };
 
         // This is the number of threads used for star extraction with SEP
         uint32_t m_PartitionThreads = {16};
 
+        // The background model shared with the StellarSolver, see setBackgroundCache
+        std::shared_ptr<BackgroundCache> m_BackgroundCache;
+
         // Job File related
         job_t thejob;                   //This is the job file that will be created for astrometry.net to solve
         job_t* job = &thejob;           //This is a pointer to that job file
@@ -151,9 +262,9 @@ class STELLARSOLVER_API InternalExtractorSolver: public ExtractorSolver
         FILE *logFile = nullptr;        // This is the name of the log file used
         AstrometryLogger astroLogger;  // This is an object that lets C based astrometry report to C++ based code
 
-        // This is for star extraction, these are the futures for separate threads
+        // This is for star extraction, these are the futures for the threads that work through the tiles
         // We need to keep a variable for this avaiable so we can abort the process if needed.
-        QVector<QFuture<QList<FITSImage::Star>>> futures;
+        QVector<QFuture<void>> futures;
         QBasicMutex futuresMutex;
 
         // InternalExtractorSolver Methods
@@ -180,28 +291,6 @@ class STELLARSOLVER_API InternalExtractorSolver: public ExtractorSolver
          */
         void waitSEP();
 
-        /**
-         * @brief getFloatBuffer gets a float buffer from the image buffer for SEP to perform star extraction
-         * @param buffer is a pointer to the created image buffer
-         * @param x is the starting x coordinate of the buffer
-         * @param y is the starting y coordinate of the buffer
-         * @param w is the width of the buffer
-         * @param h is the height of the buffer
-         */
-        template <typename T> float* getFloatBuffer(int x, int y, int w, int h);
-
-        /**
-         * @brief downsampleImage downsamples the image by the requested factor
-         * @param d The factor to downsample by in both dimensions
-         */
-        bool downsampleImage(int d);
-
-        /**
-         * @brief downSampleImageType allows the downsampling code to handle various data types
-         * @param d The factor to downsample by in both dimensions
-         */
-        template <typename T> bool downSampleImageType(int d);
-
 
 };
 
@@ -48,7 +48,7 @@ void OnlineSolver::execute()
             emit finished(fail);
             return;
         }
-        if(m_ExtractedStars.size() == 0)
+        if(m_ExtractedStars->isEmpty())
         {
             emit logOutput("No stars were found, so the image cannot be solved");
             emit finished(-1);
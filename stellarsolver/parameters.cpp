@@ -44,6 +44,7 @@ bool SSolver::Parameters::operator==(const Parameters& o)
 
             //Settings from the Astrometry Config file
             inParallel == o.inParallel &&
+            compactCodeTrees == o.compactCodeTrees &&
             solverTimeLimit == o.solverTimeLimit &&
             minwidth == o.minwidth &&
             maxwidth == o.maxwidth &&
@@ -108,6 +109,7 @@ QMap<QString, QVariant> SSolver::Parameters::convertToMap(const Parameters &para
     settingsMap.insert("maxwidth", QVariant(params.maxwidth)) ;
     settingsMap.insert("minwidth", QVariant(params.minwidth)) ;
     settingsMap.insert("inParallel", QVariant(params.inParallel)) ;
+    settingsMap.insert("compactCodeTrees", QVariant(params.compactCodeTrees)) ;
     settingsMap.insert("solverTimeLimit", QVariant(params.solverTimeLimit));
 
     //Astrometry Basic Parameters
@@ -172,6 +174,7 @@ SSolver::Parameters SSolver::Parameters::convertFromMap(const QMap<QString, QVar
     params.maxwidth = settingsMap.value("maxwidth", params.maxwidth).toDouble() ;
     params.minwidth = settingsMap.value("minwidth", params.minwidth).toDouble() ;
     params.inParallel = settingsMap.value("inParallel", params.inParallel).toBool() ;
+    params.compactCodeTrees = settingsMap.value("compactCodeTrees", params.compactCodeTrees).toBool() ;
     params.solverTimeLimit = settingsMap.value("solverTimeLimit", params.solverTimeLimit).toInt();
 
     //Astrometry Basic Parameters
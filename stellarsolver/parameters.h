@@ -372,6 +372,7 @@ class STELLARSOLVER_API Parameters
         MultiAlgo multiAlgorithm = MULTI_AUTO;
             // Note: If the indices you are using take less than 2 GB of space, and you have at least as much physical memory as indices, you want inParallel enabled for sure.
         bool inParallel = true;     // Check the indices in parallel? This loads them in memory at the same time.
+        bool compactCodeTrees = false; // Search u16 copies of double-precision code trees, which walk a quarter of the memory.  The copies use memory in addition to the trees, are built once per index file, and matches are re-checked at full precision.  See StellarSolver::setIndexCacheLimit to keep them between solves.
         int solverTimeLimit = 600;  // Give up solving after the specified number of seconds of CPU time
         double minwidth = 0.1;      // If no scale estimate is given, this is the limit on the minimum field width in degrees.
         double maxwidth = 180;      // If no scale estimate is given, this is the limit on the maximum field width in degrees.
@@ -24,6 +24,7 @@
 #include "sep.h"
 #include "sepcore.h"
 
+#include <algorithm>
 #include <cmath>
 
 namespace SEP
@@ -103,7 +104,7 @@ int Analyze::analysemthresh(int objnb, objliststruct *objlist, int minarea,
             }
         }
         else
-            fqmedian(heap, minarea);
+            std::sort(heap, heap + minarea); //# Modified for the StellarSolver Internal Library: fqmedian no longer sorts the heap
         h--;
     }
 
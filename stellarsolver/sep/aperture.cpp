@@ -24,6 +24,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <vector>
 #include "sep.h"
 #include "sepcore.h"
 #include "overlap.h"
@@ -38,6 +39,16 @@ namespace SEP
 #define WINPOS_STEPMIN  0.0001  /* Minimum change in position for continuing */
 #define WINPOS_FAC      2.0     /* Centroid offset factor (2 for a Gaussian) */
 
+//# Modified for the StellarSolver Internal Library: if the image carries its background, the apertures
+//# subtract it from the pixels they read, evaluated for one row of the box at a time.
+static int aper_bkgrow(sep_image *im, int iy, int xmin, int xmax, std::vector<PIXTYPE> &bkgrow)
+{
+    if (!im->bkg || xmax <= xmin)
+        return RETURN_OK;
+    bkgrow.resize(xmax - xmin);
+    return bkg_line_span(im->bkg, iy + im->bkgy, xmin + im->bkgx, xmax + im->bkgx, bkgrow.data());
+}
+
 /****************************************************************************/
 /* conversions between ellipse representations */
 
@@ -330,6 +341,7 @@ int sep_sum_circann_multi(sep_image *im,
     short errisarray, errisstd;
     BYTE *datat, *errort, *maskt, *segt;
     converter convert, econvert, mconvert, sconvert;
+    std::vector<PIXTYPE> bkgrow;
     double rpix, r_out, r_out2, d, prevbinmargin, nextbinmargin, step, stepdens;
     int j, ismasked;
 
@@ -400,6 +412,9 @@ int sep_sum_circann_multi(sep_image *im,
     /* loop over rows in the box */
     for (iy = ymin; iy < ymax; iy++)
     {
+        if ((status = aper_bkgrow(im, iy, xmin, xmax, bkgrow)))
+            return status;
+
         /* set pointers to the start of this row */
         pos = (iy % im->raw_h) * im->raw_w + xmin;
         datat = reinterpret_cast<uint8_t *>(im->data) + pos * size;
@@ -420,6 +435,8 @@ int sep_sum_circann_multi(sep_image *im,
             {
                 /* get pixel values */
                 pix = convert(datat);
+                if (im->bkg)
+                    pix -= bkgrow[ix - xmin];
                 if (errisarray)
                 {
                     varpix = econvert(errort);
@@ -623,6 +640,7 @@ int sep_kron_radius(sep_image *im, double x, double y,
 
     BYTE *datat, *maskt, *segt;
     converter convert, mconvert, sconvert;
+    std::vector<PIXTYPE> bkgrow;
 
     r2 = r * r;
     r1 = v1 = 0.0;
@@ -646,6 +664,9 @@ int sep_kron_radius(sep_image *im, double x, double y,
     /* loop over rows in the box */
     for (iy = ymin; iy < ymax; iy++)
     {
+        if ((status = aper_bkgrow(im, iy, xmin, xmax, bkgrow)))
+            return status;
+
         /* set pointers to the start of this row */
         pos = (iy % im->raw_h) * im->raw_w + xmin;
         datat = reinterpret_cast<uint8_t *>(im->data)  + pos * size;
@@ -663,6 +684,8 @@ int sep_kron_radius(sep_image *im, double x, double y,
             if (rpix2 <= r2)
             {
                 pix = convert(datat);
+                if (im->bkg)
+                    pix -= bkgrow[ix - xmin];
                 ismasked = 0;
                 if ((pix < -BIG) || (im->mask && mconvert(maskt) > im->maskthresh))
                     ismasked = 1;
@@ -787,6 +810,7 @@ int sep_windowed(sep_image *im,
     short errisarray, errisstd;
     BYTE *datat, *errort, *maskt;
     converter convert, econvert, mconvert;
+    std::vector<PIXTYPE> bkgrow;
     double r2, r_in2, r_out2;
 
     /* input checks */
@@ -861,6 +885,9 @@ int sep_windowed(sep_image *im,
         /* loop over rows in the box */
         for (iy = ymin; iy < ymax; iy++)
         {
+            if ((status = aper_bkgrow(im, iy, xmin, xmax, bkgrow)))
+                return status;
+
             /* set pointers to the start of this row */
             pos = (iy % im->raw_h) * im->raw_w + xmin;
             datat = reinterpret_cast<uint8_t *>(im->data) + pos * size;
@@ -903,6 +930,8 @@ int sep_windowed(sep_image *im,
 
                     /* get pixel value and variance value */
                     pix = convert(datat);
+                    if (im->bkg)
+                        pix -= bkgrow[ix - xmin];
                     if (errisarray)
                     {
                         varpix = econvert(errort);
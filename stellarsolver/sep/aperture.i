@@ -19,6 +19,7 @@ int APER_NAME(sep_image *im,
     short errisarray, errisstd;
     BYTE *datat, *errort, *maskt, *segt;
     converter convert, econvert, mconvert, sconvert;
+    std::vector<PIXTYPE> bkgrow;
     APER_DECL;
 
     /* input checks */
@@ -73,6 +74,9 @@ int APER_NAME(sep_image *im,
     /* loop over rows in the box */
     for (iy = ymin; iy < ymax; iy++)
     {
+        if ((status = aper_bkgrow(im, iy, xmin, xmax, bkgrow)))
+            return status;
+
         /* set pointers to the start of this row */
         pos = (iy % im->raw_h) * im->raw_w + xmin;
         datat = reinterpret_cast<uint8_t*>(im->data) + pos * size;
@@ -118,6 +122,8 @@ int APER_NAME(sep_image *im,
                     overlap = 1.0;
 
                 pix = convert(datat);
+                if (im->bkg)
+                    pix -= bkgrow[ix - xmin];
 
                 if (errisarray)
                 {
@@ -24,6 +24,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <vector>
 #include "sep.h"
 #include "sepcore.h"
 
@@ -58,12 +59,53 @@ float backguess(backstruct *bkg, float *mean, float *sigma);
 int makebackspline(sep_bkg *bkg, float *map, float *dmap);
 
 
-int sep_background(sep_image* image, int bw, int bh, int fw, int fh,
-                   double fthresh, sep_bkg **bkg)
+/* The blocks of one parallel_blocks call, as the executor hands them out */
+template <typename F>
+struct block_job
+{
+    F *fn;
+    int n, nblocks;
+    std::vector<int> statuses;
+};
+
+template <typename F>
+static void run_block(void *arg, int block)
+{
+    block_job<F> *job = static_cast<block_job<F> *>(arg);
+    job->statuses[block] = (*job->fn)((int)((long)job->n * block / job->nblocks),
+                                      (int)((long)job->n * (block + 1) / job->nblocks));
+}
+
+/* Run fn(begin, end) over [0, n) split into nblocks contiguous blocks, on the
+ * caller's executor.  Each block writes only its own part of the output, so the
+ * result does not depend on the number of blocks.  Returns the first non-zero
+ * status of the blocks, in block order. */
+template <typename F>
+static int parallel_blocks(int n, int nblocks, sep_executor executor, F fn)
+{
+    int t, status;
+
+    if (nblocks > n)
+        nblocks = n;
+    if (nblocks <= 1 || !executor)
+        return fn(0, n);
+
+    block_job<F> job = {&fn, n, nblocks, std::vector<int>(nblocks, RETURN_OK)};
+    executor(run_block<F>, &job, nblocks);
+
+    status = RETURN_OK;
+    for (t = 0; t < nblocks && status == RETURN_OK; t++)
+        status = job.statuses[t];
+    return status;
+}
+
+/* Compute the background and sigma of the meshes in rows jstart to jend - 1,
+ * with buffers of its own, so that blocks of rows can run concurrently. */
+static int background_rows(sep_image *image, int bw, int bh, int nx, int ny,
+                           int jstart, int jend, sep_bkg *bkgout)
 {
     BYTE *imt, *maskt;
-    int npix;                   /* size of image */
-    int nx, ny, nb;             /* number of background boxes in x, y, total */
+    int lastrows;               /* number of image rows in the last row of boxes */ //# Modified for the StellarSolver Internal Library, image->w * image->h overflowed int
     int bufsize;                /* size of a "row" of boxes in pixels (w*bh) */
     int imgbufsize;             /* size of a "row" of boxes in pixels (raw_w*bh) for the whole image width */
     int elsize;                 /* size (in bytes) of an image array element */
@@ -72,57 +114,24 @@ int sep_background(sep_image* image, int bw, int bh, int fw, int fh,
     PIXTYPE maskthresh;
     array_converter convert, mconvert;
     backstruct *backmesh, *bm;  /* info about each background "box" */
-    sep_bkg *bkgout;          /* output */
-    int j, k, m, status;
+    int j, k, l, m, status, copylines;
 
-    //status = RETURN_OK; //# Modified by Robert Lancaster for the StellarSolver Internal Library to resolve warning
-    npix = image->w * image->h;
-    bufsize = image->w * bh;
+    lastrows = image->h % bh;
     imgbufsize = image->raw_w * bh;
     maskthresh = image->maskthresh;
     if (image->mask == NULL) maskthresh = 0.0;
 
-    backmesh = bm = NULL;
-    bkgout = NULL;
+    backmesh = NULL;
     buf = mbuf = buft = mbuft = NULL;
     convert = mconvert = NULL;
-
-    /* determine number of background boxes */
-    if ((nx = (image->w - 1) / bw + 1) < 1)
-        nx = 1;
-    if ((ny = (image->h - 1) / bh + 1) < 1)
-        ny = 1;
-    nb = nx * ny;
+    elsize = melsize = 0;
 
     /* Allocate temp memory & initialize */
-    backmesh = static_cast<backstruct*>(malloc(sizeof(backstruct) * nx));
+    QMALLOC(backmesh, backstruct, nx, status);
     bm = backmesh;
     for (m = nx; m--; bm++)
         bm->histo = NULL;
 
-    /* Allocate the returned struct */
-    bkgout = static_cast<sep_bkg*>(malloc(sizeof(sep_bkg)));
-    //QMALLOC(bkgout, sep_bkg, 1, status);
-    bkgout->w = image->w;
-    bkgout->h = image->h;
-    bkgout->nx = nx;
-    bkgout->ny = ny;
-    bkgout->n = nb;
-    bkgout->bw = bw;
-    bkgout->bh = bh;
-    bkgout->back = NULL;
-    bkgout->sigma = NULL;
-    bkgout->dback = NULL;
-    bkgout->dsigma = NULL;
-    QMALLOC(bkgout->back, float, nb, status);
-    QMALLOC(bkgout->sigma, float, nb, status);
-    QMALLOC(bkgout->dback, float, nb, status);
-    QMALLOC(bkgout->dsigma, float, nb, status);
-
-    /* cast input array pointers. These are used to step through the arrays. */
-    imt = (BYTE *)image->data;
-    maskt = (BYTE *)image->mask;
-
     /* get the correct array converter and element size, based on dtype code */
     status = get_array_converter(image->dtype, &convert, &elsize);
     if (status != RETURN_OK)
@@ -136,21 +145,26 @@ int sep_background(sep_image* image, int bw, int bh, int fw, int fh,
 
     /* If the input array type is not PIXTYPE, allocate a buffer to hold
        converted values */
-    if (image->dtype != PIXDTYPE)
+    //# Modified for the StellarSolver Internal Library: the image may be part of a wider array
+    //# (raw_w > w), then its lines are copied into the buffer as well.
+    copylines = (image->raw_w != image->w);
+    if (image->dtype != PIXDTYPE || copylines)
     {
-        QMALLOC(buf, PIXTYPE, bufsize, status);
+        QMALLOC(buf, PIXTYPE, image->w * bh, status);
         buft = buf;
-        if (status != RETURN_OK)
-            goto exit;
     }
-    if (image->mask && (image->mdtype != PIXDTYPE))
+    if (image->mask && (image->mdtype != PIXDTYPE || copylines))
     {
-        QMALLOC(mbuf, PIXTYPE, bufsize, status);
+        QMALLOC(mbuf, PIXTYPE, image->w * bh, status);
         mbuft = mbuf;
-        if (status != RETURN_OK)
-            goto exit;
     }
 
+    /* cast input array pointers. These are used to step through the arrays. */
+    imt = (BYTE *)image->data + (size_t)elsize * imgbufsize * jstart;
+    maskt = (BYTE *)image->mask;
+    if (maskt)
+        maskt += (size_t)melsize * imgbufsize * jstart;
+
     /* loop over rows of background boxes.
      * (here, we could loop over individual boxes rather than entire
      * rows, but this is convenient for converting the image and mask
@@ -158,21 +172,28 @@ int sep_background(sep_image* image, int bw, int bh, int fw, int fh,
      * because the pixel buffers are only read in from disk in
      * increments of a row of background boxes at a time.)
      */
-    for (j = 0; j < ny; j++)
+    for (j = jstart; j < jend; j++)
     {
         /* if the last row, modify the width appropriately*/
-        if (j == ny - 1 && npix % bufsize)
-            bufsize = npix % bufsize;
+        bufsize = image->w * bh;
+        if (j == ny - 1 && lastrows)
+            bufsize = image->w * lastrows;
 
         /* convert this row to PIXTYPE and store in buffer(s)*/
-        if (image->dtype != PIXDTYPE)
+        if (copylines)
+            for (l = 0; l < bufsize / image->w; l++)
+                convert(imt + (size_t)elsize * image->raw_w * l, image->w, buft + (size_t)image->w * l);
+        else if (image->dtype != PIXDTYPE)
             convert(imt, bufsize, buft);
         else
             buft = (PIXTYPE *)imt;
 
         if (image->mask)
         {
-            if (image->mdtype != PIXDTYPE)
+            if (copylines)
+                for (l = 0; l < bufsize / image->w; l++)
+                    mconvert(maskt + (size_t)melsize * image->raw_w * l, image->w, mbuft + (size_t)image->w * l);
+            else if (image->mdtype != PIXDTYPE)
                 mconvert(maskt, bufsize, mbuft);
             else
                 mbuft = (PIXTYPE *)maskt;
@@ -209,13 +230,90 @@ int sep_background(sep_image* image, int bw, int bh, int fw, int fh,
             maskt += melsize * imgbufsize;
     }
 
-    /* free memory */
+exit:
     free(buf);
-    buf = NULL;
+    buf = 0;                //# Added by Hy Murveit for the StellarSolver Internal Library for memory safety.
     free(mbuf);
-    mbuf = NULL;
+    mbuf = 0;               //# Added by Hy Murveit for the StellarSolver Internal Library for memory safety.
+    if (backmesh)
+    {
+        bm = backmesh;
+        for (m = 0; m < nx; m++, bm++)
+        {
+            free(bm->histo);
+            bm->histo = 0;  //# Added by Hy Murveit for the StellarSolver Internal Library for memory safety.
+        }
+    }
     free(backmesh);
-    backmesh = NULL;
+    backmesh = 0;           //# Added by Hy Murveit for the StellarSolver Internal Library for memory safety.
+    return status;
+}
+
+/****** sep_background ********************************************************/
+int sep_background(sep_image* image, int bw, int bh, int fw, int fh,
+                   double fthresh, sep_bkg **bkg)
+{
+    return sep_background_meshes(image, bw, bh, fw, fh, fthresh, bkg, NULL, NULL);
+}
+
+/****** sep_background_meshes *************************************************/
+//# Added for the StellarSolver Internal Library: the meshes are kept before they are filtered, for sep_bkg_drift().
+int sep_background_meshes(sep_image* image, int bw, int bh, int fw, int fh,
+                          double fthresh, sep_bkg **bkg,
+                          float **meshback, float **meshsigma)
+{
+    int nx, ny, nb;             /* number of background boxes in x, y, total */
+    sep_bkg *bkgout;          /* output */
+    int status;
+
+    //status = RETURN_OK; //# Modified by Robert Lancaster for the StellarSolver Internal Library to resolve warning
+    bkgout = NULL;
+    if (meshback && meshsigma)
+        *meshback = *meshsigma = NULL;
+
+    /* determine number of background boxes */
+    if ((nx = (image->w - 1) / bw + 1) < 1)
+        nx = 1;
+    if ((ny = (image->h - 1) / bh + 1) < 1)
+        ny = 1;
+    nb = nx * ny;
+
+    /* Allocate the returned struct */
+    bkgout = static_cast<sep_bkg*>(malloc(sizeof(sep_bkg)));
+    //QMALLOC(bkgout, sep_bkg, 1, status);
+    bkgout->w = image->w;
+    bkgout->h = image->h;
+    bkgout->nx = nx;
+    bkgout->ny = ny;
+    bkgout->n = nb;
+    bkgout->bw = bw;
+    bkgout->bh = bh;
+    bkgout->nthreads = image->nthreads;
+    bkgout->executor = image->executor;
+    bkgout->back = NULL;
+    bkgout->sigma = NULL;
+    bkgout->dback = NULL;
+    bkgout->dsigma = NULL;
+    QMALLOC(bkgout->back, float, nb, status);
+    QMALLOC(bkgout->sigma, float, nb, status);
+    QMALLOC(bkgout->dback, float, nb, status);
+    QMALLOC(bkgout->dsigma, float, nb, status);
+
+    //# Modified for the StellarSolver Internal Library: mesh rows are independent, so blocks of them run in parallel.
+    status = parallel_blocks(ny, image->nthreads, image->executor, [&](int jstart, int jend)
+    {
+        return background_rows(image, bw, bh, nx, ny, jstart, jend, bkgout);
+    });
+    if (status != RETURN_OK)
+        goto exit;
+
+    if (meshback && meshsigma)
+    {
+        QMALLOC(*meshback, float, nb, status);
+        QMALLOC(*meshsigma, float, nb, status);
+        memcpy(*meshback, bkgout->back, nb * sizeof(float));
+        memcpy(*meshsigma, bkgout->sigma, nb * sizeof(float));
+    }
 
     /* Median-filter and check suitability of the background map */
     if ((status = filterback(bkgout, fw, fh, fthresh)) != RETURN_OK)
@@ -234,24 +332,15 @@ int sep_background(sep_image* image, int bw, int bh, int fw, int fh,
 
     /* If we encountered a problem, clean up any allocated memory */
 exit:
-    free(buf);
-    buf = 0;                //# Added by Hy Murveit for the StellarSolver Internal Library for memory safety.
-    free(mbuf);
-    mbuf = 0;               //# Added by Hy Murveit for the StellarSolver Internal Library for memory safety.
-    if (backmesh)
-    {
-        bm = backmesh;
-        for (m = 0; m < nx; m++, bm++)
-        {
-            free(bm->histo);
-            bm->histo = 0;  //# Added by Hy Murveit for the StellarSolver Internal Library for memory safety.
-        }
-    }
-    free(backmesh);
-    backmesh = 0;           //# Added by Hy Murveit for the StellarSolver Internal Library for memory safety.
     sep_bkg_free(bkgout);
     bkgout = 0;             //# Added by Hy Murveit for the StellarSolver Internal Library for memory safety.
     *bkg = NULL;
+    if (meshback && meshsigma)
+    {
+        free(*meshback);
+        free(*meshsigma);
+        *meshback = *meshsigma = NULL;
+    }
     return status;
 }
 
@@ -635,12 +724,16 @@ int filterback(sep_bkg *bkg, int fw, int fh, double fthresh)
     memcpy(sigma, sigma2, np * sizeof(float));
     bkg->globalrms = fqmedian(sigma2, np);
 
+    //# Modified for the StellarSolver Internal Library: fqmedian no longer sorts sigma2, so the positive values
+    //# are gathered at the start of it rather than found at its end.
     if (bkg->globalrms <= 0.0)
     {
-        sigmat = sigma2 + np;
-        for (i = np; i-- && *(--sigmat) > 0.0;);
-        if (i >= 0 && i < (np - 1))
-            bkg->globalrms = fqmedian(sigmat + 1, np - 1 - i);
+        sigmat = sigma2;
+        for (i = 0; i < np; i++)
+            if (sigma2[i] > 0.0)
+                *(sigmat++) = sigma2[i];
+        if (sigmat > sigma2 && sigmat - sigma2 < np)
+            bkg->globalrms = fqmedian(sigma2, sigmat - sigma2);
         else
             bkg->globalrms = 1.0;
     }
@@ -781,15 +874,17 @@ float sep_bkg_pix(sep_bkg *bkg, int x, int y)
 
 /*****************************************************************************/
 
-int bkg_line_flt_internal(sep_bkg *bkg, float *values, float *dvalues, int y,
-                          float *line)
+//# Modified for the StellarSolver Internal Library: evaluates columns xmin to xmax - 1 only, so
+//# aperture photometry can subtract the background of the few pixels it reads.
+static int bkg_span_flt_internal(sep_bkg *bkg, float *values, float *dvalues, int y,
+                                 int xmin, int xmax, float *line)
 /* Interpolate background at line y (bicubic spline interpolation between
  * background map vertices) and save to line.
  * (values, dvalues) is either (bkg->back, bkg->dback) or
  * (bkg->sigma, bkg->dsigma) depending on whether the background value or rms
  * is being evaluated. */
 {
-    int i, j, x, yl, nbx, nbxm1, nby, nx, width, ystep, changepoint, status;
+    int i, j, x, yl, nbx, nbxm1, nby, nx, ystep, changepoint, nseg, status;
     float	dx, dx0, dy, dy3, cdx, cdy, cdy3, temp, xstep;
     float *nodebuf, *dnodebuf, *u;
     float *node, *nodep, *dnode, *blo, *bhi, *dblo, *dbhi;
@@ -799,7 +894,6 @@ int bkg_line_flt_internal(sep_bkg *bkg, float *values, float *dvalues, int y,
     dnodebuf = dnode = NULL;
     u = NULL;
 
-    width = bkg->w;
     nbx = bkg->nx;
     nbxm1 = nbx - 1;
     nby = bkg->ny;
@@ -881,7 +975,27 @@ int bkg_line_flt_internal(sep_bkg *bkg, float *values, float *dvalues, int y,
         bhi = node + 1;
         dblo = dnode;
         dbhi = dnode + 1;
-        for (x = i = 0, j = width; j--; i++, dx += xstep)
+        x = i = 0;
+        if (xmin > 0)
+        {
+            /* Start in the state the loop below has at pixel xmin: it moves to
+             * the next pair of nodes halfway through every mesh but the first
+             * and the last. */
+            x = (xmin - 1) / nx;
+            i = (xmin - 1) % nx + 1;
+            nseg = (changepoint > 0 && xmin - 1 >= changepoint) ? (xmin - 1 - changepoint) / nx : 0;
+            if (nseg > nbx - 2)
+                nseg = nbx - 2;
+            if (nseg > 0)
+                dx = dx0 + (xmin - (nseg * nx + changepoint)) * xstep;
+            else
+                dx += xmin * xstep;
+            blo += nseg;
+            bhi += nseg;
+            dblo += nseg;
+            dbhi += nseg;
+        }
+        for (j = xmax - xmin; j--; i++, dx += xstep)
         {
             if (i == changepoint && x > 0 && x < nbxm1)
             {
@@ -904,7 +1018,7 @@ int bkg_line_flt_internal(sep_bkg *bkg, float *values, float *dvalues, int y,
         }
     }
     else
-        for (j = width; j--;)
+        for (j = xmax - xmin; j--;)
         {
             *(line++) = (float) * node;
         }
@@ -916,6 +1030,20 @@ exit:
     return status;
 }
 
+int bkg_line_flt_internal(sep_bkg *bkg, float *values, float *dvalues, int y,
+                          float *line)
+{
+    return bkg_span_flt_internal(bkg, values, dvalues, y, 0, bkg->w, line);
+}
+
+int bkg_line_span(sep_bkg *bkg, int y, int xmin, int xmax, float *line)
+/* Interpolate background at columns xmin to xmax - 1 of line y */
+{
+    return bkg_span_flt_internal(bkg, bkg->back, bkg->dback, y, xmin, xmax, line);
+}
+
+/*****************************************************************************/
+
 int sep_bkg_line_flt(sep_bkg *bkg, int y, float *line)
 /* Interpolate background at line y (bicubic spline interpolation between
  * background map vertices) and save to line */
@@ -992,7 +1120,12 @@ exit:
     return status;
 }
 
-int sep_bkg_array(sep_bkg *bkg, void *arr, int dtype)
+/* Evaluate the background (values, dvalues = back, dback) or rms
+ * (sigma, dsigma) on lines ystart to yend - 1 of arr, either writing it or,
+ * with "subtract" set, subtracting it.  Used by the whole-array functions
+ * below, which hand blocks of lines to separate threads. */
+static int bkg_array_rows(sep_bkg *bkg, float *values, float *dvalues, void *arr, int dtype,
+                          int subtract, int ystart, int yend)
 {
     int y, width, size, status;
     array_writer write_array;
@@ -1003,24 +1136,28 @@ int sep_bkg_array(sep_bkg *bkg, void *arr, int dtype)
     status = RETURN_OK;
     width = bkg->w;
 
-    if (dtype == SEP_TFLOAT)
+    if (dtype == SEP_TFLOAT && !subtract)
     {
-        tmpline = (float *)arr;
-        for (y = 0; y < bkg->h; y++, tmpline += width)
-            if ((status = sep_bkg_line_flt(bkg, y, tmpline)) != RETURN_OK)
+        tmpline = (float *)arr + (size_t)width * ystart;
+        for (y = ystart; y < yend; y++, tmpline += width)
+            if ((status = bkg_line_flt_internal(bkg, values, dvalues, y, tmpline)) != RETURN_OK)
                 return status;
         return status;
     }
 
-    if ((status = get_array_writer(dtype, &write_array, &size)) != RETURN_OK)
+    if (subtract)
+        status = get_array_subtractor(dtype, &write_array, &size);
+    else
+        status = get_array_writer(dtype, &write_array, &size);
+    if (status != RETURN_OK)
         goto exit;
 
     QMALLOC(tmpline, float, width, status);
 
-    line = (BYTE *)arr;
-    for (y = 0; y < bkg->h; y++, line += size * width)
+    line = (BYTE *)arr + (size_t)size * width * ystart;
+    for (y = ystart; y < yend; y++, line += size * width)
     {
-        if ((status = sep_bkg_line_flt(bkg, y, tmpline)) != RETURN_OK)
+        if ((status = bkg_line_flt_internal(bkg, values, dvalues, y, tmpline)) != RETURN_OK)
             goto exit;
         write_array(tmpline, width, line);
     }
@@ -1030,42 +1167,20 @@ exit:
     return status;
 }
 
-int sep_bkg_rmsarray(sep_bkg *bkg, void *arr, int dtype)
+int sep_bkg_array(sep_bkg *bkg, void *arr, int dtype)
 {
-    int y, width, size, status;
-    array_writer write_array;
-    float *tmpline;
-    BYTE *line;
-
-    tmpline = NULL;
-    status = RETURN_OK;
-    width = bkg->w;
-
-    if (dtype == SEP_TFLOAT)
+    return parallel_blocks(bkg->h, bkg->nthreads, bkg->executor, [&](int ystart, int yend)
     {
-        tmpline = (float *)arr;
-        for (y = 0; y < bkg->h; y++, tmpline += width)
-            if ((status = sep_bkg_rmsline_flt(bkg, y, tmpline)) != RETURN_OK)
-                return status;
-        return status;
-    }
-
-    if ((status = get_array_writer(dtype, &write_array, &size)) != RETURN_OK)
-        goto exit;
-
-    QMALLOC(tmpline, float, width, status);
+        return bkg_array_rows(bkg, bkg->back, bkg->dback, arr, dtype, 0, ystart, yend);
+    });
+}
 
-    line = (BYTE *)arr;
-    for (y = 0; y < bkg->h; y++, line += size * width)
+int sep_bkg_rmsarray(sep_bkg *bkg, void *arr, int dtype)
+{
+    return parallel_blocks(bkg->h, bkg->nthreads, bkg->executor, [&](int ystart, int yend)
     {
-        if ((status = sep_bkg_rmsline_flt(bkg, y, tmpline)) != RETURN_OK)
-            goto exit;
-        write_array(tmpline, width, line);
-    }
-
-exit:
-    free(tmpline);
-    return status;
+        return bkg_array_rows(bkg, bkg->sigma, bkg->dsigma, arr, dtype, 0, ystart, yend);
+    });
 }
 
 int sep_bkg_subline(sep_bkg *bkg, int y, void *line, int dtype)
@@ -1096,32 +1211,10 @@ exit:
 
 int sep_bkg_subarray(sep_bkg *bkg, void *arr, int dtype)
 {
-    array_writer subtract_array;
-    int y, status, size, width;
-    PIXTYPE *tmpline;
-    BYTE *arrt;
-
-    tmpline = NULL;
-    //status = RETURN_OK; //# Modified by Robert Lancaster for the StellarSolver Internal Library to resolve warning
-    width = bkg->w;
-    arrt = (BYTE *)arr;
-
-    QMALLOC(tmpline, PIXTYPE, width, status);
-
-    status = get_array_subtractor(dtype, &subtract_array, &size);
-    if (status != RETURN_OK)
-        goto exit;
-
-    for (y = 0; y < bkg->h; y++, arrt += (width * size))
+    return parallel_blocks(bkg->h, bkg->nthreads, bkg->executor, [&](int ystart, int yend)
     {
-        if ((status = sep_bkg_line_flt(bkg, y, tmpline)) != RETURN_OK)
-            goto exit;
-        subtract_array(tmpline, width, arrt);
-    }
-
-exit:
-    free(tmpline);
-    return status;
+        return bkg_array_rows(bkg, bkg->back, bkg->dback, arr, dtype, 1, ystart, yend);
+    });
 }
 
 /*****************************************************************************/
@@ -1144,4 +1237,68 @@ void sep_bkg_free(sep_bkg *bkg)
     return;
 }
 
+/****** sep_bkg_drift *********************************************************/
+int sep_bkg_drift(sep_image *image, const sep_bkg *bkg, const float *meshback, const float *meshsigma,
+                  int nsamples, float *drift)
+{
+    sep_image mesh;
+    sep_bkg meshbkg;
+    float back, sigma, *changes;
+    int i, j, k, mx, my, stepx, stepy, elsize, melsize, nchanges, status;
+    array_converter convert;
+
+    status = RETURN_OK;
+    changes = NULL;
+    *drift = BIG;
+
+    if (image->w != bkg->w || image->h != bkg->h || bkg->globalrms <= 0.0 || nsamples < 1)
+        return RETURN_OK;
+    if ((status = get_array_converter(image->dtype, &convert, &elsize)) != RETURN_OK)
+        return status;
+    melsize = 0;
+    if (image->mask && (status = get_array_converter(image->mdtype, &convert, &melsize)) != RETURN_OK)
+        return status;
+
+    /* the sampled meshes are spread evenly, in the middle of their share of the map */
+    stepx = bkg->nx > nsamples ? bkg->nx / nsamples : 1;
+    stepy = bkg->ny > nsamples ? bkg->ny / nsamples : 1;
+    QMALLOC(changes, float, ((bkg->nx + stepx - 1) / stepx) * ((bkg->ny + stepy - 1) / stepy), status);
+
+    /* each sample is measured as an image of one mesh, the way sep_background() measures it */
+    meshbkg.nx = meshbkg.ny = meshbkg.n = 1;
+    meshbkg.back = &back;
+    meshbkg.sigma = &sigma;
+    nchanges = 0;
+    for (j = stepy / 2; j < bkg->ny; j += stepy)
+        for (i = stepx / 2; i < bkg->nx; i += stepx)
+        {
+            mx = i * bkg->bw;
+            my = j * bkg->bh;
+            mesh = *image;
+            mesh.data = (BYTE *)image->data + ((size_t)my * image->raw_w + mx) * elsize;
+            if (image->mask)
+                mesh.mask = (BYTE *)image->mask + ((size_t)my * image->raw_w + mx) * melsize;
+            mesh.w = image->w - mx < bkg->bw ? image->w - mx : bkg->bw;
+            mesh.h = image->h - my < bkg->bh ? image->h - my : bkg->bh;
+            mesh.nthreads = 1;
+            if ((status = background_rows(&mesh, bkg->bw, bkg->bh, 1, 1, 0, 1, &meshbkg)) != RETURN_OK)
+                goto exit;
+            /* a mesh with too few good pixels, now or before, is replaced by its neighbours in the map, it says nothing */
+            k = i + bkg->nx * j;
+            if (back <= -BIG || meshback[k] <= -BIG)
+                continue;
+            changes[nchanges] = fabs(back - meshback[k]);
+            if (fabs(sigma - meshsigma[k]) > changes[nchanges])
+                changes[nchanges] = fabs(sigma - meshsigma[k]);
+            changes[nchanges++] /= bkg->globalrms;
+        }
+
+    if (nchanges)
+        *drift = fqmedian(changes, nchanges);
+
+exit:
+    free(changes);
+    return status;
+}
+
 }
@@ -38,11 +38,15 @@
 namespace SEP
 {
 
-Deblend::Deblend(int deblend_nthresh, const plistvalues &values)
+Deblend::Deblend()
+{
+}
+
+int Deblend::setup(int deblend_nthresh, const plistvalues &values)
 {
-    allocdeblend(deblend_nthresh);
     plistsize = values.plistsize;
     plist_values = values;
+    return allocdeblend(deblend_nthresh);
 }
 
 Deblend::~Deblend()
@@ -139,12 +143,20 @@ int Deblend::deblend(objliststruct *objlistin, int l, objliststruct *objlistout,
                         goto exit;
                     }
                     if (h >= nbm - 1)
-                        if (!(son = (short *)
-                                    realloc(son, xn * NSONMAX * (nbm += 16) * sizeof(short))))
+                    {
+                        nbm += 16;
+                        if ((size_t)xn * NSONMAX * nbm > sonsize)
                         {
-                            status = MEMORY_ALLOC_ERROR;
-                            goto exit;
+                            if (!(son = (short *)
+                                        realloc(son, xn * NSONMAX * nbm * sizeof(short))))
+                            {
+                                sonsize = 0;
+                                status = MEMORY_ALLOC_ERROR;
+                                goto exit;
+                            }
+                            sonsize = (size_t)xn * NSONMAX * nbm;
                         }
+                    }
                     son[k - 1 + xn * (i + NSONMAX * (h++))] = (short)m;
                     ok[k + xn * m] = (short)1;
                 }
@@ -223,9 +235,15 @@ Allocate the memory allocated by global pointers in refine.c
 int Deblend::allocdeblend(int deblend_nthresh)
 {
     int status = RETURN_OK;
+    if (deblend_nthresh <= nthreshsize)
+        return RETURN_OK;
+
+    freedeblend();
     QMALLOC(son, short,  deblend_nthresh * NSONMAX * NBRANCH, status);
     QMALLOC(ok, short,  deblend_nthresh * NSONMAX, status);
     QMALLOC(objlist, objliststruct, deblend_nthresh, status);
+    sonsize = (size_t)deblend_nthresh * NSONMAX * NBRANCH;
+    nthreshsize = deblend_nthresh;
 
     return status;
 exit:
@@ -239,6 +257,8 @@ Free the memory allocated by global pointers in refine.c
 */
 void Deblend::freedeblend(void)
 {
+    nthreshsize = 0;
+    sonsize = 0;
     free(son);
     son = NULL;
     free(ok);
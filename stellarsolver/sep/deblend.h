@@ -35,9 +35,13 @@ class Analyze;
 class Deblend
 {
     public:
-        Deblend(int deblend_nthresh, const plistvalues &values);
+        Deblend();
         ~Deblend();
 
+        //# Modified for the StellarSolver Internal Library: one Deblend is kept by each Extract, and set up
+        //# for every image. Its buffers are only reallocated for more thresholds than any before.
+        int setup(int deblend_nthresh, const plistvalues &values);
+
         int deblend(objliststruct *objlistin, int l, objliststruct *objlistout,
                     int deblend_nthresh, double deblend_mincont, int minarea, SEP::Lutz *lutz);
 
@@ -55,6 +59,8 @@ class Deblend
 
         objliststruct *objlist = nullptr;
         short *son = nullptr, *ok = nullptr;
+        int nthreshsize = 0;        /* number of thresholds the buffers are allocated for */
+        size_t sonsize = 0;         /* number of elements in son, which grows for objects with many branches */
 
         objliststruct	debobjlist, debobjlist2;
         plistvalues plist_values;
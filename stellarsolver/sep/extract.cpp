@@ -33,12 +33,26 @@ namespace SEP
 
 Extract::Extract()
 {
-
+    lutz.reset(new Lutz());
+    deblend.reset(new Deblend());
 }
 
 Extract::~Extract()
 {
+    int i;
 
+    for (i = 0; i < WS_COUNT; i++)
+        workbuffer_free(&workspace[i]);
+}
+
+size_t Extract::workspace_allocations() const
+{
+    size_t n = 0;
+    int i;
+
+    for (i = 0; i < WS_COUNT; i++)
+        n += workspace[i].nalloc;
+    return n;
 }
 
 
@@ -46,8 +60,13 @@ Extract::~Extract()
 
 /* initialize buffer */
 /* bufw must be less than or equal to w */
+//# Modified for the StellarSolver Internal Library: if bkg is given, it is subtracted from every line
+//# as it is converted, so the caller's array is read as it is and never copied or modified.
+//# bkg may cover a larger area than the array, with the array at bkgx, bkgy in it.
+//# The buffer lines are kept in the work buffers data and bkgline, so they are not freed.
 int Extract::arraybuffer_init(arraybuffer *buf, void *arr, int dtype, int w, int h,
-                              int bufw, int bufh)
+                              int bufw, int bufh, sep_bkg *bkg, int bkgx, int bkgy,
+                              workbuffer *data, workbuffer *bkgline)
 {
     int status, yl;
     //status = RETURN_OK; //# Modified by Robert Lancaster for the StellarSolver Internal Library to resolve warning
@@ -59,7 +78,13 @@ int Extract::arraybuffer_init(arraybuffer *buf, void *arr, int dtype, int w, int
 
     /* buffer array info */
     buf->bptr = NULL;
-    QMALLOC(buf->bptr, PIXTYPE, bufw * bufh, status);
+    buf->bkg = bkg;
+    buf->bkgx = bkgx;
+    buf->bkgy = bkgy;
+    buf->bkgline = NULL;
+    QWORKBUF(*data, buf->bptr, PIXTYPE, bufw * bufh, status);
+    if (bkg)
+        QWORKBUF(*bkgline, buf->bkgline, PIXTYPE, bufw, status);
     buf->bw = bufw;
     buf->bh = bufh;
 
@@ -81,8 +106,8 @@ int Extract::arraybuffer_init(arraybuffer *buf, void *arr, int dtype, int w, int
     return status;
 
 exit:
-    free(buf->bptr);
     buf->bptr = NULL;
+    buf->bkgline = NULL;
     return status;
 }
 
@@ -90,7 +115,7 @@ exit:
 void Extract::arraybuffer_readline(arraybuffer *buf)
 {
     PIXTYPE *line;
-    int y;
+    int x, y;
 
     /* shift all lines down one */
     for (line = buf->bptr; line < buf->lastline; line += buf->bw)
@@ -105,20 +130,17 @@ void Extract::arraybuffer_readline(arraybuffer *buf)
     //                      buf->lastline);
 
     if (y < buf->dh)
-        buf->readline(buf->dptr + buf->elsize * buf->dw * y, buf->bw - 1,
+    {
+        buf->readline(buf->dptr + (size_t)buf->elsize * buf->dw * y, buf->bw - 1,
                       buf->lastline);
+        if (buf->bkg && bkg_line_span(buf->bkg, y + buf->bkgy, buf->bkgx, buf->bkgx + buf->bw - 1, buf->bkgline) == RETURN_OK)
+            for (x = 0; x < buf->bw - 1; x++)
+                buf->lastline[x] -= buf->bkgline[x];
+    }
 
     return;
 }
 
-void Extract::arraybuffer_free(arraybuffer *buf)
-{
-    if(buf && buf->bptr){    //# Modified by Robert Lancaster for the StellarSolver Internal Library to resolve warning
-        free(buf->bptr);
-        buf->bptr = NULL;
-    }
-}
-
 /* apply_mask_line: Apply the mask to the image and noise buffers.
  *
  * If convolution is off, masked values should simply be not
@@ -181,7 +203,9 @@ int Extract::sep_extract(sep_image *image, float thresh, int thresh_type,
     char              *marker;
     PIXTYPE           *scan, *cdscan, *wscan, *dummyscan;
     PIXTYPE           *sigscan, *workscan;
-    float             *convnorm;
+    PIXTYPE           *sepwork, *sepnumwork, *sepdenomwork;
+    float             *convnorm, *hconv, *vconv;
+    int               separable;
     int               *start, *end, *survives;
     pixstatus         *psstack;
     char              errtext[512];
@@ -190,6 +214,9 @@ int Extract::sep_extract(sep_image *image, float thresh, int thresh_type,
     //status = RETURN_OK; //# Modified by Robert Lancaster for the StellarSolver Internal Library to resolve warning
     pixel = NULL;
     convnorm = NULL;
+    hconv = vconv = NULL;
+    sepwork = sepnumwork = sepdenomwork = NULL;
+    separable = 0;
     scan = wscan = cdscan = dummyscan = NULL;
     sigscan = workscan = NULL;
     info = NULL;
@@ -200,6 +227,8 @@ int Extract::sep_extract(sep_image *image, float thresh, int thresh_type,
     finalobjlist = NULL;
     survives = NULL;
     cat = NULL;
+    dbuf.bptr = nbuf.bptr = mbuf.bptr = NULL;
+    dbuf.bkgline = nbuf.bkgline = mbuf.bkgline = NULL;
     //convn = 0; //# Modified by Robert Lancaster for the StellarSolver Internal Library to resolve warning
     sum = 0.0;
     w = image->w;
@@ -269,13 +298,15 @@ int Extract::sep_extract(sep_image *image, float thresh, int thresh_type,
 
     /*Allocate memory for buffers */
     stacksize = w + 1;
-    QMALLOC(info, infostruct, stacksize, status);
-    QCALLOC(store, infostruct, stacksize, status);
-    QMALLOC(marker, char, stacksize, status);
-    QMALLOC(dummyscan, PIXTYPE, stacksize, status);
-    QMALLOC(psstack, pixstatus, stacksize, status);
-    QCALLOC(start, int, stacksize, status);
-    QMALLOC(end, int, stacksize, status);
+    QWORKBUF(workspace[WS_INFO], info, infostruct, stacksize, status);
+    QWORKBUF(workspace[WS_STORE], store, infostruct, stacksize, status);
+    memset(store, 0, stacksize * sizeof(infostruct));
+    QWORKBUF(workspace[WS_MARKER], marker, char, stacksize, status);
+    QWORKBUF(workspace[WS_DUMMYSCAN], dummyscan, PIXTYPE, stacksize, status);
+    QWORKBUF(workspace[WS_PSSTACK], psstack, pixstatus, stacksize, status);
+    QWORKBUF(workspace[WS_START], start, int, stacksize, status);
+    memset(start, 0, stacksize * sizeof(int));
+    QWORKBUF(workspace[WS_END], end, int, stacksize, status);
 
     //    if ((status = lutzalloc(w, h)) != RETURN_OK)
     //        goto exit;
@@ -289,18 +320,19 @@ int Extract::sep_extract(sep_image *image, float thresh, int thresh_type,
      */
     bufh = conv ? convh : 1;
     status = arraybuffer_init(&dbuf, image->data, image->dtype, image->raw_w, h, stacksize,
-                              bufh);
+                              bufh, image->bkg, image->bkgx, image->bkgy,
+                              &workspace[WS_DBUF], &workspace[WS_DBUFBKG]);
     if (status != RETURN_OK) goto exit;
     if (isvarnoise)
     {
         status = arraybuffer_init(&nbuf, image->noise, image->ndtype, image->raw_w, h,
-                                  stacksize, bufh);
+                                  stacksize, bufh, NULL, 0, 0, &workspace[WS_NBUF], NULL);
         if (status != RETURN_OK) goto exit;
     }
     if (image->mask)
     {
         status = arraybuffer_init(&mbuf, image->mask, image->mdtype, image->raw_w, h,
-                                  stacksize, bufh);
+                                  stacksize, bufh, NULL, 0, 0, &workspace[WS_MBUF], NULL);
         if (status != RETURN_OK) goto exit;
     }
 
@@ -334,12 +366,14 @@ int Extract::sep_extract(sep_image *image, float thresh, int thresh_type,
 
 
     /* Allocate memory for the pixel list */
+    //# Modified for the StellarSolver Internal Library: no more pixels than the image has can be active,
+    //# so a small image does not need, or have to link up, the whole pixel stack.
+    if ((size_t)w * h + 2 < mem_pixstack)
+        mem_pixstack = (size_t)w * h + 2;
     plistinit((conv != NULL), (image->noise_type != SEP_NOISE_NONE));
-    if (!(pixel = objlist.plist = (pliststruct *)malloc(nposize = mem_pixstack * plistsize)))
-    {
-        status = MEMORY_ALLOC_ERROR;
-        goto exit;
-    }
+    nposize = mem_pixstack * plistsize;
+    QWORKBUF(workspace[WS_PLIST], pixel, pliststruct, nposize, status);
+    objlist.plist = pixel;
 
     /*----- at the beginning, "free" object fills the whole pixel list */
     freeinfo.firstpix = 0;
@@ -357,20 +391,34 @@ int Extract::sep_extract(sep_image *image, float thresh, int thresh_type,
     if (conv)
     {
         /* allocate memory for convolved buffers */
-        QMALLOC(cdscan, PIXTYPE, stacksize, status);
+        QWORKBUF(workspace[WS_CDSCAN], cdscan, PIXTYPE, stacksize, status);
         if (filter_type == SEP_FILTER_MATCHED)
         {
-            QMALLOC(sigscan, PIXTYPE, stacksize, status);
-            QMALLOC(workscan, PIXTYPE, stacksize, status);
+            QWORKBUF(workspace[WS_SIGSCAN], sigscan, PIXTYPE, stacksize, status);
+            QWORKBUF(workspace[WS_WORKSCAN], workscan, PIXTYPE, stacksize, status);
         }
 
         /* normalize the filter */
         convn = convw * convh;
-        QMALLOC(convnorm, PIXTYPE, convn, status);
+        QWORKBUF(workspace[WS_CONVNORM], convnorm, PIXTYPE, convn, status);
         for (i = 0; i < convn; i++)
             sum += fabs(conv[i]);
         for (i = 0; i < convn; i++)
             convnorm[i] = conv[i] / sum;
+
+        //# Modified for the StellarSolver Internal Library: filter in two 1D passes when the kernel is separable.
+        QWORKBUF(workspace[WS_HCONV], hconv, float, convw, status);
+        QWORKBUF(workspace[WS_VCONV], vconv, float, convh, status);
+        separable = conv_separate(convnorm, convw, convh, hconv, vconv);
+        if (separable)
+        {
+            QWORKBUF(workspace[WS_SEPWORK], sepwork, PIXTYPE, stacksize, status);
+            if (filter_type == SEP_FILTER_MATCHED)
+            {
+                QWORKBUF(workspace[WS_SEPNUMWORK], sepnumwork, PIXTYPE, stacksize, status);
+                QWORKBUF(workspace[WS_SEPDENOMWORK], sepdenomwork, PIXTYPE, stacksize, status);
+            }
+        }
     }
 
     plist_values.plistexist_cdvalue = plistexist_cdvalue;
@@ -383,8 +431,10 @@ int Extract::sep_extract(sep_image *image, float thresh, int thresh_type,
     plist_values.plistsize = plistsize;
 
     analyze.reset(new Analyze(plist_values));
-    lutz.reset(new Lutz(image->w, image->h, analyze.get(), plist_values));
-    deblend.reset(new Deblend(deblend_nthresh, plist_values));
+    if ((status = lutz->setup(image->w, image->h, analyze.get(), plist_values)) != RETURN_OK)
+        goto exit;
+    if ((status = deblend->setup(deblend_nthresh, plist_values)) != RETURN_OK)
+        goto exit;
 
 
     /*----- MAIN LOOP ------ */
@@ -399,7 +449,6 @@ int Extract::sep_extract(sep_image *image, float thresh, int thresh_type,
         {
             if (conv)
             {
-                free(cdscan);  // cdscan set to dummyscan below
                 if (filter_type == SEP_FILTER_MATCHED)
                 {
                     for (xl = 0; xl < stacksize; xl++)
@@ -425,15 +474,25 @@ int Extract::sep_extract(sep_image *image, float thresh, int thresh_type,
             /* filter the lines */
             if (conv)
             {
-                status = convolve(&dbuf, yl, convnorm, convw, convh, cdscan);
+                if (separable)
+                    status = convolve_separable(&dbuf, yl, hconv, convw, vconv, convh,
+                                                sepwork, cdscan);
+                else
+                    status = convolve(&dbuf, yl, convnorm, convw, convh, cdscan);
                 if (status != RETURN_OK)
                     goto exit;
 
                 if (filter_type == SEP_FILTER_MATCHED)
                 {
-                    status = matched_filter(&dbuf, &nbuf, yl, convnorm, convw,
-                                            convh, workscan, sigscan,
-                                            image->noise_type);
+                    if (separable)
+                        status = matched_filter_separable(&dbuf, &nbuf, yl, hconv, convw,
+                                                          vconv, convh, workscan, sepnumwork,
+                                                          sepdenomwork, sigscan,
+                                                          image->noise_type);
+                    else
+                        status = matched_filter(&dbuf, &nbuf, yl, convnorm, convw,
+                                                convh, workscan, sigscan,
+                                                image->noise_type);
 
                     if (status != RETURN_OK)
                         goto exit;
@@ -546,6 +605,8 @@ int Extract::sep_extract(sep_image *image, float thresh, int thresh_type,
                     nposize = mem_pixstack * plistsize;
                     pixel = (pliststruct *)realloc(pixel, nposize);
                     objlist.plist = pixel;
+                    workspace[WS_PLIST].ptr = pixel;
+                    workspace[WS_PLIST].size = pixel ? nposize : 0;
                     if (!pixel)
                     {
                         status = MEMORY_ALLOC_ERROR;
@@ -725,49 +786,9 @@ exit:
         free(finalobjlist);
         finalobjlist = 0;        //# Added by Hy Murveit for the StellarSolver Internal Library for memory safety.
     }
-    free(pixel);
-    pixel = 0;                   //# Added by Hy Murveit for the StellarSolver Internal Library for memory safety.
-    free(info);
-    info = 0;                    //# Added by Hy Murveit for the StellarSolver Internal Library for memory safety.
-    free(store);
-    store = 0;                   //# Added by Hy Murveit for the StellarSolver Internal Library for memory safety.
-    free(marker);
-    marker = 0;                  //# Added by Hy Murveit for the StellarSolver Internal Library for memory safety.
-    free(psstack);
-    psstack = 0;                 //# Added by Hy Murveit for the StellarSolver Internal Library for memory safety.
-    free(start);
-    start = 0;                   //# Added by Hy Murveit for the StellarSolver Internal Library for memory safety.
-    free(end);
-    end = 0;                     //# Added by Hy Murveit for the StellarSolver Internal Library for memory safety.
     free(survives);
     survives = 0;                //# Added by Hy Murveit for the StellarSolver Internal Library for memory safety.
-    arraybuffer_free(&dbuf);
-    if (image->noise)
-        arraybuffer_free(&nbuf);
-    if (image->mask)
-        arraybuffer_free(&mbuf);
-    if (conv){
-        free(convnorm);
-        convnorm = 0;            //# Added by Hy Murveit for the StellarSolver Internal Library for memory safety.
-    }
-    if (filter_type == SEP_FILTER_MATCHED)
-    {
-        free(sigscan);
-        sigscan = 0;             //# Added by Hy Murveit for the StellarSolver Internal Library for memory safety.
-        free(workscan);
-        workscan = 0;            //# Added by Hy Murveit for the StellarSolver Internal Library for memory safety.
-    }
-
-    /* free cdscan if we didn't do it on the last `yl` line */
-    if (conv && (cdscan != dummyscan))
-    {
-        free(cdscan);
-        cdscan = 0;              //# Added by Hy Murveit for the StellarSolver Internal Library for memory safety.
-    }
-
-    //# Modified by Hy Murveit for the StellarSolver Internal Library, possible bug. Moved free(dummyscan) to here from earlier since it was referenced in the if above.
-    free(dummyscan);
-    dummyscan = 0;
+    //# Modified for the StellarSolver Internal Library: the other buffers are kept for the next call.
 
     if (status != RETURN_OK)
     {
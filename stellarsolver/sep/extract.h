@@ -35,6 +35,10 @@ class Lutz;
 class Deblend;
 class Analyze;
 
+//# Modified for the StellarSolver Internal Library: an Extract keeps its buffers, and its Lutz and Deblend,
+//# from one call of sep_extract to the next, only growing them for a wider image, a larger pixel stack or more
+//# deblending thresholds.  Keeping one Extract for each thread saves allocating them again for every image.
+//# An Extract must not be used by two threads at once.
 class Extract
 {
     public:
@@ -42,6 +46,9 @@ class Extract
         Extract();
         ~Extract();
 
+        /* the number of times the buffers kept between calls have been allocated */
+        size_t workspace_allocations() const;
+
         int sep_extract(sep_image *image, float thresh, int thresh_type,
                         int minarea, float *conv, int convw, int convh,
                         int filter_type, int deblend_nthresh, double deblend_cont,
@@ -72,9 +79,9 @@ class Extract
 
 
         int arraybuffer_init(arraybuffer *buf, void *arr, int dtype, int w, int h,
-                             int bufw, int bufh);
+                             int bufw, int bufh, sep_bkg *bkg, int bkgx, int bkgy,
+                             workbuffer *data, workbuffer *bkgline);
         void arraybuffer_readline(arraybuffer *buf);
-        void arraybuffer_free(arraybuffer *buf);
 
     private:
 
@@ -91,6 +98,17 @@ class Extract
         size_t extract_pixstack = 300000;
         plistvalues plist_values;
         objstruct obj;
+
+        /* the buffers kept between calls */
+        enum
+        {
+            WS_INFO, WS_STORE, WS_MARKER, WS_DUMMYSCAN, WS_PSSTACK, WS_START, WS_END, WS_PLIST,
+            WS_CDSCAN, WS_SIGSCAN, WS_WORKSCAN, WS_CONVNORM, WS_HCONV, WS_VCONV,
+            WS_SEPWORK, WS_SEPNUMWORK, WS_SEPDENOMWORK,
+            WS_DBUF, WS_DBUFBKG, WS_NBUF, WS_MBUF,
+            WS_COUNT
+        };
+        workbuffer workspace[WS_COUNT] = {};
 };
 
 }
@@ -34,13 +34,17 @@
 namespace SEP
 {
 
-Lutz::Lutz(int width, int height, Analyze *a, const plistvalues &values)
+Lutz::Lutz()
+{
+}
+
+int Lutz::setup(int width, int height, Analyze *a, const plistvalues &values)
 {
     plist_values = values;
     plistsize = values.plistsize;
     plistoff_cdvalue = values.plistoff_cdvalue;
-    lutzalloc(width, height);
     analyzer = a;
+    return lutzalloc(width, height);
 }
 
 Lutz::~Lutz()
@@ -55,12 +59,16 @@ Allocate once for all memory space for buffers used by lutz().
 int Lutz::lutzalloc(int width, int height)
 {
     int *discant;
-    int stacksize, i, status = RETURN_OK;
+    int i, status = RETURN_OK;
 
-    stacksize = width + 1;
     xmin = ymin = 0;
     xmax = width - 1;
     ymax = height - 1;
+    if (width + 1 <= stacksize)
+        return RETURN_OK;
+
+    lutzfree();
+    stacksize = width + 1;
     QMALLOC(info, infostruct, stacksize, status);
     QMALLOC(store, infostruct, stacksize, status);
     QMALLOC(marker, char, stacksize, status);
@@ -86,6 +94,7 @@ Free once for all memory space for buffers used by lutz().
 */
 void Lutz::lutzfree()
 {
+    stacksize = 0;
     free(discan);
     discan = NULL;
     free(info);
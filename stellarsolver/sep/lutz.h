@@ -30,9 +30,13 @@ class Analyze;
 class Lutz
 {
     public:
-        explicit Lutz(int width, int height, Analyze *a, const plistvalues &values);
+        Lutz();
         ~Lutz();
 
+        //# Modified for the StellarSolver Internal Library: one Lutz is kept by each Extract, and set up
+        //# for every image. Its buffers are only reallocated for an image wider than any before.
+        int setup(int width, int height, Analyze *a, const plistvalues &values);
+
         void lutzsort(infostruct *, objliststruct *);
 
         int lutz(pliststruct *plistin,
@@ -53,6 +57,7 @@ class Lutz
         pixstatus   *psstack = nullptr;
         int         *start = nullptr, *end = nullptr, *discan = nullptr;
         int         xmin, ymin, xmax, ymax;
+        int         stacksize = 0;
         infostruct	curpixinfo, initinfo;
 
         plistvalues plist_values;
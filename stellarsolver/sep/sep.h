@@ -32,6 +32,22 @@ namespace SEP
 /* native int type */
 #define SEP_TFLOAT       42
 #define SEP_TDOUBLE      82
+//# Modified for the StellarSolver Internal Library: the other integer types of FITS images, with their CFITSIO codes.
+#define SEP_TUSHORT      20
+/* 16-bit unsigned short */
+#define SEP_TSHORT       21
+/* 16-bit signed short */
+#define SEP_TUINT        30
+/* 32-bit unsigned int */
+//# Modified for the StellarSolver Internal Library: the pixels of an uncompressed FITS image as the file stores them,
+//# big endian, so a mapped file can be read in place.  The unsigned types are stored signed with an offset of 2^15 or
+//# 2^31 (BZERO), which flips their sign bit.
+#define SEP_TSHORT_BE    1021
+#define SEP_TUSHORT_BE   1020
+#define SEP_TINT_BE      1031
+#define SEP_TUINT_BE     1030
+#define SEP_TFLOAT_BE    1042
+#define SEP_TDOUBLE_BE   1082
 
 /* object & aperture flags */
 #define SEP_OBJ_MERGED       0x0001  /* object is result of deblending */
@@ -61,6 +77,35 @@ namespace SEP
 
 /* structs ------------------------------------------------------------------*/
 
+/* sep_executor
+ *
+ * Runs fn(arg, 0) to fn(arg, n - 1), on as many threads as it likes, and
+ * returns when all of them have finished.  The caller supplies it, so that the
+ * blocks of rows run on the caller's threads; SEP starts none of its own.
+ */ //# Added for the StellarSolver Internal Library
+typedef void (*sep_executor)(void (*fn)(void *arg, int block), void *arg, int n);
+
+/* sep_bkg
+ *
+ * The result of sep_background() -- represents a smooth image background
+ * and its noise with splines.
+ */
+typedef struct
+{
+    int w, h;          /* original image width, height */
+    int bw, bh;        /* single tile width, height */
+    int nx, ny;        /* number of tiles in x, y */
+    int n;             /* nx*ny */
+    float global;      /* global mean */
+    float globalrms;   /* global sigma */
+    float *back;       /* node data for interpolation */
+    float *dback;
+    float *sigma;
+    float *dsigma;
+    int nthreads;      /* blocks of rows for the sep_bkg_*array functions */
+    sep_executor executor; /* runs those blocks (can be NULL to run them in turn) */
+} sep_bkg;
+
 /* sep_image
  *
  * Represents an image, including data, noise and mask arrays, and
@@ -84,27 +129,12 @@ typedef struct
     short noise_type;  /* interpretation of noise value                  */
     double gain;       /* (poisson counts / data unit)                   */
     double maskthresh; /* pixel considered masked if mask > maskthresh   */
+    int nthreads;      /* blocks of rows for sep_background; 0 or 1 runs serially */
+    sep_executor executor; /* runs those blocks (can be NULL to run them in turn) */
+    sep_bkg *bkg;      /* background subtracted from data as it is read (can be NULL) */
+    int bkgx, bkgy;    /* position of this image in the area bkg was made for */
 } sep_image;
 
-/* sep_bkg
- *
- * The result of sep_background() -- represents a smooth image background
- * and its noise with splines.
- */
-typedef struct
-{
-    int w, h;          /* original image width, height */
-    int bw, bh;        /* single tile width, height */
-    int nx, ny;        /* number of tiles in x, y */
-    int n;             /* nx*ny */
-    float global;      /* global mean */
-    float globalrms;   /* global sigma */
-    float *back;       /* node data for interpolation */
-    float *dback;
-    float *sigma;
-    float *dsigma;
-} sep_bkg;
-
 /* sep_catalog
  *
  * The result of sep_extract(). This is a struct of arrays. Each array has
@@ -161,6 +191,20 @@ int sep_background(sep_image *image,
                    double fthresh,   /* filter threshold                 */
                    sep_bkg **bkg);   /* OUTPUT                           */
 
+/* sep_background_meshes()
+ *
+ * The same as sep_background(), but it also gives copies of the background
+ * and rms of each mesh before the map is filtered, for sep_bkg_drift().  The
+ * nx * ny values of `meshback` and `meshsigma` must be freed with free().
+ */
+//# Added for the StellarSolver Internal Library, so a background model can be kept for the frames that follow.
+int sep_background_meshes(sep_image *image,
+                          int bw, int bh,
+                          int fw, int fh,
+                          double fthresh,
+                          sep_bkg **bkg,       /* OUTPUT */
+                          float **meshback,    /* OUTPUT */
+                          float **meshsigma);  /* OUTPUT */
 
 /* sep_bkg_global[rms]()
  *
@@ -207,6 +251,20 @@ int sep_bkg_rmsarray(sep_bkg *bkg, void *arr, int dtype);
  */
 void sep_bkg_free(sep_bkg *bkg);
 
+/* sep_bkg_drift()
+ *
+ * Measure how far the background of `image` has moved from `bkg`, which was
+ * made by sep_background_meshes() for an image of the same size and mesh size.
+ * Only `nsamples` x `nsamples` meshes spread over the image are measured
+ * again, so this is much cheaper than sep_background().  They are compared
+ * with `meshback` and `meshsigma`, the meshes before they were filtered, as
+ * the filtered map smooths away sky that is really there.  `drift` is the
+ * median of the changes of those meshes, in units of bkg->globalrms.
+ */
+//# Added for the StellarSolver Internal Library, so a background model can be kept for the frames that follow.
+int sep_bkg_drift(sep_image *image, const sep_bkg *bkg, const float *meshback, const float *meshsigma,
+                  int nsamples, float *drift);
+
 /*-------------------------- aperture photometry ----------------------------*/
 
 
@@ -73,6 +73,14 @@ typedef void (*array_writer)(float *ptr, int n, void *target);
       };								\
   }
 
+//# Modified for the StellarSolver Internal Library: points dst at a work buffer that is kept between calls,
+//# growing it only when it is too small for nel elements.
+#define	QWORKBUF(buf, dst, typ, nel, status)				\
+  {if ((status = workbuffer_reserve(&(buf), (size_t)(nel)*sizeof(typ))) != RETURN_OK) \
+      goto exit;							\
+   dst = (typ *)(buf).ptr;						\
+  }
+
 #define	UNKNOWN	        -1    /* flag for LUTZ */
 #define	CLEAN_ZONE      10.0  /* zone (in sigma) to consider for processing */
 #define CLEAN_STACKSIZE 3000  /* replaces prefs.clean_stacksize  */
@@ -141,6 +149,9 @@ typedef struct
     array_converter readline;  /* function to read a data line into buffer */
     int elsize;         /* size in bytes of one element in original data */
     int yoff;           /* line index in original data corresponding to bufptr */
+    sep_bkg *bkg;       /* background subtracted from each line read (can be NULL) */
+    int bkgx, bkgy;     /* position of the data in the area bkg was made for */
+    PIXTYPE *bkgline;   /* the background of the line being read */
 } arraybuffer;
 
 typedef struct
@@ -185,6 +196,14 @@ typedef struct
     int	   lastpix;			     /* ptr to last pixel */
 } objstruct;
 
+/* a buffer that is kept between calls, and only reallocated when a larger one is needed */
+typedef struct
+{
+    void   *ptr;
+    size_t size;      /* in bytes */
+    size_t nalloc;    /* number of times it has been allocated */
+} workbuffer;
+
 typedef struct
 {
     int           nobj;	  /* number of objects in list */
@@ -202,10 +221,22 @@ int get_array_converter(int dtype, array_converter *f, int *size);
 int get_array_writer(int dtype, array_writer *f, int *size);
 int get_array_subtractor(int dtype, array_writer *f, int *size);
 
+int bkg_line_span(sep_bkg *bkg, int y, int xmin, int xmax, float *line);
+
 int addobjdeep(int objnb, objliststruct *objl1, objliststruct *objl2, int plistsize);
 
+int workbuffer_reserve(workbuffer *buf, size_t size);
+void workbuffer_free(workbuffer *buf);
+
 int convolve(arraybuffer *buf, int y, float *conv, int convw, int convh, PIXTYPE *out);
 int matched_filter(arraybuffer *imbuf, arraybuffer *nbuf, int y, float *conv, int convw, int convh,
                    PIXTYPE *work, PIXTYPE *out, int noise_type);
+int conv_separate(const float *conv, int convw, int convh, float *hconv, float *vconv);
+int convolve_separable(arraybuffer *buf, int y, float *hconv, int convw,
+                       float *vconv, int convh, PIXTYPE *work, PIXTYPE *out);
+int matched_filter_separable(arraybuffer *imbuf, arraybuffer *nbuf, int y,
+                             float *hconv, int convw, float *vconv, int convh,
+                             PIXTYPE *work, PIXTYPE *numwork, PIXTYPE *denomwork,
+                             PIXTYPE *out, int noise_type);
 
 }
@@ -16,9 +16,11 @@
 *%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%*/
 
 #include <math.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <algorithm>
 #include "sep.h"
 #include "sepcore.h"
 
@@ -52,6 +54,86 @@ PIXTYPE convert_byt(void *ptr)
     return *(BYTE *)ptr;
 }
 
+//# Modified for the StellarSolver Internal Library: 16-bit and unsigned 32-bit camera images are read as they are.
+PIXTYPE convert_sht(void *ptr)
+{
+    return *(int16_t *)ptr;
+}
+
+PIXTYPE convert_usht(void *ptr)
+{
+    return *(uint16_t *)ptr;
+}
+
+PIXTYPE convert_uint(void *ptr)
+{
+    return *(uint32_t *)ptr;
+}
+
+//# Modified for the StellarSolver Internal Library: the pixels of a FITS file mapped into memory are swapped from big
+//# endian as they are converted, so the file is read in place and never copied.  Compilers turn these loads into byte
+//# swap instructions.
+static inline uint16_t load_be16(const BYTE *p)
+{
+    return (uint16_t)((p[0] << 8) | p[1]);
+}
+
+static inline uint32_t load_be32(const BYTE *p)
+{
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | (uint32_t)p[3];
+}
+
+static inline uint64_t load_be64(const BYTE *p)
+{
+    return ((uint64_t)load_be32(p) << 32) | load_be32(p + 4);
+}
+
+static inline float load_be_flt(const BYTE *p)
+{
+    uint32_t bits = load_be32(p);
+    float value;
+    memcpy(&value, &bits, sizeof(float));
+    return value;
+}
+
+static inline double load_be_dbl(const BYTE *p)
+{
+    uint64_t bits = load_be64(p);
+    double value;
+    memcpy(&value, &bits, sizeof(double));
+    return value;
+}
+
+PIXTYPE convert_sht_be(void *ptr)
+{
+    return (int16_t)load_be16((BYTE *)ptr);
+}
+
+PIXTYPE convert_usht_be(void *ptr)
+{
+    return (uint16_t)(load_be16((BYTE *)ptr) ^ 0x8000u);
+}
+
+PIXTYPE convert_int_be(void *ptr)
+{
+    return (int32_t)load_be32((BYTE *)ptr);
+}
+
+PIXTYPE convert_uint_be(void *ptr)
+{
+    return load_be32((BYTE *)ptr) ^ 0x80000000u;
+}
+
+PIXTYPE convert_flt_be(void *ptr)
+{
+    return load_be_flt((BYTE *)ptr);
+}
+
+PIXTYPE convert_dbl_be(void *ptr)
+{
+    return load_be_dbl((BYTE *)ptr);
+}
+
 /* return the correct converter depending on the datatype code */
 int get_converter(int dtype, converter *f, int *size)
 {
@@ -77,6 +159,51 @@ int get_converter(int dtype, converter *f, int *size)
         *f = convert_byt;
         *size = sizeof(BYTE);
     }
+    else if (dtype == SEP_TSHORT)
+    {
+        *f = convert_sht;
+        *size = sizeof(int16_t);
+    }
+    else if (dtype == SEP_TUSHORT)
+    {
+        *f = convert_usht;
+        *size = sizeof(uint16_t);
+    }
+    else if (dtype == SEP_TUINT)
+    {
+        *f = convert_uint;
+        *size = sizeof(uint32_t);
+    }
+    else if (dtype == SEP_TSHORT_BE)
+    {
+        *f = convert_sht_be;
+        *size = sizeof(int16_t);
+    }
+    else if (dtype == SEP_TUSHORT_BE)
+    {
+        *f = convert_usht_be;
+        *size = sizeof(uint16_t);
+    }
+    else if (dtype == SEP_TINT_BE)
+    {
+        *f = convert_int_be;
+        *size = sizeof(int32_t);
+    }
+    else if (dtype == SEP_TUINT_BE)
+    {
+        *f = convert_uint_be;
+        *size = sizeof(uint32_t);
+    }
+    else if (dtype == SEP_TFLOAT_BE)
+    {
+        *f = convert_flt_be;
+        *size = sizeof(float);
+    }
+    else if (dtype == SEP_TDOUBLE_BE)
+    {
+        *f = convert_dbl_be;
+        *size = sizeof(double);
+    }
     else
     {
         *f = NULL;
@@ -119,6 +246,78 @@ void convert_array_byt(void *ptr, int n, PIXTYPE *target)
         target[i] = *source;
 }
 
+void convert_array_sht(void *ptr, int n, PIXTYPE *target)
+{
+    int16_t *source = (int16_t *)ptr;
+    int i;
+    for (i = 0; i < n; i++, source++)
+        target[i] = *source;
+}
+
+void convert_array_usht(void *ptr, int n, PIXTYPE *target)
+{
+    uint16_t *source = (uint16_t *)ptr;
+    int i;
+    for (i = 0; i < n; i++, source++)
+        target[i] = *source;
+}
+
+void convert_array_uint(void *ptr, int n, PIXTYPE *target)
+{
+    uint32_t *source = (uint32_t *)ptr;
+    int i;
+    for (i = 0; i < n; i++, source++)
+        target[i] = *source;
+}
+
+void convert_array_sht_be(void *ptr, int n, PIXTYPE *target)
+{
+    const BYTE *source = (const BYTE *)ptr;
+    int i;
+    for (i = 0; i < n; i++, source += sizeof(int16_t))
+        target[i] = (int16_t)load_be16(source);
+}
+
+void convert_array_usht_be(void *ptr, int n, PIXTYPE *target)
+{
+    const BYTE *source = (const BYTE *)ptr;
+    int i;
+    for (i = 0; i < n; i++, source += sizeof(uint16_t))
+        target[i] = (uint16_t)(load_be16(source) ^ 0x8000u);
+}
+
+void convert_array_int_be(void *ptr, int n, PIXTYPE *target)
+{
+    const BYTE *source = (const BYTE *)ptr;
+    int i;
+    for (i = 0; i < n; i++, source += sizeof(int32_t))
+        target[i] = (int32_t)load_be32(source);
+}
+
+void convert_array_uint_be(void *ptr, int n, PIXTYPE *target)
+{
+    const BYTE *source = (const BYTE *)ptr;
+    int i;
+    for (i = 0; i < n; i++, source += sizeof(uint32_t))
+        target[i] = load_be32(source) ^ 0x80000000u;
+}
+
+void convert_array_flt_be(void *ptr, int n, PIXTYPE *target)
+{
+    const BYTE *source = (const BYTE *)ptr;
+    int i;
+    for (i = 0; i < n; i++, source += sizeof(float))
+        target[i] = load_be_flt(source);
+}
+
+void convert_array_dbl_be(void *ptr, int n, PIXTYPE *target)
+{
+    const BYTE *source = (const BYTE *)ptr;
+    int i;
+    for (i = 0; i < n; i++, source += sizeof(double))
+        target[i] = load_be_dbl(source);
+}
+
 int get_array_converter(int dtype, array_converter *f, int *size)
 {
     int status = RETURN_OK;
@@ -143,6 +342,51 @@ int get_array_converter(int dtype, array_converter *f, int *size)
         *f = convert_array_dbl;
         *size = sizeof(double);
     }
+    else if (dtype == SEP_TSHORT)
+    {
+        *f = convert_array_sht;
+        *size = sizeof(int16_t);
+    }
+    else if (dtype == SEP_TUSHORT)
+    {
+        *f = convert_array_usht;
+        *size = sizeof(uint16_t);
+    }
+    else if (dtype == SEP_TUINT)
+    {
+        *f = convert_array_uint;
+        *size = sizeof(uint32_t);
+    }
+    else if (dtype == SEP_TSHORT_BE)
+    {
+        *f = convert_array_sht_be;
+        *size = sizeof(int16_t);
+    }
+    else if (dtype == SEP_TUSHORT_BE)
+    {
+        *f = convert_array_usht_be;
+        *size = sizeof(uint16_t);
+    }
+    else if (dtype == SEP_TINT_BE)
+    {
+        *f = convert_array_int_be;
+        *size = sizeof(int32_t);
+    }
+    else if (dtype == SEP_TUINT_BE)
+    {
+        *f = convert_array_uint_be;
+        *size = sizeof(uint32_t);
+    }
+    else if (dtype == SEP_TFLOAT_BE)
+    {
+        *f = convert_array_flt_be;
+        *size = sizeof(float);
+    }
+    else if (dtype == SEP_TDOUBLE_BE)
+    {
+        *f = convert_array_dbl_be;
+        *size = sizeof(double);
+    }
     else
     {
         *f = NULL;
@@ -320,27 +564,24 @@ void sep_get_errmsg(int status, char *errtext)
 /*****************************************************************************/
 /* Array median */
 
-static int fqcmp(const void *p1, const void *p2)
-/* Sorting function for floats, used in fqmedian() below.
- * Return value is 1 if *p1>*p2, 0 if *p1==*p2, -1 otherwise */
-{
-    double f1 = *((float *)p1);
-    double f2 = *((float *)p2);
-    return f1 > f2 ? 1 : (f1 < f2 ? -1 : 0);
-}
-
 float fqmedian(float *ra, int n)
 /* Compute median of an array of floats.
  *
  * WARNING: input data are reordered! */
+//# Modified for the StellarSolver Internal Library: the median is selected with nth_element, which takes linear
+//# time, instead of sorting the whole array with qsort.  The array is only partitioned around the median, not sorted.
 {
-    int dqcmp(const void *p1, const void *p2);
+    float *mid, below;
 
-    qsort(ra, n, sizeof(float), fqcmp);
     if (n < 2)
         return *ra;
-    else
-        return n & 1 ? ra[n / 2] : (ra[n / 2 - 1] + ra[n / 2]) / 2.0;
+    mid = ra + n / 2;
+    std::nth_element(ra, mid, ra + n);
+    if (n & 1)
+        return *mid;
+    /* the other middle value is the largest of the lower half */
+    below = *std::max_element(ra, mid);
+    return (below + *mid) / 2.0;
 }
 
 /********** addobjdeep (originally in manobjlist.c) **************************/
@@ -405,4 +646,32 @@ earlyexit:
     return MEMORY_ALLOC_ERROR;
 }
 
+/*****************************************************************************/
+/* work buffers */
+
+//# Modified for the StellarSolver Internal Library: the old contents are not kept, so the buffer is
+//# freed and allocated again rather than realloc'd.
+int workbuffer_reserve(workbuffer *buf, size_t size)
+{
+    if (size <= buf->size)
+        return RETURN_OK;
+    free(buf->ptr);
+    buf->ptr = malloc(size);
+    if (!buf->ptr)
+    {
+        buf->size = 0;
+        return MEMORY_ALLOC_ERROR;
+    }
+    buf->size = size;
+    buf->nalloc++;
+    return RETURN_OK;
+}
+
+void workbuffer_free(workbuffer *buf)
+{
+    free(buf->ptr);
+    buf->ptr = NULL;
+    buf->size = 0;
+}
+
 }
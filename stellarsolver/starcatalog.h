@@ -0,0 +1,244 @@
+/*  StarCatalog, StellarSolver Internal Library developed by Robert Lancaster, 2020
+
+    This application is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public
+    License as published by the Free Software Foundation; either
+    version 2 of the License, or (at your option) any later version.
+*/
+#pragma once
+
+//System Includes
+#include <type_traits>
+#include <vector>
+
+//Qt Includes
+#include <QList>
+
+//Project Includes
+#include "structuredefinitions.h"
+
+namespace FITSImage
+{
+
+/**
+ * The StarCatalog holds the stars found by star extraction with one array for each property of the stars, rather than
+ * one Star for each star.  Star extraction writes each star into it once, the filters reorder and cut it by
+ * gathering the rows they keep, and the solver reads the positions straight out of it.  The x and y positions are
+ * doubles so that the solver can use them as they are.  RA and DEC are not part of it, they are attached to the
+ * list of stars once the image is solved.
+ */
+class StarCatalog
+{
+    public:
+        // A read only view of one property of all the stars
+        template <typename T>
+        class Column
+        {
+            public:
+                Column(const T *data, int size) : m_Data(data), m_Size(size) {}
+                const T *data() const
+                {
+                    return m_Data;
+                }
+                int size() const
+                {
+                    return m_Size;
+                }
+                const T *begin() const
+                {
+                    return m_Data;
+                }
+                const T *end() const
+                {
+                    return m_Data + m_Size;
+                }
+                const T &operator[](int i) const
+                {
+                    return m_Data[i];
+                }
+            private:
+                const T *m_Data;
+                int m_Size;
+        };
+
+        int size() const
+        {
+            return static_cast<int>(m_X.size());
+        }
+
+        bool isEmpty() const
+        {
+            return m_X.empty();
+        }
+
+        void clear()
+        {
+            resize(0);
+        }
+
+        void reserve(int n)
+        {
+            forEachColumn([n](auto & column)
+            {
+                column.reserve(n);
+            });
+        }
+
+        // The new rows are all zero until they are set
+        void resize(int n)
+        {
+            forEachColumn([n](auto & column)
+            {
+                column.resize(n);
+            });
+        }
+
+        void set(int i, const Star &star)
+        {
+            m_X[i] = star.x;
+            m_Y[i] = star.y;
+            m_Mag[i] = star.mag;
+            m_Flux[i] = star.flux;
+            m_Peak[i] = star.peak;
+            m_HFR[i] = star.HFR;
+            m_A[i] = star.a;
+            m_B[i] = star.b;
+            m_Theta[i] = star.theta;
+            m_NumPixels[i] = star.numPixels;
+        }
+
+        void append(const Star &star)
+        {
+            resize(size() + 1);
+            set(size() - 1, star);
+        }
+
+        void append(const StarCatalog &other)
+        {
+            appendColumn(m_X, other.m_X);
+            appendColumn(m_Y, other.m_Y);
+            appendColumn(m_Mag, other.m_Mag);
+            appendColumn(m_Flux, other.m_Flux);
+            appendColumn(m_Peak, other.m_Peak);
+            appendColumn(m_HFR, other.m_HFR);
+            appendColumn(m_A, other.m_A);
+            appendColumn(m_B, other.m_B);
+            appendColumn(m_Theta, other.m_Theta);
+            appendColumn(m_NumPixels, other.m_NumPixels);
+        }
+
+        Star at(int i) const
+        {
+            return {static_cast<float>(m_X[i]), static_cast<float>(m_Y[i]), m_Mag[i], m_Flux[i], m_Peak[i], m_HFR[i],
+                    m_A[i], m_B[i], m_Theta[i], 0, 0, m_NumPixels[i]};
+        }
+
+        QList<Star> toList() const
+        {
+            QList<Star> stars;
+            stars.reserve(size());
+            for (int i = 0; i < size(); i++)
+                stars.append(at(i));
+            return stars;
+        }
+
+        /**
+         * @brief select keeps just the rows listed, in the order they are listed, gathering each column once.
+         * @param rows The rows to keep, each no more than once
+         */
+        void select(const std::vector<int> &rows)
+        {
+            forEachColumn([&rows](auto & column)
+            {
+                std::remove_reference_t<decltype(column)> selected(rows.size());
+                for (size_t i = 0; i < rows.size(); i++)
+                    selected[i] = column[rows[i]];
+                column.swap(selected);
+            });
+        }
+
+        // Moves all the stars, to go from the coordinates of part of an image to those of the whole image
+        void translate(double dx, double dy)
+        {
+            for (auto &x : m_X)
+                x += dx;
+            for (auto &y : m_Y)
+                y += dy;
+        }
+
+        Column<double> x() const
+        {
+            return {m_X.data(), size()};
+        }
+        Column<double> y() const
+        {
+            return {m_Y.data(), size()};
+        }
+        Column<float> mag() const
+        {
+            return {m_Mag.data(), size()};
+        }
+        Column<float> flux() const
+        {
+            return {m_Flux.data(), size()};
+        }
+        Column<float> peak() const
+        {
+            return {m_Peak.data(), size()};
+        }
+        Column<float> HFR() const
+        {
+            return {m_HFR.data(), size()};
+        }
+        Column<float> a() const
+        {
+            return {m_A.data(), size()};
+        }
+        Column<float> b() const
+        {
+            return {m_B.data(), size()};
+        }
+        Column<float> theta() const
+        {
+            return {m_Theta.data(), size()};
+        }
+        Column<int> numPixels() const
+        {
+            return {m_NumPixels.data(), size()};
+        }
+
+    private:
+        template <typename F>
+        void forEachColumn(F f)
+        {
+            f(m_X);
+            f(m_Y);
+            f(m_Mag);
+            f(m_Flux);
+            f(m_Peak);
+            f(m_HFR);
+            f(m_A);
+            f(m_B);
+            f(m_Theta);
+            f(m_NumPixels);
+        }
+
+        template <typename T>
+        static void appendColumn(std::vector<T> &column, const std::vector<T> &other)
+        {
+            column.insert(column.end(), other.begin(), other.end());
+        }
+
+        std::vector<double> m_X;        // The x position of the star in Pixels
+        std::vector<double> m_Y;        // The y position of the star in Pixels
+        std::vector<float> m_Mag;       // The relative magnitude of the star
+        std::vector<float> m_Flux;      // The calculated total flux
+        std::vector<float> m_Peak;      // The peak value of the star
+        std::vector<float> m_HFR;       // The half flux radius of the star
+        std::vector<float> m_A;         // The semi-major axis of the star
+        std::vector<float> m_B;         // The semi-minor axis of the star
+        std::vector<float> m_Theta;     // The angle of orientation of the star
+        std::vector<int> m_NumPixels;   // The number of pixels occupied by the star in the image.
+};
+
+} // namespace FITSImage
@@ -0,0 +1,148 @@
+/*  StarFilters, StellarSolver Internal Library developed by Robert Lancaster, 2020
+
+    This application is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public
+    License as published by the Free Software Foundation; either
+    version 2 of the License, or (at your option) any later version.
+*/
+#pragma once
+
+//System Includes
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+//Project Includes
+#include "starcatalog.h"
+
+/**
+ * The StarFilters choose the stars of a StarCatalog that are kept for solving, without sorting the whole catalog.
+ * Every star is tested against all the filters in one pass.  The brightest and dimmest percentages and the number of
+ * stars to keep are then cut with std::nth_element, and only the stars that are kept are sorted by magnitude.  They do
+ * not depend on Qt, so that they can be tested and benchmarked on their own.
+ */
+namespace StarFilters
+{
+
+// These are the filters from the Parameters, the saturation limit is worked out for the data type of the image
+typedef struct
+{
+    bool resort;            // Whether the stars are sorted by magnitude, the percentages and keepNum need this
+    double maxSize;         // The widest star to keep in pixels, 0 for no limit
+    double minSize;         // The smallest star to keep in pixels, 0 for no limit
+    double removeBrightest; // The percentage of the brightest stars to remove
+    double removeDimmest;   // The percentage of the dimmest stars to remove
+    double maxEllipse;      // The largest a/b ratio to keep, no limit unless it is greater than 1
+    double maxPeak;         // The largest peak value of a star that is not saturated, no limit unless it is greater than 0
+    int keepNum;            // The number of brightest stars to keep, 0 for all of them
+} Options;
+
+// The number of stars each percentage removed, for the log
+typedef struct
+{
+    int brightestRemoved;
+    int dimmestRemoved;
+} Report;
+
+/**
+ * @brief filterRows chooses the stars to keep.  The brightest and dimmest percentages are of the stars that pass the
+ * size filters, and the ellipse and saturation filters are applied to the stars that are left, as they always were.
+ * Stars with the same magnitude are kept in the order they are in the catalog.
+ * @param stars The star catalog to filter
+ * @param options The filters to apply
+ * @param report If this is not null, it is filled in with the number of stars each percentage removed
+ * @return The rows of the catalog to keep, by increasing magnitude if options.resort is set, otherwise in catalog order
+ */
+inline std::vector<int> filterRows(const FITSImage::StarCatalog &stars, const Options &options, Report *report = nullptr)
+{
+    const auto mag = stars.mag();
+    const auto a = stars.a();
+    const auto b = stars.b();
+    const auto peak = stars.peak();
+    auto rightSize = [&](int i)
+    {
+        return !(options.maxSize > 0.0 && (a[i] > options.maxSize || b[i] > options.maxSize)) &&
+               !(options.minSize > 0.0 && (a[i] < options.minSize || b[i] < options.minSize));
+    };
+    auto rightShape = [&](int i)
+    {
+        return !(options.maxEllipse > 1 && b[i] != 0 && a[i] / b[i] > options.maxEllipse) &&
+               !(options.maxPeak > 0.0 && peak[i] > options.maxPeak);
+    };
+    if (report)
+        *report = {0, 0};
+
+    std::vector<int> rows;
+    rows.reserve(stars.size());
+    if (!options.resort)
+    {
+        for (int i = 0; i < stars.size(); i++)
+        {
+            if (rightSize(i) && rightShape(i))
+                rows.push_back(i);
+        }
+        return rows;
+    }
+
+    // The magnitude is copied next to the row, so the selections do not jump around the catalog.  A magnitude that
+    // is not a number, from a star with no flux, goes after all the others.
+    struct Candidate
+    {
+        float mag;
+        int row;
+        bool rightShape;
+        bool operator<(const Candidate &other) const
+        {
+            return mag < other.mag || (mag == other.mag && row < other.row);
+        }
+    };
+    std::vector<Candidate> candidates;
+    candidates.reserve(stars.size());
+    for (int i = 0; i < stars.size(); i++)
+    {
+        if (rightSize(i))
+            candidates.push_back({std::isnan(mag[i]) ? HUGE_VALF : mag[i], i, rightShape(i)});
+    }
+
+    // The stars from first to last are the ones still in, the cuts move them to the ends
+    auto first = candidates.begin();
+    auto last = candidates.end();
+    if (options.removeBrightest > 0.0 && options.removeBrightest < 100.0)
+    {
+        const int numToRemove = (last - first) * (options.removeBrightest / 100.0);
+        if (report)
+            report->brightestRemoved = numToRemove;
+        if (numToRemove > 1)
+        {
+            std::nth_element(first, first + numToRemove, last);
+            first += numToRemove;
+        }
+    }
+    if (options.removeDimmest > 0.0 && options.removeDimmest < 100.0)
+    {
+        const int numToRemove = (last - first) * (options.removeDimmest / 100.0);
+        if (report)
+            report->dimmestRemoved = numToRemove;
+        if (numToRemove > 1)
+        {
+            std::nth_element(first, last - numToRemove, last);
+            last -= numToRemove;
+        }
+    }
+    last = std::partition(first, last, [](const Candidate & candidate)
+    {
+        return candidate.rightShape;
+    });
+    if (options.keepNum > 0 && (last - first) - options.keepNum > 1)
+    {
+        std::nth_element(first, first + options.keepNum, last);
+        last = first + options.keepNum;
+    }
+
+    std::sort(first, last);
+    for (auto candidate = first; candidate != last; ++candidate)
+        rows.push_back(candidate->row);
+    return rows;
+}
+
+}  // namespace StarFilters
@@ -20,10 +20,26 @@
 #include "extractorsolver.h"
 
 #include "onlinesolver.h"
+#include "wcsrefiner.h"
+
+//Astrometry.net includes
+extern "C" {
+#include "astrometry/codekd.h"
+}
 
 
 using namespace SSolver;
 
+// The Statistic counts the pixels of one channel in 32 bits, so it cannot describe a larger image.
+// This returns why the image cannot be loaded, or an empty string if it can.
+static QString imageSizeIssue(const FITSImage::Statistic &imagestats)
+{
+    if(static_cast<uint64_t>(imagestats.width) * imagestats.height <= UINT32_MAX)
+        return QString();
+    return QString("The image is too large, a %1x%2 image has more than %3 pixels in a channel.")
+           .arg(imagestats.width).arg(imagestats.height).arg(UINT32_MAX);
+}
+
 StellarSolver::StellarSolver(QObject *parent) : QObject(parent)
 {
     registerMetaTypes();
@@ -77,10 +93,64 @@ bool StellarSolver::loadNewImageBuffer(const FITSImage::Statistic &imagestats, u
 {
     if(imageBuffer == nullptr)
         return false;
+    const QString sizeIssue = imageSizeIssue(imagestats);
+    if(!sizeIssue.isEmpty())
+    {
+        emit logOutput(sizeIssue);
+        return false;
+    }
     if(isRunning())
         return false;
     m_ImageBuffer = imageBuffer;
+    m_RowReader = nullptr;
+    m_MappedImage = FITSImage::MappedImage();
     m_Statistics = imagestats;
+    resetImageState();
+    return true;
+}
+
+bool StellarSolver::loadNewImageStream(const FITSImage::Statistic &imagestats, const FITSImage::RowReader &rowReader)
+{
+    if(!rowReader)
+        return false;
+    const QString sizeIssue = imageSizeIssue(imagestats);
+    if(!sizeIssue.isEmpty())
+    {
+        emit logOutput(sizeIssue);
+        return false;
+    }
+    if(isRunning())
+        return false;
+    m_ImageBuffer = nullptr;
+    m_RowReader = rowReader;
+    m_MappedImage = FITSImage::MappedImage();
+    m_Statistics = imagestats;
+    resetImageState();
+    return true;
+}
+
+bool StellarSolver::loadNewImageMapped(const FITSImage::Statistic &imagestats, const FITSImage::MappedImage &mappedImage)
+{
+    if(!mappedImage.isValid())
+        return false;
+    const QString sizeIssue = imageSizeIssue(imagestats);
+    if(!sizeIssue.isEmpty())
+    {
+        emit logOutput(sizeIssue);
+        return false;
+    }
+    if(isRunning())
+        return false;
+    m_ImageBuffer = nullptr;
+    m_RowReader = nullptr;
+    m_MappedImage = mappedImage;
+    m_Statistics = imagestats;
+    resetImageState();
+    return true;
+}
+
+void StellarSolver::resetImageState()
+{
     m_Subframe = QRect(0, 0, m_Statistics.width, m_Statistics.height);
 
     //information that should be reset since it was about the last image
@@ -103,13 +173,13 @@ bool StellarSolver::loadNewImageBuffer(const FITSImage::Statistic &imagestats, u
     m_ParallelSolversFinishedCount = 0;
     background = {};
     m_ExtractorStars.clear();
+    m_ExtractorCatalog.reset();
+    m_ExtractionTiles.clear();
     m_SolverStars.clear();
     numStars = 0;
     solution = {};
     solutionIndexNumber = -1;
     solutionHealpix = -1;
-
-    return true;
 }
 
 ExtractorSolver* StellarSolver::createExtractorSolver()
@@ -128,7 +198,12 @@ ExtractorSolver* StellarSolver::createExtractorSolver()
     }
     else if((m_ProcessType == SOLVE && m_SolverType == SOLVER_STELLARSOLVER) || (m_ProcessType != SOLVE
             && m_ExtractorType != EXTRACTOR_EXTERNAL))
-        solver = new InternalExtractorSolver(m_ProcessType, m_ExtractorType, m_SolverType, m_Statistics, m_ImageBuffer, this);
+    {
+        InternalExtractorSolver *internalSolver = new InternalExtractorSolver(m_ProcessType, m_ExtractorType, m_SolverType,
+                m_Statistics, m_ImageBuffer, this);
+        internalSolver->setBackgroundCache(m_BackgroundCache);
+        solver = internalSolver;
+    }
     else
     {
         ExternalExtractorSolver *extSolver = new ExternalExtractorSolver(m_ProcessType, m_ExtractorType, m_SolverType,
@@ -143,6 +218,8 @@ ExtractorSolver* StellarSolver::createExtractorSolver()
     if(useSubframe)
         solver->setUseSubframe(m_Subframe);
     solver->m_ColorChannel = m_ColorChannel;
+    solver->m_RowReader = m_RowReader;
+    solver->m_MappedImage = m_MappedImage;
     solver->m_LogToFile = m_LogToFile;
     solver->m_LogFileName = m_LogFileName;
     solver->m_AstrometryLogLevel = m_AstrometryLogLevel;
@@ -238,6 +315,30 @@ bool StellarSolver::extract(bool calculateHFR, QRect frame)
     return m_HasExtracted;
 }
 
+QList<QList<FITSImage::Star>> StellarSolver::extractROIs(const QList<QRect> &rois, bool calculateHFR)
+{
+    if((!m_ImageBuffer && !m_MappedImage.isValid()) || m_Statistics.width <= 0 || m_Statistics.height <= 0)
+    {
+        emit logOutput("The image buffer is not loaded, please load an image before processing it.");
+        QList<QList<FITSImage::Star>> empty;
+        for(int i = 0; i < rois.size(); i++)
+            empty.append(QList<FITSImage::Star>());
+        return empty;
+    }
+
+    // The extractor is only used for its SEP methods here, its thread is never started.
+    InternalExtractorSolver extractor(calculateHFR ? EXTRACT_WITH_HFR : EXTRACT, EXTRACTOR_INTERNAL, m_SolverType, m_Statistics,
+                                      m_ImageBuffer);
+    extractor.m_ColorChannel = m_ColorChannel;
+    extractor.m_MappedImage = m_MappedImage;
+    extractor.m_SSLogLevel = m_SSLogLevel;
+    extractor.m_ActiveParameters = params;
+    extractor.convFilter = convFilter;
+    if(m_SSLogLevel != SSolver::LOG_OFF)
+        connect(&extractor, &ExtractorSolver::logOutput, this, &StellarSolver::logOutput);
+    return extractor.extractRegions(rois);
+}
+
 bool StellarSolver::solve()
 {
     m_ProcessType = SOLVE;
@@ -251,6 +352,61 @@ bool StellarSolver::solve()
     return m_HasSolved;
 }
 
+bool StellarSolver::refineWCS(const WCSData &previous, QList<FITSImage::Star> &stars)
+{
+    sip_t previousSIP;
+    if(!previous.getInternalSIP(previousSIP))
+    {
+        if(m_SSLogLevel != LOG_OFF)
+            emit logOutput("Only WCS Data from an internal solve can be refined.");
+        return false;
+    }
+    if(m_Statistics.width <= 0 || m_Statistics.height <= 0)
+    {
+        if(m_SSLogLevel != LOG_OFF)
+            emit logOutput("The image buffer is not loaded, please load an image before processing it.");
+        return false;
+    }
+
+    if(!m_WCSRefiner)
+        m_WCSRefiner.reset(new WCSRefiner());
+    m_WCSRefiner->setIndexFiles(m_IndexFilePaths.isEmpty() ? getIndexFiles(indexFolderPaths) : m_IndexFilePaths);
+
+    WCSRefiner::Result result;
+    QString error;
+    if(!m_WCSRefiner->refine(previousSIP, stars, m_Statistics.width, m_Statistics.height, result, error))
+    {
+        if(m_SSLogLevel != LOG_OFF)
+            emit logOutput("WCS refinement failed: " + error);
+        return false;
+    }
+    if(result.logodds < params.logratio_tokeep)
+    {
+        if(m_SSLogLevel != LOG_OFF)
+            emit logOutput(QString("WCS refinement rejected, log odds %1 with %2 matches").arg(result.logodds).arg(result.matches));
+        return false;
+    }
+
+    solution = InternalExtractorSolver::solutionFromWCS(result.wcs, 1, m_UsePosition, m_SearchRA, m_SearchDE);
+
+    if(m_SSLogLevel == LOG_VERBOSE)
+    {
+        emit logOutput(QString("Refined WCS with %1 of %2 stars matched to %3 stars of index %4, log odds %5")
+                       .arg(result.matches).arg(stars.size()).arg(result.references).arg(result.indexID).arg(result.logodds));
+        emit logOutput(QString("Field center: (RA,Dec) = (%1, %2) deg.").arg(solution.ra).arg(solution.dec));
+    }
+
+    solutionIndexNumber = result.indexID;
+    solutionHealpix = -1;
+    wcsData = WCSData(result.wcs, 1);
+    hasWCS = true;
+    m_HasSolved = true;
+    m_HasFailed = false;
+    wcsData.appendStarsRAandDEC(stars);
+    m_SolverStars = stars;
+    return true;
+}
+
 void StellarSolver::start()
 {
     if(checkParameters() == false)
@@ -273,6 +429,7 @@ void StellarSolver::start()
     if(m_ProcessType == EXTRACT || m_ProcessType == EXTRACT_WITH_HFR)
     {
         m_ExtractorStars.clear();
+        m_ExtractorCatalog.reset();
         m_HasExtracted = false;
     }
     else
@@ -342,11 +499,31 @@ void StellarSolver::start()
 
 bool StellarSolver::checkParameters()
 {
-    if(m_ImageBuffer == nullptr)
+    if(m_ImageBuffer == nullptr && !m_RowReader && !m_MappedImage.isValid())
     {
         emit logOutput("The image buffer is not loaded, please load an image before processing it.");
         return false;
     }
+
+    if(m_RowReader || m_MappedImage.isValid())
+    {
+        // Only the internal extractor can read the image a band at a time, and only StellarSolver can solve from the stars alone.
+        if(m_ProcessType == SOLVE && m_SolverType != SOLVER_STELLARSOLVER)
+        {
+            emit logOutput("Only the StellarSolver solver can solve an image that is not loaded into memory.");
+            return false;
+        }
+        if(m_ProcessType != SOLVE && m_ExtractorType == EXTRACTOR_EXTERNAL)
+        {
+            emit logOutput("The external extractor cannot process an image that is not loaded into memory.");
+            return false;
+        }
+        if(m_Statistics.channels == 3 && (m_ColorChannel == FITSImage::AVERAGE_RGB || m_ColorChannel == FITSImage::INTEGRATED_RGB))
+        {
+            emit logOutput("The channels of an image that is not loaded into memory cannot be merged, please choose one channel.");
+            return false;
+        }
+    }
     #if QT_VERSION >= QT_VERSION_CHECK(6, 0, 0)
         if(params.partition == true)
         {
@@ -377,13 +554,22 @@ bool StellarSolver::checkParameters()
 
     if(m_ProcessType == SOLVE  && params.autoDownsample)
     {
-        //Take whichever one is bigger
+        //Take whichever one is bigger, and use the smallest factor that brings it down to 2048 pixels.
+        //The downsampled image is rounded up, so it keeps the edges of the image that do not fill a whole block.
         int imageSize = m_Statistics.width > m_Statistics.height ? m_Statistics.width : m_Statistics.height;
-        params.downsample = imageSize / 2048 + 1;
+        params.downsample = imageSize > 2048 ? (imageSize + 2047) / 2048 : 1;
         if(m_SSLogLevel != LOG_OFF)
             emit logOutput(QString("Automatically downsampling the image by %1").arg(params.downsample));
     }
 
+    if(m_ProcessType == SOLVE && params.downsample != 1 && (m_RowReader || m_MappedImage.isValid()))
+    {
+        // An image that is not in memory, or that is read in place, is extracted and solved at full resolution.
+        if(m_SSLogLevel != LOG_OFF)
+            emit logOutput("The image is not loaded into memory, so it is solved without downsampling.");
+        params.downsample = 1;
+    }
+
     if(m_ProcessType == SOLVE && m_SolverType != SOLVER_ASTAP)
     {
         if(m_SolverType == SOLVER_STELLARSOLVER && m_ExtractorType != EXTRACTOR_INTERNAL)
@@ -552,8 +738,10 @@ void StellarSolver::processFinished(int code)
         }
         else if((m_ProcessType == EXTRACT || m_ProcessType == EXTRACT_WITH_HFR) && m_ExtractorSolver->extractionDone())
         {
-            m_ExtractorStars = m_ExtractorSolver->getStarList();
+            m_ExtractorCatalog = m_ExtractorSolver->getStarCatalog();
+            m_ExtractorStars = m_ExtractorCatalog->toList();
             background = m_ExtractorSolver->getBackground();
+            m_ExtractionTiles = m_ExtractorSolver->getExtractionTiles();
             m_CalculateHFR = m_ExtractorSolver->isCalculatingHFR();
             if(hasWCS)
                 wcsData.appendStarsRAandDEC(m_ExtractorStars);
@@ -931,6 +1119,29 @@ void StellarSolver::setParameterProfile(SSolver::Parameters::ParametersProfile p
     setParameters(profileList.at(profile));
 }
 
+void StellarSolver::setReuseBackground(bool reuse, double tolerance)
+{
+    if(!reuse)
+    {
+        m_BackgroundCache.reset();
+        return;
+    }
+    if(!m_BackgroundCache)
+        m_BackgroundCache = std::make_shared<BackgroundCache>();
+    m_BackgroundCache->tolerance = tolerance;
+}
+
+void StellarSolver::clearBackground()
+{
+    // A new cache is made rather than emptying this one, an extraction that is running may still be using it.
+    if(m_BackgroundCache)
+    {
+        const double tolerance = m_BackgroundCache->tolerance;
+        m_BackgroundCache = std::make_shared<BackgroundCache>();
+        m_BackgroundCache->tolerance = tolerance;
+    }
+}
+
 void StellarSolver::setUseSubframe(QRect frame)
 {
     int x = frame.x();
@@ -1033,6 +1244,16 @@ QStringList StellarSolver::getDefaultIndexFolderPaths()
     return indexFilePaths;
 }
 
+void StellarSolver::setIndexCacheLimit(size_t bytes)
+{
+    codetree_set_compact_cache_limit(bytes);
+}
+
+void StellarSolver::clearIndexCache()
+{
+    codetree_clear_compact_cache();
+}
+
 bool StellarSolver::appendStarsRAandDEC(QList<FITSImage::Star> &stars)
 {
     if(hasWCS)
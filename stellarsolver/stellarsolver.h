@@ -25,8 +25,14 @@
 #include <QVariant>
 #include <QVector>
 
+// System Includes
+#include <memory>
+
 using namespace SSolver;
 
+class WCSRefiner;
+struct BackgroundCache;
+
 class STELLARSOLVER_API StellarSolver : public QObject
 {
   Q_OBJECT
@@ -87,10 +93,33 @@ public:
    * @param imagestats Information about the imagebuffer provided
    * @param imageBuffer The imagebuffer to be processed
    * @return whether or not it succesfully loaded a new image.  It will not be successful if you try
-   * to load a null image buffer or if a process is running.
+   * to load a null image buffer, an image with more than 2^32 - 1 pixels in a channel, or if a
+   * process is running.
    */
   bool loadNewImageBuffer(const FITSImage::Statistic & imagestats, uint8_t const * imageBuffer);
 
+  /**
+   * @brief loadNewImageStream loads an image that is not in memory, for images too large to load.
+   * The internal star extractor reads it a band of rows at a time, after estimating the background
+   * from a decimated first pass.  Only the internal extractor and the StellarSolver solver can use it.
+   * @param imagestats Information about the image, the buffer size information is not used
+   * @param rowReader Reads rows of the image, it is called from one thread at a time
+   * @return whether or not it succesfully loaded a new image.  It will not be successful if the
+   * reader is empty, the image has more than 2^32 - 1 pixels in a channel, or if a process is running.
+   */
+  bool loadNewImageStream(const FITSImage::Statistic & imagestats, const FITSImage::RowReader & rowReader);
+
+  /**
+   * @brief loadNewImageMapped loads an uncompressed FITS image that is mapped into memory, see fileio::loadFitsMapped.
+   * The internal star extractor reads its pixels in place, swapping their bytes as it converts them, so the image is
+   * never copied.  Like a streamed image, only the internal extractor and the StellarSolver solver can use it.
+   * @param imagestats Information about the image, the buffer size information is not used
+   * @param mappedImage The mapped image, it stays mapped for as long as StellarSolver keeps it
+   * @return whether or not it succesfully loaded a new image.  It will not be successful if the
+   * image is not mapped, it has more than 2^32 - 1 pixels in a channel, or if a process is running.
+   */
+  bool loadNewImageMapped(const FITSImage::Statistic & imagestats, const FITSImage::MappedImage & mappedImage);
+
   /**
    * @brief getDefaultExternalPaths gets the default external program paths appropriate for the
    * selected Computer System
@@ -234,6 +263,21 @@ public:
    */
   bool extract(bool calculateHFR = false, QRect frame = QRect());
 
+  /**
+   * @brief extractROIs performs Star Extraction on several small regions of the image at once, such
+   * as the boxes around the guide stars of a guider.  Each region gets its own background and the
+   * regions are extracted in parallel on the thread pool.  No extraction thread is started and the
+   * image is not converted, so this is much cheaper than calling extract once per region.  This is
+   * performed synchronously with the internal extractor, on the selected color channel.  The
+   * channels of an RGB image cannot be averaged or integrated for it, please choose one channel.
+   * @param rois The regions of the image to extract stars from
+   * @param calculateHFR If true, it will also calculate the Half-Flux Radius of each star.
+   * @return One list of stars for each region, in the order of rois, with image coordinates.  A
+   * region outside the image gives an empty list, and so do all the regions if the channels of an
+   * RGB image were to be merged.
+   */
+  QList<QList<FITSImage::Star>> extractROIs(const QList<QRect> &rois, bool calculateHFR = false);
+
   /**
    * @brief solve Plate Solves the image.  This is performed synchronously and blocks the calling
    * thread until the finished signal is emitted.
@@ -241,6 +285,19 @@ public:
    */
   bool solve();
 
+  /**
+   * @brief refineWCS updates a previous plate solve for a new frame of the same field without a
+   * quad search.  The stars are matched to the index reference stars around the previous field
+   * center and the SIP solution is refit to them.  The reference stars are cached, so successive
+   * frames of a field only cost the match and the fit.  This is performed synchronously.
+   * @param previous The WCS Data from a previous internal solve of this field
+   * @param stars The stars extracted from the new frame, brightest first. RA and DEC are attached
+   * to them if it succeeds.
+   * @return A boolean that reports whether it was successful, true means success.  The new WCS
+   * Data and Solution can then be retrieved as after a solve.
+   */
+  bool refineWCS(const WCSData & previous, QList<FITSImage::Star> & stars);
+
   /**
    * @brief start Starts a Star Extraction or Plate Solving proccess.  The process is performed
    * asynchronously.  The calling program should then wait for the ready or finished signal.
@@ -421,6 +478,19 @@ public:
    */
   static QStringList getDefaultIndexFolderPaths();
 
+  /**
+   * @brief setIndexCacheLimit lets the compact code trees of the index files be kept after the solvers using them are
+   * done, so the next solve with compactCodeTrees does not build them again.  They are shared by all the solvers.
+   * @param bytes How much memory the trees no solver is using may take, the least recently used are freed first.
+   * 0, the default, frees each tree when the last solver using it is done.
+   */
+  static void setIndexCacheLimit(size_t bytes);
+
+  /**
+   * @brief clearIndexCache frees the compact code trees that no solver is using, whatever the limit is
+   */
+  static void clearIndexCache();
+
   // Accessor Method for external classes
   /**
    * @brief getNumStarsFound gets the number of stars found in the star extraction
@@ -439,6 +509,15 @@ public:
     return m_ExtractorStars;
   }
 
+  /**
+   * @brief getStarCatalog gets the stars found during star extraction, one array for each property, without copying them
+   * @return The star catalog, it does not have the RA and DEC of the stars, it is null if nothing was extracted
+   */
+  std::shared_ptr<const FITSImage::StarCatalog> getStarCatalog() const
+  {
+    return m_ExtractorCatalog;
+  }
+
   /**
    * @brief getStarListFromSolve gets the list of stars used to plate solve the image
    * @return A QList full of stars and their properties
@@ -457,6 +536,16 @@ public:
     return background;
   }
 
+  /**
+   * @brief getExtractionTiles gets the tiles the last internal star extraction was split into,
+   * with the number of stars and the time taken for each, to help tune partitioning
+   * @return The tiles of the last star extraction
+   */
+  const QList<FITSImage::ExtractionTile> & getExtractionTiles() const
+  {
+    return m_ExtractionTiles;
+  }
+
   /**
    * @brief getSolution gets the Solution information from the latest plate solve
    * @return The Solution information
@@ -577,6 +666,22 @@ public:
     m_Subframe = QRect(0, 0, m_Statistics.width, m_Statistics.height);
   };
 
+  /**
+   * @brief setReuseBackground keeps the background model of each star extraction for the next one.
+   * On the next frame a few of its meshes are measured again, and the whole background is only
+   * measured again if the sky has drifted.  This suits focus runs and guiding, where many frames
+   * of the same field are extracted.  It applies to the internal extractor with images in memory.
+   * @param reuse Whether or not to keep the background model
+   * @param tolerance How far the sky may drift, in units of the background rms, before the model is replaced
+   */
+  void setReuseBackground(bool reuse, double tolerance = 0.1);
+
+  /**
+   * @brief clearBackground drops the kept background model, so the next star extraction measures
+   * the background again.
+   */
+  void clearBackground();
+
   /**
    * @brief setColorChannel allows you to choose which color channel to use for Star Extraction and
    * Solving in an RGB Image
@@ -717,11 +822,17 @@ private:
 
   FITSImage::Statistic m_Statistics;       // This is information about the image
   const uint8_t * m_ImageBuffer{nullptr};  // The generic data buffer containing the image data
+  FITSImage::RowReader m_RowReader;        // This reads the image a band at a time if it is not in memory
+  FITSImage::MappedImage m_MappedImage;    // The image as it is stored in a FITS file mapped into memory, if it is
   QList<ExtractorSolver *>
     parallelSolvers;  // This is the list of parallel ExtractorSolvers when solving in parallel
   QScopedPointer<ExtractorSolver>
     m_ExtractorSolver;  // This is the single ExtractorSolver used when not working in parallel
   WCSData wcsData;      // This is the WCS information from the last solve.
+  QScopedPointer<WCSRefiner>
+    m_WCSRefiner;  // This updates wcsData for new frames, it keeps the reference stars it loaded
+  std::shared_ptr<BackgroundCache>
+    m_BackgroundCache;  // If the background is reused, this keeps the model from the last star extraction
   int m_ParallelSolversFinishedCount{0};  // This is the number of parallel solvers that are done.
 
   // StellarSolver Results Information
@@ -730,6 +841,10 @@ private:
     background;  // This is a report on the background levels found during star extraction
   QList<FITSImage::Star>
     m_ExtractorStars;  // This is the list of stars that get extracted from the image
+  std::shared_ptr<const FITSImage::StarCatalog>
+    m_ExtractorCatalog;  // This is the catalog the list of extracted stars was built from
+  QList<FITSImage::ExtractionTile>
+    m_ExtractionTiles;  // This reports on the tiles of the last star extraction
   QList<FITSImage::Star>
     m_SolverStars;   // This is the list of stars that were extracted for the last successful solve
   int numStars = 0;  // The number of stars found in the last operation
@@ -808,6 +923,11 @@ private:
    */
   bool checkParameters();
 
+  /**
+   * @brief resetImageState forgets everything about the last image when a new one is loaded
+   */
+  void resetImageState();
+
   /**
    * @brief createExtractorSolver is an internal StellarSolver method that creates the
    * ExtractorSolvers that will be used in the operation.
@@ -7,6 +7,10 @@
 //system includes
 #include <stdint.h>
 #include <math.h>
+#include <functional>
+#include <memory>
+#include <string.h>
+#include <type_traits>
 #include <QString>
 
 #include "stellarsolver_export.h"
@@ -66,14 +70,61 @@ typedef struct STELLARSOLVER_API Statistic
     double SNR { 0 };                   // Signal to noise ratio
     uint32_t dataType { 0 };            // FITS image data type (TBYTE, TUSHORT, TULONG, TFLOAT, TLONGLONG, TDOUBLE)
     int bytesPerPixel { 1 };            // Number of bytes used for each pixel, size of datatype above
+    uint32_t sourceDataType { 0 };      // The data type the pixels had before they were made floats, 0 if they were not.  The saturation limit is a fraction of its largest value.
     int ndim { 2 };                     // Number of dimensions in a fits image
     int64_t size { 0 };                 // Filesize in bytes
     uint32_t samples_per_channel { 0 }; // area of the image in pixels
-    uint16_t width { 0 };               // width of the image in pixels
-    uint16_t height { 0 };              // height of the image in pixels
+    uint32_t width { 0 };               // width of the image in pixels
+    uint32_t height { 0 };              // height of the image in pixels
     uint8_t channels { 1 };             // Mono Images have 1 channel, RGB has 3 channels
 } Statistic;
 
+// This reads whole rows of one channel of an image that is not loaded into memory.  It copies numRows rows,
+// starting at firstRow, into buffer in the Statistic's dataType, and returns false if they could not be read.
+typedef std::function<bool(uint32_t channel, uint32_t firstRow, uint32_t numRows, void *buffer)> RowReader;
+
+// This is an uncompressed FITS image that is read where it lies in the file, which is mapped into memory instead of
+// loaded.  The pixels are kept the way FITS stores them, big endian, with the sign bit of unsigned integers flipped by
+// their BZERO offset.  The internal star extractor converts them to floats as it reads them, so nothing is copied and
+// only the pages of the file that are used are ever read from the disk.
+typedef struct STELLARSOLVER_API MappedImage
+{
+    std::shared_ptr<const uint8_t> data;    // The first pixel of the image, the file stays mapped while a copy of this exists
+    uint32_t dataType { 0 };                // The type of the pixels once they are read (TBYTE, TSHORT, TUSHORT, TLONG, TULONG, TFLOAT, TDOUBLE)
+    int bytesPerPixel { 1 };                // Number of bytes used for each pixel
+    uint32_t width { 0 };                   // width of the image in pixels
+    uint32_t height { 0 };                  // height of the image in pixels
+
+    bool isValid() const
+    {
+        return data != nullptr;
+    }
+
+    // This points to a pixel as it is stored in the file
+    const uint8_t *at(uint32_t channel, uint32_t x, uint32_t y) const
+    {
+        return data.get() + ((static_cast<size_t>(channel) * height + y) * width + x) * bytesPerPixel;
+    }
+
+    // This reads a pixel stored as T, swapping its bytes and, for unsigned integers, taking off the BZERO offset
+    template <typename T>
+    T value(uint32_t channel, uint32_t x, uint32_t y) const
+    {
+        typedef typename std::conditional < sizeof(T) == 1, uint8_t,
+                typename std::conditional < sizeof(T) == 2, uint16_t,
+                typename std::conditional < sizeof(T) == 4, uint32_t, uint64_t >::type >::type >::type Bits;
+        const uint8_t *bytes = at(channel, x, y);
+        Bits bits = 0;
+        for (size_t i = 0; i < sizeof(T); i++)
+            bits = static_cast<Bits>((bits << 8) | bytes[i]);
+        if (std::is_unsigned<T>::value && sizeof(T) > 1)
+            bits ^= static_cast<Bits>(Bits(1) << (8 * sizeof(T) - 1));
+        T pixel;
+        memcpy(&pixel, &bits, sizeof(T));
+        return pixel;
+    }
+} MappedImage;
+
 // This structure holds data about sources that are found within
 // an image.  It is returned by Source Extraction
 typedef struct STELLARSOLVER_API Star
@@ -102,6 +153,15 @@ typedef struct STELLARSOLVER_API Background
     int num_stars_detected; // Number of stars detected before any reduction.
 } Background;
 
+// This struct reports on one tile of a partitioned star extraction
+typedef struct STELLARSOLVER_API ExtractionTile
+{
+    int x, y;               // The corner of the tile in the image, not including its margins
+    int width, height;      // The size of the tile, not including its margins
+    int num_stars;          // Number of stars found in the tile before any filtering
+    double milliseconds;    // The time it took to extract the stars in the tile
+} ExtractionTile;
+
 // This struct contains information about the astrometric solution
 // for an image.
 typedef struct STELLARSOLVER_API Solution
@@ -8,6 +8,7 @@
 //Astrometry.net includes
 extern "C" {
 #include "astrometry/starutil.h"
+#include "astrometry/sip-utils.h"
 }
 
 WCSData::WCSData()
@@ -126,6 +127,17 @@ bool WCSData::appendStarsRAandDEC(QList<FITSImage::Star> &stars)
     }
 }
 
+bool WCSData::getInternalSIP(sip_t &sip) const
+{
+    if(!hasWCS || !internalWCS)
+        return false;
+    if(d != 1)
+        sip_scale(&wcs, &sip, d);
+    else
+        sip = wcs;
+    return true;
+}
+
 double WCSData::getCRVAL(int i) const 
 {
     if(internalWCS)
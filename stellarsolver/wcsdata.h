@@ -46,6 +46,13 @@ public:
      */
     bool appendStarsRAandDEC(QList<FITSImage::Star> &stars);
 
+    /**
+     * @brief getInternalSIP gets the astrometry.net SIP solution in full resolution image pixels
+     * @param sip The SIP structure to fill
+     * @return false if there is no WCS or it was loaded from a file instead of solved internally
+     */
+    bool getInternalSIP(sip_t &sip) const;
+
     double getCRVAL(int i) const;
     double getCRPIX(int i) const;
     double getCD(int i, int j) const;
@@ -0,0 +1,274 @@
+/*  WCSRefiner, StellarSolver Internal Library developed by Robert Lancaster, 2020
+
+    This application is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public
+    License as published by the Free Software Foundation; either
+    version 2 of the License, or (at your option) any later version.
+*/
+#include "wcsrefiner.h"
+
+//System Includes
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+//Astrometry.net Includes
+extern "C" {
+#include "astrometry/gslutils.h"
+#include "astrometry/healpix.h"
+#include "astrometry/index.h"
+#include "astrometry/sip-utils.h"
+#include "astrometry/solver.h"
+#include "astrometry/starkd.h"
+#include "astrometry/starutil.h"
+#include "astrometry/tweak2.h"
+}
+
+// The quads an index is built from should be between these fractions of the field width,
+// the same limits the solver uses when it picks indexes for a blind solve.
+#define REFINE_QUAD_FRACTION_LO 0.1
+#define REFINE_QUAD_FRACTION_HI 1.0
+
+// Reference stars are loaded for this multiple of the field radius, so that a drifting field
+// can keep using them for a while.
+#define REFINE_CACHE_MARGIN 2.0
+
+// If the field radius changes by more than this factor, a different index may be the best choice.
+#define REFINE_SCALE_CHANGE 1.25
+
+WCSRefiner::WCSRefiner()
+{
+}
+
+WCSRefiner::~WCSRefiner()
+{
+    gslutils_lsq_free(m_FitWorkspace);
+}
+
+void WCSRefiner::setIndexFiles(const QStringList &indexFiles)
+{
+    if(indexFiles == m_IndexFiles)
+        return;
+    m_IndexFiles = indexFiles;
+    m_IndexInfo.clear();
+    m_HaveIndexInfo = false;
+    clearCache();
+}
+
+void WCSRefiner::clearCache()
+{
+    m_RefRADec.clear();
+    m_HaveCache = false;
+    m_CacheIndexID = -1;
+}
+
+bool WCSRefiner::loadIndexInfo(QString &error)
+{
+    m_IndexInfo.clear();
+    for(const auto &path : m_IndexFiles)
+    {
+        index_t meta;
+        memset(&meta, 0, sizeof(index_t));
+        if(index_get_meta(path.toUtf8().constData(), &meta))
+            continue;
+        IndexInfo info;
+        info.path = path;
+        info.indexID = meta.indexid;
+        info.healpix = meta.healpix;
+        info.hpnside = meta.hpnside;
+        info.jitter = meta.index_jitter;
+        info.scaleLower = meta.index_scale_lower;
+        info.scaleUpper = meta.index_scale_upper;
+        index_close(&meta);
+        m_IndexInfo.append(info);
+    }
+    if(m_IndexInfo.isEmpty())
+    {
+        error = "No usable index files were found";
+        return false;
+    }
+    m_HaveIndexInfo = true;
+    return true;
+}
+
+bool WCSRefiner::loadReferenceStars(double ra, double dec, double fieldRadius, double fieldWidth, QString &error)
+{
+    double radius = REFINE_CACHE_MARGIN * fieldRadius;
+    double quadLo = REFINE_QUAD_FRACTION_LO * fieldWidth;
+    double quadHi = REFINE_QUAD_FRACTION_HI * fieldWidth;
+
+    // The index series with the smallest quads that still suit this field has the most stars in it.
+    int bestID = -1;
+    double bestScale = HUGE_VAL;
+    for(const auto &info : m_IndexInfo)
+    {
+        if(info.scaleUpper < quadLo || info.scaleLower > quadHi)
+            continue;
+        if(info.healpix != -1 && healpix_distance_to_radec(info.healpix, info.hpnside, ra, dec, NULL) > radius)
+            continue;
+        if(info.scaleLower < bestScale)
+        {
+            bestScale = info.scaleLower;
+            bestID = info.indexID;
+        }
+    }
+    if(bestID == -1)
+    {
+        error = QString("No index file covers a %1 arcsec field at RA %2, DEC %3").arg(fieldWidth).arg(ra).arg(dec);
+        return false;
+    }
+
+    clearCache();
+    double jitter = 0;
+    for(const auto &info : m_IndexInfo)
+    {
+        if(info.indexID != bestID)
+            continue;
+        if(info.healpix != -1 && healpix_distance_to_radec(info.healpix, info.hpnside, ra, dec, NULL) > radius)
+            continue;
+        startree_t* starkd = startree_open(info.path.toUtf8().constData());
+        if(!starkd)
+            continue;
+        double* radec = nullptr;
+        int N = 0;
+        startree_search_for_radec(starkd, ra, dec, radius, NULL, &radec, NULL, &N);
+        for(int i = 0; i < 2 * N; i++)
+            m_RefRADec.append(radec[i]);
+        free(radec);
+        startree_close(starkd);
+        jitter = std::max(jitter, info.jitter);
+    }
+
+    // Neighbouring healpix tiles share the stars along their edges, drop the copies.
+    int N = m_RefRADec.size() / 2;
+    QVector<int> order(N);
+    for(int i = 0; i < N; i++)
+        order[i] = i;
+    const double *rd = m_RefRADec.constData();
+    std::sort(order.begin(), order.end(), [rd](int a, int b)
+    {
+        if(rd[2 * a + 1] != rd[2 * b + 1])
+            return rd[2 * a + 1] < rd[2 * b + 1];
+        return rd[2 * a] < rd[2 * b];
+    });
+    QVector<double> unique;
+    unique.reserve(2 * N);
+    for(int i = 0; i < N; i++)
+    {
+        int s = order[i];
+        if(i > 0)
+        {
+            int p = order[i - 1];
+            if(rd[2 * s] == rd[2 * p] && rd[2 * s + 1] == rd[2 * p + 1])
+                continue;
+        }
+        unique.append(rd[2 * s]);
+        unique.append(rd[2 * s + 1]);
+    }
+    m_RefRADec.swap(unique);
+
+    if(m_RefRADec.isEmpty())
+    {
+        error = QString("Index %1 has no stars near RA %2, DEC %3").arg(bestID).arg(ra).arg(dec);
+        return false;
+    }
+
+    m_HaveCache = true;
+    m_CacheRA = ra;
+    m_CacheDec = dec;
+    m_CacheRadius = radius;
+    m_CacheFieldRadius = fieldRadius;
+    m_CacheIndexID = bestID;
+    m_CacheJitter = jitter > 0 ? jitter : DEFAULT_INDEX_JITTER;
+    return true;
+}
+
+bool WCSRefiner::refine(const sip_t &previous, const QList<FITSImage::Star> &stars, int width, int height,
+                        Result &result, QString &error)
+{
+    if(stars.size() < 2)
+    {
+        error = "At least two stars are needed to refine the WCS";
+        return false;
+    }
+    if(!m_HaveIndexInfo && !loadIndexInfo(error))
+        return false;
+
+    double ra, dec;
+    sip_get_radec_center(&previous, &ra, &dec);
+    double pixscale = sip_pixel_scale(&previous);
+    double fieldWidth = std::max(width, height) * pixscale;
+    double fieldRadius = 0.5 * hypot(width, height) * pixscale / 3600.0;
+
+    bool cacheUsable = m_HaveCache &&
+                       fieldRadius < m_CacheFieldRadius * REFINE_SCALE_CHANGE &&
+                       fieldRadius > m_CacheFieldRadius / REFINE_SCALE_CHANGE &&
+                       deg_between_radecdeg(ra, dec, m_CacheRA, m_CacheDec) + fieldRadius <= m_CacheRadius;
+    if(!cacheUsable && !loadReferenceStars(ra, dec, fieldRadius, fieldWidth, error))
+        return false;
+
+    int Nfield = stars.size();
+    QVector<double> fieldxy(2 * Nfield);
+    for(int i = 0; i < Nfield; i++)
+    {
+        fieldxy[2 * i] = stars[i].x;
+        fieldxy[2 * i + 1] = stars[i].y;
+    }
+
+    // The previous solution is trusted over the whole frame, so the "quad" is the frame itself.
+    double qc[2] = { width / 2.0, height / 2.0 };
+    double Q2 = 0.25 * ((double)width * width + (double)height * height);
+
+    int sipOrder = std::max(previous.a_order, 2);
+    int sipInvOrder = std::max(previous.ap_order, 2);
+    int startOrder = std::min(std::max(previous.a_order, 1), sipOrder);
+
+    sip_t startsip = previous;
+    startsip.wcstan.imagew = width;
+    startsip.wcstan.imageh = height;
+
+    if(!m_FitWorkspace)
+        m_FitWorkspace = gslutils_lsq_new();
+
+    int* theta = nullptr;
+    double* odds = nullptr;
+    double logodds = -HUGE_VAL;
+    int besti = -1;
+    int Nref = m_RefRADec.size() / 2;
+    // tweak2 frees the output solution itself when it fails, so let it allocate one.
+    sip_t* sip = tweak2_ws(fieldxy.constData(), Nfield,
+                           DEFAULT_VERIFY_PIX,
+                           width, height,
+                           m_RefRADec.constData(), Nref,
+                           m_CacheJitter, qc, Q2,
+                           DEFAULT_DISTRACTOR_RATIO,
+                           log(DEFAULT_BAIL_THRESHOLD),
+                           sipOrder, sipInvOrder,
+                           &startsip, NULL, &theta, &odds,
+                           NULL, &logodds, &besti, NULL, startOrder,
+                           m_FitWorkspace);
+    if(!sip)
+    {
+        error = "The stars could not be matched to the reference stars";
+        return false;
+    }
+
+    // Every star is counted, not just those up to besti.  tweak2 returns theta in the order of the stars given to it,
+    // while besti counts the stars in the order verify tested them, and the last fit used every star that matched.
+    int matches = 0;
+    for(int i = 0; i < Nfield; i++)
+    {
+        if(theta[i] >= 0)
+            matches++;
+    }
+    free(theta);
+    free(odds);
+
+    result.wcs = *sip;
+    result.logodds = logodds;
+    result.matches = matches;
+    result.references = Nref;
+    result.indexID = m_CacheIndexID;
+    sip_free(sip);
+    return true;
+}
@@ -0,0 +1,105 @@
+/*  WCSRefiner, StellarSolver Internal Library developed by Robert Lancaster, 2020
+
+    This application is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public
+    License as published by the Free Software Foundation; either
+    version 2 of the License, or (at your option) any later version.
+*/
+#pragma once
+
+//Qt Includes
+#include <QList>
+#include <QString>
+#include <QStringList>
+#include <QVector>
+
+//Astrometry.net Includes
+extern "C" {
+#include "astrometry/sip.h"
+}
+
+//Project Includes
+#include "structuredefinitions.h"
+
+struct gslutils_lsq;
+
+/**
+ * @brief The WCSRefiner class updates an existing SIP solution for a new frame of the same field.
+ * Instead of searching for quads, it matches the frame's stars against the index reference stars
+ * around the previous field center and refits the SIP polynomial with tweak2.  The reference stars
+ * are cached, so successive frames that stay inside the cached area do not touch the index files.
+ */
+class WCSRefiner
+{
+    public:
+        WCSRefiner();
+        ~WCSRefiner();
+
+        // This is the outcome of one refinement
+        typedef struct
+        {
+            sip_t wcs;          // The refined solution, in full resolution image pixels
+            double logodds;     // The log odds that the matches are real
+            int matches;        // The number of image stars matched to reference stars
+            int references;     // The number of reference stars that were available
+            short indexID;      // The index series the reference stars came from
+        } Result;
+
+        /**
+         * @brief setIndexFiles sets the index files that reference stars are taken from.  Changing
+         * the list drops any cached reference stars.
+         * @param indexFiles The paths of the index files
+         */
+        void setIndexFiles(const QStringList &indexFiles);
+
+        /**
+         * @brief refine fits a new SIP solution for a frame starting from the previous one
+         * @param previous The previous solution, in full resolution image pixels
+         * @param stars The stars extracted from the new frame, brightest first
+         * @param width The width of the frame in pixels
+         * @param height The height of the frame in pixels
+         * @param result Where the new solution and its statistics are stored
+         * @param error A description of the problem if it fails
+         * @return true if a new solution was fit
+         */
+        bool refine(const sip_t &previous, const QList<FITSImage::Star> &stars, int width, int height,
+                    Result &result, QString &error);
+
+        /**
+         * @brief clearCache drops the cached reference stars, so the next frame reloads them
+         */
+        void clearCache();
+
+    private:
+        // The metadata of one index file, read once
+        typedef struct
+        {
+            QString path;
+            int indexID;
+            int healpix;
+            int hpnside;
+            double jitter;      // arcseconds
+            double scaleLower;  // arcseconds
+            double scaleUpper;  // arcseconds
+        } IndexInfo;
+
+        bool loadIndexInfo(QString &error);
+        bool loadReferenceStars(double ra, double dec, double fieldRadius, double fieldWidth, QString &error);
+
+        QStringList m_IndexFiles;
+        QVector<IndexInfo> m_IndexInfo;
+        bool m_HaveIndexInfo {false};
+
+        // The cached reference stars, ra0,dec0,ra1,dec1,... in degrees, and the area they cover
+        QVector<double> m_RefRADec;
+        bool m_HaveCache {false};
+        double m_CacheRA {0};
+        double m_CacheDec {0};
+        double m_CacheRadius {0};       // degrees
+        double m_CacheFieldRadius {0};  // degrees, the field radius the index was chosen for
+        int m_CacheIndexID {-1};
+        double m_CacheJitter {0};
+
+        // The least-squares workspace that tweak2 reuses from frame to frame
+        struct gslutils_lsq *m_FitWorkspace {nullptr};
+};
@@ -0,0 +1,422 @@
+#include "testbackground.h"
+#include "testhelpers.h"
+#include "sep/sepcore.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <chrono>
+#include <thread>
+
+using namespace SEP;
+using namespace TestHelpers;
+
+TestBackground::TestBackground()
+{
+}
+
+// SEP runs its blocks on the executor it is given, here one thread for each
+static void runOnThreads(void (*fn)(void *, int), void *arg, int n)
+{
+    std::vector<std::thread> threads;
+    for (int block = 1; block < n; block++)
+        threads.emplace_back(fn, arg, block);
+    fn(arg, 0);
+    for (auto &thread : threads)
+        thread.join();
+}
+
+static sep_image makeSepImage(void *data, int dtype, int w, int h, int threads)
+{
+    sep_image im;
+    memset(&im, 0, sizeof(im));
+    im.data = data;
+    im.dtype = dtype;
+    im.raw_w = w;
+    im.raw_h = h;
+    im.w = w;
+    im.h = h;
+    im.noise_type = SEP_NOISE_NONE;
+    im.noiseval = 1.0;
+    im.nthreads = threads;
+    im.executor = runOnThreads;
+    return im;
+}
+
+// ==========================================
+// 1. Threaded results equal serial ones
+// ==========================================
+bool TestBackground::runThreadsMatchSerial(int dtype, int threads)
+{
+    srand(5);
+    width = TEST_W;
+    height = TEST_H;
+    image = makeStarField<float>(width, height, 800, 40, 3000);
+    std::vector<int> ints(image.size());
+    for (size_t i = 0; i < image.size(); i++)
+        ints[i] = (int)image[i];
+    void *data = (dtype == SEP_TFLOAT) ? (void *)image.data() : (void *)ints.data();
+
+    sep_bkg *serial = nullptr, *threaded = nullptr;
+    sep_image im1 = makeSepImage(data, dtype, width, height, 1);
+    sep_image imN = makeSepImage(data, dtype, width, height, threads);
+    if (sep_background(&im1, 64, 64, 3, 3, 0.0, &serial) != 0 ||
+            sep_background(&imN, 64, 64, 3, 3, 0.0, &threaded) != 0)
+    {
+        printf("ERROR: sep_background failed\n");
+        sep_bkg_free(serial);
+        sep_bkg_free(threaded);
+        return false;
+    }
+
+    bool passed = true;
+    size_t n = serial->n * sizeof(float);
+    if (memcmp(serial->back, threaded->back, n) || memcmp(serial->sigma, threaded->sigma, n) ||
+            memcmp(serial->dback, threaded->dback, n) || memcmp(serial->dsigma, threaded->dsigma, n) ||
+            serial->global != threaded->global || serial->globalrms != threaded->globalrms)
+    {
+        printf("ERROR: the mesh statistics differ with %d threads\n", threads);
+        passed = false;
+    }
+
+    std::vector<float> back1((size_t)width * height), backN((size_t)width * height);
+    sep_bkg_array(serial, back1.data(), SEP_TFLOAT);
+    sep_bkg_array(threaded, backN.data(), SEP_TFLOAT);
+    if (memcmp(back1.data(), backN.data(), back1.size() * sizeof(float)))
+    {
+        printf("ERROR: sep_bkg_array differs with %d threads\n", threads);
+        passed = false;
+    }
+    sep_bkg_rmsarray(serial, back1.data(), SEP_TFLOAT);
+    sep_bkg_rmsarray(threaded, backN.data(), SEP_TFLOAT);
+    if (memcmp(back1.data(), backN.data(), back1.size() * sizeof(float)))
+    {
+        printf("ERROR: sep_bkg_rmsarray differs with %d threads\n", threads);
+        passed = false;
+    }
+
+    std::vector<float> sub1 = image, subN = image;
+    sep_bkg_subarray(serial, sub1.data(), SEP_TFLOAT);
+    sep_bkg_subarray(threaded, subN.data(), SEP_TFLOAT);
+    if (memcmp(sub1.data(), subN.data(), sub1.size() * sizeof(float)))
+    {
+        printf("ERROR: sep_bkg_subarray differs with %d threads\n", threads);
+        passed = false;
+    }
+
+    sep_bkg_free(serial);
+    sep_bkg_free(threaded);
+    return passed;
+}
+
+// ==========================================
+// 2. A 16-bit window of a wider frame, read in place
+// ==========================================
+bool TestBackground::runSubImageMatchesCopy()
+{
+    srand(9);
+    width = TEST_W;
+    height = TEST_H;
+    image = makeStarField<float>(width, height, 800, 40, 3000);
+    std::vector<uint16_t> frame(image.size());
+    for (size_t i = 0; i < image.size(); i++)
+        frame[i] = (uint16_t)image[i];
+
+    const int startX = 123, startY = 77, subW = 610, subH = 455;
+    std::vector<float> copy((size_t)subW * subH);
+    for (int y = 0; y < subH; y++)
+        for (int x = 0; x < subW; x++)
+            copy[(size_t)y * subW + x] = frame[(size_t)(y + startY) * width + x + startX];
+
+    sep_image inPlace = makeSepImage(&frame[(size_t)startY * width + startX], SEP_TUSHORT, subW, subH, 3);
+    inPlace.raw_w = width;
+    inPlace.raw_h = height;
+    sep_image copied = makeSepImage(copy.data(), SEP_TFLOAT, subW, subH, 1);
+
+    sep_bkg *a = nullptr, *b = nullptr;
+    if (sep_background(&inPlace, 64, 64, 3, 3, 0.0, &a) != 0 ||
+            sep_background(&copied, 64, 64, 3, 3, 0.0, &b) != 0)
+    {
+        printf("ERROR: sep_background failed\n");
+        sep_bkg_free(a);
+        sep_bkg_free(b);
+        return false;
+    }
+
+    bool passed = true;
+    size_t n = a->n * sizeof(float);
+    if (memcmp(a->back, b->back, n) || memcmp(a->sigma, b->sigma, n) ||
+            a->global != b->global || a->globalrms != b->globalrms)
+    {
+        printf("ERROR: the background of the window differs from the background of its float copy\n");
+        passed = false;
+    }
+    sep_bkg_free(a);
+    sep_bkg_free(b);
+    return passed;
+}
+
+// ==========================================
+// 3. Parts of a line match the whole line
+// ==========================================
+bool TestBackground::runSpanMatchesLine(int bw)
+{
+    srand(3);
+    width = TEST_W;
+    height = TEST_H;
+    image = makeStarField<float>(width, height, 800, 40, 3000);
+    sep_image im = makeSepImage(image.data(), SEP_TFLOAT, width, height, 1);
+    sep_bkg *bkg = nullptr;
+    if (sep_background(&im, bw, bw, 3, 3, 0.0, &bkg) != 0)
+    {
+        printf("ERROR: sep_background failed\n");
+        return false;
+    }
+
+    bool passed = true;
+    std::vector<float> line(width), span(width);
+    for (int y = 0; y < height && passed; y += 37)
+    {
+        sep_bkg_line(bkg, y, line.data(), SEP_TFLOAT);
+        for (int xmin = 0; xmin < width && passed; xmin += 13)
+        {
+            int xmax = std::min(width, xmin + 1 + (xmin * 7) % 150);
+            bkg_line_span(bkg, y, xmin, xmax, span.data());
+            for (int x = xmin; x < xmax; x++)
+            {
+                if (fabs(span[x - xmin] - line[x]) > 1e-3)
+                {
+                    printf("ERROR: with %d pixel meshes, pixel %d,%d of the span from %d is %f, the line has %f\n",
+                           bw, x, y, xmin, span[x - xmin], line[x]);
+                    passed = false;
+                    break;
+                }
+            }
+        }
+    }
+    sep_bkg_free(bkg);
+    return passed;
+}
+
+// ==========================================
+// 4. Timing on a large frame
+// ==========================================
+bool TestBackground::runBenchmark()
+{
+    srand(11);
+    width = BENCH_W;
+    height = BENCH_H;
+    image = makeStarField<float>(width, height, 800, 40, 3000);
+    int threads = std::max(1u, std::thread::hardware_concurrency());
+    std::vector<float> back((size_t)width * height);
+
+    for (int t : {1, threads})
+    {
+        sep_image im = makeSepImage(image.data(), SEP_TFLOAT, width, height, t);
+        sep_bkg *bkg = nullptr;
+        auto start = std::chrono::steady_clock::now();
+        if (sep_background(&im, 64, 64, 3, 3, 0.0, &bkg) != 0)
+        {
+            printf("ERROR: sep_background failed\n");
+            return false;
+        }
+        auto mid = std::chrono::steady_clock::now();
+        sep_bkg_array(bkg, back.data(), SEP_TFLOAT);
+        auto end = std::chrono::steady_clock::now();
+        printf("%dx%d with %2d threads: %8.1f ms sep_background, %8.1f ms sep_bkg_array\n", width, height, t,
+               std::chrono::duration<double, std::milli>(mid - start).count(),
+               std::chrono::duration<double, std::milli>(end - mid).count());
+        fflush(stdout);
+        sep_bkg_free(bkg);
+        if (t == threads)
+            break;
+    }
+    return true;
+}
+
+// The median the way fqmedian used to find it, by sorting the whole array
+static int floatCompare(const void *p1, const void *p2)
+{
+    float f1 = *((const float *)p1);
+    float f2 = *((const float *)p2);
+    return f1 > f2 ? 1 : (f1 < f2 ? -1 : 0);
+}
+
+static float sortedMedian(float *ra, int n)
+{
+    qsort(ra, n, sizeof(float), floatCompare);
+    if (n < 2)
+        return *ra;
+    return n & 1 ? ra[n / 2] : (ra[n / 2 - 1] + ra[n / 2]) / 2.0;
+}
+
+// ==========================================
+// 6. Selected medians equal sorted ones
+// ==========================================
+bool TestBackground::runMedianMatchesSort()
+{
+    srand(17);
+    bool passed = true;
+    std::vector<float> a, b;
+    for (int n = 1; n <= 200 && passed; n++)
+    {
+        for (int trial = 0; trial < 20; trial++)
+        {
+            a.resize(n);
+            // Few distinct values now and then, so there are ties around the median
+            const int range = (trial % 4 == 0) ? 5 : RAND_MAX;
+            for (int i = 0; i < n; i++)
+                a[i] = (float)(rand() % range) - range / 2.0f;
+            b = a;
+            float selected = fqmedian(a.data(), n);
+            float sorted = sortedMedian(b.data(), n);
+            if (selected != sorted)
+            {
+                printf("ERROR: the median of %d values is %f, sorting gives %f\n", n, selected, sorted);
+                passed = false;
+                break;
+            }
+        }
+    }
+    return passed;
+}
+
+// ==========================================
+// 7. Median benchmark
+// ==========================================
+bool TestBackground::runMedianBenchmark()
+{
+    // The 3x3 filter windows of the mesh map, and the map of a 4096x4096 image cut into 64x64 meshes
+    srand(23);
+    bool passed = true;
+    for (int n : {9, 64 * 64})
+    {
+        const int repeats = n < 100 ? 200000 : 2000;
+        std::vector<float> data((size_t)n * 16), work(n);
+        for (auto &v : data)
+            v = 800.0f + 40.0f * ((float)rand() / RAND_MAX);
+
+        double selectedSum = 0, sortedSum = 0;
+        auto start = std::chrono::steady_clock::now();
+        for (int r = 0; r < repeats; r++)
+        {
+            memcpy(work.data(), data.data() + (size_t)(r % 16) * n, n * sizeof(float));
+            selectedSum += fqmedian(work.data(), n);
+        }
+        auto mid = std::chrono::steady_clock::now();
+        for (int r = 0; r < repeats; r++)
+        {
+            memcpy(work.data(), data.data() + (size_t)(r % 16) * n, n * sizeof(float));
+            sortedSum += sortedMedian(work.data(), n);
+        }
+        auto end = std::chrono::steady_clock::now();
+
+        const double selectedMs = std::chrono::duration<double, std::milli>(mid - start).count();
+        const double sortedMs = std::chrono::duration<double, std::milli>(end - mid).count();
+        printf("%d medians of %4d values: %8.1f ms selected, %8.1f ms sorted (%.1fx)\n", repeats, n,
+               selectedMs, sortedMs, selectedMs > 0 ? sortedMs / selectedMs : 0.0);
+        fflush(stdout);
+        if (selectedSum != sortedSum)
+        {
+            printf("ERROR: the selected and sorted medians differ\n");
+            passed = false;
+        }
+    }
+    return passed;
+}
+
+// ==========================================
+// 8. Drift of a kept background
+// ==========================================
+bool TestBackground::runDriftCheck()
+{
+    // The sky is brighter on every other mesh, which the median filter of the map smooths away.  The drift check has
+    // to compare with the meshes as they were measured, or it would see that structure as drift on every frame.
+    auto addPattern = [this]()
+    {
+        for (int y = 0; y < height; y++)
+            for (int x = 0; x < width; x++)
+                if ((x / 64 + y / 64) % 2)
+                    image[(size_t)y * width + x] += 30.0f;
+    };
+    srand(29);
+    width = TEST_W;
+    height = TEST_H;
+    image = makeStarField<float>(width, height, 800, 40, 3000);
+    addPattern();
+    std::vector<float> first = image;
+    sep_image im = makeSepImage(first.data(), SEP_TFLOAT, width, height, 1);
+    sep_bkg *bkg = nullptr;
+    float *meshBack = nullptr, *meshSigma = nullptr;
+    if (sep_background_meshes(&im, 64, 64, 3, 3, 0.0, &bkg, &meshBack, &meshSigma) != 0)
+    {
+        printf("ERROR: sep_background_meshes failed\n");
+        return false;
+    }
+
+    // A new frame of the same sky with new noise, then the same frame with the sky brighter by half the rms
+    srand(31);
+    width = TEST_W;
+    height = TEST_H;
+    image = makeStarField<float>(width, height, 800, 40, 3000);
+    addPattern();
+    std::vector<float> brighter = image;
+    for (auto &v : brighter)
+        v += 0.5f * bkg->globalrms;
+
+    float same = 0, shifted = 0;
+    sep_image sameIm = makeSepImage(image.data(), SEP_TFLOAT, width, height, 1);
+    sep_image shiftedIm = makeSepImage(brighter.data(), SEP_TFLOAT, width, height, 1);
+    bool passed = sep_bkg_drift(&sameIm, bkg, meshBack, meshSigma, 4, &same) == 0 &&
+                  sep_bkg_drift(&shiftedIm, bkg, meshBack, meshSigma, 4, &shifted) == 0;
+    printf("Drift of the same sky %.3f sigma, of a brighter sky %.3f sigma\n", same, shifted);
+    if (!passed || same > 0.1f || shifted < 0.4f || shifted > 0.6f)
+    {
+        printf("ERROR: the drift check did not tell the stable sky from the brighter one\n");
+        passed = false;
+    }
+    sep_bkg_free(bkg);
+    free(meshBack);
+    free(meshSigma);
+    return passed;
+}
+
+int main(int argc, char *argv[])
+{
+    TestBackground test;
+
+    printf("Starting SEP background test suite...\n");
+    fflush(stdout);
+
+    bool floats = test.runThreadsMatchSerial(SEP_TFLOAT, 4) && test.runThreadsMatchSerial(SEP_TFLOAT, 7);
+    bool ints = test.runThreadsMatchSerial(SEP_TINT, 4) && test.runThreadsMatchSerial(SEP_TINT, 7);
+    bool window = test.runSubImageMatchesCopy();
+    bool spans = test.runSpanMatchesLine(64) && test.runSpanMatchesLine(37);
+    bool runBenchmark = TestHelpers::benchmarksRequested(argc, argv);
+    bool benchmark = !runBenchmark || test.runBenchmark();
+    bool medians = test.runMedianMatchesSort();
+    bool medianBenchmark = !runBenchmark || test.runMedianBenchmark();
+    bool drift = test.runDriftCheck();
+
+    printf("\n========================================\n");
+    printf("SEP BACKGROUND TEST SUITE SUMMARY:\n");
+    printf("1. Threaded background matches (float):  %s\n", floats ? "PASSED" : "FAILED");
+    printf("2. Threaded background matches (int):    %s\n", ints ? "PASSED" : "FAILED");
+    printf("3. 16-bit window matches float copy:     %s\n", window ? "PASSED" : "FAILED");
+    printf("4. Line spans match whole lines:         %s\n", spans ? "PASSED" : "FAILED");
+    printf("5. Benchmark ran:                        %s\n", TestHelpers::benchmarkResult(runBenchmark, benchmark));
+    printf("6. Selected medians match sorted:        %s\n", medians ? "PASSED" : "FAILED");
+    printf("7. Median benchmark ran:                 %s\n", TestHelpers::benchmarkResult(runBenchmark, medianBenchmark));
+    printf("8. Background drift is measured:         %s\n", drift ? "PASSED" : "FAILED");
+    printf("========================================\n");
+    fflush(stdout);
+
+    if (floats && ints && window && spans && benchmark && medians && medianBenchmark && drift)
+    {
+        printf("All SEP background tests passed successfully!\n");
+        return 0;
+    }
+    printf("Some SEP background tests FAILED!\n");
+    return 1;
+}
@@ -0,0 +1,27 @@
+#ifndef TESTBACKGROUND_H
+#define TESTBACKGROUND_H
+
+#include <stdio.h>
+#include <vector>
+
+#include "sep/sep.h"
+
+class TestBackground
+{
+public:
+    TestBackground();
+    bool runThreadsMatchSerial(int dtype, int threads);
+    bool runSubImageMatchesCopy();
+    bool runSpanMatchesLine(int bw);
+    bool runBenchmark();
+    bool runMedianMatchesSort();
+    bool runMedianBenchmark();
+    bool runDriftCheck();
+
+private:
+    int width { 0 };
+    int height { 0 };
+    std::vector<float> image;
+};
+
+#endif // TESTBACKGROUND_H
@@ -0,0 +1,222 @@
+#include "testconvolve.h"
+#include "testhelpers.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <chrono>
+
+using namespace SEP;
+using namespace TestHelpers;
+
+// The Gaussian kernel StellarSolver::generateConvFilter makes, size 2 * fwhm + 1
+static std::vector<float> gaussianKernel(int fwhm, int &size)
+{
+    size = 2 * fwhm + 1;
+    double sigma = fwhm / 2.355;
+    std::vector<float> kernel(size * size);
+    for (int y = 0; y < size; y++)
+        for (int x = 0; x < size; x++)
+        {
+            double dx = x - fwhm, dy = y - fwhm;
+            kernel[y * size + x] = exp(-(dx * dx + dy * dy) / (2 * sigma * sigma));
+        }
+    return kernel;
+}
+
+// The normalization sep_extract applies before filtering
+static void normalize(std::vector<float> &kernel)
+{
+    double sum = 0;
+    for (float k : kernel)
+        sum += fabs(k);
+    for (float &k : kernel)
+        k /= sum;
+}
+
+TestConvolve::TestConvolve()
+{
+}
+
+// An arraybuffer holding the whole image, so every line is always available
+arraybuffer TestConvolve::makeBuffer(std::vector<float> &data)
+{
+    arraybuffer buf;
+    memset(&buf, 0, sizeof(buf));
+    buf.dw = width;
+    buf.dh = height;
+    buf.bw = width + 1;
+    buf.bh = height;
+    buf.bptr = data.data();
+    buf.yoff = 0;
+    return buf;
+}
+
+// ==========================================
+// 1. Separable kernels are recognized
+// ==========================================
+bool TestConvolve::runSeparabilityDetection()
+{
+    bool passed = true;
+    float h[9], v[9];
+
+    float defaultFilter[9] = {1, 2, 1, 2, 4, 2, 1, 2, 1};
+    if (!conv_separate(defaultFilter, 3, 3, h, v))
+    {
+        printf("ERROR: the default 3x3 filter was not found separable\n");
+        passed = false;
+    }
+    for (int fwhm = 1; fwhm <= 4; fwhm++)
+    {
+        int size;
+        std::vector<float> kernel = gaussianKernel(fwhm, size);
+        if (!conv_separate(kernel.data(), size, size, h, v))
+        {
+            printf("ERROR: the %dx%d Gaussian was not found separable\n", size, size);
+            passed = false;
+        }
+    }
+
+    // A top hat is a disk, which is not an outer product
+    float tophat[25];
+    for (int y = 0; y < 5; y++)
+        for (int x = 0; x < 5; x++)
+            tophat[y * 5 + x] = ((x - 2) * (x - 2) + (y - 2) * (y - 2) <= 4) ? 1 : 0;
+    if (conv_separate(tophat, 5, 5, h, v))
+    {
+        printf("ERROR: the 5x5 top hat was found separable\n");
+        passed = false;
+    }
+    return passed;
+}
+
+// ==========================================
+// 2. The two-pass filters match the 2D ones
+// ==========================================
+bool TestConvolve::runSeparableMatches(int fwhm, bool matched)
+{
+    srand(fwhm);
+    width = TEST_W;
+    height = TEST_H;
+    image = makeStarField<float>(width, height, 985, 30, 5000, width + 1);
+    noise = makeStarField<float>(width, height, 5, 1, 0, width + 1);
+    int size;
+    std::vector<float> kernel = gaussianKernel(fwhm, size);
+    normalize(kernel);
+    std::vector<float> h(size), v(size);
+    conv_separate(kernel.data(), size, size, h.data(), v.data());
+
+    arraybuffer imbuf = makeBuffer(image);
+    arraybuffer nbuf = makeBuffer(noise);
+    std::vector<float> full(width + 1), sep(width + 1);
+    std::vector<float> work(width + 1), work2(width + 1), work3(width + 1);
+
+    double worst = 0;
+    for (int y = 0; y < height; y++)
+    {
+        int s1, s2;
+        if (matched)
+        {
+            s1 = matched_filter(&imbuf, &nbuf, y, kernel.data(), size, size, work.data(), full.data(),
+                                SEP_NOISE_STDDEV);
+            s2 = matched_filter_separable(&imbuf, &nbuf, y, h.data(), size, v.data(), size, work.data(),
+                                          work2.data(), work3.data(), sep.data(), SEP_NOISE_STDDEV);
+        }
+        else
+        {
+            s1 = convolve(&imbuf, y, kernel.data(), size, size, full.data());
+            s2 = convolve_separable(&imbuf, y, h.data(), size, v.data(), size, work.data(), sep.data());
+        }
+        if (s1 != RETURN_OK || s2 != RETURN_OK)
+        {
+            printf("ERROR: filtering line %d failed (%d, %d)\n", y, s1, s2);
+            return false;
+        }
+        for (int x = 0; x < width; x++)
+            worst = fmax(worst, fabs(full[x] - sep[x]) / fmax(fabs(full[x]), 1e-6));
+    }
+    if (worst > 1e-4)
+    {
+        printf("ERROR: %s with a %dx%d Gaussian differs by %g relative\n",
+               matched ? "matched filter" : "convolution", size, size, worst);
+        return false;
+    }
+    return true;
+}
+
+// ==========================================
+// 3. Timing on a large frame
+// ==========================================
+bool TestConvolve::runBenchmark(int fwhm)
+{
+    srand(99);
+    width = BENCH_W;
+    height = BENCH_H;
+    image = makeStarField<float>(width, height, 985, 30, 5000, width + 1);
+    int size;
+    std::vector<float> kernel = gaussianKernel(fwhm, size);
+    normalize(kernel);
+    std::vector<float> h(size), v(size);
+    conv_separate(kernel.data(), size, size, h.data(), v.data());
+
+    arraybuffer imbuf = makeBuffer(image);
+    std::vector<float> out(width + 1), work(width + 1);
+    double checksum1 = 0, checksum2 = 0;
+
+    auto start = std::chrono::steady_clock::now();
+    for (int y = 0; y < height; y++)
+    {
+        convolve(&imbuf, y, kernel.data(), size, size, out.data());
+        checksum1 += out[y % width];
+    }
+    auto mid = std::chrono::steady_clock::now();
+    for (int y = 0; y < height; y++)
+    {
+        convolve_separable(&imbuf, y, h.data(), size, v.data(), size, work.data(), out.data());
+        checksum2 += out[y % width];
+    }
+    auto end = std::chrono::steady_clock::now();
+
+    double full = std::chrono::duration<double, std::milli>(mid - start).count();
+    double sep = std::chrono::duration<double, std::milli>(end - mid).count();
+    printf("%dx%d kernel on %dx%d: %8.1f ms 2D, %8.1f ms separable (%.1fx)\n",
+           size, size, width, height, full, sep, full / sep);
+    fflush(stdout);
+    return fabs(checksum1 - checksum2) <= 1e-4 * fabs(checksum1);
+}
+
+int main(int argc, char *argv[])
+{
+    TestConvolve test;
+    bool detection, convolution = true, matched = true, benchmarks = true;
+
+    printf("Starting SEP convolution test suite...\n");
+    fflush(stdout);
+
+    detection = test.runSeparabilityDetection();
+    for (int fwhm = 1; fwhm <= 4; fwhm++)
+    {
+        convolution = test.runSeparableMatches(fwhm, false) && convolution;
+        matched = test.runSeparableMatches(fwhm, true) && matched;
+    }
+    bool runBenchmark = TestHelpers::benchmarksRequested(argc, argv);
+    for (int fwhm = 1; fwhm <= 4 && runBenchmark; fwhm++)
+        benchmarks = test.runBenchmark(fwhm) && benchmarks;
+
+    printf("\n========================================\n");
+    printf("SEP CONVOLUTION TEST SUITE SUMMARY:\n");
+    printf("1. Separable kernels detected:      %s\n", detection ? "PASSED" : "FAILED");
+    printf("2. Separable convolution matches:   %s\n", convolution ? "PASSED" : "FAILED");
+    printf("3. Separable matched filter matches: %s\n", matched ? "PASSED" : "FAILED");
+    printf("4. Benchmark results agree:         %s\n", TestHelpers::benchmarkResult(runBenchmark, benchmarks));
+    printf("========================================\n");
+    fflush(stdout);
+
+    if (detection && convolution && matched && benchmarks)
+    {
+        printf("All SEP convolution tests passed successfully!\n");
+        return 0;
+    }
+    printf("Some SEP convolution tests FAILED!\n");
+    return 1;
+}
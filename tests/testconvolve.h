@@ -0,0 +1,26 @@
+#ifndef TESTCONVOLVE_H
+#define TESTCONVOLVE_H
+
+#include <stdio.h>
+#include <vector>
+
+#include "sep/sep.h"
+#include "sep/sepcore.h"
+
+class TestConvolve
+{
+public:
+    TestConvolve();
+    bool runSeparabilityDetection();
+    bool runSeparableMatches(int fwhm, bool matched);
+    bool runBenchmark(int fwhm);
+
+private:
+    SEP::arraybuffer makeBuffer(std::vector<float> &data);
+    int width { 0 };
+    int height { 0 };
+    std::vector<float> image;
+    std::vector<float> noise;
+};
+
+#endif // TESTCONVOLVE_H
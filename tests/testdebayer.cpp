@@ -0,0 +1,187 @@
+#include "testdebayer.h"
+#include "testhelpers.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <algorithm>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+using namespace TestHelpers;
+
+// A bayer image is made of whole 2x2 cells, the whole image decoders read past the end of an odd sized one
+static constexpr int BAYER_W = TEST_W & ~1;
+static constexpr int BAYER_H = TEST_H & ~1;
+static const dc1394color_filter_t FILTERS[] = { DC1394_COLOR_FILTER_RGGB, DC1394_COLOR_FILTER_GBRG,
+                                                DC1394_COLOR_FILTER_GRBG, DC1394_COLOR_FILTER_BGGR };
+static const char *METHOD_NAMES[] = { "nearest", "simple", "bilinear", "hqlinear", "downsample", "edgesense", "vng", "ahd" };
+
+TestDebayer::TestDebayer()
+{
+}
+
+static dc1394error_t decodeRows(const uint8_t *bayer, uint8_t *rgb, int w, int h, int firstRow, int numRows,
+                                dc1394color_filter_t filter, dc1394bayer_method_t method)
+{
+    return dc1394_bayer_decoding_8bit_rows(bayer, rgb, w, h, firstRow, numRows, filter, method);
+}
+
+static dc1394error_t decodeRows(const uint16_t *bayer, uint16_t *rgb, int w, int h, int firstRow, int numRows,
+                                dc1394color_filter_t filter, dc1394bayer_method_t method)
+{
+    return dc1394_bayer_decoding_16bit_rows(bayer, rgb, w, h, firstRow, numRows, filter, method, 16);
+}
+
+static dc1394error_t decodeWhole(const uint8_t *bayer, uint8_t *rgb, int w, int h, dc1394color_filter_t filter,
+                                 dc1394bayer_method_t method)
+{
+    return dc1394_bayer_decoding_8bit(bayer, rgb, w, h, filter, method);
+}
+
+static dc1394error_t decodeWhole(const uint16_t *bayer, uint16_t *rgb, int w, int h, dc1394color_filter_t filter,
+                                 dc1394bayer_method_t method)
+{
+    return dc1394_bayer_decoding_16bit(bayer, rgb, w, h, filter, method, 16);
+}
+
+// Each thread decodes one band of rows, the way fileio does
+template <typename T>
+static bool decodeBands(const std::vector<T> &bayer, std::vector<T> &rgb, int w, int h, int bands,
+                        dc1394color_filter_t filter, dc1394bayer_method_t method)
+{
+    std::vector<std::thread> workers;
+    std::vector<dc1394error_t> errors(bands, DC1394_SUCCESS);
+    for (int b = 0; b < bands; b++)
+    {
+        int firstRow = h * b / bands;
+        int lastRow = h * (b + 1) / bands;
+        workers.emplace_back([&, b, firstRow, lastRow]()
+        {
+            errors[b] = decodeRows(bayer.data(), rgb.data() + (size_t)firstRow * w * 3, w, h, firstRow, lastRow - firstRow,
+                                   filter, method);
+        });
+    }
+    for (auto &worker : workers)
+        worker.join();
+    return std::all_of(errors.begin(), errors.end(), [](dc1394error_t e)
+    {
+        return e == DC1394_SUCCESS;
+    });
+}
+
+template <typename T>
+static bool bandsMatchWhole(dc1394bayer_method_t method)
+{
+    bool passed = true;
+    std::vector<T> bayer = makeNoise<T>((size_t)BAYER_W * BAYER_H);
+    for (dc1394color_filter_t filter : FILTERS)
+    {
+        // Some methods leave the edges alone, so the whole image is decoded into a zeroed buffer
+        std::vector<T> whole((size_t)BAYER_W * BAYER_H * 3, 0);
+        if (decodeWhole(bayer.data(), whole.data(), BAYER_W, BAYER_H, filter, method) != DC1394_SUCCESS)
+        {
+            printf("ERROR: %s failed on the whole %d bit image\n", METHOD_NAMES[method], (int)sizeof(T) * 8);
+            passed = false;
+            continue;
+        }
+        for (int bands : {2, 5, 7, 16})
+        {
+            std::vector<T> banded(whole.size(), 1);
+            if (!decodeBands(bayer, banded, BAYER_W, BAYER_H, bands, filter, method))
+            {
+                printf("ERROR: %s failed on %d bands of the %d bit image\n", METHOD_NAMES[method], bands, (int)sizeof(T) * 8);
+                passed = false;
+            }
+            else if (memcmp(whole.data(), banded.data(), whole.size() * sizeof(T)) != 0)
+            {
+                printf("ERROR: %s on %d bands of the %d bit image with filter %d differs from the whole image\n",
+                       METHOD_NAMES[method], bands, (int)sizeof(T) * 8, (int)filter);
+                passed = false;
+            }
+        }
+    }
+    return passed;
+}
+
+// ==========================================
+// 1. Bands of rows match the whole image
+// ==========================================
+bool TestDebayer::runBandsMatchWhole(dc1394bayer_method_t method)
+{
+    srand(17);
+    if (method == DC1394_BAYER_METHOD_AHD)
+        dc1394_bayer_AHD_init();
+    return bandsMatchWhole<uint8_t>(method) && bandsMatchWhole<uint16_t>(method);
+}
+
+// ==========================================
+// 2. Benchmark of one thread against bands
+// ==========================================
+bool TestDebayer::runBenchmark(dc1394bayer_method_t method)
+{
+    srand(19);
+    std::vector<uint16_t> bayer = makeNoise<uint16_t>((size_t)BENCH_W * BENCH_H);
+    std::vector<uint16_t> rgb((size_t)BENCH_W * BENCH_H * 3);
+    int threads = std::max(1u, std::thread::hardware_concurrency());
+
+    double wholeMs = HUGE_VAL, bandsMs = HUGE_VAL;
+    for (int r = 0; r < BENCH_RUNS; r++)
+    {
+        auto start = std::chrono::steady_clock::now();
+        if (decodeWhole(bayer.data(), rgb.data(), BENCH_W, BENCH_H, DC1394_COLOR_FILTER_RGGB, method) != DC1394_SUCCESS)
+            return false;
+        auto mid = std::chrono::steady_clock::now();
+        if (!decodeBands(bayer, rgb, BENCH_W, BENCH_H, threads, DC1394_COLOR_FILTER_RGGB, method))
+            return false;
+        auto end = std::chrono::steady_clock::now();
+        wholeMs = std::min(wholeMs, std::chrono::duration<double, std::milli>(mid - start).count());
+        bandsMs = std::min(bandsMs, std::chrono::duration<double, std::milli>(end - mid).count());
+    }
+    printf("%dx%d 16 bit %-9s whole image: %8.1f ms, %2d bands: %8.1f ms (%.1fx)\n", BENCH_W, BENCH_H,
+           METHOD_NAMES[method], wholeMs, threads, bandsMs, wholeMs / bandsMs);
+    fflush(stdout);
+    return true;
+}
+
+int main(int argc, char *argv[])
+{
+    TestDebayer test;
+
+    printf("Starting debayer test suite...\n");
+    fflush(stdout);
+
+    bool nearest = test.runBandsMatchWhole(DC1394_BAYER_METHOD_NEAREST);
+    bool simple = test.runBandsMatchWhole(DC1394_BAYER_METHOD_SIMPLE);
+    bool bilinear = test.runBandsMatchWhole(DC1394_BAYER_METHOD_BILINEAR);
+    bool hqlinear = test.runBandsMatchWhole(DC1394_BAYER_METHOD_HQLINEAR);
+    bool edgesense = test.runBandsMatchWhole(DC1394_BAYER_METHOD_EDGESENSE);
+    bool vng = test.runBandsMatchWhole(DC1394_BAYER_METHOD_VNG);
+    bool ahd = test.runBandsMatchWhole(DC1394_BAYER_METHOD_AHD);
+    bool runBenchmark = TestHelpers::benchmarksRequested(argc, argv);
+    bool benchmark = !runBenchmark || (test.runBenchmark(DC1394_BAYER_METHOD_NEAREST) &&
+                                       test.runBenchmark(DC1394_BAYER_METHOD_BILINEAR) && test.runBenchmark(DC1394_BAYER_METHOD_HQLINEAR));
+
+    printf("\n========================================\n");
+    printf("DEBAYER TEST SUITE SUMMARY:\n");
+    printf("1. Bands match whole (nearest):   %s\n", nearest ? "PASSED" : "FAILED");
+    printf("2. Bands match whole (simple):    %s\n", simple ? "PASSED" : "FAILED");
+    printf("3. Bands match whole (bilinear):  %s\n", bilinear ? "PASSED" : "FAILED");
+    printf("4. Bands match whole (hqlinear):  %s\n", hqlinear ? "PASSED" : "FAILED");
+    printf("5. Bands match whole (edgesense): %s\n", edgesense ? "PASSED" : "FAILED");
+    printf("6. Bands match whole (vng):       %s\n", vng ? "PASSED" : "FAILED");
+    printf("7. Bands match whole (ahd):       %s\n", ahd ? "PASSED" : "FAILED");
+    printf("8. Benchmark:                     %s\n", TestHelpers::benchmarkResult(runBenchmark, benchmark));
+    printf("========================================\n");
+    fflush(stdout);
+
+    if (nearest && simple && bilinear && hqlinear && edgesense && vng && ahd && benchmark)
+    {
+        printf("All debayer tests passed successfully!\n");
+        return 0;
+    }
+    printf("Some debayer tests FAILED!\n");
+    return 1;
+}
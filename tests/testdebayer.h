@@ -0,0 +1,16 @@
+#ifndef TESTDEBAYER_H
+#define TESTDEBAYER_H
+
+#include <stdio.h>
+
+#include "ssolverutils/bayer.h"
+
+class TestDebayer
+{
+public:
+    TestDebayer();
+    bool runBandsMatchWhole(dc1394bayer_method_t method);
+    bool runBenchmark(dc1394bayer_method_t method);
+};
+
+#endif // TESTDEBAYER_H
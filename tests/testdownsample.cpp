@@ -0,0 +1,204 @@
+#include "testdownsample.h"
+#include "testhelpers.h"
+#include "imagepreparation.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+using namespace ImagePreparation;
+using namespace TestHelpers;
+
+static constexpr int BENCH_D = 3;
+
+TestDownsample::TestDownsample()
+{
+}
+
+// Each prepared pixel is the average of the source pixels in its block, worked out one pixel at a time
+template <typename T>
+static std::vector<double> referenceImage(const std::vector<T> &image, int w, int h, int numChannels, double channelScale, int d)
+{
+    int ow = (w + d - 1) / d, oh = (h + d - 1) / d;
+    std::vector<double> out((size_t)ow * oh);
+    for (int y = 0; y < oh; y++)
+        for (int x = 0; x < ow; x++)
+        {
+            double sum = 0;
+            int n = 0;
+            for (int c = 0; c < numChannels; c++)
+                for (int y2 = y * d; y2 < std::min(h, (y + 1) * d); y2++)
+                    for (int x2 = x * d; x2 < std::min(w, (x + 1) * d); x2++)
+                    {
+                        sum += image[(size_t)c * w * h + (size_t)y2 * w + x2];
+                        if (c == 0)
+                            n++;
+                    }
+            out[(size_t)y * ow + x] = sum * channelScale / n;
+        }
+    return out;
+}
+
+// ==========================================
+// 1. Prepared images match a reference
+// ==========================================
+template <typename T>
+bool TestDownsample::runMatchesReference(bool merge)
+{
+    srand(5);
+    int numChannels = merge ? 3 : 1;
+    double channelScale = merge ? 1.0 / 3.0 : 1.0;
+    std::vector<T> image = makeNoise<T>((size_t)TEST_W * TEST_H * numChannels);
+    bool passed = true;
+    for (int d : {1, 2, 3, 4, 7, 16})
+    {
+        Layout l = layout(TEST_W, TEST_H, (size_t)TEST_W * TEST_H, numChannels, channelScale, d);
+        std::vector<float> prepared((size_t)l.width * l.height);
+        prepareRows<T>(image.data(), l, prepared.data(), 0, l.height);
+        std::vector<double> reference = referenceImage(image, TEST_W, TEST_H, numChannels, channelScale, d);
+        if (prepared.size() != reference.size())
+        {
+            printf("ERROR: factor %d gave %zu pixels instead of %zu\n", d, prepared.size(), reference.size());
+            passed = false;
+            continue;
+        }
+        double worst = 0;
+        for (size_t i = 0; i < prepared.size(); i++)
+            worst = std::max(worst, fabs(prepared[i] - reference[i]) / std::max(1.0, fabs(reference[i])));
+        if (worst > 1e-6)
+        {
+            printf("ERROR: factor %d is off the reference by %g\n", d, worst);
+            passed = false;
+        }
+    }
+    return passed;
+}
+
+// ==========================================
+// 2. Bands of rows match one pass
+// ==========================================
+bool TestDownsample::runThreadsMatchSerial(int threads)
+{
+    srand(9);
+    std::vector<uint16_t> image = makeNoise<uint16_t>((size_t)TEST_W * TEST_H);
+    Layout l = layout(TEST_W, TEST_H, (size_t)TEST_W * TEST_H, 1, 1.0, 3);
+    std::vector<float> serial((size_t)l.width * l.height), banded(serial.size());
+    prepareRows<uint16_t>(image.data(), l, serial.data(), 0, l.height);
+
+    std::vector<std::thread> workers;
+    for (int t = 0; t < threads; t++)
+        workers.emplace_back(prepareRows<uint16_t>, image.data(), std::cref(l), banded.data(),
+                             l.height * t / threads, l.height * (t + 1) / threads);
+    for (auto &worker : workers)
+        worker.join();
+
+    if (memcmp(serial.data(), banded.data(), serial.size() * sizeof(float)) != 0)
+    {
+        printf("ERROR: %d bands do not match one pass\n", threads);
+        return false;
+    }
+    return true;
+}
+
+// The downsampler the way it used to be, one thread adding up doubles and leaving out partial blocks
+template <typename T>
+static void oldDownsample(const T *source, int w, int h, int d, float *destination)
+{
+    int ow = w / d, oh = h / d;
+    for (int y = 0; y < oh; y++)
+        for (int x = 0; x < ow; x++)
+        {
+            double total = 0;
+            for (int y2 = 0; y2 < d; y2++)
+                for (int x2 = 0; x2 < d; x2++)
+                    total += source[(size_t)(y * d + y2) * w + x * d + x2];
+            destination[(size_t)y * ow + x] = (float)(total / (d * d));
+        }
+}
+
+// ==========================================
+// 3. Benchmark against the old downsampler
+// ==========================================
+bool TestDownsample::runBenchmark()
+{
+    srand(13);
+    std::vector<uint16_t> image = makeNoise<uint16_t>((size_t)BENCH_W * BENCH_H);
+    Layout l = layout(BENCH_W, BENCH_H, (size_t)BENCH_W * BENCH_H, 1, 1.0, BENCH_D);
+    std::vector<float> prepared((size_t)l.width * l.height);
+    int threads = std::max(1u, std::thread::hardware_concurrency());
+
+    // The best of a few runs, so the first touch of the buffers is not counted
+    double oldMs = HUGE_VAL;
+    for (int r = 0; r < BENCH_RUNS; r++)
+    {
+        auto start = std::chrono::steady_clock::now();
+        oldDownsample(image.data(), BENCH_W, BENCH_H, BENCH_D, prepared.data());
+        auto end = std::chrono::steady_clock::now();
+        oldMs = std::min(oldMs, std::chrono::duration<double, std::milli>(end - start).count());
+    }
+    printf("%dx%d 16 bit by %d, old downsampler:      %8.1f ms\n", BENCH_W, BENCH_H, BENCH_D, oldMs);
+
+    for (int t : {1, threads})
+    {
+        double ms = HUGE_VAL;
+        for (int r = 0; r < BENCH_RUNS; r++)
+        {
+            auto start = std::chrono::steady_clock::now();
+            std::vector<std::thread> workers;
+            for (int band = 1; band < t; band++)
+                workers.emplace_back(prepareRows<uint16_t>, image.data(), std::cref(l), prepared.data(),
+                                     l.height * band / t, l.height * (band + 1) / t);
+            prepareRows<uint16_t>(image.data(), l, prepared.data(), 0, l.height / t);
+            for (auto &worker : workers)
+                worker.join();
+            auto end = std::chrono::steady_clock::now();
+            ms = std::min(ms, std::chrono::duration<double, std::milli>(end - start).count());
+        }
+        printf("%dx%d 16 bit by %d, prepareRows %2d threads: %8.1f ms (%.1fx)\n", BENCH_W, BENCH_H, BENCH_D, t, ms, oldMs / ms);
+        fflush(stdout);
+        if (t == threads)
+            break;
+    }
+    return true;
+}
+
+int main(int argc, char *argv[])
+{
+    TestDownsample test;
+
+    printf("Starting downsample test suite...\n");
+    fflush(stdout);
+
+    bool byteGray = test.runMatchesReference<uint8_t>(false);
+    bool shortGray = test.runMatchesReference<uint16_t>(false);
+    bool shortRGB = test.runMatchesReference<uint16_t>(true);
+    bool longGray = test.runMatchesReference<int32_t>(false);
+    bool floatRGB = test.runMatchesReference<float>(true);
+    bool threads = test.runThreadsMatchSerial(7);
+    bool runBenchmark = benchmarksRequested(argc, argv);
+    bool benchmark = !runBenchmark || test.runBenchmark();
+
+    printf("\n========================================\n");
+    printf("DOWNSAMPLE TEST SUITE SUMMARY:\n");
+    printf("1. Matches reference (8 bit):      %s\n", byteGray ? "PASSED" : "FAILED");
+    printf("2. Matches reference (16 bit):     %s\n", shortGray ? "PASSED" : "FAILED");
+    printf("3. Matches reference (16 bit RGB): %s\n", shortRGB ? "PASSED" : "FAILED");
+    printf("4. Matches reference (32 bit):     %s\n", longGray ? "PASSED" : "FAILED");
+    printf("5. Matches reference (float RGB):  %s\n", floatRGB ? "PASSED" : "FAILED");
+    printf("6. Bands match one pass:           %s\n", threads ? "PASSED" : "FAILED");
+    printf("7. Benchmark:                      %s\n", benchmarkResult(runBenchmark, benchmark));
+    printf("========================================\n");
+    fflush(stdout);
+
+    if (byteGray && shortGray && shortRGB && longGray && floatRGB && threads && benchmark)
+    {
+        printf("All downsample tests passed successfully!\n");
+        return 0;
+    }
+    printf("Some downsample tests FAILED!\n");
+    return 1;
+}
@@ -0,0 +1,15 @@
+#ifndef TESTDOWNSAMPLE_H
+#define TESTDOWNSAMPLE_H
+
+#include <stdio.h>
+
+class TestDownsample
+{
+public:
+    TestDownsample();
+    template <typename T> bool runMatchesReference(bool merge);
+    bool runThreadsMatchSerial(int threads);
+    bool runBenchmark();
+};
+
+#endif // TESTDOWNSAMPLE_H
@@ -0,0 +1,241 @@
+#include "testextractrois.h"
+#include "testhelpers.h"
+
+#include <QElapsedTimer>
+#include <math.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <vector>
+
+// A guider tracks a few dozen stars, each in a small box around it
+static constexpr int NUM_GUIDE_STARS = 30;
+static constexpr int BOX_SIZE = 48;
+
+TestExtractROIs::TestExtractROIs()
+{
+}
+
+TestExtractROIs::~TestExtractROIs()
+{
+}
+
+bool TestExtractROIs::loadImage(QString fileName)
+{
+    if(!imageLoader.loadImage(fileName))
+    {
+        printf("ERROR: could not load %s\n", fileName.toUtf8().data());
+        return false;
+    }
+    stats = imageLoader.getStats();
+    imageBuffer = imageLoader.getImageBuffer();
+
+    StellarSolver solver(stats, imageBuffer, nullptr);
+    if(!solver.extract(false))
+    {
+        printf("ERROR: the full frame extraction failed\n");
+        return false;
+    }
+    fullFrameStars = solver.getStarList();
+    printf("%d stars in the full frame\n", static_cast<int>(fullFrameStars.size()));
+    return fullFrameStars.size() > 0;
+}
+
+// Boxes centered on the brightest stars that are well inside the frame, centers gets the stars they are around
+QList<QRect> TestExtractROIs::guideBoxes(QList<FITSImage::Star> *centers)
+{
+    QList<QRect> boxes;
+    for(const auto &star : fullFrameStars)
+    {
+        if(boxes.size() == NUM_GUIDE_STARS)
+            break;
+        QRect box(static_cast<int>(star.x) - BOX_SIZE / 2, static_cast<int>(star.y) - BOX_SIZE / 2, BOX_SIZE, BOX_SIZE);
+        if(box.left() < 0 || box.top() < 0 || box.right() >= static_cast<int>(stats.width) ||
+                box.bottom() >= static_cast<int>(stats.height))
+            continue;
+        boxes.append(box);
+        if(centers)
+            centers->append(star);
+    }
+    return boxes;
+}
+
+// ==========================================
+// 1. Each box finds the star it was put around
+// ==========================================
+bool TestExtractROIs::runROIsFindFullFrameStars()
+{
+    QList<FITSImage::Star> guideStars;
+    QList<QRect> boxes = guideBoxes(&guideStars);
+
+    StellarSolver solver(stats, imageBuffer, nullptr);
+    QList<QList<FITSImage::Star>> boxStars = solver.extractROIs(boxes, true);
+    if(boxStars.size() != boxes.size())
+    {
+        printf("ERROR: %d star lists for %d boxes\n", static_cast<int>(boxStars.size()), static_cast<int>(boxes.size()));
+        return false;
+    }
+
+    bool passed = true;
+    for(int i = 0; i < boxes.size(); i++)
+    {
+        double nearest = HUGE_VAL;
+        for(const auto &star : boxStars[i])
+        {
+            if(!boxes[i].contains(static_cast<int>(star.x), static_cast<int>(star.y)))
+            {
+                printf("ERROR: box %d returned a star at %f, %f outside of it\n", i, star.x, star.y);
+                passed = false;
+            }
+            nearest = std::min(nearest, hypot(star.x - guideStars[i].x, star.y - guideStars[i].y));
+        }
+        // Each box has its own background, so the centroids can move a little.
+        if(nearest > 0.5)
+        {
+            printf("ERROR: box %d did not find the star at %f, %f\n", i, guideStars[i].x, guideStars[i].y);
+            passed = false;
+        }
+    }
+    printf("%d boxes checked\n", static_cast<int>(boxes.size()));
+    return passed;
+}
+
+// ==========================================
+// 2. A box outside the image finds nothing
+// ==========================================
+bool TestExtractROIs::runOutsideROIIsEmpty()
+{
+    StellarSolver solver(stats, imageBuffer, nullptr);
+    QList<QRect> boxes;
+    boxes << QRect(stats.width + 10, 10, BOX_SIZE, BOX_SIZE) << QRect(-100, -100, BOX_SIZE, BOX_SIZE);
+    QList<QList<FITSImage::Star>> boxStars = solver.extractROIs(boxes);
+    return boxStars.size() == 2 && boxStars[0].isEmpty() && boxStars[1].isEmpty();
+}
+
+// ==========================================
+// 3. Each channel of an RGB image finds its own star, and merged channels are refused
+// ==========================================
+bool TestExtractROIs::runRGBChannels()
+{
+    // Each channel has one star, in a different place
+    const int size = 160;
+    const QPointF channelStars[3] = { QPointF(40.3, 40.6), QPointF(100.5, 60.2), QPointF(60.7, 120.4) };
+    std::vector<uint16_t> rgb(static_cast<size_t>(size) * size * 3);
+    srand(17);
+    for(int c = 0; c < 3; c++)
+        for(int y = 0; y < size; y++)
+            for(int x = 0; x < size; x++)
+            {
+                const double r2 = pow(x - channelStars[c].x(), 2) + pow(y - channelStars[c].y(), 2);
+                rgb[(static_cast<size_t>(c) * size + y) * size + x] = static_cast<uint16_t>(1000 + rand() % 20 + 20000 * exp(-r2 / 4.5));
+            }
+    FITSImage::Statistic rgbStats;
+    rgbStats.dataType = TUSHORT;
+    rgbStats.bytesPerPixel = sizeof(uint16_t);
+    rgbStats.width = size;
+    rgbStats.height = size;
+    rgbStats.samples_per_channel = size * size;
+    rgbStats.channels = 3;
+
+    StellarSolver solver(rgbStats, reinterpret_cast<const uint8_t *>(rgb.data()), nullptr);
+    solver.setLogLevel(LOG_NONE);
+    QList<QRect> boxes;
+    boxes << QRect(0, 0, size, size) << QRect(size / 2, 0, size / 2, size);
+    bool passed = true;
+    for(int c = 0; c < 3; c++)
+    {
+        solver.setColorChannel(c);
+        QList<QList<FITSImage::Star>> boxStars = solver.extractROIs(boxes);
+        if(boxStars.size() != boxes.size() || boxStars[0].isEmpty())
+        {
+            printf("ERROR: channel %d found no stars\n", c);
+            passed = false;
+            continue;
+        }
+        for(const auto &star : boxStars[0])
+        {
+            if(hypot(star.x - channelStars[c].x(), star.y - channelStars[c].y()) > 0.5)
+            {
+                printf("ERROR: channel %d found a star at %f, %f instead of at %f, %f\n", c, star.x, star.y,
+                       channelStars[c].x(), channelStars[c].y());
+                passed = false;
+            }
+        }
+        // Only the green star is in the right half of the image
+        if(boxStars[1].isEmpty() != (c != FITSImage::GREEN))
+        {
+            printf("ERROR: channel %d found %d stars in the right half\n", c, static_cast<int>(boxStars[1].size()));
+            passed = false;
+        }
+    }
+    for(int channel : { FITSImage::AVERAGE_RGB, FITSImage::INTEGRATED_RGB })
+    {
+        solver.setColorChannel(channel);
+        QList<QList<FITSImage::Star>> boxStars = solver.extractROIs(boxes);
+        if(boxStars.size() != boxes.size() || !boxStars[0].isEmpty() || !boxStars[1].isEmpty())
+        {
+            printf("ERROR: channel mode %d was not refused\n", channel);
+            passed = false;
+        }
+    }
+    return passed;
+}
+
+// ==========================================
+// 4. One call for all boxes vs one extract per box
+// ==========================================
+bool TestExtractROIs::runBenchmark()
+{
+    QList<QRect> boxes = guideBoxes();
+    StellarSolver solver(stats, imageBuffer, nullptr);
+
+    QElapsedTimer timer;
+    timer.start();
+    solver.extractROIs(boxes, true);
+    const double batchMs = timer.nsecsElapsed() / 1e6;
+
+    timer.restart();
+    for(const auto &box : boxes)
+        solver.extract(true, box);
+    const double singleMs = timer.nsecsElapsed() / 1e6;
+
+    printf("%d boxes: %8.1f ms with extractROIs, %8.1f ms with one extract each\n", static_cast<int>(boxes.size()), batchMs,
+           singleMs);
+    fflush(stdout);
+    return true;
+}
+
+int main(int argc, char *argv[])
+{
+    QApplication app(argc, argv);
+#if defined(__linux__)
+    setlocale(LC_NUMERIC, "C");
+#endif
+    TestExtractROIs test;
+
+    printf("Starting ROI extraction test suite...\n");
+    fflush(stdout);
+
+    bool loaded = test.loadImage("randomsky.fits");
+    bool found = loaded && test.runROIsFindFullFrameStars();
+    bool outside = loaded && test.runOutsideROIIsEmpty();
+    bool rgb = test.runRGBChannels();
+    bool runBenchmark = TestHelpers::benchmarksRequested(argc, argv);
+    bool benchmark = !runBenchmark || (loaded && test.runBenchmark());
+
+    printf("\n========================================\n");
+    printf("ROI EXTRACTION TEST SUITE SUMMARY:\n");
+    printf("1. Boxes find the full frame stars: %s\n", found ? "PASSED" : "FAILED");
+    printf("2. Boxes outside the image empty:   %s\n", outside ? "PASSED" : "FAILED");
+    printf("3. RGB channel modes:               %s\n", rgb ? "PASSED" : "FAILED");
+    printf("4. Benchmark ran:                   %s\n", TestHelpers::benchmarkResult(runBenchmark, benchmark));
+    printf("========================================\n");
+    fflush(stdout);
+
+    if (found && outside && rgb && benchmark)
+    {
+        printf("All ROI extraction tests passed successfully!\n");
+        return 0;
+    }
+    printf("Some ROI extraction tests FAILED!\n");
+    return 1;
+}
@@ -0,0 +1,35 @@
+#ifndef TESTEXTRACTROIS_H
+#define TESTEXTRACTROIS_H
+
+//Qt Includes
+#include <QApplication>
+#include <QObject>
+
+#include <stdio.h>
+
+//Includes for this project
+#include "structuredefinitions.h"
+#include "stellarsolver.h"
+#include "ssolverutils/fileio.h"
+
+class TestExtractROIs : public QObject
+{
+    Q_OBJECT
+public:
+    TestExtractROIs();
+    ~TestExtractROIs();
+    bool loadImage(QString fileName);
+    bool runROIsFindFullFrameStars();
+    bool runOutsideROIIsEmpty();
+    bool runRGBChannels();
+    bool runBenchmark();
+
+private:
+    QList<QRect> guideBoxes(QList<FITSImage::Star> *centers = nullptr);
+    fileio imageLoader;
+    FITSImage::Statistic stats;
+    const uint8_t *imageBuffer { nullptr };
+    QList<FITSImage::Star> fullFrameStars;
+};
+
+#endif // TESTEXTRACTROIS_H
@@ -0,0 +1,202 @@
+#include "testextracttiles.h"
+
+#include <math.h>
+#include <stdlib.h>
+
+#include <algorithm>
+#include <vector>
+
+// Enough threads that the image is cut into many tiles on any machine
+static constexpr uint32_t TILE_THREADS = 8;
+
+TestExtractTiles::TestExtractTiles()
+{
+}
+
+TestExtractTiles::~TestExtractTiles()
+{
+}
+
+bool TestExtractTiles::loadImage(QString fileName)
+{
+    if(!imageLoader.loadImage(fileName))
+    {
+        printf("ERROR: could not load %s\n", fileName.toUtf8().data());
+        return false;
+    }
+    stats = imageLoader.getStats();
+    return extract(false, oneTileStars, oneTile) && extract(true, tiledStars, tiles);
+}
+
+// Extracts all the stars of the image with their HFR, as one tile or cut into tiles.  The extractor is used directly,
+// so partitioning is not turned off as StellarSolver does with Qt 6.
+bool TestExtractTiles::extract(bool partition, QList<FITSImage::Star> &stars, QList<FITSImage::ExtractionTile> &tileList)
+{
+    InternalExtractorSolver extractor(SSolver::EXTRACT_WITH_HFR, SSolver::EXTRACTOR_INTERNAL, SSolver::SOLVER_STELLARSOLVER,
+                                      stats, imageLoader.getImageBuffer());
+    extractor.m_ActiveParameters = StellarSolver::getBuiltInProfiles().at(SSolver::Parameters::ALL_STARS);
+    extractor.m_ActiveParameters.partition = partition;
+    // No star is filtered out, so the stars the tiles report are all the stars in the list
+    extractor.m_ActiveParameters.maxEllipse = 0;
+    extractor.convFilter = StellarSolver::generateConvFilter(extractor.m_ActiveParameters.convFilterType,
+                           extractor.m_ActiveParameters.fwhm);
+    extractor.setPartitionThreads(TILE_THREADS);
+    if(extractor.extract() != 0)
+    {
+        printf("ERROR: the stars were not extracted %s\n", partition ? "in tiles" : "in one partition");
+        return false;
+    }
+    stars = extractor.getStarList();
+    tileList = extractor.getExtractionTiles();
+    printf("%s: %d stars in %d tiles\n", partition ? "tiled" : "one partition", static_cast<int>(stars.size()),
+           static_cast<int>(tileList.size()));
+    return true;
+}
+
+// ==========================================
+// 1. Without partitioning the image is one tile with all the stars
+// ==========================================
+bool TestExtractTiles::runOnePartitionIsOneTile()
+{
+    if(oneTile.size() != 1)
+    {
+        printf("ERROR: one partition reported %d tiles\n", static_cast<int>(oneTile.size()));
+        return false;
+    }
+    const FITSImage::ExtractionTile &tile = oneTile.first();
+    if(tile.x != 0 || tile.y != 0 || tile.width != static_cast<int>(stats.width) || tile.height != static_cast<int>(stats.height))
+    {
+        printf("ERROR: the one tile is %dx%d at %d, %d\n", tile.width, tile.height, tile.x, tile.y);
+        return false;
+    }
+    if(tile.num_stars != oneTileStars.size())
+    {
+        printf("ERROR: the one tile reported %d stars, %d were found\n", tile.num_stars, static_cast<int>(oneTileStars.size()));
+        return false;
+    }
+    return true;
+}
+
+// ==========================================
+// 2. The tiles cover every pixel of the image once, and report all the stars
+// ==========================================
+bool TestExtractTiles::runTilesCoverImage()
+{
+    if(tiles.size() < static_cast<int>(TILE_THREADS))
+    {
+        printf("ERROR: only %d tiles for %u threads\n", static_cast<int>(tiles.size()), TILE_THREADS);
+        return false;
+    }
+    std::vector<int> covered(static_cast<size_t>(stats.width) * stats.height, 0);
+    int numStars = 0;
+    for(const auto &tile : tiles)
+    {
+        if(tile.x < 0 || tile.y < 0 || tile.width <= 0 || tile.height <= 0 ||
+                tile.x + tile.width > static_cast<int>(stats.width) || tile.y + tile.height > static_cast<int>(stats.height))
+        {
+            printf("ERROR: a %dx%d tile at %d, %d is not in the image\n", tile.width, tile.height, tile.x, tile.y);
+            return false;
+        }
+        for(int y = tile.y; y < tile.y + tile.height; y++)
+            for(int x = tile.x; x < tile.x + tile.width; x++)
+                covered[static_cast<size_t>(y) * stats.width + x]++;
+        numStars += tile.num_stars;
+    }
+    if(std::count(covered.begin(), covered.end(), 1) != static_cast<long>(covered.size()))
+    {
+        printf("ERROR: the tiles leave out or overlap some pixels\n");
+        return false;
+    }
+    if(numStars != tiledStars.size())
+    {
+        printf("ERROR: the tiles reported %d stars, %d were found\n", numStars, static_cast<int>(tiledStars.size()));
+        return false;
+    }
+    return true;
+}
+
+// ==========================================
+// 3. The tiles find the same stars as one partition, measured the same way
+// ==========================================
+bool TestExtractTiles::runTilesFindSameStars()
+{
+    // Every tile subtracts the same background and has a margin wider than the stars, so a star is only different if
+    // deblending splits it differently where it meets the edge of a tile
+    if(abs(tiledStars.size() - oneTileStars.size()) > oneTileStars.size() / 100)
+    {
+        printf("ERROR: the tiles found %d stars instead of %d\n", static_cast<int>(tiledStars.size()),
+               static_cast<int>(oneTileStars.size()));
+        return false;
+    }
+
+    auto byY = [](const FITSImage::Star & a, const FITSImage::Star & b)
+    {
+        return a.y < b.y;
+    };
+    QList<FITSImage::Star> tiled = tiledStars;
+    std::sort(tiled.begin(), tiled.end(), byY);
+    int matched = 0, differentHFR = 0;
+    for(const auto &star : oneTileStars)
+    {
+        FITSImage::Star low = star;
+        low.y -= 0.01f;
+        for(auto other = std::lower_bound(tiled.begin(), tiled.end(), low, byY);
+                other != tiled.end() && other->y <= star.y + 0.01f; ++other)
+        {
+            if(fabs(other->x - star.x) <= 0.01f)
+            {
+                matched++;
+                if(fabs(other->HFR - star.HFR) > 1e-3 * star.HFR || fabs(other->flux - star.flux) > 1e-3 * star.flux)
+                    differentHFR++;
+                break;
+            }
+        }
+    }
+    printf("%d of %d stars are in the same place, %d of them measured differently\n", matched,
+           static_cast<int>(oneTileStars.size()), differentHFR);
+    bool passed = true;
+    if(matched < oneTileStars.size() * 99 / 100)
+    {
+        printf("ERROR: only %d of %d stars were found by the tiles\n", matched, static_cast<int>(oneTileStars.size()));
+        passed = false;
+    }
+    if(differentHFR > matched / 100)
+    {
+        printf("ERROR: %d of the stars were measured differently by the tiles\n", differentHFR);
+        passed = false;
+    }
+    return passed;
+}
+
+int main(int argc, char *argv[])
+{
+    QApplication app(argc, argv);
+#if defined(__linux__)
+    setlocale(LC_NUMERIC, "C");
+#endif
+    TestExtractTiles test;
+
+    printf("Starting extraction tiles test suite...\n");
+    fflush(stdout);
+
+    bool loaded = test.loadImage("randomsky.fits");
+    bool oneTile = loaded && test.runOnePartitionIsOneTile();
+    bool covered = loaded && test.runTilesCoverImage();
+    bool same = loaded && test.runTilesFindSameStars();
+
+    printf("\n========================================\n");
+    printf("EXTRACTION TILES TEST SUITE SUMMARY:\n");
+    printf("1. One partition is one tile:         %s\n", oneTile ? "PASSED" : "FAILED");
+    printf("2. The tiles cover the image once:    %s\n", covered ? "PASSED" : "FAILED");
+    printf("3. The tiles find the same stars:     %s\n", same ? "PASSED" : "FAILED");
+    printf("========================================\n");
+    fflush(stdout);
+
+    if (oneTile && covered && same)
+    {
+        printf("All extraction tiles tests passed successfully!\n");
+        return 0;
+    }
+    printf("Some extraction tiles tests FAILED!\n");
+    return 1;
+}
@@ -0,0 +1,37 @@
+#ifndef TESTEXTRACTTILES_H
+#define TESTEXTRACTTILES_H
+
+//Qt Includes
+#include <QApplication>
+#include <QObject>
+
+#include <stdio.h>
+
+//Includes for this project
+#include "structuredefinitions.h"
+#include "stellarsolver.h"
+#include "internalextractorsolver.h"
+#include "ssolverutils/fileio.h"
+
+class TestExtractTiles : public QObject
+{
+    Q_OBJECT
+public:
+    TestExtractTiles();
+    ~TestExtractTiles();
+    bool loadImage(QString fileName);
+    bool runOnePartitionIsOneTile();
+    bool runTilesCoverImage();
+    bool runTilesFindSameStars();
+
+private:
+    bool extract(bool partition, QList<FITSImage::Star> &stars, QList<FITSImage::ExtractionTile> &tiles);
+    fileio imageLoader;
+    FITSImage::Statistic stats;
+    QList<FITSImage::Star> oneTileStars;
+    QList<FITSImage::Star> tiledStars;
+    QList<FITSImage::ExtractionTile> oneTile;
+    QList<FITSImage::ExtractionTile> tiles;
+};
+
+#endif // TESTEXTRACTTILES_H
@@ -0,0 +1,167 @@
+#include "testextractworkspace.h"
+#include "testhelpers.h"
+#include "sep/extract.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <algorithm>
+
+using namespace SEP;
+using namespace TestHelpers;
+
+// These are the tile sizes, in the order they are extracted, and the deblending thresholds to use.
+// The sizes grow and shrink so the workspace has to grow part way through and then be reused.
+static constexpr int NUM_FRAMES = 6;
+static constexpr int FRAMES[NUM_FRAMES][3] =
+{
+    { 300, 200, 32 }, { 900, 700, 32 }, { 150, 400, 16 }, { 900, 700, 64 }, { 200, 200, 32 }, { 1200, 300, 32 }
+};
+static constexpr int STEADY_FRAMES = 20;
+
+static float convFilter[9] = { 1, 2, 1, 2, 4, 2, 1, 2, 1 };
+
+TestExtractWorkspace::TestExtractWorkspace()
+{
+}
+
+static int extractImage(Extract &extractor, std::vector<float> &data, int w, int h, int nthresh, sep_catalog **catalog)
+{
+    sep_image im;
+    memset(&im, 0, sizeof(im));
+    im.data = data.data();
+    im.dtype = SEP_TFLOAT;
+    im.raw_w = w;
+    im.raw_h = h;
+    im.w = w;
+    im.h = h;
+    im.noise_type = SEP_NOISE_NONE;
+    im.noiseval = 1.0;
+    return extractor.sep_extract(&im, 8, SEP_THRESH_ABS, 5, convFilter, 3, 3, SEP_FILTER_CONV,
+                                 nthresh, 0.005, 1, 1, catalog);
+}
+
+static bool catalogsMatch(const sep_catalog *a, const sep_catalog *b)
+{
+    if (a->nobj != b->nobj)
+        return false;
+    for (int i = 0; i < a->nobj; i++)
+    {
+        if (a->x[i] != b->x[i] || a->y[i] != b->y[i] || a->flux[i] != b->flux[i] ||
+                a->npix[i] != b->npix[i] || a->flag[i] != b->flag[i])
+            return false;
+    }
+    return true;
+}
+
+// ==========================================
+// 1. A reused workspace gives the same catalog
+// ==========================================
+bool TestExtractWorkspace::runReuseMatchesFresh()
+{
+    srand(11);
+    bool passed = true;
+    Extract reused;
+    for (int f = 0; f < NUM_FRAMES; f++)
+    {
+        width = FRAMES[f][0];
+        height = FRAMES[f][1];
+        image = makeStarField<float>(width, height, -5, 10, 3000);
+        sep_catalog *a = nullptr, *b = nullptr;
+        Extract fresh;
+        int statusA = extractImage(reused, image, width, height, FRAMES[f][2], &a);
+        int statusB = extractImage(fresh, image, width, height, FRAMES[f][2], &b);
+        if (statusA != 0 || statusB != 0)
+        {
+            printf("ERROR: sep_extract failed on frame %d (%d, %d)\n", f, statusA, statusB);
+            passed = false;
+        }
+        else if (!catalogsMatch(a, b))
+        {
+            printf("ERROR: frame %d found %d objects with a reused workspace and %d with a fresh one\n",
+                   f, a->nobj, b->nobj);
+            passed = false;
+        }
+        else
+            printf("Frame %dx%d: %d objects, %zu workspace allocations so far\n",
+                   width, height, a->nobj, reused.workspace_allocations());
+        Extract::sep_catalog_free(a);
+        Extract::sep_catalog_free(b);
+    }
+    return passed;
+}
+
+// ==========================================
+// 2. No allocations once the workspace is warm
+// ==========================================
+bool TestExtractWorkspace::runSteadyStateAllocations()
+{
+    srand(3);
+    Extract extractor;
+    // The largest frame first, after that every frame fits in the buffers it left behind
+    width = 1200;
+    height = 900;
+    image = makeStarField<float>(width, height, -5, 10, 3000);
+    sep_catalog *catalog = nullptr;
+    if (extractImage(extractor, image, width, height, 32, &catalog) != 0)
+    {
+        printf("ERROR: sep_extract failed on the warm-up frame\n");
+        return false;
+    }
+    Extract::sep_catalog_free(catalog);
+    size_t warmAllocations = extractor.workspace_allocations();
+
+    bool passed = true;
+    for (int f = 0; f < STEADY_FRAMES && passed; f++)
+    {
+        width = 400 + 40 * f;
+        height = 300 + 30 * f;
+        image = makeStarField<float>(width, height, -5, 10, 3000);
+        catalog = nullptr;
+        if (extractImage(extractor, image, width, height, 32, &catalog) != 0)
+        {
+            printf("ERROR: sep_extract failed on frame %d\n", f);
+            passed = false;
+        }
+        Extract::sep_catalog_free(catalog);
+    }
+
+    if (passed && extractor.workspace_allocations() != warmAllocations)
+    {
+        printf("ERROR: %zu workspace allocations during %d steady-state frames\n",
+               extractor.workspace_allocations() - warmAllocations, STEADY_FRAMES);
+        passed = false;
+    }
+    else if (passed)
+    {
+        printf("%zu workspace allocations during warm-up, none in %d steady-state frames\n",
+               warmAllocations, STEADY_FRAMES);
+    }
+    return passed;
+}
+
+int main(int argc, char *argv[])
+{
+    TestExtractWorkspace test;
+
+    printf("Starting SEP extraction workspace test suite...\n");
+    fflush(stdout);
+
+    bool reuse = test.runReuseMatchesFresh();
+    bool steady = test.runSteadyStateAllocations();
+
+    printf("\n========================================\n");
+    printf("EXTRACTION WORKSPACE TEST SUITE SUMMARY:\n");
+    printf("1. Reused workspace matches fresh: %s\n", reuse ? "PASSED" : "FAILED");
+    printf("2. Steady state allocations:       %s\n", steady ? "PASSED" : "FAILED");
+    printf("========================================\n");
+    fflush(stdout);
+
+    if (reuse && steady)
+    {
+        printf("All extraction workspace tests passed successfully!\n");
+        return 0;
+    }
+    printf("Some extraction workspace tests FAILED!\n");
+    return 1;
+}
@@ -0,0 +1,22 @@
+#ifndef TESTEXTRACTWORKSPACE_H
+#define TESTEXTRACTWORKSPACE_H
+
+#include <stdio.h>
+#include <vector>
+
+#include "sep/sep.h"
+
+class TestExtractWorkspace
+{
+public:
+    TestExtractWorkspace();
+    bool runReuseMatchesFresh();
+    bool runSteadyStateAllocations();
+
+private:
+    int width { 0 };
+    int height { 0 };
+    std::vector<float> image;
+};
+
+#endif // TESTEXTRACTWORKSPACE_H
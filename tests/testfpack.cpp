@@ -0,0 +1,142 @@
+#include "testfpack.h"
+#include "testhelpers.h"
+#include "ssolverutils/fileio.h"
+
+#include <fitsio.h>
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+#include <QFile>
+
+using namespace TestHelpers;
+
+// The test image is not a multiple of the tiles, so the last tile of each row and column is cut short, and there are
+// more rows of tiles than cores, so each band decompresses several of them
+static constexpr int TILE_W = 100;
+static constexpr int TILE_H = 37;
+
+TestFpack::TestFpack()
+{
+}
+
+// Writes a sky with noise and some stars the way fpack does, Rice compressed in 2D tiles in the first extension after
+// an empty primary HDU
+template <typename T>
+bool TestFpack::writeCompressed(const QString &fileName, int bitpix, int datatype, int channels)
+{
+    std::vector<T> image = makeSky<T>(TEST_W, TEST_H, channels);
+
+    int status = 0;
+    fitsfile *fptr = nullptr;
+    long naxes[3] = { TEST_W, TEST_H, channels };
+    long tile[3] = { TILE_W, TILE_H, 1 };
+    // The ! replaces the file of an earlier run
+    fits_create_file(&fptr, ("!" + fileName).toLocal8Bit().constData(), &status);
+    fits_set_compression_type(fptr, RICE_1, &status);
+    fits_set_tile_dim(fptr, channels == 1 ? 2 : 3, tile, &status);
+    fits_create_img(fptr, bitpix, channels == 1 ? 2 : 3, naxes, &status);
+    fits_write_img(fptr, datatype, 1, static_cast<LONGLONG>(image.size()), image.data(), &status);
+    fits_close_file(fptr, &status);
+    if (status != 0)
+    {
+        char errorMessage[FLEN_STATUS];
+        fits_get_errstatus(status, errorMessage);
+        printf("ERROR: writing %s failed: %s\n", fileName.toUtf8().data(), errorMessage);
+        return false;
+    }
+    return true;
+}
+
+// Reads the compressed image with one fits_read_img call, the way fileio reads it when CFITSIO is not reentrant
+bool TestFpack::readWithCFITSIO(const QString &fileName, int datatype, size_t nelements, void *buffer)
+{
+    int status = 0, anynull = 0;
+    fitsfile *fptr = nullptr;
+    fits_open_diskfile(&fptr, fileName.toLocal8Bit().constData(), READONLY, &status);
+    fits_movabs_hdu(fptr, 2, nullptr, &status);
+    fits_read_img(fptr, datatype, 1, static_cast<LONGLONG>(nelements), nullptr, buffer, &anynull, &status);
+    fits_close_file(fptr, &status);
+    return status == 0;
+}
+
+// ==========================================
+// 1. The tiles decompressed in parallel are byte identical to fits_read_img
+// ==========================================
+template <typename T>
+bool TestFpack::runParallelReadMatchesCFITSIO(int bitpix, int datatype, int channels)
+{
+    const QString fileName = QString("testfpack_%1_%2.fz").arg(bitpix).arg(channels);
+    if (!writeCompressed<T>(fileName, bitpix, datatype, channels))
+        return false;
+
+    const size_t nelements = (size_t)TEST_W * TEST_H * channels;
+    fileio imageLoader;
+    if (!imageLoader.loadImageBufferOnly(fileName))
+    {
+        printf("ERROR: fileio could not load %s\n", fileName.toUtf8().data());
+        QFile::remove(fileName);
+        return false;
+    }
+    const FITSImage::Statistic stats = imageLoader.getStats();
+    bool passed = true;
+    if (stats.width != TEST_W || stats.height != TEST_H || (int)stats.channels != channels ||
+            stats.bytesPerPixel != (int)sizeof(T))
+    {
+        printf("ERROR: %s was loaded as %ux%ux%d with %d bytes per pixel\n", fileName.toUtf8().data(), stats.width,
+               stats.height, (int)stats.channels, stats.bytesPerPixel);
+        passed = false;
+    }
+
+    // The same data type fileio asked for, some images are read as another type
+    std::vector<T> expected(nelements);
+    if (passed && !readWithCFITSIO(fileName, static_cast<int>(stats.dataType), nelements, expected.data()))
+    {
+        printf("ERROR: fits_read_img could not read %s\n", fileName.toUtf8().data());
+        passed = false;
+    }
+    if (passed && memcmp(imageLoader.getImageBuffer(), expected.data(), nelements * sizeof(T)) != 0)
+    {
+        printf("ERROR: the pixels of %s differ from fits_read_img\n", fileName.toUtf8().data());
+        passed = false;
+    }
+    QFile::remove(fileName);
+    return passed;
+}
+
+int main(int argc, char *argv[])
+{
+    Q_UNUSED(argc);
+    Q_UNUSED(argv);
+    TestFpack test;
+    srand(1);
+
+    printf("Starting fpack test suite...\n");
+    printf("CFITSIO %s reentrant, so the tiles are read %s\n", fits_is_reentrant() ? "is" : "is not",
+           fits_is_reentrant() ? "in parallel" : "serially");
+    fflush(stdout);
+
+    bool ushort = test.runParallelReadMatchesCFITSIO<uint16_t>(USHORT_IMG, TUSHORT, 1);
+    bool shorts = test.runParallelReadMatchesCFITSIO<int16_t>(SHORT_IMG, TSHORT, 1);
+    bool floats = test.runParallelReadMatchesCFITSIO<float>(FLOAT_IMG, TFLOAT, 1);
+    bool rgb = test.runParallelReadMatchesCFITSIO<uint16_t>(USHORT_IMG, TUSHORT, 3);
+
+    printf("\n========================================\n");
+    printf("FPACK TEST SUITE SUMMARY:\n");
+    printf("1. Parallel read matches (unsigned 16 bit): %s\n", ushort ? "PASSED" : "FAILED");
+    printf("2. Parallel read matches (signed 16 bit):   %s\n", shorts ? "PASSED" : "FAILED");
+    printf("3. Parallel read matches (float):           %s\n", floats ? "PASSED" : "FAILED");
+    printf("4. Parallel read matches (RGB):             %s\n", rgb ? "PASSED" : "FAILED");
+    printf("========================================\n");
+    fflush(stdout);
+
+    if (ushort && shorts && floats && rgb)
+    {
+        printf("All fpack tests passed successfully!\n");
+        return 0;
+    }
+    printf("Some fpack tests FAILED!\n");
+    return 1;
+}
@@ -0,0 +1,19 @@
+#ifndef TESTFPACK_H
+#define TESTFPACK_H
+
+#include <stdio.h>
+
+#include <QString>
+
+class TestFpack
+{
+public:
+    TestFpack();
+    template <typename T> bool runParallelReadMatchesCFITSIO(int bitpix, int datatype, int channels);
+
+private:
+    template <typename T> bool writeCompressed(const QString &fileName, int bitpix, int datatype, int channels);
+    bool readWithCFITSIO(const QString &fileName, int datatype, size_t nelements, void *buffer);
+};
+
+#endif // TESTFPACK_H
@@ -0,0 +1,100 @@
+#ifndef TESTHELPERS_H
+#define TESTHELPERS_H
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <limits>
+#include <type_traits>
+#include <vector>
+
+// The image sizes, the made up images and the benchmark switch that the tests share
+namespace TestHelpers
+{
+
+// An odd size, so that rows, bands, tiles and blocks do not divide the image evenly
+static constexpr int TEST_W = 1003;
+static constexpr int TEST_H = 757;
+// The size of a 61 megapixel sensor, for the benchmarks
+static constexpr int BENCH_W = 9576;
+static constexpr int BENCH_H = 6388;
+// The benchmarks report the best of this many runs
+static constexpr int BENCH_RUNS = 3;
+
+// Pixels spread evenly over the whole range of an integer type, or from -1000 to 65535 for floating point
+template <typename T>
+inline std::vector<T> makeNoise(size_t n)
+{
+    std::vector<T> image(n);
+    const bool floating = std::is_floating_point<T>::value;
+    const double low = floating ? -1000.0 : (double)std::numeric_limits<T>::min();
+    const double high = floating ? 65535.0 : (double)std::numeric_limits<T>::max();
+    for (auto &v : image)
+        v = (T)(low + (high - low) * ((double)rand() / RAND_MAX));
+    return image;
+}
+
+// A sky with noise and some stars, so the median and the deviation are not trivial
+template <typename T>
+inline std::vector<T> makeSky(int w, int h, int channels)
+{
+    std::vector<T> image((size_t)w * h * channels);
+    const double sky = std::is_same<T, uint8_t>::value ? 40 : 1000;
+    const double noise = std::is_same<T, uint8_t>::value ? 10 : 200;
+    const double top = std::is_same<T, uint8_t>::value ? 255 : std::is_same<T, int16_t>::value ? 32767 : 65535;
+    for (auto &v : image)
+    {
+        double value = sky + noise * ((double)rand() / RAND_MAX);
+        if (rand() % 1000 == 0)
+            value = top * ((double)rand() / RAND_MAX);
+        v = (T)value;
+    }
+    return image;
+}
+
+// A sky of sky plus up to noise, with round stars of up to peak above it, about one for every 2000 pixels.  The rows
+// are stride pixels apart, the padding at their ends is left at 0, so that a test can leave room after each row.
+template <typename T>
+inline std::vector<T> makeStarField(int w, int h, double sky, double noise, double peak, int stride = 0)
+{
+    if (stride < w)
+        stride = w;
+    std::vector<T> image((size_t)stride * h, (T)0);
+    for (int y = 0; y < h; y++)
+        for (int x = 0; x < w; x++)
+            image[(size_t)y * stride + x] = (T)(sky + noise * ((double)rand() / RAND_MAX));
+    for (int s = 0; s < w * h / 2000; s++)
+    {
+        const int sx = rand() % w, sy = rand() % h;
+        const double amp = peak * ((double)rand() / RAND_MAX);
+        for (int y = std::max(0, sy - 6); y < std::min(h, sy + 7); y++)
+            for (int x = std::max(0, sx - 6); x < std::min(w, sx + 7); x++)
+                image[(size_t)y * stride + x] += (T)(amp * exp(-((x - sx) * (x - sx) + (y - sy) * (y - sy)) / 5.0));
+    }
+    return image;
+}
+
+// The benchmarks take a while on images this large, so they only run when the test is started with --benchmark
+inline bool benchmarksRequested(int argc, char *argv[])
+{
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--benchmark") == 0)
+            return true;
+    }
+    return false;
+}
+
+// What the summary says about a benchmark, one that was not asked for does not fail the test
+inline const char *benchmarkResult(bool requested, bool passed)
+{
+    return !requested ? "SKIPPED" : passed ? "PASSED" : "FAILED";
+}
+
+}  // namespace TestHelpers
+
+#endif // TESTHELPERS_H
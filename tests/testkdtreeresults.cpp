@@ -0,0 +1,392 @@
+#include "testkdtreeresults.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <vector>
+
+extern "C" {
+#include "astrometry/errors.h"
+#include "astrometry/kdtree_fits_io.h"
+
+// Define mocks for functions needed by errors.c/bl.c/kdtree to avoid linking issues
+void debug(const char* format, ...) {
+    // Silent mock
+}
+char* strdup_safe(const char* str) {
+    return str ? strdup(str) : nullptr;
+}
+void asprintf_safe(char** strp, const char* format, ...) {
+    // Silent mock
+}
+void fitsbin_chunk_init(fitsbin_chunk_t* chunk) {
+    // Silent mock
+}
+int kdtree_fits_read_chunk(kdtree_fits_t* io, fitsbin_chunk_t* chunk) {
+    // Silent mock
+    return 0;
+}
+// The code trees are made in memory, so codekd.c never reads a file
+void logverb(const char* format, ...) {
+    // Silent mock
+}
+kdtree_fits_t* kdtree_fits_open(const char* fn) {
+    return nullptr;
+}
+kdtree_fits_t* kdtree_fits_open_fits(anqfits_t* fits) {
+    return nullptr;
+}
+int kdtree_fits_contains_tree(const kdtree_fits_t* io, const char* treename) {
+    return 0;
+}
+kdtree_t* kdtree_fits_read_tree(kdtree_fits_t* io, const char* treename, qfits_header** p_hdr) {
+    return nullptr;
+}
+int kdtree_fits_close(kdtree_t* kd) {
+    // The test frees its own trees
+    return 0;
+}
+int fitsbin_close_fd(fitsbin_t* fb) {
+    return 0;
+}
+qfits_header* qfits_header_default(void) {
+    return nullptr;
+}
+void qfits_header_add(qfits_header* hdr, const char* key, const char* val, const char* com, const char* lin) {
+    // Silent mock
+}
+void qfits_header_destroy(qfits_header* hdr) {
+    // Silent mock
+}
+}
+
+// These mirror the code-tree searches done for every quad in solver.c
+static constexpr int CODE_DIM = 4;
+static constexpr int NUM_CODES = 20000;
+static constexpr int WARMUP_QUERIES = 1000;
+static constexpr int STEADY_QUERIES = 100000;
+static constexpr double CODE_TOL2 = 0.01 * 0.01 * 25;
+static constexpr int CODE_OPTIONS = KD_OPTIONS_SMALL_RADIUS | KD_OPTIONS_COMPUTE_DISTS |
+                                    KD_OPTIONS_NO_RESIZE_RESULTS | KD_OPTIONS_USE_SPLIT;
+
+TestKDTreeResults::TestKDTreeResults()
+{
+}
+
+TestKDTreeResults::~TestKDTreeResults()
+{
+    free(treeData);
+}
+
+kdtree_t *TestKDTreeResults::buildTree(int treetype, int N, int D)
+{
+    free(treeData);
+    if (treetype == KDTT_FLOAT)
+    {
+        float *data = (float *)malloc(N * D * sizeof(float));
+        for (int i = 0; i < N * D; ++i)
+            data[i] = (float)rand() / RAND_MAX;
+        treeData = data;
+    }
+    else
+    {
+        double *data = (double *)malloc(N * D * sizeof(double));
+        for (int i = 0; i < N * D; ++i)
+            data[i] = (double)rand() / RAND_MAX;
+        treeData = data;
+    }
+    return kdtree_build(nullptr, treeData, N, D, 16, treetype, KD_BUILD_SPLIT);
+}
+
+// The compact trees are known by the size and time of their file, so the tests write one to stand for an index
+static bool writeCodeFile(const char *fn, size_t bytes)
+{
+    FILE *f = fopen(fn, "wb");
+    if (!f)
+        return false;
+    std::vector<char> contents(bytes, 'c');
+    const bool written = fwrite(contents.data(), 1, bytes, f) == bytes;
+    return fclose(f) == 0 && written;
+}
+
+// Fills "pt" with a random query point of the tree's external type.
+static void randomQuery(int treetype, void *pt)
+{
+    for (int d = 0; d < CODE_DIM; ++d)
+    {
+        double v = (double)rand() / RAND_MAX;
+        if (treetype == KDTT_FLOAT)
+            ((float *)pt)[d] = (float)v;
+        else
+            ((double *)pt)[d] = v;
+    }
+}
+
+// ==========================================
+// 1. Reused buffers give the same answers
+// ==========================================
+bool TestKDTreeResults::runReuseMatchesFresh(int treetype)
+{
+    srand(42);
+    kdtree_t *kd = buildTree(treetype, NUM_CODES, CODE_DIM);
+    if (!kd)
+    {
+        printf("ERROR: kdtree_build failed!\n");
+        return false;
+    }
+
+    bool passed = true;
+    double pt[CODE_DIM];
+    kdtree_qres_t *reused = kdtree_qres_new();
+    for (int q = 0; q < WARMUP_QUERIES && passed; ++q)
+    {
+        randomQuery(treetype, pt);
+        // Large radii now and then, so the buffer has to grow past its initial size.
+        double maxd2 = (q % 50 == 0) ? 0.05 : CODE_TOL2;
+        reused = kdtree_rangesearch_options_reuse(kd, reused, pt, maxd2, CODE_OPTIONS);
+        kdtree_qres_t *fresh = kdtree_rangesearch_options(kd, pt, maxd2, KD_OPTIONS_COMPUTE_DISTS);
+
+        std::vector<u32> a(reused->inds, reused->inds + reused->nres);
+        std::vector<u32> b(fresh->inds, fresh->inds + fresh->nres);
+        std::sort(a.begin(), a.end());
+        std::sort(b.begin(), b.end());
+        if (a != b)
+        {
+            printf("ERROR: query %d found %u results with a reused buffer and %u with a fresh one\n",
+                   q, reused->nres, fresh->nres);
+            passed = false;
+        }
+        kdtree_free_query(fresh);
+        kdtree_qres_reset(reused);
+        if (reused->nres != 0)
+        {
+            printf("ERROR: kdtree_qres_reset did not clear the results\n");
+            passed = false;
+        }
+    }
+    kdtree_free_query(reused);
+    kdtree_free(kd);
+    return passed;
+}
+
+// ==========================================
+// 2. No allocations once the buffer is warm
+// ==========================================
+bool TestKDTreeResults::runSteadyStateAllocations(int treetype)
+{
+    srand(7);
+    kdtree_t *kd = buildTree(treetype, NUM_CODES, CODE_DIM);
+    if (!kd)
+    {
+        printf("ERROR: kdtree_build failed!\n");
+        return false;
+    }
+
+    double pt[CODE_DIM];
+    kdtree_qres_t *res = kdtree_qres_new();
+    for (int q = 0; q < WARMUP_QUERIES; ++q)
+    {
+        randomQuery(treetype, pt);
+        res = kdtree_rangesearch_options_reuse(kd, res, pt, CODE_TOL2, CODE_OPTIONS);
+        kdtree_qres_reset(res);
+    }
+    size_t warmAllocations = res->nalloc;
+    unsigned int warmCapacity = res->capacity;
+
+    for (int q = 0; q < STEADY_QUERIES; ++q)
+    {
+        randomQuery(treetype, pt);
+        res = kdtree_rangesearch_options_reuse(kd, res, pt, CODE_TOL2, CODE_OPTIONS);
+        kdtree_qres_reset(res);
+    }
+
+    bool passed = true;
+    if (res->nalloc != warmAllocations || res->capacity != warmCapacity)
+    {
+        printf("ERROR: %zu allocations during %d steady-state queries (capacity %u -> %u)\n",
+               res->nalloc - warmAllocations, STEADY_QUERIES, warmCapacity, res->capacity);
+        passed = false;
+    }
+    else
+    {
+        printf("%zu allocations during warm-up, none in %d steady-state queries\n",
+               warmAllocations, STEADY_QUERIES);
+    }
+    kdtree_free_query(res);
+    kdtree_free(kd);
+    return passed;
+}
+
+// ==========================================
+// 3. The compact code tree finds the same codes
+// ==========================================
+bool TestKDTreeResults::runCompactSearchMatches()
+{
+    srand(99);
+    kdtree_t *kd = buildTree(KDTT_DOUBLE, NUM_CODES, CODE_DIM);
+    codetree_t *codes = (codetree_t *)calloc(1, sizeof(codetree_t));
+    codetree_t *again = (codetree_t *)calloc(1, sizeof(codetree_t));
+    if (!kd || !codes || !again)
+    {
+        printf("ERROR: kdtree_build failed!\n");
+        return false;
+    }
+    codes->tree = kd;
+    again->tree = kd;
+    if (!writeCodeFile("codes.ckdt", 2880))
+    {
+        printf("ERROR: codes.ckdt could not be written\n");
+        return false;
+    }
+    if (codetree_compact(codes, "codes.ckdt") != 0 || !codes->compact)
+    {
+        printf("ERROR: codetree_compact failed!\n");
+        return false;
+    }
+
+    bool passed = true;
+    // The next solve opens the same file again, and gets the same compact tree rather than building another
+    if (codetree_compact(again, "codes.ckdt") != 0 || again->compact != codes->compact)
+    {
+        printf("ERROR: the compact tree of the same file was built again\n");
+        passed = false;
+    }
+
+    // Every coordinate can be up to a quarter outside the codes, so many queries are outside the tree's bounds
+    double pt[CODE_DIM];
+    kdtree_qres_t *full = kdtree_qres_new();
+    kdtree_qres_t *compact = kdtree_qres_new();
+    size_t numFound = 0;
+    int numOutside = 0;
+    for (int q = 0; q < WARMUP_QUERIES * 10 && passed; ++q)
+    {
+        bool outside = false;
+        for (int d = 0; d < CODE_DIM; ++d)
+        {
+            pt[d] = -0.25 + 1.5 * rand() / RAND_MAX;
+            outside = outside || pt[d] < 0.0 || pt[d] > 1.0;
+        }
+        numOutside += outside;
+        double maxd2 = (q % 2 == 0) ? 0.05 : CODE_TOL2;
+        full = kdtree_rangesearch_options_reuse(kd, full, pt, maxd2, CODE_OPTIONS);
+        compact = codetree_rangesearch(codes, compact, pt, maxd2, CODE_OPTIONS);
+
+        std::vector<u32> a(full->inds, full->inds + full->nres);
+        std::vector<u32> b(compact->inds, compact->inds + compact->nres);
+        std::sort(a.begin(), a.end());
+        std::sort(b.begin(), b.end());
+        if (a != b)
+        {
+            printf("ERROR: query %d found %u codes in the full tree and %u in the compact one\n", q, full->nres,
+                   compact->nres);
+            passed = false;
+        }
+        numFound += a.size();
+        kdtree_qres_reset(full);
+        kdtree_qres_reset(compact);
+    }
+    printf("%zu codes found by %d queries, %d of them outside the tree\n", numFound, WARMUP_QUERIES * 10, numOutside);
+    kdtree_free_query(full);
+    kdtree_free_query(compact);
+    codetree_close(again);
+    codetree_close(codes);
+    // By default no tree is kept once the code trees using it are closed
+    if (codetree_compact_cache_idle_bytes() != 0)
+    {
+        printf("ERROR: %zu bytes of compact trees were kept without a cache limit\n", codetree_compact_cache_idle_bytes());
+        passed = false;
+    }
+    remove("codes.ckdt");
+    kdtree_free(kd);
+    return passed && numFound > 0 && numOutside > 0;
+}
+
+// ==========================================
+// 4. The compact trees are kept up to the limit, and a file that changed gets a new one
+// ==========================================
+bool TestKDTreeResults::runCompactCacheKeepsTrees()
+{
+    srand(101);
+    kdtree_t *kd = buildTree(KDTT_DOUBLE, NUM_CODES, CODE_DIM);
+    if (!kd || !writeCodeFile("cached.ckdt", 2880))
+    {
+        printf("ERROR: the code tree could not be made\n");
+        return false;
+    }
+    // Each solve opens the index again, and closes its code tree when it is done
+    auto compactTree = [kd]()
+    {
+        codetree_t *codes = (codetree_t *)calloc(1, sizeof(codetree_t));
+        codes->tree = kd;
+        codetree_compact(codes, "cached.ckdt");
+        kdtree_t *compact = codes->compact;
+        codetree_close(codes);
+        return compact;
+    };
+
+    bool passed = true;
+    codetree_set_compact_cache_limit((size_t)64 << 20);
+    kdtree_t *kept = compactTree();
+    if (!kept || codetree_compact_cache_idle_bytes() == 0)
+    {
+        printf("ERROR: the compact tree was not kept after its code tree was closed\n");
+        passed = false;
+    }
+    if (compactTree() != kept)
+    {
+        printf("ERROR: the kept compact tree was not used again\n");
+        passed = false;
+    }
+
+    // The index file is replaced.  The kept tree is still in memory, so a new one cannot have its address.
+    if (!writeCodeFile("cached.ckdt", 5760) || compactTree() == kept)
+    {
+        printf("ERROR: the compact tree of the replaced file was not built again\n");
+        passed = false;
+    }
+
+    codetree_clear_compact_cache();
+    if (codetree_compact_cache_idle_bytes() != 0)
+    {
+        printf("ERROR: %zu bytes of compact trees were left after the cache was cleared\n", codetree_compact_cache_idle_bytes());
+        passed = false;
+    }
+    codetree_set_compact_cache_limit(0);
+    remove("cached.ckdt");
+    kdtree_free(kd);
+    return passed;
+}
+
+int main(int argc, char *argv[])
+{
+    TestKDTreeResults test;
+
+    printf("Starting kd-tree result reuse test suite...\n");
+    fflush(stdout);
+
+    bool reuseDouble = test.runReuseMatchesFresh(KDTT_DOUBLE);
+    bool reuseFloat = test.runReuseMatchesFresh(KDTT_FLOAT);
+    bool steadyDouble = test.runSteadyStateAllocations(KDTT_DOUBLE);
+    bool steadyFloat = test.runSteadyStateAllocations(KDTT_FLOAT);
+    bool compact = test.runCompactSearchMatches();
+    bool cache = test.runCompactCacheKeepsTrees();
+
+    printf("\n========================================\n");
+    printf("KD-TREE RESULT REUSE TEST SUITE SUMMARY:\n");
+    printf("1. Reused results match (double): %s\n", reuseDouble ? "PASSED" : "FAILED");
+    printf("2. Reused results match (float):  %s\n", reuseFloat ? "PASSED" : "FAILED");
+    printf("3. Steady state allocs (double):  %s\n", steadyDouble ? "PASSED" : "FAILED");
+    printf("4. Steady state allocs (float):   %s\n", steadyFloat ? "PASSED" : "FAILED");
+    printf("5. Compact code tree matches:     %s\n", compact ? "PASSED" : "FAILED");
+    printf("6. Compact trees are cached:      %s\n", cache ? "PASSED" : "FAILED");
+    printf("========================================\n");
+    fflush(stdout);
+
+    if (reuseDouble && reuseFloat && steadyDouble && steadyFloat && compact && cache)
+    {
+        printf("All kd-tree result reuse tests passed successfully!\n");
+        return 0;
+    }
+    printf("Some kd-tree result reuse tests FAILED!\n");
+    return 1;
+}
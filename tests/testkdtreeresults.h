@@ -0,0 +1,26 @@
+#ifndef TESTKDTREERESULTS_H
+#define TESTKDTREERESULTS_H
+
+#include <stdio.h>
+
+extern "C" {
+#include "astrometry/kdtree.h"
+#include "astrometry/codekd.h"
+}
+
+class TestKDTreeResults
+{
+public:
+    TestKDTreeResults();
+    ~TestKDTreeResults();
+    bool runReuseMatchesFresh(int treetype);
+    bool runSteadyStateAllocations(int treetype);
+    bool runCompactSearchMatches();
+    bool runCompactCacheKeepsTrees();
+
+private:
+    kdtree_t *buildTree(int treetype, int N, int D);
+    void *treeData { nullptr };
+};
+
+#endif // TESTKDTREERESULTS_H
@@ -0,0 +1,250 @@
+#include "testmappedimage.h"
+#include "testhelpers.h"
+#include "structuredefinitions.h"
+#include "sep/sepcore.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <chrono>
+#include <type_traits>
+#include <vector>
+
+using namespace SEP;
+using namespace TestHelpers;
+
+TestMappedImage::TestMappedImage()
+{
+}
+
+// The pixels the way a FITS file stores them, big endian with the sign bit of unsigned integers flipped by BZERO
+template <typename T>
+static std::vector<uint8_t> toFITS(const std::vector<T> &image)
+{
+    std::vector<uint8_t> bytes(image.size() * sizeof(T));
+    for (size_t i = 0; i < image.size(); i++)
+    {
+        uint8_t native[sizeof(T)];
+        memcpy(native, &image[i], sizeof(T));
+        for (size_t b = 0; b < sizeof(T); b++)
+            bytes[i * sizeof(T) + b] = native[sizeof(T) - 1 - b];
+        if (std::is_unsigned<T>::value && sizeof(T) > 1)
+            bytes[i * sizeof(T)] ^= 0x80;
+    }
+    return bytes;
+}
+
+// ==========================================
+// 1. Big endian converters match the native ones
+// ==========================================
+template <typename T>
+bool TestMappedImage::runConvertersMatchNative(int nativeType, int bigEndianType)
+{
+    srand(5);
+    std::vector<T> image = makeNoise<T>((size_t)TEST_W * TEST_H);
+    std::vector<uint8_t> fits = toFITS(image);
+
+    array_converter nativeArray, fitsArray;
+    converter nativeOne, fitsOne;
+    int nativeSize, fitsSize, oneSize;
+    if (get_array_converter(nativeType, &nativeArray, &nativeSize) != RETURN_OK ||
+            get_array_converter(bigEndianType, &fitsArray, &fitsSize) != RETURN_OK ||
+            get_converter(bigEndianType, &fitsOne, &oneSize) != RETURN_OK ||
+            get_converter(nativeType, &nativeOne, &oneSize) != RETURN_OK)
+    {
+        printf("ERROR: there is no converter for type %d or %d\n", nativeType, bigEndianType);
+        return false;
+    }
+    if (fitsSize != nativeSize || fitsSize != (int)sizeof(T))
+    {
+        printf("ERROR: type %d has %d byte pixels instead of %d\n", bigEndianType, fitsSize, (int)sizeof(T));
+        return false;
+    }
+
+    std::vector<float> nativeRow(TEST_W), fitsRow(TEST_W);
+    for (int y = 0; y < TEST_H; y++)
+    {
+        nativeArray(image.data() + (size_t)y * TEST_W, TEST_W, nativeRow.data());
+        fitsArray(fits.data() + (size_t)y * TEST_W * sizeof(T), TEST_W, fitsRow.data());
+        if (memcmp(nativeRow.data(), fitsRow.data(), TEST_W * sizeof(float)) != 0)
+        {
+            printf("ERROR: type %d converts row %d differently\n", bigEndianType, y);
+            return false;
+        }
+        for (int x = 0; x < TEST_W; x += 97)
+        {
+            size_t i = (size_t)y * TEST_W + x;
+            if (nativeOne(&image[i]) != fitsOne(fits.data() + i * sizeof(T)))
+            {
+                printf("ERROR: type %d converts pixel %d,%d differently\n", bigEndianType, x, y);
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+// ==========================================
+// 2. The element accessor matches the native pixels
+// ==========================================
+template <typename T>
+bool TestMappedImage::runAccessorMatchesNative()
+{
+    srand(7);
+    const int channels = 3;
+    std::vector<T> image = makeNoise<T>((size_t)TEST_W * TEST_H * channels);
+    std::vector<uint8_t> fits = toFITS(image);
+
+    FITSImage::MappedImage mapped;
+    mapped.data = std::shared_ptr<const uint8_t>(fits.data(), [](const uint8_t *) {});
+    mapped.bytesPerPixel = sizeof(T);
+    mapped.width = TEST_W;
+    mapped.height = TEST_H;
+    for (uint32_t c = 0; c < (uint32_t)channels; c++)
+        for (uint32_t y = 0; y < (uint32_t)TEST_H; y += 13)
+            for (uint32_t x = 0; x < (uint32_t)TEST_W; x += 7)
+            {
+                T expected = image[((size_t)c * TEST_H + y) * TEST_W + x];
+                T pixel = mapped.value<T>(c, x, y);
+                if (memcmp(&pixel, &expected, sizeof(T)) != 0)
+                {
+                    printf("ERROR: %d byte pixel %u,%u of channel %u reads wrong\n", (int)sizeof(T), x, y, c);
+                    return false;
+                }
+            }
+    return true;
+}
+
+static sep_image makeSepImage(void *data, int dtype, int w, int h)
+{
+    sep_image im;
+    memset(&im, 0, sizeof(im));
+    im.data = data;
+    im.dtype = dtype;
+    im.raw_w = w;
+    im.raw_h = h;
+    im.w = w;
+    im.h = h;
+    im.noise_type = SEP_NOISE_NONE;
+    im.noiseval = 1.0;
+    im.nthreads = 1;
+    return im;
+}
+
+// ==========================================
+// 3. The background of the file equals the background of the loaded image
+// ==========================================
+bool TestMappedImage::runBackgroundMatchesNative()
+{
+    srand(11);
+    std::vector<uint16_t> image((size_t)TEST_W * TEST_H);
+    for (int y = 0; y < TEST_H; y++)
+        for (int x = 0; x < TEST_W; x++)
+            image[(size_t)y * TEST_W + x] = (uint16_t)(1000 + x / 10 + y / 20 + rand() % 200);
+    std::vector<uint8_t> fits = toFITS(image);
+
+    sep_bkg *nativeBkg = nullptr, *fitsBkg = nullptr;
+    sep_image nativeImage = makeSepImage(image.data(), SEP_TUSHORT, TEST_W, TEST_H);
+    sep_image fitsImage = makeSepImage(fits.data(), SEP_TUSHORT_BE, TEST_W, TEST_H);
+    if (sep_background(&nativeImage, 64, 64, 3, 3, 0.0, &nativeBkg) != 0 ||
+            sep_background(&fitsImage, 64, 64, 3, 3, 0.0, &fitsBkg) != 0)
+    {
+        printf("ERROR: sep_background failed\n");
+        sep_bkg_free(nativeBkg);
+        sep_bkg_free(fitsBkg);
+        return false;
+    }
+    bool passed = true;
+    if (memcmp(nativeBkg->back, fitsBkg->back, sizeof(float) * nativeBkg->n) != 0 ||
+            memcmp(nativeBkg->sigma, fitsBkg->sigma, sizeof(float) * nativeBkg->n) != 0)
+    {
+        printf("ERROR: the background of the big endian image differs\n");
+        passed = false;
+    }
+    sep_bkg_free(nativeBkg);
+    sep_bkg_free(fitsBkg);
+    return passed;
+}
+
+// ==========================================
+// 4. Benchmark against swapping the image first
+// ==========================================
+bool TestMappedImage::runBenchmark()
+{
+    srand(13);
+    std::vector<uint16_t> image = makeNoise<uint16_t>((size_t)BENCH_W * BENCH_H);
+    std::vector<uint8_t> fits = toFITS(image);
+    std::vector<uint16_t> swapped(image.size());
+    std::vector<float> row(BENCH_W);
+    array_converter convertNative, convertFITS;
+    int size;
+    get_array_converter(SEP_TUSHORT, &convertNative, &size);
+    get_array_converter(SEP_TUSHORT_BE, &convertFITS, &size);
+
+    // The best of a few runs, so the first touch of the buffers is not counted
+    double swapMs = HUGE_VAL, fusedMs = HUGE_VAL;
+    for (int r = 0; r < BENCH_RUNS; r++)
+    {
+        auto start = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < swapped.size(); i++)
+            swapped[i] = (uint16_t)(((fits[2 * i] ^ 0x80) << 8) | fits[2 * i + 1]);
+        for (int y = 0; y < BENCH_H; y++)
+            convertNative(swapped.data() + (size_t)y * BENCH_W, BENCH_W, row.data());
+        auto middle = std::chrono::steady_clock::now();
+        for (int y = 0; y < BENCH_H; y++)
+            convertFITS(fits.data() + (size_t)y * BENCH_W * 2, BENCH_W, row.data());
+        auto end = std::chrono::steady_clock::now();
+        swapMs = std::min(swapMs, std::chrono::duration<double, std::milli>(middle - start).count());
+        fusedMs = std::min(fusedMs, std::chrono::duration<double, std::milli>(end - middle).count());
+    }
+    printf("%dx%d 16 bit, swap then convert:  %8.1f ms\n", BENCH_W, BENCH_H, swapMs);
+    printf("%dx%d 16 bit, convert big endian: %8.1f ms (%.1fx)\n", BENCH_W, BENCH_H, fusedMs, swapMs / fusedMs);
+    fflush(stdout);
+    return true;
+}
+
+int main(int argc, char *argv[])
+{
+    TestMappedImage test;
+
+    printf("Starting mapped image test suite...\n");
+    fflush(stdout);
+
+    bool shortConvert = test.runConvertersMatchNative<int16_t>(SEP_TSHORT, SEP_TSHORT_BE);
+    bool ushortConvert = test.runConvertersMatchNative<uint16_t>(SEP_TUSHORT, SEP_TUSHORT_BE);
+    bool intConvert = test.runConvertersMatchNative<int32_t>(SEP_TINT, SEP_TINT_BE);
+    bool uintConvert = test.runConvertersMatchNative<uint32_t>(SEP_TUINT, SEP_TUINT_BE);
+    bool floatConvert = test.runConvertersMatchNative<float>(SEP_TFLOAT, SEP_TFLOAT_BE);
+    bool doubleConvert = test.runConvertersMatchNative<double>(SEP_TDOUBLE, SEP_TDOUBLE_BE);
+    bool accessor = test.runAccessorMatchesNative<uint8_t>() && test.runAccessorMatchesNative<int16_t>() &&
+                    test.runAccessorMatchesNative<uint16_t>() && test.runAccessorMatchesNative<int32_t>() &&
+                    test.runAccessorMatchesNative<uint32_t>() && test.runAccessorMatchesNative<float>() &&
+                    test.runAccessorMatchesNative<double>();
+    bool background = test.runBackgroundMatchesNative();
+    bool runBenchmark = benchmarksRequested(argc, argv);
+    bool benchmark = !runBenchmark || test.runBenchmark();
+
+    printf("\n========================================\n");
+    printf("MAPPED IMAGE TEST SUITE SUMMARY:\n");
+    printf("1. Converters match (16 bit):          %s\n", shortConvert ? "PASSED" : "FAILED");
+    printf("2. Converters match (unsigned 16 bit): %s\n", ushortConvert ? "PASSED" : "FAILED");
+    printf("3. Converters match (32 bit):          %s\n", intConvert ? "PASSED" : "FAILED");
+    printf("4. Converters match (unsigned 32 bit): %s\n", uintConvert ? "PASSED" : "FAILED");
+    printf("5. Converters match (float):           %s\n", floatConvert ? "PASSED" : "FAILED");
+    printf("6. Converters match (double):          %s\n", doubleConvert ? "PASSED" : "FAILED");
+    printf("7. Element accessor matches:           %s\n", accessor ? "PASSED" : "FAILED");
+    printf("8. Background matches:                 %s\n", background ? "PASSED" : "FAILED");
+    printf("9. Benchmark:                          %s\n", benchmarkResult(runBenchmark, benchmark));
+    printf("========================================\n");
+    fflush(stdout);
+
+    if (shortConvert && ushortConvert && intConvert && uintConvert && floatConvert && doubleConvert && accessor && background
+            && benchmark)
+    {
+        printf("All mapped image tests passed successfully!\n");
+        return 0;
+    }
+    printf("Some mapped image tests FAILED!\n");
+    return 1;
+}
@@ -0,0 +1,18 @@
+#ifndef TESTMAPPEDIMAGE_H
+#define TESTMAPPEDIMAGE_H
+
+#include <stdio.h>
+
+#include "sep/sep.h"
+
+class TestMappedImage
+{
+public:
+    TestMappedImage();
+    template <typename T> bool runConvertersMatchNative(int nativeType, int bigEndianType);
+    template <typename T> bool runAccessorMatchesNative();
+    bool runBackgroundMatchesNative();
+    bool runBenchmark();
+};
+
+#endif // TESTMAPPEDIMAGE_H
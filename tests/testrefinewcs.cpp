@@ -0,0 +1,141 @@
+#include "testrefinewcs.h"
+
+#include <math.h>
+
+// The stars of each new frame are moved by this many pixels from the last, enough that a WCS which did not follow them would put
+// the center several pixels away
+static constexpr double SHIFT_X = 3.0;
+static constexpr double SHIFT_Y = -2.0;
+// The refined center must land within this many pixels of where the shift puts it
+static constexpr double CENTER_TOLERANCE = 0.5;
+
+TestRefineWCS::TestRefineWCS()
+{
+}
+
+TestRefineWCS::~TestRefineWCS()
+{
+}
+
+// Solves the image at full resolution, so the stars of the solve are in the pixels of the image
+bool TestRefineWCS::solveImage(QString fileName)
+{
+    if(!imageLoader.loadImage(fileName))
+    {
+        printf("ERROR: could not load %s\n", fileName.toUtf8().data());
+        return false;
+    }
+    stats = imageLoader.getStats();
+    solver.reset(new StellarSolver(stats, imageLoader.getImageBuffer(), nullptr));
+    solver->setProperty("ExtractorType", SSolver::EXTRACTOR_INTERNAL);
+    solver->setProperty("SolverType", SSolver::SOLVER_STELLARSOLVER);
+    solver->setProperty("ProcessType", SSolver::SOLVE);
+    solver->setParameterProfile(SSolver::Parameters::DEFAULT);
+    SSolver::Parameters params = solver->getCurrentParameters();
+    params.autoDownsample = false;
+    params.downsample = 1;
+    solver->setParameters(params);
+    solver->setIndexFolderPaths(QStringList() << "astrometry");
+    solver->setLogLevel(LOG_NONE);
+    if(!solver->solve())
+    {
+        printf("ERROR: %s did not solve\n", fileName.toUtf8().data());
+        return false;
+    }
+    solvedStars = solver->getStarListFromSolve();
+    solvedWCS = solver->getWCSData();
+    const FITSImage::Solution solution = solver->getSolution();
+    printf("solved: RA=%.5f Dec=%.5f pixscale=%.4f with %d stars\n", solution.ra, solution.dec, solution.pixscale,
+           static_cast<int>(solvedStars.size()));
+    return true;
+}
+
+// Refines the WCS of the previous frame with the solved stars moved by one more shift, as if the mount had drifted,
+// and checks that the new center is the sky the previous WCS put at the center minus the shift
+bool TestRefineWCS::refineFrame(WCSData &previous, int frame, WCSData &refined)
+{
+    QList<FITSImage::Star> stars = solvedStars;
+    for(auto &star : stars)
+    {
+        star.x += frame * SHIFT_X;
+        star.y += frame * SHIFT_Y;
+    }
+    if(!solver->refineWCS(previous, stars))
+    {
+        printf("ERROR: the shifted stars were not refined\n");
+        return false;
+    }
+    refined = solver->getWCSData();
+
+    const QPointF center(stats.width / 2.0, stats.height / 2.0);
+    FITSImage::wcs_point expected, found, unmoved;
+    if(!previous.pixelToWCS(center - QPointF(SHIFT_X, SHIFT_Y), expected) || !refined.pixelToWCS(center, found)
+            || !previous.pixelToWCS(center, unmoved))
+    {
+        printf("ERROR: the center could not be converted to RA and DEC\n");
+        return false;
+    }
+    const double pixscale = solver->getSolution().pixscale;
+    auto pixelsApart = [pixscale](const FITSImage::wcs_point & a, const FITSImage::wcs_point & b)
+    {
+        const double dRA = (a.ra - b.ra) * cos(b.dec * M_PI / 180.0);
+        return hypot(dRA, a.dec - b.dec) * 3600.0 / pixscale;
+    };
+    const double off = pixelsApart(found, expected);
+    printf("refined center is %.3f pixels from the shifted center and %.3f from the previous one\n", off,
+           pixelsApart(found, unmoved));
+    if(off > CENTER_TOLERANCE)
+    {
+        printf("ERROR: the refined center is at %f, %f instead of %f, %f\n", found.ra, found.dec, expected.ra, expected.dec);
+        return false;
+    }
+    return true;
+}
+
+// ==========================================
+// 1. Refining with shifted stars moves the center with them
+// ==========================================
+bool TestRefineWCS::runShiftedStarsRecoverCenter()
+{
+    return refineFrame(solvedWCS, 1, firstFrameWCS);
+}
+
+// ==========================================
+// 2. A second frame, refined from the first with the cached reference stars, moves the center again
+// ==========================================
+bool TestRefineWCS::runSecondFrameRecoversCenter()
+{
+    WCSData secondFrameWCS;
+    return refineFrame(firstFrameWCS, 2, secondFrameWCS);
+}
+
+int main(int argc, char *argv[])
+{
+    QApplication app(argc, argv);
+#if defined(__linux__)
+    setlocale(LC_NUMERIC, "C");
+#endif
+    TestRefineWCS test;
+
+    printf("Starting WCS refinement test suite...\n");
+    fflush(stdout);
+
+    bool solved = test.solveImage("randomsky.fits");
+    bool shifted = solved && test.runShiftedStarsRecoverCenter();
+    bool second = shifted && test.runSecondFrameRecoversCenter();
+
+    printf("\n========================================\n");
+    printf("WCS REFINEMENT TEST SUITE SUMMARY:\n");
+    printf("1. Shifted stars move the center:      %s\n", shifted ? "PASSED" : "FAILED");
+    printf("2. A second frame moves it again:      %s\n", second ? "PASSED" : "FAILED");
+    printf("========================================\n");
+    fflush(stdout);
+
+    if (shifted && second)
+    {
+        printf("All WCS refinement tests passed successfully!\n");
+        return 0;
+    }
+    printf("Some WCS refinement tests FAILED!\n");
+    return 1;
+}
@@ -0,0 +1,35 @@
+#ifndef TESTREFINEWCS_H
+#define TESTREFINEWCS_H
+
+//Qt Includes
+#include <QApplication>
+#include <QObject>
+
+#include <stdio.h>
+
+//Includes for this project
+#include "structuredefinitions.h"
+#include "stellarsolver.h"
+#include "ssolverutils/fileio.h"
+
+class TestRefineWCS : public QObject
+{
+    Q_OBJECT
+public:
+    TestRefineWCS();
+    ~TestRefineWCS();
+    bool solveImage(QString fileName);
+    bool runShiftedStarsRecoverCenter();
+    bool runSecondFrameRecoversCenter();
+
+private:
+    bool refineFrame(WCSData &previous, int frame, WCSData &refined);
+    fileio imageLoader;
+    FITSImage::Statistic stats;
+    std::unique_ptr<StellarSolver> solver;
+    QList<FITSImage::Star> solvedStars;
+    WCSData solvedWCS;
+    WCSData firstFrameWCS;
+};
+
+#endif // TESTREFINEWCS_H
@@ -0,0 +1,173 @@
+#include "testsaturation.h"
+
+#include <math.h>
+#include <stdlib.h>
+
+#include <algorithm>
+
+#include "testhelpers.h"
+
+// The stars are on a grid, every fourth one so bright that its middle is clipped at the top of the 16 bit range
+static constexpr int GRID = 40;
+static constexpr int NUM_X = TestHelpers::TEST_W / GRID - 1;
+static constexpr int NUM_Y = TestHelpers::TEST_H / GRID - 1;
+static constexpr int NUM_SATURATED = (NUM_X * NUM_Y + 3) / 4;
+static constexpr int NUM_UNSATURATED = NUM_X * NUM_Y - NUM_SATURATED;
+
+// This lets the test prepare the image the way a solve does before it extracts the stars
+class PreparedExtractor : public InternalExtractorSolver
+{
+    public:
+        using InternalExtractorSolver::InternalExtractorSolver;
+        using InternalExtractorSolver::prepareImage;
+};
+
+TestSaturation::TestSaturation()
+{
+}
+
+TestSaturation::~TestSaturation()
+{
+}
+
+void TestSaturation::makeStarGrid(int channels)
+{
+    const int w = TestHelpers::TEST_W, h = TestHelpers::TEST_H;
+    srand(43);
+    image.assign(static_cast<size_t>(w) * h * channels, 0);
+    for(int c = 0; c < channels; c++)
+    {
+        uint16_t *plane = image.data() + static_cast<size_t>(c) * w * h;
+        for(int y = 0; y < h; y++)
+            for(int x = 0; x < w; x++)
+            {
+                double value = 1000 + 20.0 * rand() / RAND_MAX;
+                const int gx = (x + GRID / 2) / GRID, gy = (y + GRID / 2) / GRID;
+                if(gx >= 1 && gx <= NUM_X && gy >= 1 && gy <= NUM_Y)
+                {
+                    const double dx = x - gx * GRID, dy = y - gy * GRID;
+                    const double peak = ((gx - 1) + (gy - 1) * NUM_X) % 4 == 0 ? 200000 : 5000;
+                    value += peak * exp(-(dx * dx + dy * dy) / (2 * 2.5 * 2.5));
+                }
+                plane[static_cast<size_t>(y) * w + x] = static_cast<uint16_t>(std::min(value, 65535.0));
+            }
+    }
+}
+
+// Extracts the stars of the image, merging its channels if it has three, and downsampling it first if asked to
+bool TestSaturation::extract(int channels, int downsample, double saturationLimit, QList<FITSImage::Star> &stars)
+{
+    FITSImage::Statistic stats;
+    stats.dataType = TUSHORT;
+    stats.bytesPerPixel = sizeof(uint16_t);
+    stats.width = TestHelpers::TEST_W;
+    stats.height = TestHelpers::TEST_H;
+    stats.samples_per_channel = stats.width * stats.height;
+    stats.channels = channels;
+    PreparedExtractor extractor(SSolver::EXTRACT, SSolver::EXTRACTOR_INTERNAL, SSolver::SOLVER_STELLARSOLVER,
+                                stats, reinterpret_cast<const uint8_t *>(image.data()));
+    extractor.m_ActiveParameters = StellarSolver::getBuiltInProfiles().at(SSolver::Parameters::ALL_STARS);
+    extractor.m_ActiveParameters.maxEllipse = 0;
+    extractor.m_ActiveParameters.saturationLimit = saturationLimit;
+    extractor.convFilter = StellarSolver::generateConvFilter(extractor.m_ActiveParameters.convFilterType,
+                           extractor.m_ActiveParameters.fwhm);
+    extractor.m_ColorChannel = channels == 3 ? FITSImage::AVERAGE_RGB : FITSImage::GREEN;
+    if(downsample > 1 && !extractor.prepareImage(channels == 3, downsample))
+    {
+        printf("ERROR: the image was not downsampled\n");
+        return false;
+    }
+    if(extractor.extract() != 0)
+    {
+        printf("ERROR: the stars were not extracted\n");
+        return false;
+    }
+    stars = extractor.getStarList();
+    return true;
+}
+
+// The saturation limit of the profiles, 80% of the 16 bit range, removes the saturated stars and only them
+bool TestSaturation::checkSaturatedRemoved(int channels, int downsample)
+{
+    const double maxPeak = 0.8 * 65535;
+    makeStarGrid(channels);
+    QList<FITSImage::Star> all, unsaturated;
+    if(!extract(channels, downsample, 0, all) || !extract(channels, downsample, 80, unsaturated))
+        return false;
+    int numSaturated = 0;
+    for(const auto &star : all)
+    {
+        if(star.peak > maxPeak)
+            numSaturated++;
+    }
+    printf("%d stars without the saturation limit, %d of them saturated, %d with the limit\n", static_cast<int>(all.size()),
+           numSaturated, static_cast<int>(unsaturated.size()));
+    if(all.size() < NUM_SATURATED + NUM_UNSATURATED || numSaturated < NUM_SATURATED)
+    {
+        printf("ERROR: the stars of the image were not all found\n");
+        return false;
+    }
+    if(unsaturated.size() != all.size() - numSaturated)
+    {
+        printf("ERROR: %d stars were left instead of the %d that are not saturated\n", static_cast<int>(unsaturated.size()),
+               static_cast<int>(all.size()) - numSaturated);
+        return false;
+    }
+    return true;
+}
+
+// ==========================================
+// 1. Saturated stars are removed at full resolution
+// ==========================================
+bool TestSaturation::runFullResolution()
+{
+    return checkSaturatedRemoved(1, 1);
+}
+
+// ==========================================
+// 2. Saturated stars are removed from a downsampled image, which is made of floats
+// ==========================================
+bool TestSaturation::runDownsampled()
+{
+    return checkSaturatedRemoved(1, 2);
+}
+
+// ==========================================
+// 3. Saturated stars are removed when the channels of an RGB image are merged
+// ==========================================
+bool TestSaturation::runMergedChannels()
+{
+    return checkSaturatedRemoved(3, 1);
+}
+
+int main(int argc, char *argv[])
+{
+    QApplication app(argc, argv);
+#if defined(__linux__)
+    setlocale(LC_NUMERIC, "C");
+#endif
+    TestSaturation test;
+
+    printf("Starting saturation filter test suite...\n");
+    fflush(stdout);
+
+    bool full = test.runFullResolution();
+    bool downsampled = test.runDownsampled();
+    bool merged = test.runMergedChannels();
+
+    printf("\n========================================\n");
+    printf("SATURATION FILTER TEST SUITE SUMMARY:\n");
+    printf("1. Full resolution:               %s\n", full ? "PASSED" : "FAILED");
+    printf("2. Downsampled image:             %s\n", downsampled ? "PASSED" : "FAILED");
+    printf("3. Merged RGB channels:           %s\n", merged ? "PASSED" : "FAILED");
+    printf("========================================\n");
+    fflush(stdout);
+
+    if (full && downsampled && merged)
+    {
+        printf("All saturation filter tests passed successfully!\n");
+        return 0;
+    }
+    printf("Some saturation filter tests FAILED!\n");
+    return 1;
+}
@@ -0,0 +1,34 @@
+#ifndef TESTSATURATION_H
+#define TESTSATURATION_H
+
+//Qt Includes
+#include <QApplication>
+#include <QObject>
+
+#include <stdio.h>
+
+#include <vector>
+
+//Includes for this project
+#include "structuredefinitions.h"
+#include "stellarsolver.h"
+#include "internalextractorsolver.h"
+
+class TestSaturation : public QObject
+{
+    Q_OBJECT
+public:
+    TestSaturation();
+    ~TestSaturation();
+    bool runFullResolution();
+    bool runDownsampled();
+    bool runMergedChannels();
+
+private:
+    void makeStarGrid(int channels);
+    bool extract(int channels, int downsample, double saturationLimit, QList<FITSImage::Star> &stars);
+    bool checkSaturatedRemoved(int channels, int downsample);
+    std::vector<uint16_t> image;
+};
+
+#endif // TESTSATURATION_H
@@ -0,0 +1,205 @@
+#include "testsipfit.h"
+#include "testhelpers.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <chrono>
+
+extern "C" {
+#include "astrometry/fit-wcs.h"
+#include "astrometry/gslutils.h"
+}
+
+// Roughly what tweak2 sees when tuning a match on a 4k x 3k frame
+static constexpr int IMAGE_W = 4000;
+static constexpr int IMAGE_H = 3000;
+static constexpr int NUM_STARS = 400;
+static constexpr int BENCH_FITS = 200;
+
+// Compares two fits term by term, allowing for rounding.
+static bool sameFit(const sip_t &a, const sip_t &b)
+{
+    for (int i = 0; i < 2; i++)
+        if (fabs(a.wcstan.crval[i] - b.wcstan.crval[i]) > 1e-12 ||
+                fabs(a.wcstan.crpix[i] - b.wcstan.crpix[i]) > 1e-9)
+            return false;
+    for (int i = 0; i < 2; i++)
+        for (int j = 0; j < 2; j++)
+            if (fabs(a.wcstan.cd[i][j] - b.wcstan.cd[i][j]) > 1e-9 * fabs(a.wcstan.cd[i][j]) + 1e-18)
+                return false;
+    for (int p = 0; p < SIP_MAXORDER; p++)
+        for (int q = 0; q < SIP_MAXORDER; q++)
+            if (fabs(a.a[p][q] - b.a[p][q]) > 1e-9 * fabs(a.a[p][q]) + 1e-20 ||
+                    fabs(a.b[p][q] - b.b[p][q]) > 1e-9 * fabs(a.b[p][q]) + 1e-20 ||
+                    fabs(a.ap[p][q] - b.ap[p][q]) > 1e-9 * fabs(a.ap[p][q]) + 1e-20 ||
+                    fabs(a.bp[p][q] - b.bp[p][q]) > 1e-9 * fabs(a.bp[p][q]) + 1e-20)
+                return false;
+    return true;
+}
+
+TestSipFit::TestSipFit()
+{
+    memset(&truth, 0, sizeof(truth));
+}
+
+// A TAN plus a small distortion of the given order, and stars placed through it.
+void TestSipFit::makeStars(int order, int N)
+{
+    tan_t tan;
+    memset(&tan, 0, sizeof(tan));
+    tan.crval[0] = 83.8;
+    tan.crval[1] = -5.4;
+    tan.crpix[0] = IMAGE_W / 2.0;
+    tan.crpix[1] = IMAGE_H / 2.0;
+    tan.cd[0][0] = 1.2 / 3600.0;
+    tan.cd[1][1] = -1.2 / 3600.0;
+    tan.imagew = IMAGE_W;
+    tan.imageh = IMAGE_H;
+    sip_wrap_tan(&tan, &truth);
+    truth.a_order = truth.b_order = order;
+    for (int p = 0; p <= order; p++)
+        for (int q = 0; p + q <= order; q++)
+            if (p + q >= 2)
+            {
+                double scale = pow(IMAGE_W / 2.0, -(double)(p + q - 1));
+                truth.a[p][q] = 2e-2 * scale * ((double)rand() / RAND_MAX - 0.5);
+                truth.b[p][q] = 2e-2 * scale * ((double)rand() / RAND_MAX - 0.5);
+            }
+
+    starxyz.resize(3 * N);
+    fieldxy.resize(2 * N);
+    weights.resize(N);
+    for (int i = 0; i < N; i++)
+    {
+        double x = 1 + (IMAGE_W - 1) * (double)rand() / RAND_MAX;
+        double y = 1 + (IMAGE_H - 1) * (double)rand() / RAND_MAX;
+        fieldxy[2 * i + 0] = x;
+        fieldxy[2 * i + 1] = y;
+        sip_pixelxy2xyzarr(&truth, x, y, &starxyz[3 * i]);
+        weights[i] = 0.5 + 0.5 * (double)rand() / RAND_MAX;
+    }
+}
+
+// ==========================================
+// 1. A reused workspace gives the same fit
+// ==========================================
+bool TestSipFit::runWorkspaceMatchesFresh(int order)
+{
+    srand(1000 + order);
+    makeStars(order, NUM_STARS);
+    gslutils_lsq_t *ws = gslutils_lsq_new();
+    bool passed = true;
+
+    // Different star counts, so the workspace has to be resized in between.
+    for (int n = NUM_STARS / 4; n <= NUM_STARS && passed; n += NUM_STARS / 4)
+    {
+        sip_t fresh, reused;
+        if (fit_sip_wcs(starxyz.data(), fieldxy.data(), weights.data(), n, &truth.wcstan,
+                        order, order, 1, &fresh) ||
+                fit_sip_wcs_ws(starxyz.data(), fieldxy.data(), weights.data(), n, &truth.wcstan,
+                               order, order, 1, &reused, ws))
+        {
+            printf("ERROR: order %d fit of %d stars failed\n", order, n);
+            passed = false;
+            break;
+        }
+        if (!sameFit(fresh, reused))
+        {
+            printf("ERROR: order %d fit of %d stars differs with a reused workspace\n", order, n);
+            passed = false;
+        }
+    }
+
+    size_t warmAllocations = ws->nalloc;
+    for (int i = 0; i < 20; i++)
+    {
+        sip_t sip;
+        fit_sip_wcs_ws(starxyz.data(), fieldxy.data(), weights.data(), NUM_STARS / 2, &truth.wcstan,
+                       order, order, 1, &sip, ws);
+    }
+    if (ws->nalloc != warmAllocations)
+    {
+        printf("ERROR: order %d workspace grew again for a smaller fit\n", order);
+        passed = false;
+    }
+    gslutils_lsq_free(ws);
+    return passed;
+}
+
+// ==========================================
+// 2. Time fits with and without a workspace
+// ==========================================
+bool TestSipFit::runBenchmark(int order)
+{
+    srand(2000 + order);
+    makeStars(order, NUM_STARS);
+    gslutils_lsq_t *ws = gslutils_lsq_new();
+    sip_t sip;
+
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < BENCH_FITS; i++)
+        fit_sip_wcs(starxyz.data(), fieldxy.data(), weights.data(), NUM_STARS, &truth.wcstan,
+                    order, order, 1, &sip);
+    auto mid = std::chrono::steady_clock::now();
+    for (int i = 0; i < BENCH_FITS; i++)
+        fit_sip_wcs_ws(starxyz.data(), fieldxy.data(), weights.data(), NUM_STARS, &truth.wcstan,
+                       order, order, 1, &sip, ws);
+    auto end = std::chrono::steady_clock::now();
+
+    double fresh = std::chrono::duration<double, std::micro>(mid - start).count() / BENCH_FITS;
+    double reused = std::chrono::duration<double, std::micro>(end - mid).count() / BENCH_FITS;
+    printf("SIP order %d, %d stars: %8.1f us per fit allocating, %8.1f us with a workspace (%zu allocations)\n",
+           order, NUM_STARS, fresh, reused, ws->nalloc);
+    fflush(stdout);
+
+    // The fit should still recover the distortion we put in.
+    double worst = 0;
+    for (int i = 0; i < NUM_STARS; i++)
+    {
+        double xyz[3];
+        sip_pixelxy2xyzarr(&sip, fieldxy[2 * i + 0], fieldxy[2 * i + 1], xyz);
+        double d2 = 0;
+        for (int d = 0; d < 3; d++)
+            d2 += (xyz[d] - starxyz[3 * i + d]) * (xyz[d] - starxyz[3 * i + d]);
+        worst = fmax(worst, sqrt(d2) * 180.0 / M_PI * 3600.0 / 1.2);
+    }
+    gslutils_lsq_free(ws);
+    if (worst > 1e-3)
+    {
+        printf("ERROR: order %d fit is off by %g pixels\n", order, worst);
+        return false;
+    }
+    return true;
+}
+
+int main(int argc, char *argv[])
+{
+    TestSipFit test;
+    bool matches = true;
+    bool benchmarks = true;
+
+    printf("Starting SIP fit workspace test suite...\n");
+    fflush(stdout);
+
+    for (int order = 2; order <= 5; order++)
+        matches = test.runWorkspaceMatchesFresh(order) && matches;
+    bool runBenchmark = TestHelpers::benchmarksRequested(argc, argv);
+    for (int order = 2; order <= 5 && runBenchmark; order++)
+        benchmarks = test.runBenchmark(order) && benchmarks;
+
+    printf("\n========================================\n");
+    printf("SIP FIT WORKSPACE TEST SUITE SUMMARY:\n");
+    printf("1. Reused workspace matches (orders 2-5): %s\n", matches ? "PASSED" : "FAILED");
+    printf("2. Benchmark fits recover SIP (2-5):      %s\n", TestHelpers::benchmarkResult(runBenchmark, benchmarks));
+    printf("========================================\n");
+    fflush(stdout);
+
+    if (matches && benchmarks)
+    {
+        printf("All SIP fit workspace tests passed successfully!\n");
+        return 0;
+    }
+    printf("Some SIP fit workspace tests FAILED!\n");
+    return 1;
+}
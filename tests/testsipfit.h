@@ -0,0 +1,26 @@
+#ifndef TESTSIPFIT_H
+#define TESTSIPFIT_H
+
+#include <stdio.h>
+#include <vector>
+
+extern "C" {
+#include "astrometry/sip.h"
+}
+
+class TestSipFit
+{
+public:
+    TestSipFit();
+    bool runWorkspaceMatchesFresh(int order);
+    bool runBenchmark(int order);
+
+private:
+    void makeStars(int order, int N);
+    sip_t truth;
+    std::vector<double> starxyz;
+    std::vector<double> fieldxy;
+    std::vector<double> weights;
+};
+
+#endif // TESTSIPFIT_H
@@ -0,0 +1,322 @@
+#include "teststarcatalog.h"
+#include "testhelpers.h"
+#include "starcatalog.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <algorithm>
+#include <chrono>
+#include <numeric>
+#include <vector>
+
+#include <QVector>
+
+static constexpr int TEST_STARS = 5003;
+static constexpr int BENCH_STARS = 60000;
+static constexpr int BENCH_RUNS = 5;
+
+TestStarCatalog::TestStarCatalog()
+{
+}
+
+static float randomValue(float low, float high)
+{
+    return low + (high - low) * ((float)rand() / RAND_MAX);
+}
+
+static FITSImage::Star makeStar()
+{
+    const float a = randomValue(0.5, 12);
+    return {randomValue(0, 4000), randomValue(0, 3000), randomValue(5, 20), randomValue(100, 1e6), randomValue(100, 65535),
+            randomValue(0.5, 8), a, a * randomValue(0.3, 1), randomValue(-90, 90), 0, 0, rand() % 500};
+}
+
+static bool sameStar(const FITSImage::Star &s1, const FITSImage::Star &s2)
+{
+    return memcmp(&s1, &s2, sizeof(FITSImage::Star)) == 0;
+}
+
+// ==========================================
+// 1. Each star reads back as it was set, one by one and as a list
+// ==========================================
+bool TestStarCatalog::runRoundTrip()
+{
+    srand(3);
+    std::vector<FITSImage::Star> stars(TEST_STARS);
+    FITSImage::StarCatalog catalog;
+    catalog.resize(TEST_STARS);
+    for (int i = 0; i < TEST_STARS; i++)
+    {
+        stars[i] = makeStar();
+        catalog.set(i, stars[i]);
+    }
+    const QList<FITSImage::Star> list = catalog.toList();
+    if (catalog.size() != TEST_STARS || list.size() != TEST_STARS)
+    {
+        printf("ERROR: the catalog has %d stars instead of %d\n", catalog.size(), TEST_STARS);
+        return false;
+    }
+    for (int i = 0; i < TEST_STARS; i++)
+    {
+        if (!sameStar(catalog.at(i), stars[i]) || !sameStar(list[i], stars[i]))
+        {
+            printf("ERROR: star %d reads back differently\n", i);
+            return false;
+        }
+        if (catalog.x()[i] != stars[i].x || catalog.y()[i] != stars[i].y || catalog.mag()[i] != stars[i].mag ||
+                catalog.a()[i] != stars[i].a || catalog.numPixels()[i] != stars[i].numPixels)
+        {
+            printf("ERROR: the columns of star %d differ\n", i);
+            return false;
+        }
+    }
+    return true;
+}
+
+// ==========================================
+// 2. Selecting rows gathers them in the order given
+// ==========================================
+bool TestStarCatalog::runSelectGathersRows()
+{
+    srand(5);
+    std::vector<FITSImage::Star> stars(TEST_STARS);
+    FITSImage::StarCatalog catalog;
+    for (auto &star : stars)
+    {
+        star = makeStar();
+        catalog.append(star);
+    }
+    // Every third star, by increasing magnitude
+    std::vector<int> rows;
+    for (int i = 0; i < TEST_STARS; i += 3)
+        rows.push_back(i);
+    std::sort(rows.begin(), rows.end(), [&stars](int s1, int s2)
+    {
+        return stars[s1].mag < stars[s2].mag;
+    });
+    catalog.select(rows);
+    if (catalog.size() != (int)rows.size())
+    {
+        printf("ERROR: the selection has %d stars instead of %d\n", catalog.size(), (int)rows.size());
+        return false;
+    }
+    for (size_t i = 0; i < rows.size(); i++)
+    {
+        if (!sameStar(catalog.at(i), stars[rows[i]]))
+        {
+            printf("ERROR: row %d of the selection is not star %d\n", (int)i, rows[i]);
+            return false;
+        }
+    }
+    catalog.select({});
+    if (!catalog.isEmpty())
+    {
+        printf("ERROR: selecting no rows left %d stars\n", catalog.size());
+        return false;
+    }
+    return true;
+}
+
+// ==========================================
+// 3. Tiles cut, moved and appended the way extraction does match the same done to a list of stars
+// ==========================================
+bool TestStarCatalog::runTilesMatchStarList()
+{
+    srand(7);
+    const int tiles = 9;
+    const int tileSize = 200;
+    const int margin = 20;
+    QList<FITSImage::Star> expected;
+    FITSImage::StarCatalog catalog;
+    for (int tile = 0; tile < tiles; tile++)
+    {
+        const int startX = (tile % 3) * tileSize;
+        const int startY = (tile / 3) * tileSize;
+        FITSImage::StarCatalog tileStars;
+        std::vector<int> inside;
+        for (int i = 0; i < TEST_STARS / tiles; i++)
+        {
+            FITSImage::Star star = makeStar();
+            star.x = randomValue(0, tileSize + 2 * margin);
+            star.y = randomValue(0, tileSize + 2 * margin);
+            tileStars.append(star);
+            if (star.x < margin || star.y < margin || star.x > tileSize + margin || star.y > tileSize + margin)
+                continue;
+            inside.push_back(i);
+            star.x += startX;
+            star.y += startY;
+            expected.append(star);
+        }
+        tileStars.select(inside);
+        tileStars.translate(startX, startY);
+        catalog.append(tileStars);
+    }
+    const QList<FITSImage::Star> list = catalog.toList();
+    if (list.size() != expected.size())
+    {
+        printf("ERROR: the tiles kept %d stars instead of %d\n", (int)list.size(), (int)expected.size());
+        return false;
+    }
+    for (int i = 0; i < list.size(); i++)
+    {
+        if (!sameStar(list[i], expected[i]))
+        {
+            printf("ERROR: star %d of the tiles differs from the list\n", i);
+            return false;
+        }
+    }
+    return true;
+}
+
+// ==========================================
+// 4. Benchmark against a list of stars
+// ==========================================
+bool TestStarCatalog::runBenchmark()
+{
+    srand(11);
+    const int tiles = 16;
+    const int solvers = 4;
+    const float tileSize = 1000;
+    const float margin = 20;
+    QVector<QList<FITSImage::Star>> tileLists(tiles);
+    QVector<FITSImage::StarCatalog> tileCatalogs(tiles);
+    for (int tile = 0; tile < tiles; tile++)
+    {
+        for (int i = 0; i < BENCH_STARS / tiles; i++)
+        {
+            FITSImage::Star star = makeStar();
+            star.x = randomValue(0, tileSize + 2 * margin);
+            star.y = randomValue(0, tileSize + 2 * margin);
+            tileLists[tile].append(star);
+            tileCatalogs[tile].append(star);
+        }
+    }
+    auto inside = [&](double x, double y)
+    {
+        return x >= margin && y >= margin && x <= tileSize + margin && y <= tileSize + margin;
+    };
+
+    // Gathering the tiles, sorting by magnitude, removing the large stars and handing the positions to each solver,
+    // the best of a few runs
+    double listMs = HUGE_VAL, catalogMs = HUGE_VAL;
+    double listSum = 0, catalogSum = 0;
+    for (int r = 0; r < BENCH_RUNS; r++)
+    {
+        auto start = std::chrono::steady_clock::now();
+        QList<FITSImage::Star> list;
+        for (int tile = 0; tile < tiles; tile++)
+        {
+            QList<FITSImage::Star> accepted;
+            for (auto star : tileLists[tile])
+            {
+                if (!inside(star.x, star.y))
+                    continue;
+                star.x += tile * tileSize;
+                accepted.append(star);
+            }
+            list.append(accepted);
+        }
+        std::sort(list.begin(), list.end(), [](const FITSImage::Star & s1, const FITSImage::Star & s2)
+        {
+            return s1.mag < s2.mag;
+        });
+        list.erase(std::remove_if(list.begin(), list.end(), [](const FITSImage::Star & star)
+        {
+            return star.a > 10;
+        }), list.end());
+        for (int solver = 0; solver < solvers; solver++)
+        {
+            QList<FITSImage::Star> solverList = list;
+            std::vector<double> x(solverList.size()), y(solverList.size());
+            for (int i = 0; i < solverList.size(); i++)
+            {
+                x[i] = solverList[i].x;
+                y[i] = solverList[i].y;
+            }
+            listSum += x.back() + y.back();
+        }
+        auto middle = std::chrono::steady_clock::now();
+
+        FITSImage::StarCatalog catalog;
+        for (int tile = 0; tile < tiles; tile++)
+        {
+            FITSImage::StarCatalog accepted = tileCatalogs[tile];
+            const auto x = accepted.x();
+            const auto y = accepted.y();
+            std::vector<int> rows;
+            for (int i = 0; i < accepted.size(); i++)
+            {
+                if (inside(x[i], y[i]))
+                    rows.push_back(i);
+            }
+            accepted.select(rows);
+            accepted.translate(tile * tileSize, 0);
+            catalog.append(accepted);
+        }
+        const auto mag = catalog.mag();
+        const auto a = catalog.a();
+        std::vector<int> rows(catalog.size());
+        std::iota(rows.begin(), rows.end(), 0);
+        std::sort(rows.begin(), rows.end(), [&mag](int s1, int s2)
+        {
+            return mag[s1] < mag[s2];
+        });
+        rows.erase(std::remove_if(rows.begin(), rows.end(), [&a](int star)
+        {
+            return a[star] > 10;
+        }), rows.end());
+        catalog.select(rows);
+        for (int solver = 0; solver < solvers; solver++)
+        {
+            const double *x = catalog.x().data();
+            const double *y = catalog.y().data();
+            // The list keeps the positions as floats
+            catalogSum += static_cast<float>(x[catalog.size() - 1]) + static_cast<float>(y[catalog.size() - 1]);
+        }
+        auto end = std::chrono::steady_clock::now();
+        listMs = std::min(listMs, std::chrono::duration<double, std::milli>(middle - start).count());
+        catalogMs = std::min(catalogMs, std::chrono::duration<double, std::milli>(end - middle).count());
+    }
+    printf("%d stars in %d tiles for %d solvers, list of stars: %8.2f ms\n", BENCH_STARS, tiles, solvers, listMs);
+    printf("%d stars in %d tiles for %d solvers, star catalog:  %8.2f ms (%.1fx)\n", BENCH_STARS, tiles, solvers, catalogMs,
+           listMs / catalogMs);
+    fflush(stdout);
+    if (listSum != catalogSum)
+    {
+        printf("ERROR: the list and the catalog kept different stars\n");
+        return false;
+    }
+    return true;
+}
+
+int main(int argc, char *argv[])
+{
+    TestStarCatalog test;
+
+    printf("Starting star catalog test suite...\n");
+    fflush(stdout);
+
+    bool roundTrip = test.runRoundTrip();
+    bool select = test.runSelectGathersRows();
+    bool tiles = test.runTilesMatchStarList();
+    bool runBenchmark = TestHelpers::benchmarksRequested(argc, argv);
+    bool benchmark = !runBenchmark || test.runBenchmark();
+
+    printf("\n========================================\n");
+    printf("STAR CATALOG TEST SUITE SUMMARY:\n");
+    printf("1. Stars read back as set:            %s\n", roundTrip ? "PASSED" : "FAILED");
+    printf("2. Selection gathers rows:            %s\n", select ? "PASSED" : "FAILED");
+    printf("3. Tiles match the list of stars:     %s\n", tiles ? "PASSED" : "FAILED");
+    printf("4. Benchmark:                         %s\n", TestHelpers::benchmarkResult(runBenchmark, benchmark));
+    printf("========================================\n");
+    fflush(stdout);
+
+    if (roundTrip && select && tiles && benchmark)
+    {
+        printf("All star catalog tests passed successfully!\n");
+        return 0;
+    }
+    printf("Some star catalog tests FAILED!\n");
+    return 1;
+}
@@ -0,0 +1,16 @@
+#ifndef TESTSTARCATALOG_H
+#define TESTSTARCATALOG_H
+
+#include <stdio.h>
+
+class TestStarCatalog
+{
+public:
+    TestStarCatalog();
+    bool runRoundTrip();
+    bool runSelectGathersRows();
+    bool runTilesMatchStarList();
+    bool runBenchmark();
+};
+
+#endif // TESTSTARCATALOG_H
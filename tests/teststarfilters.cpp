@@ -0,0 +1,202 @@
+#include "teststarfilters.h"
+#include "testhelpers.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <algorithm>
+#include <chrono>
+#include <vector>
+
+static constexpr int TEST_STARS = 20011;
+static constexpr int BENCH_STARS = 60000;
+static constexpr int BENCH_RUNS = 5;
+
+TestStarFilters::TestStarFilters()
+{
+}
+
+static float randomValue(float low, float high)
+{
+    return low + (high - low) * ((float)rand() / RAND_MAX);
+}
+
+// The magnitudes are rounded, so that many stars have the same one
+static std::vector<FITSImage::Star> makeStars(int n)
+{
+    std::vector<FITSImage::Star> stars(n);
+    for (auto &star : stars)
+    {
+        const float a = randomValue(0.5, 12);
+        star = {randomValue(0, 4000), randomValue(0, 3000), roundf(randomValue(5, 20) * 100) / 100, randomValue(100, 1e6),
+                randomValue(100, 65535), randomValue(0.5, 8), a, a * randomValue(0.3, 1), randomValue(-90, 90), 0, 0, rand() % 500
+               };
+    }
+    return stars;
+}
+
+// The filters the way applyStarFilters used to apply them, one after another on a list of stars, but removing the
+// brightest and dimmest stars all at once.  The sort is stable, so stars with the same magnitude stay in the order
+// they were found.
+static std::vector<FITSImage::Star> referenceFilter(std::vector<FITSImage::Star> stars, const StarFilters::Options &o)
+{
+    auto removeStars = [&stars](auto predicate)
+    {
+        stars.erase(std::remove_if(stars.begin(), stars.end(), predicate), stars.end());
+    };
+    if (o.resort)
+        std::stable_sort(stars.begin(), stars.end(), [](const FITSImage::Star & s1, const FITSImage::Star & s2)
+    {
+        return s1.mag < s2.mag;
+    });
+    if (o.maxSize > 0.0)
+        removeStars([&](const FITSImage::Star & star)
+    {
+        return star.a > o.maxSize || star.b > o.maxSize;
+    });
+    if (o.minSize > 0.0)
+        removeStars([&](const FITSImage::Star & star)
+    {
+        return star.a < o.minSize || star.b < o.minSize;
+    });
+    if (o.resort && o.removeBrightest > 0.0 && o.removeBrightest < 100.0)
+    {
+        int numToRemove = stars.size() * (o.removeBrightest / 100.0);
+        if (numToRemove > 1)
+            stars.erase(stars.begin(), stars.begin() + numToRemove);
+    }
+    if (o.resort && o.removeDimmest > 0.0 && o.removeDimmest < 100.0)
+    {
+        int numToRemove = stars.size() * (o.removeDimmest / 100.0);
+        if (numToRemove > 1)
+            stars.resize(stars.size() - numToRemove);
+    }
+    if (o.maxEllipse > 1)
+        removeStars([&](const FITSImage::Star & star)
+    {
+        return star.b != 0 && star.a / star.b > o.maxEllipse;
+    });
+    if (o.maxPeak > 0.0)
+        removeStars([&](const FITSImage::Star & star)
+    {
+        return star.peak > o.maxPeak;
+    });
+    if (o.resort && o.keepNum > 0)
+    {
+        int numToRemove = (int)stars.size() - o.keepNum;
+        if (numToRemove > 1)
+            stars.resize(stars.size() - numToRemove);
+    }
+    return stars;
+}
+
+static FITSImage::StarCatalog toCatalog(const std::vector<FITSImage::Star> &stars)
+{
+    FITSImage::StarCatalog catalog;
+    catalog.resize(stars.size());
+    for (size_t i = 0; i < stars.size(); i++)
+        catalog.set(i, stars[i]);
+    return catalog;
+}
+
+// ==========================================
+// 1. The filters keep the same stars, in the same order, as applying them one after another
+// ==========================================
+bool TestStarFilters::runMatchesReference(const char *name, const StarFilters::Options &options)
+{
+    srand(3);
+    const std::vector<FITSImage::Star> stars = makeStars(TEST_STARS);
+    const std::vector<FITSImage::Star> expected = referenceFilter(stars, options);
+    FITSImage::StarCatalog catalog = toCatalog(stars);
+    catalog.select(StarFilters::filterRows(catalog, options));
+    if (catalog.size() != (int)expected.size())
+    {
+        printf("ERROR: %s kept %d stars instead of %d\n", name, catalog.size(), (int)expected.size());
+        return false;
+    }
+    for (int i = 0; i < catalog.size(); i++)
+    {
+        FITSImage::Star star = catalog.at(i);
+        if (memcmp(&star, &expected[i], sizeof(FITSImage::Star)) != 0)
+        {
+            printf("ERROR: star %d kept by %s differs\n", i, name);
+            return false;
+        }
+    }
+    return true;
+}
+
+// ==========================================
+// 2. Benchmark against applying the filters one after another
+// ==========================================
+bool TestStarFilters::runBenchmark()
+{
+    srand(7);
+    const std::vector<FITSImage::Star> stars = makeStars(BENCH_STARS);
+    const FITSImage::StarCatalog catalog = toCatalog(stars);
+    // The filters of the solving profiles
+    const StarFilters::Options options = {true, 10, 0, 10, 20, 1.5, 60000, 50};
+
+    // The best of a few runs
+    double referenceMs = HUGE_VAL, filterMs = HUGE_VAL;
+    size_t referenceKept = 0, filterKept = 0;
+    for (int r = 0; r < BENCH_RUNS; r++)
+    {
+        auto start = std::chrono::steady_clock::now();
+        referenceKept = referenceFilter(stars, options).size();
+        auto middle = std::chrono::steady_clock::now();
+        FITSImage::StarCatalog filtered = catalog;
+        filtered.select(StarFilters::filterRows(filtered, options));
+        filterKept = filtered.size();
+        auto end = std::chrono::steady_clock::now();
+        referenceMs = std::min(referenceMs, std::chrono::duration<double, std::milli>(middle - start).count());
+        filterMs = std::min(filterMs, std::chrono::duration<double, std::milli>(end - middle).count());
+    }
+    printf("%d stars, one filter after another: %8.2f ms\n", BENCH_STARS, referenceMs);
+    printf("%d stars, one pass and selections:  %8.2f ms (%.1fx)\n", BENCH_STARS, filterMs, referenceMs / filterMs);
+    fflush(stdout);
+    if (referenceKept != filterKept)
+    {
+        printf("ERROR: the benchmark kept %d stars instead of %d\n", (int)filterKept, (int)referenceKept);
+        return false;
+    }
+    return true;
+}
+
+int main(int argc, char *argv[])
+{
+    TestStarFilters test;
+
+    printf("Starting star filters test suite...\n");
+    fflush(stdout);
+
+    // resort, maxSize, minSize, removeBrightest, removeDimmest, maxEllipse, maxPeak, keepNum
+    bool sortOnly = test.runMatchesReference("sorting", {true, 0, 0, 0, 0, 0, 0, 0});
+    bool sizes = test.runMatchesReference("the size filters", {true, 8, 1.5, 0, 0, 0, 0, 0});
+    bool percentages = test.runMatchesReference("the percentages", {true, 0, 0, 10, 20, 0, 0, 0});
+    bool keepNum = test.runMatchesReference("keepNum", {true, 0, 0, 0, 0, 0, 0, 100});
+    bool all = test.runMatchesReference("all the filters", {true, 10, 1, 5, 25, 1.5, 50000, 500});
+    bool unsorted = test.runMatchesReference("unsorted filters", {false, 10, 1, 5, 25, 1.5, 50000, 500});
+    bool runBenchmark = TestHelpers::benchmarksRequested(argc, argv);
+    bool benchmark = !runBenchmark || test.runBenchmark();
+
+    printf("\n========================================\n");
+    printf("STAR FILTERS TEST SUITE SUMMARY:\n");
+    printf("1. Sorting matches:                   %s\n", sortOnly ? "PASSED" : "FAILED");
+    printf("2. Size filters match:                %s\n", sizes ? "PASSED" : "FAILED");
+    printf("3. Percentages match:                 %s\n", percentages ? "PASSED" : "FAILED");
+    printf("4. keepNum matches:                   %s\n", keepNum ? "PASSED" : "FAILED");
+    printf("5. All the filters match:             %s\n", all ? "PASSED" : "FAILED");
+    printf("6. Unsorted filters match:            %s\n", unsorted ? "PASSED" : "FAILED");
+    printf("7. Benchmark:                         %s\n", TestHelpers::benchmarkResult(runBenchmark, benchmark));
+    printf("========================================\n");
+    fflush(stdout);
+
+    if (sortOnly && sizes && percentages && keepNum && all && unsorted && benchmark)
+    {
+        printf("All star filters tests passed successfully!\n");
+        return 0;
+    }
+    printf("Some star filters tests FAILED!\n");
+    return 1;
+}
@@ -0,0 +1,16 @@
+#ifndef TESTSTARFILTERS_H
+#define TESTSTARFILTERS_H
+
+#include <stdio.h>
+
+#include "starfilters.h"
+
+class TestStarFilters
+{
+public:
+    TestStarFilters();
+    bool runMatchesReference(const char *name, const StarFilters::Options &options);
+    bool runBenchmark();
+};
+
+#endif // TESTSTARFILTERS_H
@@ -0,0 +1,284 @@
+#include "teststreamedimage.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <vector>
+
+// The loaded image is downsampled by this much, to check that the solutions of images that are not loaded are not
+// scaled by it
+static constexpr int DOWNSAMPLE = 2;
+
+TestStreamedImage::TestStreamedImage()
+{
+}
+
+TestStreamedImage::~TestStreamedImage()
+{
+}
+
+bool TestStreamedImage::loadImage(QString fileName)
+{
+    if(!imageLoader.loadImage(fileName) || !streamLoader.loadFitsStream(fileName) || !mappedLoader.loadFitsMapped(fileName))
+    {
+        printf("ERROR: could not load %s\n", fileName.toUtf8().data());
+        return false;
+    }
+    stats = imageLoader.getStats();
+    imageBuffer = imageLoader.getImageBuffer();
+    return true;
+}
+
+// Solves with downsampling asked for, and gets the sky position of the corners and the center of the image
+bool TestStreamedImage::solve(StellarSolver &solver, QList<FITSImage::wcs_point> &corners)
+{
+    solver.setProperty("ExtractorType", SSolver::EXTRACTOR_INTERNAL);
+    solver.setProperty("SolverType", SSolver::SOLVER_STELLARSOLVER);
+    solver.setProperty("ProcessType", SSolver::SOLVE);
+    solver.setParameterProfile(SSolver::Parameters::DEFAULT);
+    SSolver::Parameters params = solver.getCurrentParameters();
+    params.autoDownsample = false;
+    params.downsample = DOWNSAMPLE;
+    solver.setParameters(params);
+    solver.setIndexFolderPaths(QStringList() << "astrometry");
+    solver.setLogLevel(LOG_NONE);
+    if(!solver.solve())
+        return false;
+
+    QList<QPointF> pixels;
+    pixels << QPointF(0, 0) << QPointF(stats.width - 1, 0) << QPointF(0, stats.height - 1)
+           << QPointF(stats.width - 1, stats.height - 1) << QPointF(stats.width / 2.0, stats.height / 2.0);
+    for(const auto &pixel : pixels)
+    {
+        FITSImage::wcs_point sky;
+        if(!solver.pixelToWCS(pixel, sky))
+            return false;
+        corners.append(sky);
+    }
+    return true;
+}
+
+// Solves the loaded image and the image the solver was given, and checks that the two WCS agree
+bool TestStreamedImage::matchesLoaded(StellarSolver &solver, const char *name)
+{
+    StellarSolver loadedSolver(stats, imageBuffer, nullptr);
+    QList<FITSImage::wcs_point> loadedCorners;
+    if(!solve(loadedSolver, loadedCorners))
+    {
+        printf("ERROR: the loaded image did not solve\n");
+        return false;
+    }
+    QList<FITSImage::wcs_point> corners;
+    if(!solve(solver, corners))
+    {
+        printf("ERROR: the %s image did not solve\n", name);
+        return false;
+    }
+
+    // The image is solved at full resolution, so the solutions only differ by the fit
+    const FITSImage::Solution loaded = loadedSolver.getSolution();
+    const FITSImage::Solution solution = solver.getSolution();
+    printf("loaded: RA=%.5f Dec=%.5f pixscale=%.4f\n", loaded.ra, loaded.dec, loaded.pixscale);
+    printf("%s: RA=%.5f Dec=%.5f pixscale=%.4f\n", name, solution.ra, solution.dec, solution.pixscale);
+    bool passed = true;
+    if(fabs(solution.pixscale - loaded.pixscale) > 0.01 * loaded.pixscale)
+    {
+        printf("ERROR: the %s pixel scale is %f instead of %f\n", name, solution.pixscale, loaded.pixscale);
+        passed = false;
+    }
+
+    // Two pixels is far more than the fits differ by, and far less than a WCS that is scaled by the downsample
+    const double tolerance = 2 * loaded.pixscale / 3600.0;
+    for(int i = 0; i < loadedCorners.size(); i++)
+    {
+        const double dRA = (corners[i].ra - loadedCorners[i].ra) * cos(loadedCorners[i].dec * M_PI / 180.0);
+        const double dDec = corners[i].dec - loadedCorners[i].dec;
+        if(hypot(dRA, dDec) > tolerance)
+        {
+            printf("ERROR: point %d is at %f, %f in the %s WCS and %f, %f in the loaded one\n", i, corners[i].ra,
+                   corners[i].dec, name, loadedCorners[i].ra, loadedCorners[i].dec);
+            passed = false;
+        }
+    }
+    return passed;
+}
+
+// ==========================================
+// 1. A streamed image solves to the same WCS as the loaded image
+// ==========================================
+bool TestStreamedImage::runStreamedSolveMatchesLoaded()
+{
+    StellarSolver solver(stats, imageBuffer, nullptr);
+    if(!solver.loadNewImageStream(streamLoader.getStats(), streamLoader.getRowReader()))
+    {
+        printf("ERROR: the streamed image was not accepted\n");
+        return false;
+    }
+    return matchesLoaded(solver, "streamed");
+}
+
+// ==========================================
+// 2. A mapped image solves to the same WCS as the loaded image
+// ==========================================
+bool TestStreamedImage::runMappedSolveMatchesLoaded()
+{
+    if(!mappedLoader.getMappedImage().isValid())
+    {
+        printf("ERROR: the image was loaded instead of mapped\n");
+        return false;
+    }
+    StellarSolver solver(stats, imageBuffer, nullptr);
+    if(!solver.loadNewImageMapped(mappedLoader.getStats(), mappedLoader.getMappedImage()))
+    {
+        printf("ERROR: the mapped image was not accepted\n");
+        return false;
+    }
+    return matchesLoaded(solver, "mapped");
+}
+
+// Extracts all the stars of the image the solver was given
+bool TestStreamedImage::extract(StellarSolver &solver, QList<FITSImage::Star> &stars)
+{
+    solver.setProperty("ExtractorType", SSolver::EXTRACTOR_INTERNAL);
+    solver.setProperty("ProcessType", SSolver::EXTRACT);
+    solver.setParameterProfile(SSolver::Parameters::ALL_STARS);
+    solver.setLogLevel(LOG_NONE);
+    if(!solver.extract())
+        return false;
+    stars = solver.getStarList();
+    return true;
+}
+
+// ==========================================
+// 3. A streamed image has the same stars as the image in memory, across more than one band of rows
+// ==========================================
+bool TestStreamedImage::runStreamedExtractionMatchesLoaded()
+{
+    // The image is stacked until it is taller than one band of a streamed extraction, so the second band reuses the
+    // rows it shares with the first.  A band is 64MB.
+    constexpr uint32_t COPIES = 27;
+    const size_t imageBytes = static_cast<size_t>(stats.width) * stats.height * stats.bytesPerPixel;
+    std::vector<uint8_t> tall(imageBytes * COPIES);
+    for(uint32_t i = 0; i < COPIES; i++)
+        memcpy(tall.data() + i * imageBytes, imageBuffer, imageBytes);
+    FITSImage::Statistic tallStats = stats;
+    tallStats.height = stats.height * COPIES;
+    tallStats.samples_per_channel = tallStats.width * tallStats.height;
+
+    // Counts the rows read a band at a time, the background reads one row at a time
+    const size_t rowBytes = static_cast<size_t>(tallStats.width) * tallStats.bytesPerPixel;
+    uint32_t bandReads = 0, bandRowsRead = 0;
+    FITSImage::RowReader rowReader = [&](uint32_t channel, uint32_t firstRow, uint32_t numRows, void *buffer)
+    {
+        if(channel != 0 || firstRow + numRows > tallStats.height)
+            return false;
+        if(numRows > 1)
+        {
+            bandReads++;
+            bandRowsRead += numRows;
+        }
+        memcpy(buffer, tall.data() + firstRow * rowBytes, numRows * rowBytes);
+        return true;
+    };
+
+    StellarSolver loadedSolver(tallStats, tall.data(), nullptr);
+    QList<FITSImage::Star> loadedStars;
+    if(!extract(loadedSolver, loadedStars))
+    {
+        printf("ERROR: the stars of the loaded image were not extracted\n");
+        return false;
+    }
+    StellarSolver streamedSolver(tallStats, tall.data(), nullptr);
+    if(!streamedSolver.loadNewImageStream(tallStats, rowReader))
+    {
+        printf("ERROR: the streamed image was not accepted\n");
+        return false;
+    }
+    QList<FITSImage::Star> streamedStars;
+    if(!extract(streamedSolver, streamedStars))
+    {
+        printf("ERROR: the stars of the streamed image were not extracted\n");
+        return false;
+    }
+
+    printf("loaded: %d stars, streamed: %d stars in %u bands of %u rows\n", static_cast<int>(loadedStars.size()),
+           static_cast<int>(streamedStars.size()), bandReads, bandRowsRead);
+    bool passed = true;
+    if(bandReads < 2 || bandRowsRead != tallStats.height)
+    {
+        printf("ERROR: the bands read %u rows in %u reads, instead of each of the %u rows once\n", bandRowsRead, bandReads,
+               tallStats.height);
+        passed = false;
+    }
+
+    // The streamed background is estimated from every other pixel of an image this large, so the faintest stars may
+    // come and go, but the stars that are found in both are in the same place.
+    if(streamedStars.isEmpty() || abs(streamedStars.size() - loadedStars.size()) > loadedStars.size() / 20)
+    {
+        printf("ERROR: %d stars were streamed instead of %d\n", static_cast<int>(streamedStars.size()),
+               static_cast<int>(loadedStars.size()));
+        return false;
+    }
+    auto byY = [](const FITSImage::Star & a, const FITSImage::Star & b)
+    {
+        return a.y < b.y;
+    };
+    std::sort(loadedStars.begin(), loadedStars.end(), byY);
+    int matched = 0;
+    for(const auto &star : streamedStars)
+    {
+        FITSImage::Star low = star;
+        low.y -= 0.5f;
+        for(auto other = std::lower_bound(loadedStars.begin(), loadedStars.end(), low, byY);
+                other != loadedStars.end() && other->y <= star.y + 0.5f; ++other)
+        {
+            if(hypot(other->x - star.x, other->y - star.y) <= 0.5)
+            {
+                matched++;
+                break;
+            }
+        }
+    }
+    printf("%d of the streamed stars are within half a pixel of a loaded star\n", matched);
+    if(matched < streamedStars.size() * 95 / 100)
+    {
+        printf("ERROR: only %d of %d streamed stars match a loaded star\n", matched, static_cast<int>(streamedStars.size()));
+        passed = false;
+    }
+    return passed;
+}
+
+int main(int argc, char *argv[])
+{
+    QApplication app(argc, argv);
+#if defined(__linux__)
+    setlocale(LC_NUMERIC, "C");
+#endif
+    TestStreamedImage test;
+
+    printf("Starting streamed image test suite...\n");
+    fflush(stdout);
+
+    bool loaded = test.loadImage("randomsky.fits");
+    bool streamed = loaded && test.runStreamedSolveMatchesLoaded();
+    bool mapped = loaded && test.runMappedSolveMatchesLoaded();
+    bool extracted = loaded && test.runStreamedExtractionMatchesLoaded();
+
+    printf("\n========================================\n");
+    printf("STREAMED IMAGE TEST SUITE SUMMARY:\n");
+    printf("1. Streamed solve matches the loaded one: %s\n", streamed ? "PASSED" : "FAILED");
+    printf("2. Mapped solve matches the loaded one:   %s\n", mapped ? "PASSED" : "FAILED");
+    printf("3. Streamed stars match the loaded ones:  %s\n", extracted ? "PASSED" : "FAILED");
+    printf("========================================\n");
+    fflush(stdout);
+
+    if (streamed && mapped && extracted)
+    {
+        printf("All streamed image tests passed successfully!\n");
+        return 0;
+    }
+    printf("Some streamed image tests FAILED!\n");
+    return 1;
+}
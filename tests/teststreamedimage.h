@@ -0,0 +1,37 @@
+#ifndef TESTSTREAMEDIMAGE_H
+#define TESTSTREAMEDIMAGE_H
+
+//Qt Includes
+#include <QApplication>
+#include <QObject>
+
+#include <stdio.h>
+
+//Includes for this project
+#include "structuredefinitions.h"
+#include "stellarsolver.h"
+#include "ssolverutils/fileio.h"
+
+class TestStreamedImage : public QObject
+{
+    Q_OBJECT
+public:
+    TestStreamedImage();
+    ~TestStreamedImage();
+    bool loadImage(QString fileName);
+    bool runStreamedSolveMatchesLoaded();
+    bool runMappedSolveMatchesLoaded();
+    bool runStreamedExtractionMatchesLoaded();
+
+private:
+    bool solve(StellarSolver &solver, QList<FITSImage::wcs_point> &corners);
+    bool matchesLoaded(StellarSolver &solver, const char *name);
+    bool extract(StellarSolver &solver, QList<FITSImage::Star> &stars);
+    fileio imageLoader;
+    fileio streamLoader;
+    fileio mappedLoader;
+    FITSImage::Statistic stats;
+    const uint8_t *imageBuffer { nullptr };
+};
+
+#endif // TESTSTREAMEDIMAGE_H
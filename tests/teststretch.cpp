@@ -0,0 +1,251 @@
+#include "teststretch.h"
+#include "testhelpers.h"
+#include "ssolverutils/stretch.h"
+
+#include <fitsio.h>
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <algorithm>
+#include <chrono>
+#include <type_traits>
+#include <vector>
+
+using namespace TestHelpers;
+
+TestStretch::TestStretch()
+{
+}
+
+// The parameters worked out from the median of every pixel, the way section 8.5.7 of the XISF spec describes
+template <typename T>
+static StretchParams1Channel referenceParams(const T *values, size_t n, float inputRange)
+{
+    std::vector<T> sorted(values, values + n);
+    std::nth_element(sorted.begin(), sorted.begin() + n / 2, sorted.end());
+    const T medianSample = sorted[n / 2];
+    std::vector<T> deviations(n);
+    for (size_t i = 0; i < n; i++)
+        deviations[i] = medianSample > values[i] ? medianSample - values[i] : values[i] - medianSample;
+    std::nth_element(deviations.begin(), deviations.begin() + n / 2, deviations.end());
+    const float medDev = deviations[n / 2];
+
+    const float normalizedMedian = medianSample / inputRange;
+    const float MADN = 1.4826 * medDev / inputRange;
+    const bool upperHalf = normalizedMedian > 0.5;
+    const float shadows = (upperHalf || MADN == 0) ? 0.0 : fmin(1.0, fmax(0.0, (normalizedMedian + -2.8 * MADN)));
+    const float highlights = (!upperHalf || MADN == 0) ? 1.0 : fmin(1.0, fmax(0.0, (normalizedMedian - -2.8 * MADN)));
+    const float X = upperHalf ? 0.25f : normalizedMedian - shadows;
+    const float M = upperHalf ? highlights - normalizedMedian : 0.25f;
+    StretchParams1Channel params;
+    params.shadows = shadows;
+    params.highlights = highlights;
+    if (X == 0) params.midtones = 0.0f;
+    else if (X == M) params.midtones = 0.5f;
+    else if (X == 1) params.midtones = 1.0f;
+    else params.midtones = ((M - 1) * X) / ((2 * M - 1) * X - M);
+    return params;
+}
+
+static bool sameParams(const StretchParams1Channel &a, const StretchParams1Channel &b)
+{
+    return fabs(a.shadows - b.shadows) < 1e-6 && fabs(a.highlights - b.highlights) < 1e-6 &&
+           fabs(a.midtones - b.midtones) < 1e-6;
+}
+
+// ==========================================
+// 1. Histogram parameters match the exact median
+// ==========================================
+template <typename T>
+bool TestStretch::runParamsMatchReference(int dataType, int channels)
+{
+    srand(5);
+    // On a single thread the pixels are sampled instead, but there are too few of them for a sample to skip any
+    std::vector<T> image = makeSky<T>(TEST_W, TEST_H, channels);
+    Stretch stretch(TEST_W, TEST_H, channels, dataType);
+    StretchParams params = stretch.computeParams(reinterpret_cast<uint8_t *>(image.data()));
+    const float inputRange = std::is_same<T, uint8_t>::value ? 256 : 64 * 1024;
+    const StretchParams1Channel *computed[3] = { &params.grey_red, &params.green, &params.blue };
+    for (int c = 0; c < channels; c++)
+    {
+        StretchParams1Channel reference = referenceParams(image.data() + (size_t)c * TEST_W * TEST_H, (size_t)TEST_W * TEST_H,
+                                          inputRange);
+        if (!sameParams(*computed[c], reference))
+        {
+            printf("ERROR: channel %d of type %d gave %f %f %f instead of %f %f %f\n", c, dataType,
+                   computed[c]->shadows, computed[c]->midtones, computed[c]->highlights,
+                   reference.shadows, reference.midtones, reference.highlights);
+            return false;
+        }
+    }
+    return true;
+}
+
+// ==========================================
+// 2. Sampled float parameters match the median of the samples
+// ==========================================
+bool TestStretch::runSampledParamsMatchReference()
+{
+    srand(7);
+    // Fewer pixels than the sample limit, so every pixel is a sample
+    const int w = 600, h = 400;
+    std::vector<float> image = makeSky<float>(w, h, 3);
+    Stretch stretch(w, h, 3, TFLOAT);
+    StretchParams params = stretch.computeParams(reinterpret_cast<uint8_t *>(image.data()));
+    const StretchParams1Channel *computed[3] = { &params.grey_red, &params.green, &params.blue };
+    for (int c = 0; c < 3; c++)
+    {
+        StretchParams1Channel reference = referenceParams(image.data() + (size_t)c * w * h, (size_t)w * h, 64 * 1024);
+        if (!sameParams(*computed[c], reference))
+        {
+            printf("ERROR: float channel %d does not match the median of its samples\n", c);
+            return false;
+        }
+    }
+    return true;
+}
+
+// The stretch of one pixel, from section 8.5.6 of the XISF spec
+template <typename T>
+static uint8_t referenceStretch(T input, const StretchParams1Channel &p, float maxInput)
+{
+    const float hsRangeFactor = p.highlights == p.shadows ? 1.0f : 1.0f / (p.highlights - p.shadows);
+    const T nativeShadows = p.shadows * maxInput;
+    const T nativeHighlights = p.highlights * maxInput;
+    const float k1 = (p.midtones - 1) * hsRangeFactor * 255 / maxInput;
+    const float k2 = ((2 * p.midtones) - 1) * hsRangeFactor / maxInput;
+    if (input < nativeShadows) return 0;
+    if (input >= nativeHighlights) return 255;
+    const T inputFloored = (input - nativeShadows);
+    return (inputFloored * k1) / (inputFloored * k2 - p.midtones);
+}
+
+// ==========================================
+// 3. The stretched image matches a reference
+// ==========================================
+template <typename T>
+bool TestStretch::runStretchMatchesReference(int dataType, int channels, int sampling)
+{
+    srand(9);
+    std::vector<T> image = makeSky<T>(TEST_W, TEST_H, channels);
+    Stretch stretch(TEST_W, TEST_H, channels, dataType);
+    StretchParams params = stretch.computeParams(reinterpret_cast<uint8_t *>(image.data()));
+    stretch.setParams(params);
+    const int ow = (TEST_W + sampling - 1) / sampling, oh = (TEST_H + sampling - 1) / sampling;
+    QImage output(ow, oh, channels == 1 ? QImage::Format_Grayscale8 : QImage::Format_RGB32);
+    stretch.run(reinterpret_cast<uint8_t *>(image.data()), &output, sampling);
+
+    const float maxInput = std::is_same<T, uint8_t>::value ? 255 : 64 * 1024 - 1;
+    const size_t size = (size_t)TEST_W * TEST_H;
+    for (int y = 0; y < oh; y++)
+    {
+        const uchar *line = output.scanLine(y);
+        for (int x = 0; x < ow; x++)
+        {
+            const size_t i = (size_t)y * sampling * TEST_W + (size_t)x * sampling;
+            bool match;
+            if (channels == 1)
+                match = line[x] == referenceStretch(image[i], params.grey_red, maxInput);
+            else
+                match = reinterpret_cast<const QRgb *>(line)[x] == qRgb(referenceStretch(image[i], params.grey_red, maxInput),
+                        referenceStretch(image[i + size], params.green, maxInput),
+                        referenceStretch(image[i + 2 * size], params.blue, maxInput));
+            if (!match)
+            {
+                printf("ERROR: pixel %d,%d of type %d with sampling %d differs\n", x, y, dataType, sampling);
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+// The parameters the way they used to be worked out, from the median of up to 500000 samples
+static void oldComputeParams(const uint16_t *values, int w, int h)
+{
+    const int sampleBy = w * h < 500000 ? 1 : w * h / 500000;
+    const int numSamples = w * h / sampleBy;
+    std::vector<uint16_t> samples(numSamples);
+    for (int index = 0, i = 0; i < numSamples; ++i, index += sampleBy)
+        samples[i] = values[index];
+    std::nth_element(samples.begin(), samples.begin() + numSamples / 2, samples.end());
+    const uint16_t medianSample = samples[numSamples / 2];
+    for (int index = 0, i = 0; i < numSamples; ++i, index += sampleBy)
+        samples[i] = medianSample > values[index] ? medianSample - values[index] : values[index] - medianSample;
+    std::nth_element(samples.begin(), samples.begin() + numSamples / 2, samples.end());
+}
+
+// ==========================================
+// 4. Benchmark
+// ==========================================
+bool TestStretch::runBenchmark()
+{
+    srand(13);
+    std::vector<uint16_t> image = makeSky<uint16_t>(BENCH_W, BENCH_H, 3);
+    Stretch stretch(BENCH_W, BENCH_H, 3, TUSHORT);
+    QImage output(BENCH_W, BENCH_H, QImage::Format_RGB32);
+
+    // The best of a few runs, so the first touch of the buffers is not counted
+    double oldMs = HUGE_VAL, paramsMs = HUGE_VAL, runMs = HUGE_VAL;
+    for (int r = 0; r < BENCH_RUNS; r++)
+    {
+        auto start = std::chrono::steady_clock::now();
+        for (int c = 0; c < 3; c++)
+            oldComputeParams(image.data() + (size_t)c * BENCH_W * BENCH_H, BENCH_W, BENCH_H);
+        auto middle = std::chrono::steady_clock::now();
+        stretch.setParams(stretch.computeParams(reinterpret_cast<uint8_t *>(image.data())));
+        auto stretched = std::chrono::steady_clock::now();
+        stretch.run(reinterpret_cast<uint8_t *>(image.data()), &output, 1);
+        auto end = std::chrono::steady_clock::now();
+        oldMs = std::min(oldMs, std::chrono::duration<double, std::milli>(middle - start).count());
+        paramsMs = std::min(paramsMs, std::chrono::duration<double, std::milli>(stretched - middle).count());
+        runMs = std::min(runMs, std::chrono::duration<double, std::milli>(end - stretched).count());
+    }
+    printf("%dx%d 16 bit RGB, sampled medians:       %8.1f ms\n", BENCH_W, BENCH_H, oldMs);
+    printf("%dx%d 16 bit RGB, computeParams (exact): %8.1f ms\n", BENCH_W, BENCH_H, paramsMs);
+    printf("%dx%d 16 bit RGB, run:                   %8.1f ms\n", BENCH_W, BENCH_H, runMs);
+    fflush(stdout);
+    return true;
+}
+
+int main(int argc, char *argv[])
+{
+    TestStretch test;
+
+    printf("Starting stretch test suite...\n");
+    fflush(stdout);
+
+    bool byteParams = test.runParamsMatchReference<uint8_t>(TBYTE, 1);
+    bool shortParams = test.runParamsMatchReference<int16_t>(TSHORT, 1);
+    bool ushortParams = test.runParamsMatchReference<uint16_t>(TUSHORT, 3);
+    bool floatParams = test.runSampledParamsMatchReference();
+    bool byteStretch = test.runStretchMatchesReference<uint8_t>(TBYTE, 1, 1);
+    bool ushortStretch = test.runStretchMatchesReference<uint16_t>(TUSHORT, 3, 1) &&
+                         test.runStretchMatchesReference<uint16_t>(TUSHORT, 1, 3);
+    bool floatStretch = test.runStretchMatchesReference<float>(TFLOAT, 3, 2);
+    bool runBenchmark = benchmarksRequested(argc, argv);
+    bool benchmark = !runBenchmark || test.runBenchmark();
+
+    printf("\n========================================\n");
+    printf("STRETCH TEST SUITE SUMMARY:\n");
+    printf("1. Parameters match (8 bit):          %s\n", byteParams ? "PASSED" : "FAILED");
+    printf("2. Parameters match (16 bit):         %s\n", shortParams ? "PASSED" : "FAILED");
+    printf("3. Parameters match (16 bit RGB):     %s\n", ushortParams ? "PASSED" : "FAILED");
+    printf("4. Parameters match (float RGB):      %s\n", floatParams ? "PASSED" : "FAILED");
+    printf("5. Stretch matches (8 bit):           %s\n", byteStretch ? "PASSED" : "FAILED");
+    printf("6. Stretch matches (16 bit):          %s\n", ushortStretch ? "PASSED" : "FAILED");
+    printf("7. Stretch matches (float RGB):       %s\n", floatStretch ? "PASSED" : "FAILED");
+    printf("8. Benchmark:                         %s\n", benchmarkResult(runBenchmark, benchmark));
+    printf("========================================\n");
+    fflush(stdout);
+
+    if (byteParams && shortParams && ushortParams && floatParams && byteStretch && ushortStretch && floatStretch && benchmark)
+    {
+        printf("All stretch tests passed successfully!\n");
+        return 0;
+    }
+    printf("Some stretch tests FAILED!\n");
+    return 1;
+}
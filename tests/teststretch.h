@@ -0,0 +1,16 @@
+#ifndef TESTSTRETCH_H
+#define TESTSTRETCH_H
+
+#include <stdio.h>
+
+class TestStretch
+{
+public:
+    TestStretch();
+    template <typename T> bool runParamsMatchReference(int dataType, int channels);
+    bool runSampledParamsMatchReference();
+    template <typename T> bool runStretchMatchesReference(int dataType, int channels, int sampling);
+    bool runBenchmark();
+};
+
+#endif // TESTSTRETCH_H
@@ -0,0 +1,203 @@
+#include "testsuperpixel.h"
+#include "testhelpers.h"
+#include "ssolverutils/fileio.h"
+
+#include <fitsio.h>
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <math.h>
+#include <vector>
+
+#include <QFile>
+
+// TEST_W and TEST_H are odd, so a last row and column are left over whatever the offsets are
+using namespace TestHelpers;
+
+// The SCALE keyword of the files, the hint is 0.8 to 1.2 times it
+static constexpr double TEST_SCALE = 1.5;
+
+TestSuperpixel::TestSuperpixel()
+{
+}
+
+// The value of each raw pixel tells where it is, so an average of the wrong cell shows
+template <typename T>
+static T rawPixel(int x, int y)
+{
+    return (T)(x * 3 + y * 29 + (x % 2) * 7 + (y % 2) * 11);
+}
+
+template <typename T>
+bool TestSuperpixel::writeBayered(const QString &fileName, int bitpix, int datatype, int offsetX, int offsetY,
+                                  int width, int height)
+{
+    std::vector<T> image((size_t)width * height);
+    for (int y = 0; y < height; y++)
+        for (int x = 0; x < width; x++)
+            image[(size_t)y * width + x] = rawPixel<T>(x, y);
+
+    int status = 0;
+    fitsfile *fptr = nullptr;
+    long naxes[2] = { width, height };
+    double scale = TEST_SCALE;
+    char pattern[] = "RGGB";
+    // The ! replaces the file of an earlier run
+    fits_create_file(&fptr, ("!" + fileName).toLocal8Bit().constData(), &status);
+    fits_create_img(fptr, bitpix, 2, naxes, &status);
+    fits_write_key(fptr, TSTRING, "BAYERPAT", pattern, nullptr, &status);
+    fits_write_key(fptr, TINT, "XBAYROFF", &offsetX, nullptr, &status);
+    fits_write_key(fptr, TINT, "YBAYROFF", &offsetY, nullptr, &status);
+    fits_write_key(fptr, TDOUBLE, "SCALE", &scale, nullptr, &status);
+    fits_write_img(fptr, datatype, 1, static_cast<LONGLONG>(image.size()), image.data(), &status);
+    fits_close_file(fptr, &status);
+    if (status != 0)
+    {
+        char errorMessage[FLEN_STATUS];
+        fits_get_errstatus(status, errorMessage);
+        printf("ERROR: writing %s failed: %s\n", fileName.toUtf8().data(), errorMessage);
+        return false;
+    }
+    return true;
+}
+
+// ==========================================
+// 1. Each superpixel is the average of the 2x2 cell at the bayer offsets, and the scale hint is doubled
+// ==========================================
+template <typename T>
+bool TestSuperpixel::runMatchesHandAverage(int bitpix, int datatype, int offsetX, int offsetY)
+{
+    const QString fileName = QString("testsuperpixel_%1_%2_%3.fits").arg(bitpix).arg(offsetX).arg(offsetY);
+    if (!writeBayered<T>(fileName, bitpix, datatype, offsetX, offsetY, TEST_W, TEST_H))
+        return false;
+
+    fileio imageLoader;
+    imageLoader.bayerSuperpixel = true;
+    const bool loaded = imageLoader.loadFits(fileName);
+    QFile::remove(fileName);
+    if (!loaded)
+    {
+        printf("ERROR: %s was not loaded\n", fileName.toUtf8().data());
+        return false;
+    }
+
+    const int w = (TEST_W - offsetX) / 2;
+    const int h = (TEST_H - offsetY) / 2;
+    const FITSImage::Statistic stats = imageLoader.getStats();
+    if ((int)stats.width != w || (int)stats.height != h || stats.channels != 1 || stats.dataType != TFLOAT)
+    {
+        printf("ERROR: offsets %d, %d made a %ux%u image of type %d instead of %dx%d floats\n", offsetX, offsetY, stats.width,
+               stats.height, (int)stats.dataType, w, h);
+        return false;
+    }
+    // The saturation limit is still a fraction of the range of the raw pixels
+    if ((int)stats.sourceDataType != datatype)
+    {
+        printf("ERROR: offsets %d, %d recorded source type %d instead of %d\n", offsetX, offsetY, (int)stats.sourceDataType,
+               datatype);
+        return false;
+    }
+
+    bool passed = true;
+    const float *superpixels = reinterpret_cast<const float *>(imageLoader.getImageBuffer());
+    for (int y = 0; y < h && passed; y++)
+    {
+        for (int x = 0; x < w && passed; x++)
+        {
+            const int rawX = 2 * x + offsetX;
+            const int rawY = 2 * y + offsetY;
+            const double expected = (rawPixel<T>(rawX, rawY) + rawPixel<T>(rawX + 1, rawY) + rawPixel<T>(rawX, rawY + 1) +
+                                     rawPixel<T>(rawX + 1, rawY + 1)) / 4.0;
+            if (fabs(superpixels[(size_t)y * w + x] - expected) > 1e-4)
+            {
+                printf("ERROR: offsets %d, %d superpixel %d, %d is %f instead of %f\n", offsetX, offsetY, x, y,
+                       superpixels[(size_t)y * w + x], expected);
+                passed = false;
+            }
+        }
+    }
+
+    if (!imageLoader.scale_given || imageLoader.scale_units != SSolver::ARCSEC_PER_PIX ||
+            fabs(imageLoader.scale_low - 2 * 0.8 * TEST_SCALE) > 1e-9 || fabs(imageLoader.scale_high - 2 * 1.2 * TEST_SCALE) > 1e-9)
+    {
+        printf("ERROR: offsets %d, %d gave a scale hint of %f to %f instead of %f to %f\n", offsetX, offsetY,
+               imageLoader.scale_low, imageLoader.scale_high, 2 * 0.8 * TEST_SCALE, 2 * 1.2 * TEST_SCALE);
+        passed = false;
+    }
+    for (const auto &record : imageLoader.getRecords())
+    {
+        if (record.key == "BAYERPAT" || record.key == "XBAYROFF" || record.key == "YBAYROFF")
+        {
+            printf("ERROR: offsets %d, %d kept the %s record\n", offsetX, offsetY, record.key.toUtf8().data());
+            passed = false;
+        }
+    }
+    return passed;
+}
+
+// ==========================================
+// 2. An image too small for a superpixel after its offset is debayered instead
+// ==========================================
+bool TestSuperpixel::runTooSmallIsDebayered()
+{
+    const int w = TEST_W, h = 2;
+    const QString fileName = "testsuperpixel_small.fits";
+    if (!writeBayered<uint16_t>(fileName, USHORT_IMG, TUSHORT, 0, 1, w, h))
+        return false;
+
+    fileio imageLoader;
+    imageLoader.bayerSuperpixel = true;
+    const bool loaded = imageLoader.loadFits(fileName);
+    QFile::remove(fileName);
+    if (!loaded)
+    {
+        printf("ERROR: %s was not loaded\n", fileName.toUtf8().data());
+        return false;
+    }
+    const FITSImage::Statistic stats = imageLoader.getStats();
+    if ((int)stats.width != w || (int)stats.height != h || stats.channels != 3 || stats.dataType != TUSHORT)
+    {
+        printf("ERROR: a %dx%d image was loaded as %ux%u with %d channels of type %d instead of being debayered\n", w, h,
+               stats.width, stats.height, (int)stats.channels, (int)stats.dataType);
+        return false;
+    }
+    return true;
+}
+
+int main(int argc, char *argv[])
+{
+    Q_UNUSED(argc);
+    Q_UNUSED(argv);
+    TestSuperpixel test;
+
+    printf("Starting superpixel test suite...\n");
+    fflush(stdout);
+
+    bool bytes = true;
+    bool shorts = true;
+    for (int offsetY = 0; offsetY <= 1; offsetY++)
+    {
+        for (int offsetX = 0; offsetX <= 1; offsetX++)
+        {
+            bytes = test.runMatchesHandAverage<uint8_t>(BYTE_IMG, TBYTE, offsetX, offsetY) && bytes;
+            shorts = test.runMatchesHandAverage<uint16_t>(USHORT_IMG, TUSHORT, offsetX, offsetY) && shorts;
+        }
+    }
+    bool tooSmall = test.runTooSmallIsDebayered();
+
+    printf("\n========================================\n");
+    printf("SUPERPIXEL TEST SUITE SUMMARY:\n");
+    printf("1. Hand averages match (8 bit, all offsets):  %s\n", bytes ? "PASSED" : "FAILED");
+    printf("2. Hand averages match (16 bit, all offsets): %s\n", shorts ? "PASSED" : "FAILED");
+    printf("3. Too small an image is debayered:          %s\n", tooSmall ? "PASSED" : "FAILED");
+    printf("========================================\n");
+    fflush(stdout);
+
+    if (bytes && shorts && tooSmall)
+    {
+        printf("All superpixel tests passed successfully!\n");
+        return 0;
+    }
+    printf("Some superpixel tests FAILED!\n");
+    return 1;
+}
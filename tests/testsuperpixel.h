@@ -0,0 +1,20 @@
+#ifndef TESTSUPERPIXEL_H
+#define TESTSUPERPIXEL_H
+
+#include <stdio.h>
+
+#include <QString>
+
+class TestSuperpixel
+{
+public:
+    TestSuperpixel();
+    template <typename T> bool runMatchesHandAverage(int bitpix, int datatype, int offsetX, int offsetY);
+    bool runTooSmallIsDebayered();
+
+private:
+    template <typename T> bool writeBayered(const QString &fileName, int bitpix, int datatype, int offsetX, int offsetY,
+                                            int width, int height);
+};
+
+#endif // TESTSUPERPIXEL_H
@@ -221,6 +221,72 @@ void TestThreadSafeErrors::runConcurrentKDTree()
     exit(0);
 }
 
+// ==========================================
+// 4. Parallel KD-Tree Build Test
+// ==========================================
+void TestThreadSafeErrors::runParallelKDTreeBuild()
+{
+    struct TreeCompare {
+        static bool same(const void* a, const void* b, size_t n) {
+            return (!a && !b) || (a && b && memcmp(a, b, n) == 0);
+        }
+        static bool sameTree(const kdtree_t* k1, const kdtree_t* k2) {
+            return same(k1->perm, k2->perm, kdtree_sizeof_perm(k1)) &&
+                   same(k1->lr, k2->lr, kdtree_sizeof_lr(k1)) &&
+                   same(k1->split.any, k2->split.any, kdtree_sizeof_split(k1)) &&
+                   same(k1->splitdim, k2->splitdim, kdtree_sizeof_splitdim(k1)) &&
+                   same(k1->bb.any, k2->bb.any, kdtree_sizeof_bb(k1)) &&
+                   same(k1->data.any, k2->data.any, kdtree_sizeof_data(k1));
+        }
+    };
+
+    printf("Starting parallel KD-tree build test (serial vs 8 threads)...\n");
+    fflush(stdout);
+
+    // Force several threads even on small machines, so the parallel path really runs.
+    kdtree_set_build_threads(8);
+
+    // Double trees use quickselect; u32 trees without splitdim sort each node instead.
+    const int treeTypes[2] = { KDTT_DOUBLE, KDTT_DUU };
+    for (int treeType : treeTypes)
+    {
+        for (int duplicates = 0; duplicates < 2; ++duplicates)
+        {
+            int N = 200000;
+            int D = 3;
+            double* serialData = (double*)malloc(N * D * sizeof(double));
+            double* parallelData = (double*)malloc(N * D * sizeof(double));
+            for (int i = 0; i < N * D; ++i) {
+                // Many equal values produce empty nodes, which need the same handling in both builders.
+                serialData[i] = duplicates ? (double)(rand() % 3) : (double)rand() / RAND_MAX;
+            }
+            memcpy(parallelData, serialData, N * D * sizeof(double));
+
+            kdtree_t* serial = kdtree_build(nullptr, serialData, N, D, 10, treeType, KD_BUILD_SPLIT | KD_BUILD_BBOX);
+            kdtree_t* parallel = kdtree_build(nullptr, parallelData, N, D, 10, treeType,
+                                              KD_BUILD_SPLIT | KD_BUILD_BBOX | KD_BUILD_PARALLEL);
+            if (!serial || !parallel) {
+                printf("ERROR: kdtree_build failed!\n");
+                fflush(stdout);
+                exit(1);
+            }
+            if (!TreeCompare::sameTree(serial, parallel)) {
+                printf("ERROR: Parallel build of tree type 0x%x differs from the serial build!\n", treeType);
+                fflush(stdout);
+                exit(1);
+            }
+            kdtree_free(serial);
+            kdtree_free(parallel);
+            free(serialData);
+            free(parallelData);
+        }
+    }
+
+    printf("Parallel KD-Tree Build Test passed successfully!\n");
+    fflush(stdout);
+    exit(0);
+}
+
 // ==========================================
 // Subprocess Spawning Helper
 // ==========================================
@@ -289,6 +355,10 @@ int main(int argc, char *argv[])
         TestThreadSafeErrors test;
         test.runConcurrentKDTree();
         return 0;
+    } else if (args.contains("--test-kdtree-build")) {
+        TestThreadSafeErrors test;
+        test.runParallelKDTreeBuild();
+        return 0;
     } else {
         printf("Starting concurrent thread-safety test suite...\n");
         fflush(stdout);
@@ -296,16 +366,18 @@ int main(int argc, char *argv[])
         bool errorsPassed = runTestInSubprocess("--test-errors", "Thread-Safe Errors Stack");
         bool solverNumPassed = runTestInSubprocess("--test-solvernum", "SolverNum Atomic Uniqueness");
         bool kdtreePassed = runTestInSubprocess("--test-kdtree", "KD-Tree Reentrant Sorting");
+        bool kdtreeBuildPassed = runTestInSubprocess("--test-kdtree-build", "Parallel KD-Tree Build");
         
         printf("\n========================================\n");
         printf("THREAD-SAFETY TEST SUITE SUMMARY:\n");
         printf("1. Thread-Safe Errors Stack:     %s\n", errorsPassed ? "PASSED" : "FAILED");
         printf("2. SolverNum Atomic Uniqueness:  %s\n", solverNumPassed ? "PASSED" : "FAILED");
         printf("3. KD-Tree Reentrant Sorting:    %s\n", kdtreePassed ? "PASSED" : "FAILED");
+        printf("4. Parallel KD-Tree Build:       %s\n", kdtreeBuildPassed ? "PASSED" : "FAILED");
         printf("========================================\n");
         fflush(stdout);
         
-        if (errorsPassed && solverNumPassed && kdtreePassed) {
+        if (errorsPassed && solverNumPassed && kdtreePassed && kdtreeBuildPassed) {
             printf("All thread-safety tests passed successfully!\n");
             fflush(stdout);
             return 0;
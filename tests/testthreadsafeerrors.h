@@ -17,6 +17,7 @@ public:
     void runConcurrentErrors();
     void runConcurrentSolverNum();
     void runConcurrentKDTree();
+    void runParallelKDTreeBuild();
 
 private:
     QMutex seenNamesMutex;